@@ -23,9 +23,6 @@ No usage or redistribution is allowed without explicit permission.
 #include <string>
 
 #include <boost/bind.hpp>
-#include <boost/lambda/construct.hpp>
-#include <boost/lambda/lambda.hpp>
-#include <boost/lambda/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
@@ -361,22 +358,8 @@ int main(int argc, char* argv[]){
         
         if (APIport!=0) {
             
-            #if 0
+            // memory-mapped: starts instantly and is searched in place
             indexWithDataFile const iidx(iidxFn);
-            #else
-                
-                #if 0
-                indexWithData const iidx_(iidxFn);
-                indexWithDataInRam iidx(iidx_);
-                #else
-                
-                indexWithData *iidxOnDisk= new indexWithDataFile(iidxFn);
-                boost::function<indexWithData*()> iidxInRamConstructor= boost::lambda::bind( boost::lambda::new_ptr<indexWithDataInRam>(), boost::cref(*iidxOnDisk) );
-                
-                indexWithDataInRamStartDisk iidx(*iidxOnDisk, iidxInRamConstructor, true );
-                #endif
-                
-            #endif
             
             coarseResidual coarseResidual_obj( coarseClstFn, pq, iidx, w, false );
             nnSingleRetriever nnSR( &fidx, coarseResidual_obj );
@@ -16,6 +16,7 @@ No usage or redistribution is allowed without explicit permission.
 
 
 
+#include <algorithm>
 #include <cstring> // for memset and memcpy
 #include <stdexcept>
 
@@ -51,6 +52,289 @@ charStream::charStreamCreate(uint8_t bits){
 
 
 
+// ------------------------------------ charStreamView
+
+// All non-native streams are a header byte followed by the values as one big-endian
+// bit stream, i.e. value i occupies bits [i*w, (i+1)*w) counting from the MSB of the
+// first byte. So 8 consecutive values starting at a multiple of 8 take exactly w bytes,
+// which is what the SIMD kernels decode at once.
+
+#if defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && (defined(__x86_64__) || defined(__i386__))
+#define CHAR_STREAMS_SIMD
+#include <immintrin.h>
+#endif
+
+
+
+namespace charStreamsImpl {
+
+    inline uint16_t
+    getValue(uint8_t const *data, uint32_t i, uint8_t w){
+        uint32_t const bitPos= i*w, k= bitPos>>3, off= bitPos&7;
+        // only touch the next byte if the value spans into it (it might not exist)
+        uint32_t x= static_cast<uint32_t>(data[k])<<8;
+        if (off+w>8)
+            x|= data[k+1];
+        return static_cast<uint16_t>( ((x<<off) & 0xFFFF) >> (16-w) );
+    }
+    
+    
+    
+    void
+    decodeScalar(uint8_t const *data, uint8_t w, uint32_t begin, uint32_t end, uint16_t *out){
+        for (uint32_t i= begin; i<end; ++i, ++out)
+            *out= getValue(data, i, w);
+    }
+    
+    
+    
+    #ifdef CHAR_STREAMS_SIMD
+    
+    // per width: byte (k+1) into the low and k into the high half of 16-bit lane j,
+    // k= (j*w)/8, and the multiplier which drops the (j*w)%8 bits preceding the value
+    struct shuffleTables {
+        uint8_t shuffle[17][16];
+        uint16_t mult[17][8];
+    };
+    
+    
+    
+    shuffleTables
+    makeShuffleTables(){
+        shuffleTables t;
+        for (uint8_t w= 1; w<=16; ++w)
+            for (uint8_t j= 0; j<8; ++j){
+                uint8_t const k= (j*w)>>3;
+                t.shuffle[w][2*j]= std::min(k+1, 15);
+                t.shuffle[w][2*j+1]= k;
+                t.mult[w][j]= 1 << ((j*w)&7);
+            }
+        return t;
+    }
+    
+    static shuffleTables const tables= makeShuffleTables();
+    
+    
+    
+    __attribute__((target("ssse3")))
+    uint32_t
+    decodeSSSE3(uint8_t const *data, uint8_t w, uint32_t begin, uint32_t end, uint32_t size, uint16_t *out){
+        // begin is a multiple of 8; returns the first value not decoded
+        __m128i const s= _mm_loadu_si128(reinterpret_cast<__m128i const *>(tables.shuffle[w]));
+        __m128i const m= _mm_loadu_si128(reinterpret_cast<__m128i const *>(tables.mult[w]));
+        __m128i const shift= _mm_cvtsi32_si128(16-w);
+        uint32_t i= begin;
+        // each step loads 16 bytes
+        for (; i+8<=end && (i/8)*w + 16 <= size; i+= 8, out+= 8){
+            __m128i x= _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + (i/8)*w));
+            x= _mm_shuffle_epi8(x, s);
+            x= _mm_mullo_epi16(x, m);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_srl_epi16(x, shift));
+        }
+        return i;
+    }
+    
+    
+    
+    __attribute__((target("avx2")))
+    uint32_t
+    decodeAVX2(uint8_t const *data, uint8_t w, uint32_t begin, uint32_t end, uint32_t size, uint16_t *out){
+        __m256i const s= _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(tables.shuffle[w])));
+        __m256i const m= _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(tables.mult[w])));
+        __m128i const shift= _mm_cvtsi32_si128(16-w);
+        uint32_t i= begin;
+        // two groups of 8 values per step, the second one starts w bytes later
+        for (; i+16<=end && (i/8)*w + w + 16 <= size; i+= 16, out+= 16){
+            uint8_t const *p= data + (i/8)*w;
+            __m256i x= _mm256_inserti128_si256(
+                _mm256_castsi128_si256( _mm_loadu_si128(reinterpret_cast<__m128i const *>(p)) ),
+                _mm_loadu_si128(reinterpret_cast<__m128i const *>(p+w)), 1);
+            x= _mm256_shuffle_epi8(x, s);
+            x= _mm256_mullo_epi16(x, m);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_srl_epi16(x, shift));
+        }
+        _mm256_zeroupper();
+        return i;
+    }
+    
+    
+    
+    bool
+    useSSSE3(){
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3");
+    }
+    
+    
+    
+    bool
+    useAVX2(){
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+    
+    static bool const hasSSSE3= useSSSE3();
+    static bool const hasAVX2= useAVX2();
+    
+    #endif
+    
+    
+    
+    // values [begin, end) of the w-bit stream (without the header) of the given size in bytes
+    void
+    decodeBits(uint8_t const *data, uint32_t size, uint8_t w, uint32_t begin, uint32_t end, uint16_t *out){
+        #ifdef CHAR_STREAMS_SIMD
+        if (hasSSSE3 && end-begin>=8){
+            uint32_t const aligned= std::min(end, (begin+7)/8*8);
+            decodeScalar(data, w, begin, aligned, out);
+            out+= aligned-begin;
+            uint32_t i= aligned;
+            if (hasAVX2 && end-i>=16)
+                i= decodeAVX2(data, w, i, end, size, out);
+            i= decodeSSSE3(data, w, i, end, size, out + (i-aligned));
+            out+= i-aligned;
+            begin= i;
+        }
+        #endif
+        decodeScalar(data, w, begin, end, out);
+    }
+    
+};
+
+
+
+uint8_t
+charStreamView::storedBits(uint8_t bits){
+    ASSERT(bits<=64);
+    if (bits<=4) return 4;
+    if (bits<=6) return 6;
+    if (bits<=8) return 8;
+    if (bits<=10) return 10;
+    if (bits<=12) return 12;
+    if (bits<=16) return 16;
+    if (bits<=32) return 32;
+    return 64;
+}
+
+
+
+charStreamView::charStreamView(uint8_t bits, uint8_t const *data, uint32_t size) : bits_(storedBits(bits)) {
+    init(data, size);
+}
+
+
+
+charStreamView::charStreamView(uint8_t bits, std::string const &data) : bits_(storedBits(bits)) {
+    init(reinterpret_cast<uint8_t const *>(data.data()), data.size());
+}
+
+
+
+void
+charStreamView::init(uint8_t const *data, uint32_t size){
+    switch (bits_){
+        case 4:  n_= charStream4::numFromData(data, size); break;
+        case 6:  n_= charStream6::numFromData(data, size); break;
+        case 10: n_= charStream10::numFromData(data, size); break;
+        case 12: n_= charStream12::numFromData(data, size); break;
+        default:
+            ASSERT( size % (bits_/8) == 0 );
+            n_= size / (bits_/8);
+    }
+    // skip the header of non-native streams
+    values_= (bits_%8!=0 && size>0) ? data+1 : data;
+}
+
+
+
+void
+charStreamView::decode(uint32_t begin, uint32_t count, uint16_t *out) const {
+    ASSERT(bits_<=16 && begin+count<=n_);
+    if (count==0)
+        return;
+    switch (bits_){
+        case 8:
+            for (uint8_t const *it= values_+begin, *end= values_+begin+count; it!=end; ++it, ++out)
+                *out= *it;
+            break;
+        case 16:
+            std::memcpy(out, values_ + 2*begin, 2*count);
+            break;
+        default:
+            // bytes of the stream without the header
+            charStreamsImpl::decodeBits(values_, (n_*bits_+7)/8, bits_, begin, begin+count, out);
+    }
+}
+
+
+
+void
+charStreamView::decode(uint32_t begin, uint32_t count, uint64_t *out) const {
+    ASSERT(begin+count<=n_);
+    if (bits_==64){
+        std::memcpy(out, values_ + 8*begin, 8*count);
+        return;
+    }
+    if (bits_==32){
+        uint32_t value;
+        for (uint8_t const *it= values_+4*begin, *end= values_+4*(begin+count); it!=end; it+= 4, ++out){
+            std::memcpy(&value, it, 4);
+            *out= value;
+        }
+        return;
+    }
+    // in chunks through a small buffer
+    uint32_t const chunkSize= 256;
+    uint16_t buffer[chunkSize];
+    for (uint32_t i= 0; i<count; i+= chunkSize){
+        uint32_t const thisCount= std::min(chunkSize, count-i);
+        decode(begin+i, thisCount, buffer);
+        for (uint32_t j= 0; j<thisCount; ++j, ++out)
+            *out= buffer[j];
+    }
+}
+
+
+
+void
+charStreamView::encode(uint8_t bits, uint16_t const *values, uint32_t count, std::string &data){
+    uint8_t const w= storedBits(bits);
+    ASSERT(w<=16);
+    if (w==8){
+        data.resize(count);
+        for (uint32_t i= 0; i<count; ++i)
+            data[i]= static_cast<char>(values[i]);
+        return;
+    }
+    if (w==16){
+        data.assign(reinterpret_cast<char const *>(values), 2*count);
+        return;
+    }
+    // header (see flush() of the respective stream) + ceil(count*w/8) bytes
+    uint32_t const numBytes= (count*w+7)/8;
+    data.assign(1+numBytes, 0);
+    switch (w){
+        case 4:  data[0]= count%2; break;
+        case 6:  data[0]= (count*3)%4; break;
+        case 10: data[0]= (count*5)%4; break;
+        case 12: data[0]= (count*3)%2; break;
+    }
+    uint8_t *out= reinterpret_cast<uint8_t *>(&data[1]);
+    uint16_t const mask= (1<<w)-1;
+    for (uint32_t i= 0; i<count; ++i){
+        uint32_t const bitPos= i*w, k= bitPos>>3, off= bitPos&7;
+        // left-align the value in a 24-bit window starting at byte k
+        uint32_t const x= static_cast<uint32_t>(values[i] & mask) << (24-w-off);
+        out[k]|= x>>16;
+        if (off+w>8)
+            out[k+1]|= (x>>8) & 0xFF;
+        if (off+w>16)
+            out[k+2]|= x & 0xFF;
+    }
+}
+
+
+
 // ------------------------------------ charStream12
 
 
@@ -132,12 +416,29 @@ charStream12::flush() const {
 
 
 // see calculations in charStream6
+uint32_t
+charStream12::numFromData(uint8_t const *data, uint32_t size) {
+    if (size==0)
+        return 0;
+    ASSERT(data[0]<2);
+    uint32_t n= (size-1 - (data[0]!=0) )*2 + data[0];
+    ASSERT( n%3==0 );
+    return n/3;
+}
+
+
+
 void
 charStream12::computeNum() {
-    ASSERT(data_[0]<2);
-    n_= (data_.size()-1 - (data_[0]!=0) )*2 + data_[0];
-    ASSERT( n_%3==0 );
-    n_/=3;
+    n_= numFromData(&data_[0], data_.size());
+}
+
+
+
+charStreamView
+charStream12::getView() const {
+    flush();
+    return charStreamView(12, &data_[0], data_.size());
 }
 
 
@@ -223,12 +524,29 @@ charStream10::flush() const {
 
 
 // see calculations in charStream6
+uint32_t
+charStream10::numFromData(uint8_t const *data, uint32_t size) {
+    if (size==0)
+        return 0;
+    ASSERT(data[0]<4);
+    uint32_t n= ( (size-1 - (data[0]!=0) )*4 + data[0] );
+    ASSERT( n%5==0 );
+    return n/5;
+}
+
+
+
 void
 charStream10::computeNum() {
-    ASSERT(data_[0]<4);
-    n_= ( (data_.size()-1 - (data_[0]!=0) )*4 + data_[0] );
-    ASSERT( n_%5==0 );
-    n_/=5;
+    n_= numFromData(&data_[0], data_.size());
+}
+
+
+
+charStreamView
+charStream10::getView() const {
+    flush();
+    return charStreamView(10, &data_[0], data_.size());
 }
 
 
@@ -323,12 +641,29 @@ charStream6::flush() const {
 
 // so inverse calculation (apart form the 1 byte to store 3N%4):
 // N= ( ( bytes - 3N%4!=0 ) * 4 + 3N%4 ) / 3
+uint32_t
+charStream6::numFromData(uint8_t const *data, uint32_t size) {
+    if (size==0)
+        return 0;
+    ASSERT(data[0]<4);
+    uint32_t n= ( (size-1 - (data[0]!=0) )*4 + data[0] );
+    ASSERT( n%3==0 );
+    return n/3;
+}
+
+
+
 void
 charStream6::computeNum() {
-    ASSERT(data_[0]<4);
-    n_= ( (data_.size()-1 - (data_[0]!=0) )*4 + data_[0] );
-    ASSERT( n_%3==0 );
-    n_/=3;
+    n_= numFromData(&data_[0], data_.size());
+}
+
+
+
+charStreamView
+charStream6::getView() const {
+    flush();
+    return charStreamView(6, &data_[0], data_.size());
 }
 
 
@@ -410,10 +745,27 @@ charStream4::flush() const {
 
 
 
+uint32_t
+charStream4::numFromData(uint8_t const *data, uint32_t size) {
+    if (size==0)
+        return 0;
+    ASSERT(data[0]<2);
+    return (size-1)*2-data[0];
+}
+
+
+
 void
 charStream4::computeNum() {
-    ASSERT(data_[0]<2);
-    n_= (data_.size()-1)*2-data_[0];
+    n_= numFromData(&data_[0], data_.size());
+}
+
+
+
+charStreamView
+charStream4::getView() const {
+    flush();
+    return charStreamView(4, &data_[0], data_.size());
 }
 
 
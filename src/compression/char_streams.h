@@ -21,12 +21,56 @@ No usage or redistribution is allowed without explicit permission.
 #include <math.h>
 #include <stdexcept>
 #include <stdint.h>
+#include <string>
 #include <vector>
 
 #include "macros.h"
 
 
 
+// Read-only view of encoded data (as given by getDataCopy of the charStream with the same
+// number of bits, e.g. straight from an index entry) with non-virtual bulk decoding:
+// the data is not copied and there is no virtual call per value
+class charStreamView {
+    
+    public:
+        
+        // bits as in charStream::charStreamCreate, data has to outlive the view
+        charStreamView(uint8_t bits, uint8_t const *data, uint32_t size);
+        
+        charStreamView(uint8_t bits, std::string const &data);
+        
+        inline uint32_t
+            getNum() const { return n_; }
+        
+        // values [begin, begin+count) into out, only for streams of at most 16 bits
+        void
+            decode(uint32_t begin, uint32_t count, uint16_t *out) const;
+        
+        void
+            decode(uint32_t begin, uint32_t count, uint64_t *out) const;
+        
+        // symmetric to decode: data is set to what getDataCopy of a charStream
+        // with the count values would give, only for streams of at most 16 bits
+        static void
+            encode(uint8_t bits, uint16_t const *values, uint32_t count, std::string &data);
+        
+        // bits actually used to store values of the given number of bits (see charStreamCreate)
+        static uint8_t
+            storedBits(uint8_t bits);
+        
+    private:
+        
+        void
+            init(uint8_t const *data, uint32_t size);
+        
+        uint8_t bits_;
+        uint8_t const *values_; // without the header of non-native streams
+        uint32_t n_;
+};
+
+
+
 // do not use for reading and writing at the same time
 class charStream {
     
@@ -76,6 +120,10 @@ class charStream {
                 throw std::runtime_error("not implemented");
             }
         
+        // view of the current data for bulk decoding, valid until the stream is modified
+        virtual charStreamView
+            getView() const =0;
+        
         static charStream*
             charStreamCreate(uint8_t bits);
         
@@ -140,6 +188,13 @@ class charStreamNative : public charStream {
             numBytesForN(uint32_t n)
             { return n*sizeof(T); }
         
+        inline charStreamView
+            getView() const {
+                return charStreamView( 8*sizeof(T),
+                                       data_.empty() ? NULL : reinterpret_cast<uint8_t const *>(&data_[0]),
+                                       data_.size()*sizeProp_ );
+            }
+        
     private:
         uint32_t const sizeProp_;
         std::vector<T> data_;
@@ -213,6 +268,9 @@ class charStream12 : public charStreamNonNative {
         void reserve(uint32_t n);
         void clear();
         static uint32_t numBytesForN(uint32_t n);
+        charStreamView getView() const;
+        // number of values in encoded data of the given size
+        static uint32_t numFromData(uint8_t const *data, uint32_t size);
         
     private:
         void flush() const;
@@ -240,6 +298,9 @@ class charStream10 : public charStreamNonNative {
         void reserve(uint32_t n);
         void clear();
         static uint32_t numBytesForN(uint32_t n);
+        charStreamView getView() const;
+        // number of values in encoded data of the given size
+        static uint32_t numFromData(uint8_t const *data, uint32_t size);
         
     private:
         void flush() const;
@@ -269,6 +330,9 @@ class charStream6 : public charStreamNonNative {
         void reserve(uint32_t n);
         void clear();
         static uint32_t numBytesForN(uint32_t n);
+        charStreamView getView() const;
+        // number of values in encoded data of the given size
+        static uint32_t numFromData(uint8_t const *data, uint32_t size);
         
     private:
         void flush() const;
@@ -298,6 +362,9 @@ class charStream4 : public charStreamNonNative {
         void reserve(uint32_t n);
         void clear();
         static uint32_t numBytesForN(uint32_t n);
+        charStreamView getView() const;
+        // number of values in encoded data of the given size
+        static uint32_t numFromData(uint8_t const *data, uint32_t size);
         
     private:
         void flush() const;
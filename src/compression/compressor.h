@@ -17,6 +17,10 @@ No usage or redistribution is allowed without explicit permission.
 
 
 #include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "char_streams.h"
 #include "macros.h"
@@ -95,6 +99,49 @@ class compressorWithDistance : public compressor {
                 delete []distsSq_;
                 return n;
             }
+        
+        // the KNN nearest vectors in data as (distSq, index) pairs, sorted by ascending distance;
+        // override to avoid materialising all distances
+        virtual void
+            getKNN( float const vec[], std::string const &data, uint32_t KNN, std::vector< std::pair<float, uint32_t> > &distSqInds ) const {
+                std::vector<float> distsSq;
+                getDistsSq(vec, data, distsSq);
+                KNN= std::min(KNN, static_cast<uint32_t>(distsSq.size()));
+                distSqInds.clear();
+                distSqInds.reserve(distsSq.size());
+                for (uint32_t i= 0; i<distsSq.size(); ++i)
+                    distSqInds.push_back( std::make_pair(distsSq[i], i) );
+                std::partial_sort( distSqInds.begin(), distSqInds.begin()+KNN, distSqInds.end() );
+                distSqInds.resize(KNN);
+            }
+        
+        // getKNN for each of the numVecs vectors in vecs (numDims() floats each) against the same
+        // data of size bytes, which is not copied; override to scan data once for all of them
+        virtual void
+            getKNNMulti( float const vecs[], uint32_t numVecs, uint8_t const *data, uint32_t size, uint32_t KNN, std::vector< std::vector< std::pair<float, uint32_t> > > &distSqInds ) const {
+                std::string const dataStr( reinterpret_cast<char const *>(data), size );
+                distSqInds.resize(numVecs);
+                for (uint32_t i= 0; i<numVecs; ++i)
+                    getKNN( vecs + i*numDims(), dataStr, KNN, distSqInds[i] );
+            }
+        
+        // getKNNMulti of the residuals vecs-offset (e.g. against an inverted list of coarseResidual)
+        // in two steps so that the work which depends only on a vector is done once for all offsets:
+        // residualTermSize() floats of getResidualTerms for each vector (none by default)
+        virtual uint32_t
+            residualTermSize() const { return 0; }
+        
+        virtual void
+            getResidualTerms( float const vec[], float *terms ) const {}
+        
+        virtual void
+            getKNNResidualMulti( float const vecs[], float const terms[], uint32_t numVecs, float const offset[], uint8_t const *data, uint32_t size, uint32_t KNN, std::vector< std::vector< std::pair<float, uint32_t> > > &distSqInds ) const {
+                uint32_t const numDims_= numDims();
+                std::vector<float> residuals( static_cast<uint64_t>(numVecs)*numDims_ );
+                for (uint64_t i= 0; i<residuals.size(); ++i)
+                    residuals[i]= vecs[i] - offset[i%numDims_];
+                getKNNMulti( residuals.empty() ? NULL : &residuals[0], numVecs, data, size, KNN, distSqInds );
+            }
     
     private:
         DISALLOW_COPY_AND_ASSIGN(compressorWithDistance);
@@ -17,7 +17,14 @@ No usage or redistribution is allowed without explicit permission.
 #include <math.h>
 #include <cstring> // for memset and memcpy
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PQ_SIMD
+#endif
 
 
 
@@ -115,18 +122,21 @@ productQuant::compress( float const vecs[], uint32_t const n, std::string &data
 void
 productQuant::decompress( std::string const &data, float *&vecs ) const {
     
-    charStream *charStream_obj= charStreamFactoryCreate();
-    charStream_obj->setDataCopy(data);
-    uint32_t n= charStream_obj->getNum() / nSubQuant;
+    charStreamView view(codeBits(), data);
+    uint32_t n= view.getNum() / nSubQuant;
+    std::vector<uint16_t> codes(n*nSubQuant);
+    if (n>0)
+        view.decode(0, n*nSubQuant, &codes[0]);
+    std::vector<uint16_t>::const_iterator codeIt= codes.begin();
     
     vecs= new float[numDims_ * n];
     float *thisSubVec= vecs;
     
     for (uint32_t i= 0; i<n; ++i){
         
-        for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
+        for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub, ++codeIt){
             
-            unsigned subClusterID= charStream_obj->getNextUnsafe();
+            unsigned subClusterID= *codeIt;
             
             std::memcpy( thisSubVec, clstCentres_objs[iSub]->clstC_flat + subClusterID * (clstCentres_objs[iSub]->numDims), clstCentres_objs[iSub]->numDims * sizeof(float) );
             
@@ -136,7 +146,221 @@ productQuant::decompress( std::string const &data, float *&vecs ) const {
         
     }
     
-    delete charStream_obj;
+}
+
+
+
+namespace productQuantADC {
+
+// vectors scanned between top-k heap updates
+static uint32_t const blockSize= 256;
+
+
+
+// max-heap of the KNN smallest (distSq, index)
+inline void
+pushTopK( std::vector< std::pair<float, uint32_t> > &heap, uint32_t KNN, float distSq, uint32_t ind ){
+    if (heap.size()<KNN){
+        heap.push_back( std::make_pair(distSq, ind) );
+        std::push_heap(heap.begin(), heap.end());
+    } else if (distSq < heap.front().first){
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back()= std::make_pair(distSq, ind);
+        std::push_heap(heap.begin(), heap.end());
+    }
+}
+
+
+
+inline float
+topKThreshold( std::vector< std::pair<float, uint32_t> > const &heap, uint32_t KNN ){
+    return heap.size()<KNN ? std::numeric_limits<float>::infinity() : heap.front().first;
+}
+
+
+
+// distances of vectors [first, first+num) given their 8-bit codes
+void
+scan8( float const *lut, uint32_t lutStride, uint8_t const *codes, uint32_t nSubQuant, uint32_t first, uint32_t num, float *distsSq ){
+    codes+= static_cast<uint64_t>(first)*nSubQuant;
+    for (uint32_t i= 0; i<num; ++i){
+        float distSq= 0;
+        float const *subLut= lut;
+        for (uint32_t iSub= 0; iSub<nSubQuant; ++iSub, ++codes, subLut+= lutStride)
+            distSq+= subLut[*codes];
+        distsSq[i]= distSq;
+    }
+}
+
+
+
+// 4-bit codes, two per byte, high nibble first
+void
+scan4( float const *lut, uint32_t lutStride, uint8_t const *codes, uint32_t nSubQuant, uint32_t first, uint32_t num, float *distsSq ){
+    uint64_t j= static_cast<uint64_t>(first)*nSubQuant;
+    for (uint32_t i= 0; i<num; ++i){
+        float distSq= 0;
+        float const *subLut= lut;
+        for (uint32_t iSub= 0; iSub<nSubQuant; ++iSub, ++j, subLut+= lutStride)
+            distSq+= subLut[ (j & 1) ? (codes[j>>1] & 0x0F) : (codes[j>>1] >> 4) ];
+        distsSq[i]= distSq;
+    }
+}
+
+
+
+void
+scanCodes( float const *lut, uint32_t lutStride, uint16_t const *codes, uint32_t nSubQuant, uint32_t first, uint32_t num, float *distsSq ){
+    codes+= static_cast<uint64_t>(first)*nSubQuant;
+    for (uint32_t i= 0; i<num; ++i){
+        float distSq= 0;
+        float const *subLut= lut;
+        for (uint32_t iSub= 0; iSub<nSubQuant; ++iSub, ++codes, subLut+= lutStride)
+            distSq+= subLut[*codes];
+        distsSq[i]= distSq;
+    }
+}
+
+
+
+#ifdef PQ_SIMD
+
+// fast-scan: lower bounds (in units of the quantised lookup table qLut, 16 uint8 entries
+// per subquantizer) of the 16 vectors starting at first, through in-register shuffles.
+// Each vector is nSubQuant/2 bytes (nSubQuant has to be a multiple of 8): 4 bytes (8 codes)
+// of the 16 vectors are transposed at a time in registers
+__attribute__((target("ssse3")))
+void
+fastScan4SSSE3( uint8_t const *qLut, uint8_t const *codes, uint32_t nSubQuant, uint32_t first, uint16_t *lowerBounds ){
+    
+    __m128i accLo= _mm_setzero_si128(), accHi= _mm_setzero_si128();
+    __m128i const zero= _mm_setzero_si128();
+    __m128i const lowNibble= _mm_set1_epi8(0x0F);
+    __m128i const byteCols= _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    
+    uint32_t const bytesPerVec= nSubQuant/2;
+    uint8_t const *block= codes + static_cast<uint64_t>(first)*bytesPerVec;
+    
+    for (uint32_t iByte= 0; iByte<bytesPerVec; iByte+= 4){
+        
+        __m128i r[4];
+        for (int k= 0; k<4; ++k){
+            uint32_t v[4];
+            for (int i= 0; i<4; ++i)
+                std::memcpy(&v[i], block + (4*k+i)*bytesPerVec + iByte, 4);
+            // [byte 0 of the 4 vectors, byte 1 of them, ...]
+            r[k]= _mm_shuffle_epi8( _mm_setr_epi32(v[0], v[1], v[2], v[3]), byteCols );
+        }
+        __m128i const lo01= _mm_unpacklo_epi32(r[0], r[1]), lo23= _mm_unpacklo_epi32(r[2], r[3]);
+        __m128i const hi01= _mm_unpackhi_epi32(r[0], r[1]), hi23= _mm_unpackhi_epi32(r[2], r[3]);
+        __m128i const cols[4]= { _mm_unpacklo_epi64(lo01, lo23), _mm_unpackhi_epi64(lo01, lo23),
+                                 _mm_unpacklo_epi64(hi01, hi23), _mm_unpackhi_epi64(hi01, hi23) };
+        
+        // byte b of the 16 vectors holds the codes of subquantizers 2*(iByte+b) (high nibble) and +1 (low)
+        for (int b= 0; b<4; ++b){
+            uint8_t const *subQLut= qLut + 2*(iByte+b)*16;
+            __m128i const d1= _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast<__m128i const *>(subQLut) ),
+                                                _mm_and_si128( _mm_srli_epi16(cols[b], 4), lowNibble ) );
+            __m128i const d2= _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast<__m128i const *>(subQLut + 16) ),
+                                                _mm_and_si128( cols[b], lowNibble ) );
+            // saturation keeps them lower bounds
+            accLo= _mm_adds_epu16( accLo, _mm_adds_epu16( _mm_unpacklo_epi8(d1, zero), _mm_unpacklo_epi8(d2, zero) ) );
+            accHi= _mm_adds_epu16( accHi, _mm_adds_epu16( _mm_unpackhi_epi8(d1, zero), _mm_unpackhi_epi8(d2, zero) ) );
+        }
+    }
+    
+    _mm_storeu_si128( reinterpret_cast<__m128i*>(lowerBounds), accLo );
+    _mm_storeu_si128( reinterpret_cast<__m128i*>(lowerBounds + 8), accHi );
+}
+
+
+
+bool
+useSSSE3(){
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+}
+
+#else
+
+void
+fastScan4SSSE3( uint8_t const *, uint8_t const *, uint32_t, uint32_t, uint16_t * ){
+    ASSERT(false);
+}
+
+bool
+useSSSE3(){
+    return false;
+}
+
+#endif
+
+static bool const hasSSSE3= useSSSE3();
+
+
+
+// exact distances of vectors [first, first+num), the code format is given by the number of clusters
+// (see productQuant::getCodes)
+void
+scan( float const *lut, uint32_t maxSubQuantK, uint8_t const *codes, std::vector<uint16_t> const &allCodes, uint32_t nSubQuant, uint32_t first, uint32_t num, float *distsSq ){
+    if (maxSubQuantK<=16)
+        scan4( lut, maxSubQuantK, codes, nSubQuant, first, num, distsSq );
+    else if (maxSubQuantK>64 && maxSubQuantK<=256)
+        scan8( lut, maxSubQuantK, codes, nSubQuant, first, num, distsSq );
+    else
+        scanCodes( lut, maxSubQuantK, &allCodes[0], nSubQuant, first, num, distsSq );
+}
+
+};
+
+
+
+void
+productQuant::computeLUT( float const vec[], float *lut ) const {
+    
+    float const *subVec= vec;
+    for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
+        clstCentres const &clst= *clstCentres_objs[iSub];
+        float const *centre= clst.clstC_flat;
+        float *subLut= lut + iSub*maxSubQuantK;
+        for (uint32_t k= 0; k<clst.numClst; ++k, centre+= clst.numDims)
+            subLut[k]= jp_dist_l2( subVec, centre, clst.numDims );
+        // never used by valid codes
+        for (uint32_t k= clst.numClst; k<maxSubQuantK; ++k)
+            subLut[k]= std::numeric_limits<float>::infinity();
+        subVec+= clst.numDims;
+    }
+    
+}
+
+
+
+uint32_t
+productQuant::getCodes( uint8_t const *data, uint32_t size, uint8_t const *&codes, std::vector<uint16_t> &allCodes ) const {
+    
+    codes= NULL;
+    allCodes.clear();
+    
+    if (maxSubQuantK<=16){
+        // charStream4: header byte (is the number of codes odd), then 2 codes per byte
+        if (size<=1)
+            return 0;
+        ASSERT( data[0]<2 );
+        codes= data + 1;
+        return ( (size-1)*2 - data[0] ) / nSubQuant;
+    }
+    
+    if (maxSubQuantK>64 && maxSubQuantK<=256){
+        // charStreamNative<uint8_t>
+        codes= data;
+        return size / nSubQuant;
+    }
+    
+    charStreamView view(codeBits(), data, size);
+    allCodes.resize( view.getNum() );
+    if (!allCodes.empty())
+        view.decode(0, allCodes.size(), &allCodes[0]);
+    return allCodes.size() / nSubQuant;
     
 }
 
@@ -145,6 +369,252 @@ productQuant::decompress( std::string const &data, float *&vecs ) const {
 uint32_t
 productQuant::getDistsSq( float const vec[], std::string const &data, float *&distsSq ) const {
     
+    uint8_t const *codes;
+    std::vector<uint16_t> allCodes;
+    uint32_t const n= getCodes(reinterpret_cast<uint8_t const *>(data.data()), data.size(), codes, allCodes);
+    
+    // for few vectors it is cheaper to compute only the needed subquantizer distances
+    if (n<maxSubQuantK)
+        return getDistsSqSlow(vec, data, distsSq);
+    
+    std::vector<float> lut(nSubQuant*maxSubQuantK);
+    computeLUT(vec, &lut[0]);
+    
+    distsSq= new float[n];
+    productQuantADC::scan( &lut[0], maxSubQuantK, codes, allCodes, nSubQuant, 0, n, distsSq );
+    
+    return n;
+    
+}
+
+
+
+void
+productQuant::getKNN( float const vec[], std::string const &data, uint32_t KNN, std::vector< std::pair<float, uint32_t> > &distSqInds ) const {
+    
+    uint8_t const *codes;
+    std::vector<uint16_t> allCodes;
+    uint32_t const n= getCodes(reinterpret_cast<uint8_t const *>(data.data()), data.size(), codes, allCodes);
+    
+    if (n<maxSubQuantK){
+        // see getDistsSq
+        compressorWithDistance::getKNN(vec, data, KNN, distSqInds);
+        return;
+    }
+    
+    std::vector<float> lut(nSubQuant*maxSubQuantK);
+    computeLUT(vec, &lut[0]);
+    
+    distSqInds.clear();
+    KNN= std::min(KNN, n);
+    if (KNN==0)
+        return;
+    distSqInds.reserve(KNN);
+    
+    knnFromCodes( &lut[0], codes, allCodes, 0, n, KNN, distSqInds );
+    std::sort_heap(distSqInds.begin(), distSqInds.end());
+    
+}
+
+
+
+void
+productQuant::getKNNMulti( float const vecs[], uint32_t numVecs, uint8_t const *data, uint32_t size, uint32_t KNN, std::vector< std::vector< std::pair<float, uint32_t> > > &distSqInds ) const {
+    
+    uint8_t const *codes;
+    std::vector<uint16_t> allCodes;
+    uint32_t const n= getCodes(data, size, codes, allCodes);
+    
+    if (n<maxSubQuantK){
+        compressorWithDistance::getKNNMulti(vecs, numVecs, data, size, KNN, distSqInds);
+        return;
+    }
+    
+    uint32_t const lutSize= nSubQuant*maxSubQuantK;
+    std::vector<float> luts(numVecs*lutSize);
+    for (uint32_t iVec= 0; iVec<numVecs; ++iVec)
+        computeLUT(vecs + iVec*numDims_, &luts[iVec*lutSize]);
+    
+    knnMultiFromLUTs( &luts[0], numVecs, codes, allCodes, n, KNN, distSqInds );
+    
+}
+
+
+
+void
+productQuant::getResidualTerms( float const vec[], float *terms ) const {
+    
+    float const *subVec= vec;
+    for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
+        clstCentres const &clst= *clstCentres_objs[iSub];
+        float const *centre= clst.clstC_flat;
+        float *subTerms= terms + iSub*maxSubQuantK;
+        for (uint32_t k= 0; k<clst.numClst; ++k, centre+= clst.numDims){
+            float dot= 0;
+            for (uint32_t iDim= 0; iDim<clst.numDims; ++iDim)
+                dot+= subVec[iDim]*centre[iDim];
+            subTerms[k]= dot;
+        }
+        for (uint32_t k= clst.numClst; k<maxSubQuantK; ++k)
+            subTerms[k]= 0;
+        subVec+= clst.numDims;
+    }
+    
+}
+
+
+
+void
+productQuant::getKNNResidualMulti( float const vecs[], float const terms[], uint32_t numVecs, float const offset[], uint8_t const *data, uint32_t size, uint32_t KNN, std::vector< std::vector< std::pair<float, uint32_t> > > &distSqInds ) const {
+    
+    uint8_t const *codes;
+    std::vector<uint16_t> allCodes;
+    uint32_t const n= getCodes(data, size, codes, allCodes);
+    
+    if (n<maxSubQuantK){
+        compressorWithDistance::getKNNResidualMulti(vecs, terms, numVecs, offset, data, size, KNN, distSqInds);
+        return;
+    }
+    
+    uint32_t const lutSize= nSubQuant*maxSubQuantK;
+    
+    // 2<offset,p> + |p|^2, shared by all vectors
+    std::vector<float> offsetTerms(lutSize);
+    float const *subOffset= offset;
+    for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
+        clstCentres const &clst= *clstCentres_objs[iSub];
+        float const *centre= clst.clstC_flat;
+        float *subTerms= &offsetTerms[iSub*maxSubQuantK];
+        for (uint32_t k= 0; k<clst.numClst; ++k, centre+= clst.numDims){
+            float dot= 0, normSq= 0;
+            for (uint32_t iDim= 0; iDim<clst.numDims; ++iDim){
+                dot+= subOffset[iDim]*centre[iDim];
+                normSq+= centre[iDim]*centre[iDim];
+            }
+            subTerms[k]= 2*dot + normSq;
+        }
+        // never used by valid codes
+        for (uint32_t k= clst.numClst; k<maxSubQuantK; ++k)
+            subTerms[k]= std::numeric_limits<float>::infinity();
+        subOffset+= clst.numDims;
+    }
+    
+    std::vector<float> luts(numVecs*lutSize);
+    for (uint32_t iVec= 0; iVec<numVecs; ++iVec){
+        float const *subVec= vecs + static_cast<uint64_t>(iVec)*numDims_;
+        float const *subTerms= terms + static_cast<uint64_t>(iVec)*lutSize;
+        float *lut= &luts[iVec*lutSize];
+        subOffset= offset;
+        for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
+            uint32_t const subDims= clstCentres_objs[iSub]->numDims;
+            float resNormSq= 0;
+            for (uint32_t iDim= 0; iDim<subDims; ++iDim)
+                resNormSq+= (subVec[iDim]-subOffset[iDim])*(subVec[iDim]-subOffset[iDim]);
+            uint32_t const base= iSub*maxSubQuantK;
+            for (uint32_t k= 0; k<maxSubQuantK; ++k)
+                // the expansion can go slightly negative through rounding
+                lut[base+k]= std::max(0.0f, resNormSq - 2*subTerms[base+k] + offsetTerms[base+k]);
+            subVec+= subDims;
+            subOffset+= subDims;
+        }
+    }
+    
+    knnMultiFromLUTs( &luts[0], numVecs, codes, allCodes, n, KNN, distSqInds );
+    
+}
+
+
+
+void
+productQuant::knnMultiFromLUTs( float const *luts, uint32_t numVecs, uint8_t const *codes, std::vector<uint16_t> const &allCodes, uint32_t n, uint32_t KNN, std::vector< std::vector< std::pair<float, uint32_t> > > &distSqInds ) const {
+    
+    uint32_t const lutSize= nSubQuant*maxSubQuantK;
+    KNN= std::min(KNN, n);
+    distSqInds.resize(numVecs);
+    for (uint32_t iVec= 0; iVec<numVecs; ++iVec){
+        distSqInds[iVec].clear();
+        distSqInds[iVec].reserve(KNN);
+    }
+    if (KNN==0)
+        return;
+    
+    // a block of codes stays in cache while it is scanned for all vectors
+    uint32_t const multiBlockSize= 16*productQuantADC::blockSize;
+    for (uint32_t first= 0; first<n; first+= multiBlockSize){
+        uint32_t const end= std::min(n, first+multiBlockSize);
+        for (uint32_t iVec= 0; iVec<numVecs; ++iVec)
+            knnFromCodes( luts + iVec*lutSize, codes, allCodes, first, end, KNN, distSqInds[iVec] );
+    }
+    
+    for (uint32_t iVec= 0; iVec<numVecs; ++iVec)
+        std::sort_heap(distSqInds[iVec].begin(), distSqInds[iVec].end());
+    
+}
+
+
+
+void
+productQuant::knnFromCodes( float const *lut, uint8_t const *codes, std::vector<uint16_t> const &allCodes, uint32_t begin, uint32_t end, uint32_t KNN, std::vector< std::pair<float, uint32_t> > &distSqInds ) const {
+    
+    ASSERT( begin%16==0 );
+    uint32_t first= begin;
+    
+    if (maxSubQuantK<=16 && nSubQuant%8==0 && productQuantADC::hasSSSE3 && end-begin>=16){
+        
+        // quantise the lookup table to uint8 with a common step so that the
+        // sum of quantised entries (times step, plus minSum) is a lower bound of the distance
+        std::vector<uint8_t> qLut(nSubQuant*16, 255);
+        float minSum= 0, maxRange= 0;
+        std::vector<float> subMin(nSubQuant);
+        for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
+            float const *subLut= &lut[iSub*maxSubQuantK];
+            uint32_t const numClst= clstCentres_objs[iSub]->numClst;
+            subMin[iSub]= *std::min_element(subLut, subLut+numClst);
+            maxRange= std::max(maxRange, *std::max_element(subLut, subLut+numClst) - subMin[iSub]);
+            minSum+= subMin[iSub];
+        }
+        float const step= maxRange>0 ? maxRange/255 : 1.0f;
+        for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub)
+            for (uint32_t k= 0; k<clstCentres_objs[iSub]->numClst; ++k)
+                qLut[iSub*16 + k]= static_cast<uint8_t>( std::min(255.0f, floorf( (lut[iSub*maxSubQuantK + k] - subMin[iSub]) / step )) );
+        // slack for the rounding of float sums
+        float const slack= 1e-5f * (minSum + maxRange*nSubQuant) + 1e-6f;
+        
+        uint16_t lowerBounds[16];
+        float distSq;
+        
+        for (; first+16<=end; first+= 16){
+            productQuantADC::fastScan4SSSE3( &qLut[0], codes, nSubQuant, first, lowerBounds );
+            float const threshold= productQuantADC::topKThreshold(distSqInds, KNN);
+            for (uint32_t i= 0; i<16; ++i)
+                if (minSum + lowerBounds[i]*step <= threshold + slack){
+                    productQuantADC::scan4( lut, maxSubQuantK, codes, nSubQuant, first+i, 1, &distSq );
+                    productQuantADC::pushTopK(distSqInds, KNN, distSq, first+i);
+                }
+        }
+        
+    }
+    
+    // exact distances for everything else
+    float distsSq[productQuantADC::blockSize];
+    for (; first<end; first+= productQuantADC::blockSize){
+        uint32_t const num= std::min(productQuantADC::blockSize, end-first);
+        productQuantADC::scan( lut, maxSubQuantK, codes, allCodes, nSubQuant, first, num, distsSq );
+        float threshold= productQuantADC::topKThreshold(distSqInds, KNN);
+        for (uint32_t i= 0; i<num; ++i)
+            if (distsSq[i] < threshold){
+                productQuantADC::pushTopK(distSqInds, KNN, distsSq[i], first+i);
+                threshold= productQuantADC::topKThreshold(distSqInds, KNN);
+            }
+    }
+    
+}
+
+
+
+uint32_t
+productQuant::getDistsSqSlow( float const vec[], std::string const &data, float *&distsSq ) const {
+    
     charStream *charStream_obj= charStreamFactoryCreate();
     charStream_obj->setDataCopy(data);
     uint32_t n= charStream_obj->getNum() / nSubQuant;
@@ -173,11 +643,7 @@ productQuant::getDistsSq( float const vec[], std::string const &data, float *&di
     
     // do the work
     
-//     if (charStream_obj->goNative())
-//         // a lot faster
-//         getDistsSq_8bit( vec, charStream_obj->getData(), n, distsSq, dists, wasComputed, subVecs );
-//     else
-        getDistsSq_otherbits( vec, *charStream_obj, n, distsSq, dists, wasComputed, subVecs );
+    getDistsSq_otherbits( vec, *charStream_obj, n, distsSq, dists, wasComputed, subVecs );
     
     
     // free
@@ -193,38 +659,6 @@ productQuant::getDistsSq( float const vec[], std::string const &data, float *&di
 
 
 
-void
-productQuant::getDistsSq_8bit( float const vec[], unsigned char *iter, uint32_t const n, float *distsSq, float *dists[], bool *wasComputed[], float const *subVecs[] ) const {
-    
-    // compute distances to all points
-    
-    for (uint32_t i= 0; i<n; ++i){
-        
-        distsSq[i]= 0;
-        
-        for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
-            
-            unsigned subClusterID= static_cast<unsigned>( *iter );
-            ++iter;
-            
-            if (!wasComputed[iSub][subClusterID]){
-                dists[iSub][subClusterID]= jp_dist_l2(
-                    subVecs[iSub],
-                    clstCentres_objs[iSub]->clstC_flat + subClusterID * (clstCentres_objs[iSub]->numDims),
-                    clstCentres_objs[iSub]->numDims );
-                wasComputed[iSub][subClusterID]= true;
-            }
-            
-            distsSq[i]+= dists[iSub][subClusterID];
-            
-        }
-        
-    }
-    
-}
-
-
-
 void
 productQuant::getDistsSq_otherbits( float const vec[], charStream &charStream_obj, uint32_t const n, float *distsSq, float *dists[], bool *wasComputed[], float const *subVecs[] ) const {
     
@@ -275,6 +709,22 @@ productQuant::charStreamFactoryCreate() const {
 
 
 
+uint8_t
+productQuant::codeBits() const {
+    ASSERT( maxSubQuantK<=4096 );
+    if (maxSubQuantK<=16)
+        return 4;
+    else if (maxSubQuantK<=64)
+        return 6;
+    else if (maxSubQuantK<=256)
+        return 8;
+    else if (maxSubQuantK<=1024)
+        return 10;
+    return 12;
+}
+
+
+
 uint32_t
 productQuant::numBytesPerVector() const {
     ASSERT( maxSubQuantK<=4096 );
@@ -59,9 +59,36 @@ class productQuant : public compressorWithDistance, public compressorIndep {
         
         // compressorWithDistance
         
+        // asymmetric distances through per-query lookup tables (see computeLUT)
         uint32_t
             getDistsSq( float const vec[], std::string const &data, float *&distsSq  ) const;
         
+        // scans the codes straight into a top-KNN heap; for <=16 clusters per subquantizer
+        // a SIMD "fast-scan" with uint8 lookup tables skips most vectors, the rest get exact distances
+        void
+            getKNN( float const vec[], std::string const &data, uint32_t KNN, std::vector< std::pair<float, uint32_t> > &distSqInds ) const;
+        
+        // as getKNN, the codes are decoded once and scanned block by block for all vectors
+        void
+            getKNNMulti( float const vecs[], uint32_t numVecs, uint8_t const *data, uint32_t size, uint32_t KNN, std::vector< std::vector< std::pair<float, uint32_t> > > &distSqInds ) const;
+        
+        // the lookup table of a residual, |r-p|^2 with r= vec-offset and p a subquantizer centre, is
+        // |r|^2 - 2<vec,p> + (2<offset,p> + |p|^2): the terms are the inner products <vec,p>,
+        // the last part is computed once per offset
+        uint32_t
+            residualTermSize() const { return nSubQuant*maxSubQuantK; }
+        
+        void
+            getResidualTerms( float const vec[], float *terms ) const;
+        
+        void
+            getKNNResidualMulti( float const vecs[], float const terms[], uint32_t numVecs, float const offset[], uint8_t const *data, uint32_t size, uint32_t KNN, std::vector< std::vector< std::pair<float, uint32_t> > > &distSqInds ) const;
+        
+        // the original implementation of getDistsSq (lazily computed distances, one
+        // getNextUnsafe() per code), for testing and benchmarking
+        uint32_t
+            getDistsSqSlow( float const vec[], std::string const &data, float *&distsSq  ) const;
+        
         // compressorIndep
         
         charStream*
@@ -77,10 +104,29 @@ class productQuant : public compressorWithDistance, public compressorIndep {
     private:
         
         void
-            getDistsSq_8bit( float const vec[], unsigned char *iter, uint32_t const n, float *distsSq, float *dists[], bool *wasComputed[], float const *subVecs[] ) const;
+            getDistsSq_otherbits( float const vec[], charStream &charStream_obj, uint32_t const n, float *distsSq, float *dists[], bool *wasComputed[], float const *subVecs[] ) const;
         
+        // lut[iSub*maxSubQuantK + k]= squared distance between the iSub-th part of vec and the k-th centre of iSub
         void
-            getDistsSq_otherbits( float const vec[], charStream &charStream_obj, uint32_t const n, float *distsSq, float *dists[], bool *wasComputed[], float const *subVecs[] ) const;
+            computeLUT( float const vec[], float *lut ) const;
+        
+        // bits per code as stored by the charStream of charStreamFactoryCreate
+        uint8_t
+            codeBits() const;
+        
+        // number of vectors in data; codes points to the 8-bit (or 4-bit, 2 per byte, high nibble first)
+        // codes if they are stored natively, otherwise allCodes is filled with all of them (bulk decoded)
+        uint32_t
+            getCodes( uint8_t const *data, uint32_t size, uint8_t const *&codes, std::vector<uint16_t> &allCodes ) const;
+        
+        // getKNNMulti given the lookup tables of the numVecs vectors
+        void
+            knnMultiFromLUTs( float const *luts, uint32_t numVecs, uint8_t const *codes, std::vector<uint16_t> const &allCodes, uint32_t n, uint32_t KNN, std::vector< std::vector< std::pair<float, uint32_t> > > &distSqInds ) const;
+        
+        // pushes vectors [begin, end) into the (unsorted) top-KNN max-heap distSqInds,
+        // begin has to be a multiple of 16
+        void
+            knnFromCodes( float const *lut, uint8_t const *codes, std::vector<uint16_t> const &allCodes, uint32_t begin, uint32_t end, uint32_t KNN, std::vector< std::pair<float, uint32_t> > &distSqInds ) const;
         
         clstCentres const **clstCentres_objs;
         fastann::nn_obj<float> const **nn_objs;
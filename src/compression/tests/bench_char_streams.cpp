@@ -0,0 +1,95 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <stdlib.h>
+#include <iostream>
+
+#include "char_streams.h"
+#include "macros.h"
+#include "same_random.h"
+#include "timing.h"
+
+
+
+// Decoding throughput per codec: getNextUnsafe (virtual call per value) vs charStreamView::decode,
+// both of a whole stream and of many short ranges (e.g. 64-bit Hamming signatures of 4-bit codes)
+// usage: bench_char_streams [numValues rangeLength]
+
+void
+bench(uint32_t bits, uint32_t N, uint32_t rangeLength){
+    
+    sameRandomUint32 rand(N, 43);
+    sameRandomStreamUint32 randStream(rand);
+    
+    charStream *cs= charStream::charStreamCreate(bits);
+    cs->reserve(N);
+    for (uint32_t i= 0; i<N; ++i)
+        cs->add( randStream.getNext0ToN(1<<bits) );
+    std::string const data= cs->getDataCopy();
+    cs->setDataCopy(data);
+    
+    std::vector<uint16_t> out(N);
+    uint64_t sumSlow= 0, sumFast= 0;
+    
+    double t0= timing::tic();
+    cs->resetIter();
+    for (uint32_t i= 0; i<N; ++i)
+        out[i]= cs->getNextUnsafe();
+    double const tSlow= timing::toc(t0);
+    for (uint32_t i= 0; i<N; ++i) sumSlow+= out[i];
+    
+    t0= timing::tic();
+    charStreamView view(bits, data);
+    view.decode(0, N, &out[0]);
+    double const tFast= timing::toc(t0);
+    for (uint32_t i= 0; i<N; ++i) sumFast+= out[i];
+    ASSERT(sumSlow==sumFast);
+    
+    t0= timing::tic();
+    for (uint32_t begin= 0; begin+rangeLength<=N; begin+= rangeLength){
+        cs->setIter(begin);
+        for (uint32_t i= 0; i<rangeLength; ++i)
+            out[begin+i]= cs->getNextUnsafe();
+    }
+    double const tSlowRange= timing::toc(t0);
+    
+    t0= timing::tic();
+    for (uint32_t begin= 0; begin+rangeLength<=N; begin+= rangeLength)
+        view.decode(begin, rangeLength, &out[begin]);
+    double const tFastRange= timing::toc(t0);
+    
+    std::cout<<static_cast<uint32_t>(bits)<<" bits: "
+             <<N/tSlow/1e3<<" -> "<<N/tFast/1e3<<" Mvalues/s, ranges of "<<rangeLength<<": "
+             <<N/tSlowRange/1e3<<" -> "<<N/tFastRange/1e3<<" Mvalues/s\n";
+    
+    delete cs;
+}
+
+
+
+int main(int argc, char **argv){
+    
+    uint32_t const N= argc>1 ? atoi(argv[1]) : 20000000;
+    uint32_t const rangeLength= argc>2 ? atoi(argv[2]) : 16;
+    
+    std::cout<<N<<" values, getNextUnsafe -> charStreamView::decode\n";
+    bench( 4, N, rangeLength);
+    bench( 6, N, rangeLength);
+    bench( 8, N, rangeLength);
+    bench(10, N, rangeLength);
+    bench(12, N, rangeLength);
+    bench(16, N, rangeLength);
+    
+    return 0;
+}
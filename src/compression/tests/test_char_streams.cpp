@@ -18,6 +18,52 @@ No usage or redistribution is allowed without explicit permission.
 
 
 
+// bulk decoding of random ranges and, for up to 16 bits, encoding
+void
+testView(uint32_t bits, std::string const &data, std::vector<uint64_t> const &vals, sameRandomStreamUint32 &randStream){
+    
+    uint32_t const N= vals.size();
+    charStreamView view(bits, data);
+    ASSERT(view.getNum() == N);
+    
+    std::vector<uint64_t> out(N+1);
+    for (uint32_t iRange= 0; iRange<20; ++iRange){
+        uint32_t begin= randStream.getNext0ToN(N+1);
+        uint32_t count= randStream.getNext0ToN(N-begin+1);
+        if (iRange==0){ begin= 0; count= N; }
+        out[count]= 0xABCD;
+        view.decode(begin, count, &out[0]);
+        ASSERT( out[count]==0xABCD );
+        for (uint32_t i= 0; i<count; ++i)
+            ASSERT( out[i] == vals[begin+i] );
+    }
+    
+    if (bits>16)
+        return;
+    
+    std::vector<uint16_t> vals16(vals.begin(), vals.end());
+    std::string encoded;
+    for (uint32_t n= 0; n<=40; ++n){
+        // short streams (only the scalar code paths)
+        charStream *c= charStream::charStreamCreate(bits);
+        for (uint32_t i= 0; i<n; ++i)
+            c->add(vals16[i]);
+        charStreamView::encode(bits, &vals16[0], n, encoded);
+        ASSERT( encoded == c->getDataCopy() );
+        charStreamView shortView= c->getView();
+        ASSERT( shortView.getNum() == n );
+        std::vector<uint16_t> out16(n+1);
+        shortView.decode(0, n, &out16[0]);
+        for (uint32_t i= 0; i<n; ++i)
+            ASSERT( out16[i] == vals16[i] );
+        delete c;
+    }
+    charStreamView::encode(bits, &vals16[0], N, encoded);
+    ASSERT( encoded == data );
+}
+
+
+
 bool
 testStreams(uint32_t bits){
     
@@ -47,11 +93,14 @@ testStreams(uint32_t bits){
             c1->add( vals.back() );
         }
         
+        std::string const data= c1->getDataCopy();
         charStream *c2= charStream::charStreamCreate(bits);
-        c2->setDataCopy( c1->getDataCopy() );
+        c2->setDataCopy( data );
         
         delete c1;
         
+        testView(bits, data, vals, randStream);
+        
         ASSERT(N == c2->getNum());
         
         uint64_t v;
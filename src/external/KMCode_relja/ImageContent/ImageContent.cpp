@@ -1,34 +1,52 @@
 // Implementation de la classe image
-#include <stdarg.h>
+#include <setjmp.h>
 #include "imageContent.h"
 extern "C" {
 #include "jpeglib.h"
 }
 
-inline
-void abort__(const char *s, ...)
+// libjpeg's default error_exit calls exit(), jump back to read_jpeg_file instead
+struct read_jpeg_error_mgr {
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+};
+
+static void
+read_jpeg_error_exit(j_common_ptr cinfo)
 {
-  va_list args;
-  va_start(args, s);
-  vfprintf(stderr, s, args);
-  fprintf(stderr, "\n");
-  va_end(args);
-  abort();
+  (*cinfo->err->output_message)(cinfo);
+  longjmp(((read_jpeg_error_mgr*)cinfo->err)->setjmp_buffer, 1);
 }
 
+// NULL if the file can't be opened, is corrupt or isn't gray/RGB
 inline
 unsigned char*
 read_jpeg_file(const char *file_name, int *width, int *height)
 {
   struct jpeg_decompress_struct cinfo;
-  struct jpeg_error_mgr jerr;
+  struct read_jpeg_error_mgr jerr;
+  typedef unsigned char uchar;
   
   FILE *infile;
+  // set after the setjmp, volatile so that they are valid after a longjmp
+  uchar * volatile ret = NULL;
+  uchar ** volatile row_pointers = NULL;
 
-  if ((infile = fopen(file_name, "rb"))==NULL)
-    abort__("[read_jpeg_file] Can't open %s for reading", file_name);
+  if ((infile = fopen(file_name, "rb"))==NULL) {
+    fprintf(stderr, "[read_jpeg_file] Can't open %s for reading\n", file_name);
+    return NULL;
+  }
   
-  cinfo.err = jpeg_std_error(&jerr);
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = read_jpeg_error_exit;
+  if (setjmp(jerr.setjmp_buffer)) {
+    fprintf(stderr, "[read_jpeg_file] Can't decode %s\n", file_name);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(infile);
+    delete[] row_pointers;
+    delete[] ret;
+    return NULL;
+  }
 
   jpeg_create_decompress(&cinfo);
   jpeg_stdio_src(&cinfo, infile);
@@ -44,17 +62,18 @@ read_jpeg_file(const char *file_name, int *width, int *height)
   jpeg_start_decompress(&cinfo);
 
   if (cinfo.output_components != 3 && cinfo.output_components != 1) {
-    abort__("[read_jpeg_file] Only RGB is supported - comps = %d",
+    fprintf(stderr, "[read_jpeg_file] Only RGB is supported - comps = %d\n",
             cinfo.output_components);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(infile);
+    return NULL;
   }
 
-  typedef unsigned char uchar;
-
   *width = cinfo.output_width;
   *height = cinfo.output_height;
 
-  uchar *ret = new uchar[cinfo.output_height * cinfo.output_width * 3];
-  uchar **row_pointers = new uchar*[cinfo.output_height];
+  ret = new uchar[cinfo.output_height * cinfo.output_width * 3];
+  row_pointers = new uchar*[cinfo.output_height];
   for (int y=0; y<*height; ++y)
     row_pointers[y] = &ret[y * (*width) * 3];
 
@@ -339,6 +358,12 @@ ImageContent::ImageContent(const char *name)
   {
     int wid, hei;
     unsigned char* pixels = read_jpeg_file(name, &wid, &hei);
+    if (pixels == NULL) {
+      // an empty image, i.e. no features (allocated as 1x1 as init3UChar sets up the first row)
+      init3UChar(1, 1);
+      x_size = y_size = tsize = 0;
+      return;
+    }
     x_size = (uint)wid;
     y_size = (uint)hei;
     init3UChar(y_size, x_size);
@@ -1,5 +1,8 @@
 #include "corner.h"
 
+#include <pthread.h>
+#include <map>
+
 /**********************************************/
 Corner::Corner(void){    init();
 } /**********************************************/
@@ -504,9 +507,8 @@ void normalize1(DARY * img, int x, int y, float radius){
  
 } 
  
-DARY *patch_mask = new DARY(PATCH_SIZE,PATCH_SIZE);
 //float PATCH_SUM;
-void initPatchMask(int size){ 
+static void fillPatchMask(DARY *patch_mask, int size){ 
   //DARY * mask = new DARY(PATCH_SIZE,PATCH_SIZE,0.0);    
    //patch_mask;    
     int center=size>>1;
@@ -530,3 +532,26 @@ void initPatchMask(int size){
     //patch_mask->normalize(0,1);patch_mask->write("mask.pgm");cout << "mask "<< endl;getchar();
 } 
 
+static DARY *createPatchMask(int size){
+  DARY *mask = new DARY(size,size);
+  fillPatchMask(mask, size);
+  return mask;
+}
+
+// The masks are shared by all threads so they are never rewritten: patch_mask (PATCH_SIZE)
+// is built at load time, every other size gets its own mask the first time it is asked for.
+DARY *patch_mask = createPatchMask(PATCH_SIZE);
+
+static std::map<int, DARY*> other_patch_masks;
+static pthread_mutex_t other_patch_masks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+DARY *initPatchMask(int size){
+  if(size==PATCH_SIZE)return patch_mask;
+  pthread_mutex_lock(&other_patch_masks_mutex);
+  DARY *&mask = other_patch_masks[size];
+  if(mask==NULL)mask=createPatchMask(size);
+  DARY *result = mask;
+  pthread_mutex_unlock(&other_patch_masks_mutex);
+  return result;
+}
+
@@ -738,7 +738,7 @@ void hessian(DARY *image_in, DARY *hes, DARY *lap){
    delete fxx; delete fyy; delete fxy; 
 }
 
-void harris(DARY *img,DARY *har,DARY *har11,DARY *har12,DARY *har22){    
+void harris(DARY *img,DARY *har,DARY *har11,DARY *har12,DARY *har22, float alpha = ALPHA){    
   
    int col_nb, row_nb;
    float A, B, C, determinant, trace, t1,t2;
@@ -775,17 +775,17 @@ void harris(DARY *img,DARY *har,DARY *har11,DARY *har12,DARY *har22){
         C = har12->fel[row][col];
         determinant = A * B - (C*C);
         trace = A + B;
-        har->fel[row][col] = (determinant - ALPHA * (trace*trace));
+        har->fel[row][col] = (determinant - alpha * (trace*trace));
        }
    //har->write("har.pgm");cout << "ci"<< endl;getchar();
 
 }
 
 
-int getLapMax(vector<DARY *> lap, vector<float> scale, uint level, uint minlev, uint maxlev, float x, float y,float &sc){
+int getLapMax(vector<DARY *> lap, vector<float> scale, uint level, uint minlev, uint maxlev, float x, float y,float &sc, float lthres = 10){
 
   vector<float> llap;
-  float fx,fy,lp,lthres=10;
+  float fx,fy,lp;
   for(uint i=0; i<lap.size() && i<(level+maxlev);i++){
     fx=x/scale[i];
     fy=y/scale[i];
@@ -872,7 +872,7 @@ void invSqrRoot(float &a, float &b, float &c, float &r_l, float &r_m){
 }
 
 
-void harris_lap(vector<DARY *> har,vector<DARY *> har11,vector<DARY *> har12,vector<DARY *> har22, vector<DARY *> lap, vector<float> scale, vector<CornerDescriptor*>&corners, float threshold, int type){
+void harris_lap(vector<DARY *> har,vector<DARY *> har11,vector<DARY *> har12,vector<DARY *> har22, vector<DARY *> lap, vector<float> scale, vector<CornerDescriptor*>&corners, float threshold, int type, float lap_threshold = 10){
   
   CornerDescriptor *cor,*cor1;
   float act_pixel,fx,fy;
@@ -918,7 +918,7 @@ void harris_lap(vector<DARY *> har,vector<DARY *> har11,vector<DARY *> har12,vec
 	  //cout << fcol << " " << frow<< "  "<< scale[i]*fcol << " " << scale[i]*frow<<  endl;getchar();
 	  fx=scale[i]*fcol;
 	  fy=scale[i]*frow;
-	  level=getLapMax(lap, scale, i, 1, 7, fx, fy, sc);
+	  level=getLapMax(lap, scale, i, 1, 7, fx, fy, sc, lap_threshold);
 	  //fx+=0.001;
 	  //fy+=0.001;
 	  if(level>0){cgood++;
@@ -1015,7 +1015,8 @@ void findAffineRegion(vector<DARY *> image,vector<DARY *> laplacian, vector<floa
 
 void multi_scale_har(DARY* img, vector<CornerDescriptor*>&corners, 
 		   float threshold,
-		   float step, int aff){
+		   float step, int aff,
+		   float alpha, float lap_threshold){
 
   vector<DARY *> sm; 
   vector<DARY *> lap; 
@@ -1058,13 +1059,13 @@ void multi_scale_har(DARY* img, vector<CornerDescriptor*>&corners,
 
   laplacian(sm[0],lap[0]);
   for(uint i=1;i<sm.size();i++){
-    harris(sm[i],har[i],har11[i],har12[i],har22[i]);
+    harris(sm[i],har[i],har11[i],har12[i],har22[i],alpha);
     laplacian(sm[i],lap[i]);//sm[i]->write("sm.pgm");har[i]->write("har.pgm");lap[i]->write("lap.pgm");getchar();
     //cout <<i << " "<< sc[i]<< endl;
   }
    
-  if(aff==0)harris_lap(har,har11,har12,har22,lap,sc,corners,threshold,0);
-  else harris_lap(har,har11,har12,har22,lap,sc,corners,threshold,1);
+  if(aff==0)harris_lap(har,har11,har12,har22,lap,sc,corners,threshold,0,lap_threshold);
+  else harris_lap(har,har11,har12,har22,lap,sc,corners,threshold,1,lap_threshold);
 
 
   if(aff>1)findAffineRegion(sm,lap,sc,corners,aff);
@@ -1083,6 +1084,15 @@ void multi_scale_har(DARY* img, vector<CornerDescriptor*>&corners,
 }
 
 
+struct HessianLevels {
+  vector<DARY *> *sm, *hes, *lap;
+};
+
+static void hessianLevel(void *p, int i){
+  HessianLevels *levels = (HessianLevels*)p;
+  hessian((*levels->sm)[i], (*levels->hes)[i], (*levels->lap)[i]);
+}
+
 void multi_scale_hes(DARY* img, vector<CornerDescriptor*>&corners, 
 		     float threshold,
 		     float step, int aff){
@@ -1126,10 +1136,9 @@ void multi_scale_hes(DARY* img, vector<CornerDescriptor*>&corners,
       sm[i]->scale(sm[i-2],sc2,sc2);
 
 
-  for(uint i=0;i<sm.size();i++){   
-    hessian(sm[i],hes[i],lap[i]);
-    //cout <<i << " "<< sc[i]<< endl;
-  }
+  // pyramid levels are independent (largest first, as the dynamic scheduling is in order)
+  HessianLevels levels = {&sm, &hes, &lap};
+  parallelFor(sm.size(), hessianLevel, &levels);
 
   harris_lap(hes,hes,hes,hes,lap, sc, corners,threshold,2);  
  
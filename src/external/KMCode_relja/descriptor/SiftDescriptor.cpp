@@ -183,7 +183,7 @@ void SiftDescriptor::MakeKeypointSample(DARY *grad, DARY *ori)
 
 
 void SiftDescriptor::computeComponents(DARY *img){
-  static int desc_num = 0;
+  //static int desc_num = 0; // not thread-safe, only used for debugging output
   if(img==NULL){return;}
   //int mins = (int)(GAUSS_CUTOFF*c_scale+2);
   //if(!isOK(mins,img->x()-mins,img->y()-mins))return;
@@ -217,7 +217,7 @@ void SiftDescriptor::computeComponents(DARY *img){
 
   int sift_pca_size=128;
   //pca(sift_pca_size,sift_pca_avg,sift_pca_base);	
-  desc_num++;
+  //desc_num++;
 } 
 
    
@@ -86,7 +86,8 @@ operator >>(istream& is, watchpoint<T>& wp)
 
 extern DARY *patch_mask;
 extern float PATCH_SUM;
-void initPatchMask(int size);
+// mask of the given size (patch_mask for PATCH_SIZE), safe to call from several threads
+DARY *initPatchMask(int size);
 //float PATCH_SUM;
 class DllExport Corner{
 
@@ -19,8 +19,10 @@ void multi_harris_mask(DARY* image, DARY* mask,
 void multi_harris(DARY* image, vector<CornerDescriptor*>&corners, 
 		  float har_threshold, 
 		  float min_scale, float max_scale, float step);
+// alpha is the Harris k, lap_threshold the minimal |Laplacian| at the selected scale (0-255 images)
 void multi_scale_har(DARY* image, vector<CornerDescriptor*>&corners, 
-		  float har_threshold, float step, int aff);
+		  float har_threshold, float step, int aff,
+		  float alpha = ALPHA, float lap_threshold = 10);
 void multi_scale_hes(DARY* image, vector<CornerDescriptor*>&corners, 
 		  float har_threshold, float step, int aff);
 void multi_hessian(DARY* image, vector<CornerDescriptor*>&corners, 
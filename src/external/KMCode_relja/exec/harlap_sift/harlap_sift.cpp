@@ -0,0 +1,147 @@
+#include "harlap_sift.h"
+
+#include "../hesaff_sift/hesaff_sift.h"
+#include "../../ImageContent/imageContent.h"
+#include "../../descriptor/descriptor.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace KM_harlap_sift {
+
+// Same as detect_points -harlap (default threshold), with the Harris k and the
+// Laplacian threshold exposed; regions are circles of the selected scale.
+void detect(ImageContent *gray,
+            double harris_k,
+            double laplace_threshold,
+            std::vector<ellipse> &regions) {
+
+  float const threshold = 100;
+  vector<CornerDescriptor*> detected;
+  // KMCode works with intensities in [0,255]
+  multi_scale_har(gray, detected, threshold, 1.1, 0, harris_k, laplace_threshold * 255);
+
+  regions.resize(detected.size());
+  for (unsigned int i=0; i < detected.size(); i++) {
+    double const r = detected[i]->getCornerScale();
+    regions[i].set( detected[i]->getX(), detected[i]->getY(), 1.0/(r*r), 0.0, 1.0/(r*r) );
+    delete detected[i];
+  }
+}
+
+
+
+// r, g, b are planes with a step of `step` bytes between consecutive pixels
+static void extract_planes(uint8_t const *r,
+                           uint8_t const *g,
+                           uint8_t const *b,
+                           size_t step,
+                           uint32_t width,
+                           uint32_t height,
+                           bool opponent,
+                           double harris_k,
+                           double laplace_threshold,
+                           float scale_multiplier,
+                           std::vector<ellipse> &regions,
+                           uint32_t &feat_count,
+                           float *&descs) {
+
+  size_t const n = (size_t)width*height;
+
+  // intensity as ImageContent::toGRAY
+  ImageContent gray(height, width);
+  float *pix = gray.fel[0];
+  for (size_t i = 0, k = 0; i < n; i++, k += step)
+    pix[i] = (float)(unsigned char)((r[k] + g[k] + b[k]) / 3.0);
+
+  std::vector<ellipse> detected;
+  detect(&gray, harris_k, laplace_threshold, detected);
+
+  if (!opponent) {
+    KM_hesaff_sift::describe(&gray, detected, scale_multiplier, true, regions, feat_count, descs);
+    return;
+  }
+
+  // opponent channels, offset to be non-negative (gradients are unaffected)
+  ImageContent o1(height, width), o2(height, width), o3(height, width);
+  float *p1 = o1.fel[0], *p2 = o2.fel[0], *p3 = o3.fel[0];
+  float const s2 = 1.0f/sqrtf(2.0f), s6 = 1.0f/sqrtf(6.0f), s3 = 1.0f/sqrtf(3.0f);
+  for (size_t i = 0, k = 0; i < n; i++, k += step) {
+    float const R = r[k], G = g[k], B = b[k];
+    p1[i] = (R - G + 255) * s2;
+    p2[i] = (R + G - 2*B + 2*255) * s6;
+    p3[i] = (R + G + B) * s3;
+  }
+
+  ImageContent *channels[3] = {&o1, &o2, &o3};
+  std::vector<ellipse> channel_regions;
+  uint32_t channel_count[3];
+  float *channel_descs[3];
+  for (int c = 0; c < 3; c++)
+    KM_hesaff_sift::describe(channels[c], detected, scale_multiplier, true,
+                             c == 0 ? regions : channel_regions, channel_count[c], channel_descs[c]);
+  // the same regions survive in every channel as only their geometry decides
+  assert(channel_count[0] == channel_count[1] && channel_count[0] == channel_count[2]);
+
+  feat_count = channel_count[0];
+  uint32_t const sift_dim = SiftSize;
+  descs = new float[ (size_t)feat_count * 3 * sift_dim ];
+  float *desc_iter = descs;
+  for (uint32_t i = 0; i < feat_count; i++)
+    for (int c = 0; c < 3; c++, desc_iter += sift_dim)
+      std::memcpy(desc_iter, channel_descs[c] + (size_t)i * sift_dim, sift_dim * sizeof(float));
+  for (int c = 0; c < 3; c++)
+    delete []channel_descs[c];
+}
+
+
+
+void extract(uint8_t const *rgb,
+             uint32_t width,
+             uint32_t height,
+             bool opponent,
+             double harris_k,
+             double laplace_threshold,
+             float scale_multiplier,
+             std::vector<ellipse> &regions,
+             uint32_t &feat_count,
+             float *&descs,
+             uint32_t min_size) {
+
+  if (width < min_size || height < min_size) {
+    regions.clear();
+    feat_count = 0;
+    descs = new float[0];
+    return;
+  }
+  extract_planes(rgb, rgb + 1, rgb + 2, 3, width, height, opponent, harris_k, laplace_threshold,
+                 scale_multiplier, regions, feat_count, descs);
+}
+
+
+
+void extract(std::string const &jpg_filename,
+             bool opponent,
+             double harris_k,
+             double laplace_threshold,
+             float scale_multiplier,
+             std::vector<ellipse> &regions,
+             uint32_t &feat_count,
+             float *&descs,
+             uint32_t min_size) {
+
+  // JPEGs are always decoded to RGB planes
+  ImageContent image(jpg_filename.c_str());
+  assert(image.getType() == CUCHAR);
+  if (image.x() < min_size || image.y() < min_size) {
+    regions.clear();
+    feat_count = 0;
+    descs = new float[0];
+    return;
+  }
+  extract_planes(image.belr[0], image.belg[0], image.belb[0], 1, image.x(), image.y(), opponent,
+                 harris_k, laplace_threshold, scale_multiplier, regions, feat_count, descs);
+}
+
+} // end of namespace: KM_harlap_sift
@@ -0,0 +1,51 @@
+#include "../../../../matching/det_ransac/ellipse.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class ImageContent;
+
+// Harris-Laplace detection + (colour) SIFT description in memory, the in-process
+// counterpart of van de Sande's colorDescriptor --detector harrislaplace --descriptor sift|opponentsift
+// (no process spawn, no output file). Reentrant: can be called concurrently from multiple threads.
+namespace KM_harlap_sift {
+
+  // Harris-Laplace on a gray image (toGRAY() and char2float() already applied), circular
+  // regions in detect_points format. harris_k is the Harris k, laplace_threshold the minimal
+  // scale-selection response for intensities in [0,1] (colorDescriptor's --harrisK, --laplaceThreshold)
+  void detect(ImageContent *gray,
+              double harris_k,
+              double laplace_threshold,
+              std::vector<ellipse> &regions);
+
+  // rgb is interleaved 8-bit RGB (row-major, width x height).
+  // opponent: 384-d OpponentSIFT, SIFT of each of the opponent channels
+  // O1= (R-G)/sqrt(2), O2= (R+G-2B)/sqrt(6), O3= (R+G+B)/sqrt(3), concatenated in that order;
+  // otherwise 128-d SIFT of the intensity (R+G+B)/3.
+  // Descriptors are upright, regions and descs are as in KM_hesaff_sift::extract
+  // (descs is feat_count x numDims, allocated with new[]);
+  // images smaller than min_size in either dimension produce no features
+  void extract(uint8_t const *rgb,
+               uint32_t width,
+               uint32_t height,
+               bool opponent,
+               double harris_k,
+               double laplace_threshold,
+               float scale_multiplier,
+               std::vector<ellipse> &regions,
+               uint32_t &feat_count,
+               float *&descs,
+               uint32_t min_size = 10);
+
+  // decodes jpg_filename once (see KM_hesaff_sift::isJpegFilename) and calls the above,
+  // a JPEG which can't be decoded (corrupt, not gray/RGB) produces no features
+  void extract(std::string const &jpg_filename,
+               bool opponent,
+               double harris_k,
+               double laplace_threshold,
+               float scale_multiplier,
+               std::vector<ellipse> &regions,
+               uint32_t &feat_count,
+               float *&descs,
+               uint32_t min_size = 10);
+}
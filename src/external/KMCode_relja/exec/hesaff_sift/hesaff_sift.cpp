@@ -0,0 +1,265 @@
+#include "hesaff_sift.h"
+
+#include "../../ImageContent/imageContent.h"
+#include "../../descriptor/descriptor.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace KM_hesaff_sift {
+
+// Same as detect_points -hesaff, the regions are in its output format.
+void detect(ImageContent *image,
+            std::vector<ellipse> &regions,
+            int num_threads) {
+
+  float const threshold = 100;
+  vector<CornerDescriptor*> detected;
+  int saved_threads = getFilterThreads();
+  setFilterThreads(num_threads);
+  multi_scale_hes(image, detected, threshold, 1.2, 16);
+  setFilterThreads(saved_threads);
+
+  regions.resize(detected.size());
+  Matrix U(2, 2, 0.0), D, Vi, V;
+  for (unsigned int i=0; i < detected.size(); i++) {
+    U(1,1) = detected[i]->getMi11();
+    U(1,2) = detected[i]->getMi12();
+    U(2,1) = detected[i]->getMi21();
+    U(2,2) = detected[i]->getMi22();
+    U.svd(Vi,D,V);
+    D(1,1) = D(1,1) * detected[i]->getCornerScale();
+    D(2,2) = D(2,2) * detected[i]->getCornerScale();
+    D(1,1) = 1.0 / ( D(1,1)*D(1,1) );
+    D(2,2) = 1.0 / ( D(2,2)*D(2,2) );
+    U = V*D*V.transpose();
+    regions[i].set( detected[i]->getX(), detected[i]->getY(), U(1,1), U(2,1), U(2,2) );
+    delete detected[i];
+  }
+}
+
+
+
+// Same as compute_descriptors -sift -o3 given the regions (what desc_KM_SIFT did through
+// text files), with the regions converted to measurement regions as in loadCorners.
+void describe(ImageContent *image,
+              std::vector<ellipse> const &in_regions,
+              float scale_multiplier,
+              bool upright,
+              std::vector<ellipse> &regions,
+              uint32_t &feat_count,
+              float *&descs) {
+
+  vector<CornerDescriptor*> desc;
+  desc.reserve(in_regions.size());
+  Matrix U(2, 2, 0.0), D, Vi, V;
+  double a;
+  for (unsigned int i=0; i < in_regions.size(); i++) {
+    U(1,1) = in_regions[i].a;
+    U(1,2) = in_regions[i].b;
+    U(2,1) = in_regions[i].b;
+    U(2,2) = in_regions[i].c;
+    U.svd(Vi,D,V);
+    D(1,1) = ( 1.0 / sqrt(D(1,1)) );
+    D(2,2) = ( 1.0 / sqrt(D(2,2)) );
+    a = sqrt( D(2,2)*D(1,1) );
+    D.tabMat[2][2] /= a;
+    D.tabMat[1][1] /= a;
+    U = V*D*V.transpose();
+
+    CornerDescriptor *cor = new CornerDescriptor();
+    cor->setCornerScale( scale_multiplier * a );
+    cor->setX_Y( in_regions[i].x, in_regions[i].y );
+    cor->setMi( U(1,1), U(1,2), U(2,1), U(2,2) );
+    if (upright)
+      cor->setAngle(0.0);
+    desc.push_back(cor);
+  }
+
+  computeSiftDescriptors(image, desc);
+
+  // Remove ones falling over the edge.
+  size_t n = 0;
+  for (size_t i=0; i < desc.size(); i++) {
+    if (desc[i]->is_fully_inside(0, image->x(), 0, image->y()))
+      desc[n++] = desc[i];
+    else
+      delete desc[i];
+  }
+  desc.resize(n);
+
+  feat_count = desc.size();
+  regions.resize(feat_count);
+  uint32_t const desc_dim = SiftSize;
+  descs = new float[ feat_count * desc_dim ];
+
+  float *desc_iter = descs;
+  for (unsigned int i=0; i < feat_count; i++) {
+    // writeCommonWA output region
+    U(1,1) = desc[i]->getMi11();
+    U(1,2) = desc[i]->getMi12();
+    U(2,1) = desc[i]->getMi21();
+    U(2,2) = desc[i]->getMi22();
+    U.svd(Vi,D,V);
+    D = D * desc[i]->getCornerScale();
+    D(1,1) = 1.0 / ( D(1,1)*D(1,1) );
+    D(2,2) = 1.0 / ( D(2,2)*D(2,2) );
+    U = V*D*V.transpose();
+    regions[i].set( desc[i]->getX(), desc[i]->getY(), U(1,1), U(1,2), U(2,2) );
+
+    std::memcpy(desc_iter, desc[i]->getVec(), desc_dim * sizeof(float));
+    desc_iter += desc_dim;
+    delete desc[i];
+  }
+}
+
+
+
+void extract(ImageContent *image,
+             float scale_multiplier,
+             bool upright,
+             std::vector<ellipse> &regions,
+             uint32_t &feat_count,
+             float *&descs,
+             int num_threads) {
+
+  std::vector<ellipse> detected;
+  detect(image, detected, num_threads);
+  describe(image, detected, scale_multiplier, upright, regions, feat_count, descs);
+}
+
+
+
+void extract(ImageContent *image,
+             float scale_multiplier,
+             bool upright,
+             std::vector<ellipse> &regions,
+             uint32_t &feat_count,
+             uint8_t *&descs,
+             int num_threads) {
+
+  float *descs_float;
+  extract(image, scale_multiplier, upright, regions, feat_count, descs_float, num_threads);
+  descs = new uint8_t[ feat_count * SiftSize ];
+  toUint8(descs_float, feat_count, descs);
+  delete []descs_float;
+}
+
+
+
+void toUint8(float const *descs, uint32_t feat_count, uint8_t *out) {
+  float const *end = descs + (size_t)feat_count * SiftSize;
+  for (; descs != end; ++descs, ++out)
+    *out = (uint8_t)(*descs + 0.1);
+}
+
+
+
+bool isJpegFilename(std::string const &jpg_filename) {
+  char const *name = jpg_filename.c_str();
+  return strstr(name, ".jpg") || strstr(name, ".jpeg") || strstr(name, ".JPG") || strstr(name, ".JPEG");
+}
+
+
+
+// NULL if the image is smaller than min_size in either dimension
+static ImageContent *load_gray(std::string const &jpg_filename, uint32_t min_size) {
+  ImageContent *image = new ImageContent(jpg_filename.c_str());
+  if (image->x() < min_size || image->y() < min_size) {
+    delete image;
+    return NULL;
+  }
+  image->toGRAY();
+  image->char2float();
+  return image;
+}
+
+
+
+void detect(std::string const &jpg_filename,
+            std::vector<ellipse> &regions,
+            uint32_t min_size,
+            int num_threads) {
+
+  ImageContent *image = load_gray(jpg_filename, min_size);
+  if (image == NULL) {
+    regions.clear();
+    return;
+  }
+  detect(image, regions, num_threads);
+  delete image;
+}
+
+
+
+void describe(std::string const &jpg_filename,
+              std::vector<ellipse> const &in_regions,
+              float scale_multiplier,
+              bool upright,
+              std::vector<ellipse> &regions,
+              uint32_t &feat_count,
+              float *&descs,
+              uint32_t min_size) {
+
+  ImageContent *image = load_gray(jpg_filename, min_size);
+  if (image == NULL) {
+    regions.clear();
+    feat_count = 0;
+    descs = new float[0];
+    return;
+  }
+  describe(image, in_regions, scale_multiplier, upright, regions, feat_count, descs);
+  delete image;
+}
+
+
+
+void extract(std::string const &jpg_filename,
+             float scale_multiplier,
+             bool upright,
+             std::vector<ellipse> &regions,
+             uint32_t &feat_count,
+             float *&descs,
+             uint32_t min_size,
+             int num_threads) {
+
+  ImageContent *image = load_gray(jpg_filename, min_size);
+  if (image == NULL) {
+    regions.clear();
+    feat_count = 0;
+    descs = new float[0];
+    return;
+  }
+  extract(image, scale_multiplier, upright, regions, feat_count, descs, num_threads);
+  delete image;
+}
+
+
+
+void extract(uint8_t const *gray,
+             uint32_t width,
+             uint32_t height,
+             float scale_multiplier,
+             bool upright,
+             std::vector<ellipse> &regions,
+             uint32_t &feat_count,
+             float *&descs,
+             uint32_t min_size,
+             int num_threads) {
+
+  if (width < min_size || height < min_size) {
+    regions.clear();
+    feat_count = 0;
+    descs = new float[0];
+    return;
+  }
+  ImageContent *image = new ImageContent(height, width);
+  float *pix = image->fel[0];
+  for (size_t i = 0, n = (size_t)width*height; i < n; i++)
+    pix[i] = (float)gray[i];
+
+  extract(image, scale_multiplier, upright, regions, feat_count, descs, num_threads);
+  delete image;
+}
+
+} // end of namespace: KM_hesaff_sift
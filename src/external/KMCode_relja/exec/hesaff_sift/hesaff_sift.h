@@ -0,0 +1,100 @@
+#include "../../../../matching/det_ransac/ellipse.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class ImageContent;
+
+// Hessian-Affine detection + SIFT description from a single decode of the image,
+// everything stays in memory (no region/descriptor text files, no second decode).
+// Reentrant: can be called concurrently from multiple threads.
+namespace KM_hesaff_sift {
+
+  // Hessian-Affine regions as written by detect_points -hesaff
+  void detect(ImageContent *image,
+              std::vector<ellipse> &regions,
+              int num_threads = 1);
+
+  // SIFT of given (detect_points format) regions as compute_descriptors -sift -o3:
+  // regions falling over the image edge are removed, the rest are returned as
+  // in extract below
+  void describe(ImageContent *image,
+                std::vector<ellipse> const &in_regions,
+                float scale_multiplier,
+                bool upright,
+                std::vector<ellipse> &regions,
+                uint32_t &feat_count,
+                float *&descs);
+
+  // image has to be already converted with toGRAY() and char2float(), it is not modified.
+  // regions are the (scale_multiplier-scaled) measurement regions of the descriptors,
+  // descs is a contiguous feat_count x 128 row-major array allocated with new[].
+  // num_threads>1 parallelises the detector's filtering over image strips and pyramid levels
+  // (useful for a single image, e.g. a query; when indexing images are done in parallel instead).
+  // The decoded image is shared, the detector's pyramid is not: as in compute_descriptors, every
+  // SIFT patch is sampled from the full-resolution image and only the affine-normalised patch is
+  // smoothed, so taking patches from the (isotropically smoothed, resampled) pyramid levels would
+  // give different descriptors than the ones already indexed with the external binaries.
+  void extract(ImageContent *image,
+               float scale_multiplier,
+               bool upright,
+               std::vector<ellipse> &regions,
+               uint32_t &feat_count,
+               float *&descs,
+               int num_threads = 1);
+
+  // as the above with the descriptors quantised to uint8 (as the SIFT raw descriptors are stored)
+  void extract(ImageContent *image,
+               float scale_multiplier,
+               bool upright,
+               std::vector<ellipse> &regions,
+               uint32_t &feat_count,
+               uint8_t *&descs,
+               int num_threads = 1);
+
+  // SIFT components are in [0, 255], +0.1 counters numerical issues as the cast does floor()
+  void toUint8(float const *descs, uint32_t feat_count, uint8_t *out);
+
+  // decodes jpg_filename once and calls the above (see isJpegFilename);
+  // images smaller than min_size in either dimension, and JPEGs which can't be decoded
+  // (corrupt, not gray/RGB) produce no features
+  void extract(std::string const &jpg_filename,
+               float scale_multiplier,
+               bool upright,
+               std::vector<ellipse> &regions,
+               uint32_t &feat_count,
+               float *&descs,
+               uint32_t min_size = 10,
+               int num_threads = 1);
+
+  // from an already decoded 8-bit gray image (row-major, width x height), e.g. of a
+  // format the KMCode can't read, so that it doesn't have to be re-encoded and decoded
+  void extract(uint8_t const *gray,
+               uint32_t width,
+               uint32_t height,
+               float scale_multiplier,
+               bool upright,
+               std::vector<ellipse> &regions,
+               uint32_t &feat_count,
+               float *&descs,
+               uint32_t min_size = 10,
+               int num_threads = 1);
+
+  // whether ImageContent decodes jpg_filename as a JPEG (it goes by the extension)
+  bool isJpegFilename(std::string const &jpg_filename);
+
+  // as the above, decoding jpg_filename first
+  void detect(std::string const &jpg_filename,
+              std::vector<ellipse> &regions,
+              uint32_t min_size = 10,
+              int num_threads = 1);
+
+  void describe(std::string const &jpg_filename,
+                std::vector<ellipse> const &in_regions,
+                float scale_multiplier,
+                bool upright,
+                std::vector<ellipse> &regions,
+                uint32_t &feat_count,
+                float *&descs,
+                uint32_t min_size = 10);
+}
@@ -1,29 +1,76 @@
 #include "gauss_iir.h"
+
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && (defined(__x86_64__) || defined(__i386__))
+#define KM_FILTER_AVX
+#include <immintrin.h>
+#endif
       
      
-static float** table_exp_lap;
-static float** table_exp;
-static float** table_exp_x;
-static float** table_exp_xx;
-static float** table_exp_xy;
-static float** table_exp_xxx;
-static float** table_exp_xxy;
-static float** table_exp_xxxx;
-static float** table_exp_xxxy;
-static float** table_exp_xxyy;
-static float g_scale=0;
-static float x_scale=0;
-static float xx_scale=0;
-static float lap_scale=0;
-static float xy_scale=0;
-static float xxx_scale=0;
-static float xxy_scale=0;
-static float xxxx_scale=0;
-static float xxxy_scale=0;
-static float xxyy_scale=0;
-static float total=0;
-static int size=0;
-static float sum_x=0;
+// Kernel tables are cached for the last used scale; they are per-thread so that
+// detection/description can run concurrently in several threads of one process.
+static __thread float** table_exp_lap;
+static __thread float** table_exp;
+static __thread float** table_exp_x;
+static __thread float** table_exp_xx;
+static __thread float** table_exp_xy;
+static __thread float** table_exp_xxx;
+static __thread float** table_exp_xxy;
+static __thread float** table_exp_xxxx;
+static __thread float** table_exp_xxxy;
+static __thread float** table_exp_xxyy;
+static __thread float g_scale=0;
+static __thread float x_scale=0;
+static __thread float xx_scale=0;
+static __thread float lap_scale=0;
+static __thread float xy_scale=0;
+static __thread float xxx_scale=0;
+static __thread float xxy_scale=0;
+static __thread float xxxx_scale=0;
+static __thread float xxxy_scale=0;
+static __thread float xxyy_scale=0;
+static __thread float total=0;
+static __thread int size=0;
+static __thread float sum_x=0;
+
+// The tables are freed when the thread exits (pthread key destructor), otherwise
+// every worker thread which extracted features would leak them.
+static pthread_key_t tables_key;
+static pthread_once_t tables_key_once = PTHREAD_ONCE_INIT;
+
+static void free_table(float **&table){
+  if(table!=NULL){delete [] table[0];delete [] table;}
+  table=NULL;
+}
+
+static void free_tables(void*){
+  free_table(table_exp_lap);
+  free_table(table_exp);
+  free_table(table_exp_x);
+  free_table(table_exp_xx);
+  free_table(table_exp_xy);
+  free_table(table_exp_xxx);
+  free_table(table_exp_xxy);
+  free_table(table_exp_xxxx);
+  free_table(table_exp_xxxy);
+  free_table(table_exp_xxyy);
+  g_scale=x_scale=xx_scale=lap_scale=xy_scale=0;
+  xxx_scale=xxy_scale=xxxx_scale=xxxy_scale=xxyy_scale=0;
+}
+
+static void make_tables_key(){
+  pthread_key_create(&tables_key, free_tables);
+}
+
+// the destructor is only called for a non-NULL value
+static void register_tables_cleanup(){
+  pthread_once(&tables_key_once, make_tables_key);
+  if(pthread_getspecific(tables_key)==NULL)
+    pthread_setspecific(tables_key, &tables_key);
+}
  
 void set_nii_and_dii (float sigma, 
 		      float a0, float a1, float b0, float b1, float c0, float c1,
@@ -403,6 +450,273 @@ void set_nii_and_dii (float sigma,
 
 	delete ym;	
       }
+/************************************************************************
+   Fast interior of the fixed-kernel separable filters below.
+
+   out[i] = sum_j w_j * in[i+off_j] is computed for all pixels whose taps
+   are inside the image (the scalar code of each filter still does the
+   boundary pixels). Vertical passes go row by row over blocks of columns
+   instead of down each column, and the rows are split into strips over
+   getFilterThreads() threads. Products are accumulated in double in the
+   same order as in the original expressions (which use double constants),
+   so the results are bit-identical to the plain loops.
+*************************************************************************/
+
+struct FilterTaps {
+  int n;
+  int off[12];
+  double w[12];
+};
+
+typedef void (*FilterRowFn)(float const * const *src, FilterTaps const &taps,
+                            float *out, int c0, int c1);
+
+static __thread int filter_threads = 1;
+// read by all filtering threads, hence accessed atomically
+static bool fast_filters = true;
+
+void setFilterThreads(int num_threads){ filter_threads = num_threads < 1 ? 1 : num_threads; }
+int getFilterThreads(){ return filter_threads; }
+void setFastFilters(bool fast){ __atomic_store_n(&fast_filters, fast, __ATOMIC_RELAXED); }
+
+static void filterRowScalar(float const * const *src, FilterTaps const &taps,
+                            float *out, int c0, int c1){
+  for (int c = c0; c < c1; c++) {
+    double v = taps.w[0] * src[0][c];
+    for (int j = 1; j < taps.n; j++)
+      v += taps.w[j] * src[j][c];
+    out[c] = v;
+  }
+}
+
+#ifdef __SSE2__
+static void filterRowSSE2(float const * const *src, FilterTaps const &taps,
+                          float *out, int c0, int c1){
+  int c = c0;
+  for (; c + 4 <= c1; c += 4) {
+    __m128 p = _mm_loadu_ps(src[0] + c);
+    __m128d w = _mm_set1_pd(taps.w[0]);
+    __m128d lo = _mm_mul_pd(w, _mm_cvtps_pd(p));
+    __m128d hi = _mm_mul_pd(w, _mm_cvtps_pd(_mm_movehl_ps(p, p)));
+    for (int j = 1; j < taps.n; j++) {
+      p = _mm_loadu_ps(src[j] + c);
+      w = _mm_set1_pd(taps.w[j]);
+      lo = _mm_add_pd(lo, _mm_mul_pd(w, _mm_cvtps_pd(p)));
+      hi = _mm_add_pd(hi, _mm_mul_pd(w, _mm_cvtps_pd(_mm_movehl_ps(p, p))));
+    }
+    _mm_storeu_ps(out + c, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+  }
+  filterRowScalar(src, taps, out, c, c1);
+}
+#endif
+
+#ifdef KM_FILTER_AVX
+__attribute__((target("avx")))
+static void filterRowAVX(float const * const *src, FilterTaps const &taps,
+                         float *out, int c0, int c1){
+  int c = c0;
+  for (; c + 8 <= c1; c += 8) {
+    __m256 p = _mm256_loadu_ps(src[0] + c);
+    __m256d w = _mm256_set1_pd(taps.w[0]);
+    __m256d lo = _mm256_mul_pd(w, _mm256_cvtps_pd(_mm256_castps256_ps128(p)));
+    __m256d hi = _mm256_mul_pd(w, _mm256_cvtps_pd(_mm256_extractf128_ps(p, 1)));
+    for (int j = 1; j < taps.n; j++) {
+      p = _mm256_loadu_ps(src[j] + c);
+      w = _mm256_set1_pd(taps.w[j]);
+      lo = _mm256_add_pd(lo, _mm256_mul_pd(w, _mm256_cvtps_pd(_mm256_castps256_ps128(p))));
+      hi = _mm256_add_pd(hi, _mm256_mul_pd(w, _mm256_cvtps_pd(_mm256_extractf128_ps(p, 1))));
+    }
+    _mm256_storeu_ps(out + c, _mm256_insertf128_ps(
+        _mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1));
+  }
+  // the rest of KMCode is legacy SSE, avoid the AVX-SSE transition penalty
+  _mm256_zeroupper();
+  filterRowSSE2(src, taps, out, c, c1);
+}
+#endif
+
+static FilterRowFn chooseFilterRow(){
+#ifdef KM_FILTER_AVX
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx"))
+    return filterRowAVX;
+#endif
+#ifdef __SSE2__
+  return filterRowSSE2;
+#else
+  return filterRowScalar;
+#endif
+}
+
+static FilterRowFn const filterRow = chooseFilterRow();
+
+struct ParallelForArg {
+  int n;
+  volatile int next;
+  void (*fn)(void*, int);
+  void *arg;
+  int helpers;           // pool threads still wanted, the job is queued while > 0
+  int active;            // pool threads working on it
+  ParallelForArg *queued;
+};
+
+/* Threads helping parallelFor are kept in a process-wide pool (started on demand
+   and never stopped) instead of being created and joined on every filter call.
+   Jobs wanting helpers are queued, an idle pool thread takes the first one. */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static ParallelForArg *pool_jobs = NULL;
+static int pool_idle = 0;
+
+static void parallelForRun(ParallelForArg *a){
+  for (int i = __sync_fetch_and_add(&a->next, 1); i < a->n; i = __sync_fetch_and_add(&a->next, 1))
+    a->fn(a->arg, i);
+}
+
+static void unqueueJob(ParallelForArg *a){
+  for (ParallelForArg **p = &pool_jobs; *p != NULL; p = &(*p)->queued)
+    if (*p == a) {
+      *p = a->queued;
+      return;
+    }
+}
+
+static void *poolWorker(void *){
+  // filter_threads is 1 here, so filters called from a job don't start jobs of their own
+  pthread_mutex_lock(&pool_mutex);
+  for (;;) {
+    while (pool_jobs == NULL) {
+      pool_idle++;
+      pthread_cond_wait(&pool_work, &pool_mutex);
+      pool_idle--;
+    }
+    ParallelForArg *a = pool_jobs;
+    if (--a->helpers == 0)
+      pool_jobs = a->queued;
+    a->active++;
+    pthread_mutex_unlock(&pool_mutex);
+    parallelForRun(a);
+    pthread_mutex_lock(&pool_mutex);
+    if (--a->active == 0)
+      pthread_cond_broadcast(&pool_done);
+  }
+  return NULL;
+}
+
+void parallelFor(int n, void (*fn)(void*, int), void *arg){
+  int num_threads = filter_threads < n ? filter_threads : n;
+  ParallelForArg a = {n, 0, fn, arg, num_threads-1, 0, NULL};
+  if (num_threads <= 1) {
+    parallelForRun(&a);
+    return;
+  }
+
+  pthread_mutex_lock(&pool_mutex);
+  a.queued = pool_jobs;
+  pool_jobs = &a;
+  for (int missing = a.helpers - pool_idle; missing > 0; missing--) {
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    bool started = pthread_create(&thread, &attr, poolWorker, NULL) == 0;
+    pthread_attr_destroy(&attr);
+    if (!started)
+      break; // fewer helpers, the calling thread does the rest
+  }
+  pthread_cond_broadcast(&pool_work);
+  pthread_mutex_unlock(&pool_mutex);
+
+  // the calling thread works as well, none of them start more jobs
+  int saved_threads = filter_threads;
+  filter_threads = 1;
+  parallelForRun(&a);
+  filter_threads = saved_threads;
+
+  pthread_mutex_lock(&pool_mutex);
+  if (a.helpers > 0)
+    unqueueJob(&a);
+  while (a.active > 0)
+    pthread_cond_wait(&pool_done, &pool_mutex);
+  pthread_mutex_unlock(&pool_mutex);
+}
+
+struct FilterJob {
+  DARY *image, *result;
+  FilterTaps const *taps;
+  bool vertical;
+  int num_strips;
+};
+
+// columns per block of a vertical pass, so that the rows spanned by the taps stay in cache
+#define FILTER_BLOCK 1024
+
+static void filterStrip(void *p, int strip){
+  FilterJob const &job = *(FilterJob*)p;
+  FilterTaps const &taps = *job.taps;
+  int rows = job.image->y(), cols = job.image->x();
+  int lo = -taps.off[0], hi_margin = taps.off[taps.n-1];
+  float const *src[12];
+
+  if (!job.vertical) {
+    int r0 = (long)rows * strip / job.num_strips, r1 = (long)rows * (strip+1) / job.num_strips;
+    for (int r = r0; r < r1; r++) {
+      for (int j = 0; j < taps.n; j++)
+        src[j] = job.image->fel[r] + taps.off[j];
+      filterRow(src, taps, job.result->fel[r], lo, cols - hi_margin);
+    }
+  } else {
+    int n = rows - hi_margin - lo;
+    int r0 = lo + (long)n * strip / job.num_strips, r1 = lo + (long)n * (strip+1) / job.num_strips;
+    for (int cb = 0; cb < cols; cb += FILTER_BLOCK) {
+      int ce = cb + FILTER_BLOCK < cols ? cb + FILTER_BLOCK : cols;
+      for (int r = r0; r < r1; r++) {
+        for (int j = 0; j < taps.n; j++)
+          src[j] = job.image->fel[r + taps.off[j]];
+        filterRow(src, taps, job.result->fel[r], cb, ce);
+      }
+    }
+  }
+}
+
+// returns false (and does nothing) if the fast filters are disabled
+static bool filterInterior(DARY *image, DARY *result, FilterTaps const &taps, bool vertical){
+  if (!__atomic_load_n(&fast_filters, __ATOMIC_RELAXED))
+    return false;
+  int extent = vertical ? image->y() : image->x();
+  if (extent - taps.off[taps.n-1] + taps.off[0] <= 0)
+    return true;
+  FilterJob job = {image, result, &taps, vertical, 1};
+  // strips only pay off for reasonably large images
+  if (image->size() >= 128*128)
+    job.num_strips = filter_threads;
+  parallelFor(job.num_strips, filterStrip, &job);
+  return true;
+}
+
+// kernels of the filters below, as in their interior expressions
+static FilterTaps const sqrt2_taps = {7, {-3, -2, -1, 0, 1, 2, 3},
+  {0.03, 0.105, 0.222, 0.286, 0.222, 0.105, 0.03}};
+static FilterTaps const smooth9_taps = {9, {-4, -3, -2, -1, 0, 1, 2, 3, 4},
+  {0.0276, 0.0663, 0.1238, 0.1802, 0.2042, 0.1802, 0.1238, 0.0663, 0.0276}};
+static FilterTaps const der2_7_taps = {7, {-3, -2, -1, 0, 1, 2, 3},
+  {0.056, 0.1051, -0.0471, -0.2281, -0.0471, 0.1051, 0.056}};
+static FilterTaps const der2_9_taps = {9, {-5, -4, -3, -1, 0, 1, 3, 4, 5},
+  {0.128, 0.216, 0.216, -0.317, -0.485, -0.317, 0.216, 0.216, 0.128}};
+static FilterTaps const der6_taps = {6, {-3, -2, -1, 1, 2, 3},
+  {-0.0133, -0.108, -0.242, 0.242, 0.108, 0.0133}};
+static FilterTaps const derH8_taps = {8, {-4, -3, -2, -1, 1, 2, 3, 4},
+  {-0.027, -0.0486, -0.0605, -0.0486, 0.0486, 0.0605, 0.0486, 0.027}};
+static FilterTaps const derV8_taps = {8, {-4, -3, -2, -1, 1, 2, 3, 4},
+  {-0.027, -0.0486, -0.0605, -0.044, 0.044, 0.0605, 0.0486, 0.027}};
+static FilterTaps const der4_taps = {4, {-1, 0, 1, 2},
+  {-0.1213, -0.242, 0.242, 0.1213}};
+static FilterTaps const smooth5_taps = {5, {-2, -1, 0, 1, 2},
+  {0.0545, 0.2442, 0.4026, 0.2442, 0.0545}};
+static FilterTaps const smooth3_taps = {3, {-1, 0, 1},
+  {0.1664, 0.6672, 0.1664}};
+
 void HorConvSqrt2(DARY *image,  DARY *result)
 {
 
@@ -416,11 +730,13 @@ void HorConvSqrt2(DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, sqrt2_taps, false);
 
     for (r = 0; r < rows; r++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
       pixr=pix[r];
       rpixr=rpix[r];
+      if (!fast)
       for (c = 3; c < cols - 3; c++) {
 	prc =  pixr + c;
 	rpixr[c] = 0.030 * prc[-3] + 0.105 * prc[-2] + 0.222 * prc[-1] +
@@ -457,9 +773,11 @@ void VerConvSqrt2( DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, sqrt2_taps, true);
 
     for (c = 0; c < cols; c++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
+      if (!fast)
       for (r = 3; r < rows - 3; r++) {
 	rpix[r][c] = 0.030 * pix[r-3][c] + 0.105 * pix[r-2][c] +
 	  0.222 * pix[r-1][c] + 0.286 * pix[r][c] + 0.222 * pix[r+1][c] +
@@ -492,9 +810,11 @@ void smoothYYV9( DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, smooth9_taps, true);
 
     for (c = 0; c < cols; c++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
+      if (!fast)
       for (r = 4; r < rows - 4; r++) {
 	rpix[r][c] =  0.0276 * pix[r-4][c] + 0.0663 * pix[r-3][c] + 0.1238 * pix[r-2][c] 
 	  + 0.1802 * pix[r-1][c]   + 0.2042 * pix[r][c]  + 0.1802 * pix[r+1][c] + 0.1238 * pix[r+2][c] +
@@ -543,9 +863,11 @@ void smoothXXH9(DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, smooth9_taps, false);
     
     for (r = 0; r < rows; r++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
+      if (!fast)
       for (c = 4; c < cols - 4; c++) {
 	prc =  pix[r] + c;
 	rpix[r][c] = 0.0276 * prc[-4] + 0.0663 * prc[-3] + 0.1238 * prc[-2] + 0.1802  * prc[-1]
@@ -592,11 +914,13 @@ void DerXXH7(DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, der2_7_taps, false);
 
     for (r = 0; r < rows; r++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
       pixr=pix[r];
       rpixr=rpix[r];
+      if (!fast)
       for (c = 3; c < cols - 3; c++) {
 	prc =  pixr + c;
 	rpixr[c] = 0.0560 * prc[-3] + 0.1051 * prc[-2]  -0.0471 * prc[-1] -
@@ -631,9 +955,11 @@ void DerYYV7( DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, der2_7_taps, true);
 
     for (c = 0; c < cols; c++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
+      if (!fast)
       for (r = 3; r < rows - 3; r++) {
 	rpix[r][c] = 0.0560 * pix[r-3][c] + 0.1051 * pix[r-2][c] 
 	  -0.0471 * pix[r-1][c]   -0.2281 * pix[r][c]  -0.0471 * pix[r+1][c] +
@@ -667,9 +993,11 @@ void DerXXH9(DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, der2_9_taps, false);
     
     for (r = 0; r < rows; r++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
+      if (!fast)
       for (c = 5; c < cols - 5; c++) {
 	prc =  pix[r] + c;
 	rpix[r][c] = 0.128 * prc[-5] + 0.216 * prc[-4] + 0.216 * prc[-3] -0.317  * prc[-1]
@@ -722,9 +1050,11 @@ void DerYYV9( DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, der2_9_taps, true);
 
     for (c = 0; c < cols; c++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
+      if (!fast)
       for (r = 5; r < rows - 5; r++) {
 	rpix[r][c] = 0.128 * pix[r-5][c] + 0.216 * pix[r-4][c] + 0.216 * pix[r-3][c] 
 	  -0.317 * pix[r-1][c]   -0.485 * pix[r][c]  -0.317 * pix[r+1][c] +
@@ -786,11 +1116,13 @@ void DerHConv6(DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, der6_taps, false);
 
     for (r = 0; r < rows; r++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
       pixr=pix[r];
       rpixr=rpix[r];
+      if (!fast)
       for (c = 3; c < cols - 3; c++) {
 	prc =  pixr + c;
 	rpixr[c] = - 0.0133 * prc[-3] - 0.1080 * prc[-2] - 0.2420 * prc[-1] +
@@ -826,9 +1158,11 @@ void DerVConv6( DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, der6_taps, true);
 
     for (c = 0; c < cols; c++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
+      if (!fast)
       for (r = 3; r < rows - 3; r++) {
 	rpix[r][c] = -0.0133 * pix[r-3][c] -0.1080 * pix[r-2][c] -
 	  0.2420 * pix[r-1][c]  + 0.2420 * pix[r+1][c] +
@@ -860,11 +1194,13 @@ void DerHConv8(DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, derH8_taps, false);
 
     for (r = 0; r < rows; r++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
       pixr=pix[r];
       rpixr=rpix[r];
+      if (!fast)
       for (c = 4; c < cols - 4; c++) {
 	prc =  pixr + c;
 	rpixr[c] =  - 0.0270 * prc[-4] - 0.0486 * prc[-3] - 0.0605 * prc[-2] - 0.0486 * prc[-1] +
@@ -900,9 +1236,11 @@ void DerVConv8( DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, derV8_taps, true);
 
     for (c = 0; c < cols; c++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
+      if (!fast)
       for (r = 4; r < rows - 4; r++) {
 	rpix[r][c] =  -0.0270 * pix[r-4][c] -0.0486 * pix[r-3][c] -0.0605 * pix[r-2][c] -
 	  0.0440 * pix[r-1][c]  + 0.0440 * pix[r+1][c] +
@@ -945,9 +1283,11 @@ void DerVConv4(DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, der4_taps, true);
 
     for (c = 0; c < cols; c++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
+      if (!fast)
       for (r = 1; r < rows - 2; r++) {
 	rpix[r][c] = -0.1213 * pix[r-1][c] -
 	  0.2420 * pix[r][c]  + 0.2420 * pix[r+1][c] +
@@ -979,11 +1319,13 @@ void DerHConv4(DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, der4_taps, false);
 
     for (r = 0; r < rows; r++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
       pixr=pix[r];
       rpixr=rpix[r];
+      if (!fast)
       for (c = 1; c < cols - 2; c++) {
 	prc =  pixr + c;
 	rpixr[c] = - 0.1213 * prc[-1] - 0.2420 * prc[0] +
@@ -1020,9 +1362,11 @@ void VerConv5( DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, smooth5_taps, true);
 
     for (c = 0; c < cols; c++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
+      if (!fast)
       for (r = 2; r < rows - 2; r++) {
 	rpix[r][c] = 0.0545 * pix[r-2][c] + 0.2442 * pix[r-1][c] +
 	  0.4026 * pix[r][c] + 0.2442 * pix[r+1][c] + 0.0545 * pix[r+2][c];
@@ -1057,11 +1401,13 @@ void HorConv5(DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, smooth5_taps, false);
 
     for (r = 0; r < rows; r++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
       pixr=pix[r];
       rpixr=rpix[r];
+      if (!fast)
       for (c = 2; c < cols - 2; c++) {
 	prc =  pixr + c;
 	rpixr[c] = 0.0545 * prc[-2] + 0.2442 * prc[-1] +
@@ -1098,9 +1444,11 @@ void VerConv3( DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel;
     rpix = result->fel;
+    bool fast = filterInterior(image, result, smooth3_taps, true);
     rows1=rows-1;
     for (c = 0; c < cols; c++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
+      if (!fast)
       for (r = 1; r < rows - 1; r++) {
 	rpix[r][c] =  0.1664 * pix[r-1][c] + 0.6672 * pix[r][c] + 0.1664 * pix[r+1][c];
       }
@@ -1125,10 +1473,12 @@ void HorConv3(DARY *image,  DARY *result)
     cols = image->x();
     pix = image->fel; 
     rpix = result->fel;
+    bool fast = filterInterior(image, result, smooth3_taps, false);
     cols1=cols-1;
 
     for (r = 0; r < rows; r++) {
       /* Handle easiest case of pixels that do not overlap the boundary. */
+      if (!fast)
       for (c = 1; c < cols - 1; c++) {
 	prc =  pix[r] + c;
 	rpix[r][c] =  0.1664 * prc[-1] + 0.6672 * prc[0] + 0.1664 * prc[1];
@@ -1706,6 +2056,7 @@ float smooth(int x, int y, DARY* image_in, float scalex, float scaley){
       void initGauss(float scale){
 
 	if(scale==g_scale)return;
+	register_tables_cleanup();
 	g_scale=scale;
 	size=(int)rint(GAUSS_CUTOFF*g_scale);
 	if(table_exp!=NULL){delete [] table_exp[0];delete [] table_exp;}
@@ -31,6 +31,34 @@ typedef unsigned int uint;
 
 #define  GAUSS_CUTOFF 3
 
+/* The fixed-kernel filters below (smoothSqrt, dXX9, ...) are vectorised and split
+   large images into strips over getFilterThreads() threads. The number of threads
+   is per calling thread (default 1, e.g. when images are already processed in parallel). */
+void setFilterThreads(int num_threads);
+int getFilterThreads();
+/* false: use the original scalar loops (same results, for benchmarking) */
+void setFastFilters(bool fast);
+/* fn(arg, i) for i in [0,n) on up to getFilterThreads() threads (the caller and threads
+   of a pool kept for the whole process), dynamically scheduled */
+void parallelFor(int n, void (*fn)(void*, int), void *arg);
+
+void HorConvSqrt2(DARY *image,  DARY *result);
+void VerConvSqrt2(DARY *image,  DARY *result);
+void smoothXXH9(DARY *image,  DARY *result);
+void smoothYYV9(DARY *image,  DARY *result);
+void DerXXH7(DARY *image,  DARY *result);
+void DerYYV7(DARY *image,  DARY *result);
+void DerXXH9(DARY *image,  DARY *result);
+void DerYYV9(DARY *image,  DARY *result);
+void DerHConv6(DARY *image,  DARY *result);
+void DerVConv6(DARY *image,  DARY *result);
+void DerHConv8(DARY *image,  DARY *result);
+void DerVConv8(DARY *image,  DARY *result);
+void DerHConv4(DARY *image,  DARY *result);
+void DerVConv4(DARY *image,  DARY *result);
+void HorConv5(DARY *image,  DARY *result);
+void VerConv5(DARY *image,  DARY *result);
+
 void  dXY9(DARY* image_in, DARY* smooth_image);
 void  dXX9(DARY* image_in, DARY* smooth_image);
 void  dYY9(DARY* image_in, DARY* smooth_image);
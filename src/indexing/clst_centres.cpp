@@ -14,13 +14,20 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "clst_centres.h"
 
+#include <math.h>
+
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
+#include <vector>
+
+#include "compact_dist.h"
 
 
 
-clstCentres::clstCentres( const char fileName[], bool flat ){
+clstCentres::clstCentres( const char fileName[], bool flat, storageType aStorage ) : clstC(NULL), clstC_flat(NULL), storage(aStorage), clstC_uint8(NULL), clstC_float16(NULL), uint8Offset(0.0f), uint8Scale(1.0f) {
     
     std::ifstream clstF( fileName, std::ios::in | std::ios::binary);
     if (!clstF.is_open()){
@@ -49,15 +56,54 @@ clstCentres::clstCentres( const char fileName[], bool flat ){
     
     clstF.seekg(clstHeaderSize, std::ios::beg);
     
-    if (flat){
+    if (storage!=floatStorage){
+        
+        // convert a chunk at a time so that all float centres are never in RAM at once
+        uint32_t const chunkSize= 4096;
+        std::vector<float> chunk(chunkSize*numDims);
+        uint64_t const numValues= static_cast<uint64_t>(numClst)*numDims;
+        
+        if (storage==uint8Storage){
+            
+            float minV= std::numeric_limits<float>::max(), maxV= -std::numeric_limits<float>::max();
+            for (uint64_t i= 0; i<numValues; i+= chunk.size()){
+                uint64_t const n= std::min(static_cast<uint64_t>(chunk.size()), numValues-i);
+                clstF.read( (char*)&chunk[0], sizeof(float)*n );
+                for (uint64_t j= 0; j<n; ++j){
+                    minV= std::min(minV, chunk[j]);
+                    maxV= std::max(maxV, chunk[j]);
+                }
+            }
+            uint8Offset= numValues>0 ? minV : 0.0f;
+            uint8Scale= maxV>minV ? (maxV-minV)/255 : 1.0f;
+            
+            clstF.seekg(clstHeaderSize, std::ios::beg);
+            clstC_uint8= new uint8_t[numValues];
+            for (uint64_t i= 0; i<numValues; i+= chunk.size()){
+                uint64_t const n= std::min(static_cast<uint64_t>(chunk.size()), numValues-i);
+                clstF.read( (char*)&chunk[0], sizeof(float)*n );
+                for (uint64_t j= 0; j<n; ++j)
+                    clstC_uint8[i+j]= static_cast<uint8_t>( std::min(255.0f, std::max(0.0f, roundf((chunk[j]-uint8Offset)/uint8Scale))) );
+            }
+            
+        } else {
+            
+            clstC_float16= new uint16_t[numValues];
+            for (uint64_t i= 0; i<numValues; i+= chunk.size()){
+                uint64_t const n= std::min(static_cast<uint64_t>(chunk.size()), numValues-i);
+                clstF.read( (char*)&chunk[0], sizeof(float)*n );
+                compactDist::floatToHalf( &chunk[0], n, clstC_float16+i );
+            }
+            
+        }
+        
+    } else if (flat){
         
-        clstC= NULL;
         clstC_flat= new float[ numClst*numDims ];
         clstF.read( (char*)clstC_flat, sizeof(float)*numDims*numClst );
         
     } else {
         
-        clstC_flat= NULL;
         clstC= new float*[ numClst ];
         for (uint32_t iC= 0; iC<numClst; ++iC){
             clstC[iC]= new float[numDims];
@@ -86,4 +132,79 @@ clstCentres::~clstCentres(){
         delete []clstC_flat;
     }
     
+    if (clstC_uint8!=NULL)
+        delete []clstC_uint8;
+    
+    if (clstC_float16!=NULL)
+        delete []clstC_float16;
+    
+}
+
+
+
+clstCentres::storageType
+clstCentres::storageFromString( std::string const &name ){
+    if (name=="float")
+        return floatStorage;
+    if (name=="uint8")
+        return uint8Storage;
+    if (name=="float16")
+        return float16Storage;
+    throw std::runtime_error("clstCentres::storageFromString: Unknown storage type "+name);
+}
+
+
+
+float const *
+clstCentres::getCentre( uint32_t clstID, float *buf ) const {
+    uint64_t const offset= static_cast<uint64_t>(clstID)*numDims;
+    switch (storage){
+        case uint8Storage:
+            for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+                buf[iDim]= uint8Offset + clstC_uint8[offset+iDim]*uint8Scale;
+            return buf;
+        case float16Storage:
+            for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+                buf[iDim]= compactDist::halfToFloat(clstC_float16[offset+iDim]);
+            return buf;
+        default:
+            return clstC_flat!=NULL ? clstC_flat+offset : clstC[clstID];
+    }
+}
+
+
+
+void
+clstCentres::distSqs( float const vec[], uint32_t begin, uint32_t end, float distSqs[] ) const {
+    std::vector<float> q(numDims);
+    prepareQuery(vec, &q[0]);
+    for (uint32_t i= begin; i<end; ++i)
+        distSqs[i-begin]= distSqPrepared(&q[0], i);
+}
+
+
+
+void
+clstCentres::prepareQuery( float const vec[], float q[] ) const {
+    if (storage==uint8Storage){
+        // distances in units of uint8Scale
+        for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+            q[iDim]= (vec[iDim]-uint8Offset)/uint8Scale;
+    } else
+        std::copy(vec, vec+numDims, q);
+}
+
+
+
+float
+clstCentres::distSqPrepared( float const q[], uint32_t clstID ) const {
+    uint64_t const offset= static_cast<uint64_t>(clstID)*numDims;
+    switch (storage){
+        case uint8Storage:
+            return compactDist::l2(q, clstC_uint8 + offset, numDims) * (uint8Scale*uint8Scale);
+        case float16Storage:
+            return compactDist::l2(q, clstC_float16 + offset, numDims);
+        default:
+            return compactDist::l2(q, clstC_flat!=NULL ? clstC_flat+offset : clstC[clstID], numDims);
+    }
 }
@@ -16,19 +16,52 @@ No usage or redistribution is allowed without explicit permission.
 #define _CLST_CENTRES_H_
 
 #include <stdint.h>
+#include <string>
 
 
 class clstCentres {
     
     public:
         
-        clstCentres( const char fileName[], bool flat= false );
+        // floatStorage is the float array(s) clstC / clstC_flat, the others are compact
+        // flat representations (uint8 is affine with a global offset and scale, suited to SIFT-like data)
+        // which take 4 or 2 times less memory; clstC and clstC_flat are NULL then
+        enum storageType { floatStorage, uint8Storage, float16Storage };
+        
+        clstCentres( const char fileName[], bool flat= false, storageType aStorage= floatStorage );
         
         ~clstCentres();
         
+        // "float", "uint8" or "float16"
+        static storageType
+            storageFromString( std::string const &name );
+        
+        // the centre clstID as floats: points to clstC_flat for floatStorage,
+        // otherwise decodes into buf (numDims floats)
+        float const *
+            getCentre( uint32_t clstID, float *buf ) const;
+        
+        // squared L2 distances between vec and the centres [begin, end), for any storage
+        void
+            distSqs( float const vec[], uint32_t begin, uint32_t end, float distSqs[] ) const;
+        
+        // for distances to arbitrary centres: vec in the units of the storage (numDims floats) ...
+        void
+            prepareQuery( float const vec[], float q[] ) const;
+        
+        // ... and the squared L2 distance between vec and centre clstID
+        float
+            distSqPrepared( float const q[], uint32_t clstID ) const;
+        
         uint32_t numClst, numDims;
         float **clstC;
         float *clstC_flat;
+        
+        storageType storage;
+        uint8_t *clstC_uint8;
+        uint16_t *clstC_float16;
+        // uint8 value v encodes uint8Offset + v*uint8Scale
+        float uint8Offset, uint8Scale;
     
 };
 
@@ -44,6 +44,14 @@ class indexWithData {
         // returns the same value as getNumWithID(ID)
         virtual uint32_t
             getData( uint32_t ID, std::vector<uint32_t> &vecIDs, unsigned char *&data, uint32_t &size ) const =0;
+        
+        // as getData but without copying: vecIDs and data point into memory owned by the index
+        // and stay valid as long as it exists; returns false if the index can't do this
+        // (e.g. it reads from disk on demand), use getData then
+        virtual bool
+            getDataNoCopy( uint32_t ID, uint32_t &N, uint32_t const *&vecIDs, unsigned char const *&data, uint32_t &size ) const {
+                return false;
+            }
     
 };
 
@@ -115,6 +123,19 @@ class indexWithDataInRam : public indexWithData {
                 vecIDs= vecIDss[ID];
                 return Ns[ID];
             }
+        
+        bool
+            getDataNoCopy( uint32_t ID, uint32_t &N, uint32_t const *&vecIDs, unsigned char const *&data, uint32_t &size ) const {
+                if (ID>=numIDs_){
+                    N= 0; vecIDs= NULL; data= NULL; size= 0;
+                    return true;
+                }
+                N= Ns[ID];
+                vecIDs= vecIDss[ID].empty() ? NULL : &vecIDss[ID][0];
+                data= datas[ID];
+                size= sizes[ID];
+                return true;
+            }
     
     private:
         
@@ -146,6 +167,11 @@ class indexWithDataInRamStartDisk : public indexWithData {
             getData( uint32_t ID, std::vector<uint32_t> &vecIDs, unsigned char *&data, uint32_t &size ) const {
                 return slowCons_.getObject()->getData(ID, vecIDs, data, size);
             }
+        
+        inline bool
+            getDataNoCopy( uint32_t ID, uint32_t &N, uint32_t const *&vecIDs, unsigned char const *&data, uint32_t &size ) const {
+                return slowCons_.getObject()->getDataNoCopy(ID, N, vecIDs, data, size);
+            }
     
     private:
         
@@ -183,6 +209,12 @@ class indexesWithData : public indexWithData {
                 uint32_t ind= whichIdx(ID);
                 return idxs_->at(ind)->getData(ID-offsets_.at(ind), vecIDs, data, size);
             }
+        
+        bool
+            getDataNoCopy( uint32_t ID, uint32_t &N, uint32_t const *&vecIDs, unsigned char const *&data, uint32_t &size ) const {
+                uint32_t ind= whichIdx(ID);
+                return idxs_->at(ind)->getDataNoCopy(ID-offsets_.at(ind), N, vecIDs, data, size);
+            }
     
     protected:
         
@@ -15,51 +15,50 @@ No usage or redistribution is allowed without explicit permission.
 #include "index_with_data_file.h"
 
 #include <stdio.h>
+#include <cstring>
 #include <stdexcept>
 #include <algorithm>
 
 
 
-indexWithDataFile::indexWithDataFile( std::string fileName ){
-    
-    f= fopen( fileName.c_str(), "rb" );
+uint32_t const indexWithDataFile::endMark= 0x0FD0FDFD;
+
+
+
+indexWithDataFile::indexWithDataFile( std::string fileName ) : file_(fileName.c_str()) {
     
-    uint32_t temp_;
+    if (!file_.isOpen() || file_.size() < 200+3*sizeof(uint32_t))
+        throw std::runtime_error("indexWithDataFile::indexWithDataFile: Can't open "+fileName);
     
-    fseeko64(f, -3*sizeof(uint32_t), SEEK_END);
-    temp_= fread( &numIDs_, 1, sizeof(uint32_t), f);
-    temp_= fread( &maxVecID, 1, sizeof(uint32_t), f);
+    char const *end= file_.data() + file_.size();
+    std::memcpy( &numIDs_, end-3*sizeof(uint32_t), sizeof(uint32_t) );
+    std::memcpy( &maxVecID, end-2*sizeof(uint32_t), sizeof(uint32_t) );
     
     uint32_t endMark;
-    temp_= fread( &endMark, 1, sizeof(uint32_t), f);
-    if (indexWithDataFile::endMark!=endMark)
+    std::memcpy( &endMark, end-sizeof(uint32_t), sizeof(uint32_t) );
+    if (indexWithDataFile::endMark!=endMark || file_.size() < 200+3*sizeof(uint32_t)+numIDs_*sizeof(uint64_t))
         throw std::runtime_error("indexWithDataFile::indexWithDataFile: File is corrupt");
     
-    fseeko64(f, -static_cast<int64_t>(3*sizeof(uint32_t)+numIDs_*sizeof(uint64_t)), SEEK_END);
     offsets.resize( numIDs_ );
-    temp_= fread( &(offsets[0]), sizeof(uint64_t), numIDs_, f );
-    
-    if (false && temp_) {} // to avoid the warning about not checking temp_
-    
-    f_= fileno(f);
+    if (numIDs_>0)
+        std::memcpy( &(offsets[0]), end-3*sizeof(uint32_t)-numIDs_*sizeof(uint64_t), numIDs_*sizeof(uint64_t) );
     
 }
 
 
 
 indexWithDataFile::~indexWithDataFile(){
-    fclose(f);
 }
 
 
 
 uint32_t
 indexWithDataFile::getNumWithID( uint32_t ID ) const {
-    if (ID>numIDs_ || offsets[ID]==0)
+    char const *rec= record(ID);
+    if (rec==NULL)
         return 0;
     uint32_t N;
-    uint32_t temp_= pread64(f_, &N, sizeof(uint32_t), offsets[ID]);
-    if (false && temp_) {} // to avoid the warning about not checking temp_
+    std::memcpy( &N, rec, sizeof(uint32_t) );
     return N;
 }
 
@@ -68,28 +67,53 @@ indexWithDataFile::getNumWithID( uint32_t ID ) const {
 uint32_t
 indexWithDataFile::getData( uint32_t ID, std::vector<uint32_t> &vecIDs, unsigned char *&data, uint32_t &size ) const {
     
-    if (ID>numIDs_ || offsets[ID]==0){
+    char const *rec= record(ID);
+    
+    if (rec==NULL){
         vecIDs.clear();
         data= new unsigned char[0];
         size= 0;
         return 0;
     }
     
-    uint32_t N, temp_;
-    temp_= pread64(f_, &N, sizeof(uint32_t), offsets[ID]);
-    temp_= pread64(f_, &size, sizeof(uint32_t), offsets[ID]+sizeof(uint32_t));
+    uint32_t N;
+    std::memcpy( &N, rec, sizeof(uint32_t) );
+    std::memcpy( &size, rec+sizeof(uint32_t), sizeof(uint32_t) );
     vecIDs.clear(); vecIDs.resize(N);
-    temp_= pread64(f_, &(vecIDs[0]), N*sizeof(uint32_t), offsets[ID]+2*sizeof(uint32_t));
+    if (N>0)
+        std::memcpy( &(vecIDs[0]), rec+2*sizeof(uint32_t), N*sizeof(uint32_t) );
     data= new unsigned char[size];
-    temp_= pread64(f_, data, size, offsets[ID]+(2+N)*sizeof(uint32_t));
-    
-    if (false && temp_) {} // to avoid the warning about not checking temp_
+    std::memcpy( data, rec+(2+N)*sizeof(uint32_t), size );
     
     return N;
 }
 
 
 
+bool
+indexWithDataFile::getDataNoCopy( uint32_t ID, uint32_t &N, uint32_t const *&vecIDs, unsigned char const *&data, uint32_t &size ) const {
+    
+    char const *rec= record(ID);
+    
+    if (rec==NULL){
+        N= 0; vecIDs= NULL; data= NULL; size= 0;
+        return true;
+    }
+    
+    // records of files built before padding was added can be unaligned
+    if (reinterpret_cast<uintptr_t>(rec) % sizeof(uint32_t) != 0)
+        return false;
+    
+    uint32_t const *header= reinterpret_cast<uint32_t const *>(rec);
+    N= header[0];
+    size= header[1];
+    vecIDs= header+2;
+    data= reinterpret_cast<unsigned char const *>(vecIDs+N);
+    return true;
+}
+
+
+
 indexWithDataFileBuilder::indexWithDataFileBuilder( std::string fileName, std::string desc ) : hasBeenClosed(false) {
     
     if (desc.length()>200){
@@ -124,6 +148,11 @@ indexWithDataFileBuilder::addData( uint32_t ID, std::vector<uint32_t> const &vec
         offsets.push_back(0);
     else {
         
+        // align the record so that it can be read in place from a memory map
+        int64_t const pos= ftello64(f);
+        uint32_t const zero= 0;
+        fwrite( &zero, 1, (sizeof(uint32_t) - pos % sizeof(uint32_t)) % sizeof(uint32_t), f );
+        
         offsets.push_back( ftello64(f) );
         
         fwrite( &N, sizeof(uint32_t), 1, f );
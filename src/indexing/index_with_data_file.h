@@ -21,11 +21,13 @@ No usage or redistribution is allowed without explicit permission.
 #include <string>
 
 #include "index_with_data.h"
+#include "mapped_file.h"
 
 /*
 Organization:
 200 chars for textual description
 for ID=0 : numIDs-1  (apart from ones where N=0)
+    zero padding to a multiple of 4 bytes (absent in files built before it was added)
     uint32_t N (number of vectors with this ID)
     uint32_t size (size of data)
     uint32_t vecIDs[N]
@@ -34,6 +36,9 @@ uint32_t offsets[numID] (marks byte position of each above item, 0 if no vecIDs
 uint32_t numIDs
 uint32_t maxVecID
 0x0FD0FDFD (to make sure the file is not currupt)
+
+The file is memory-mapped, so opening is instant and getDataNoCopy returns pointers into
+the mapping; for old unpadded files it only does so for the records which happen to be aligned.
 */
 
 
@@ -55,20 +60,26 @@ class indexWithDataFile : public indexWithData {
         uint32_t
             getData( uint32_t ID, std::vector<uint32_t> &vecIDs, unsigned char *&data, uint32_t &size ) const;
         
+        bool
+            getDataNoCopy( uint32_t ID, uint32_t &N, uint32_t const *&vecIDs, unsigned char const *&data, uint32_t &size ) const;
+        
         static uint32_t const endMark;
     
     private:
         
+        // start of the record of ID, NULL if there are no vectors with the ID
+        inline char const *
+            record( uint32_t ID ) const {
+                return (ID>=numIDs_ || offsets[ID]==0) ? NULL : file_.data() + offsets[ID];
+            }
+        
+        mappedFile file_;
         uint32_t numIDs_, maxVecID;
         std::vector<uint64_t> offsets;
-        FILE *f;
-        int f_;
         
-    
+        DISALLOW_COPY_AND_ASSIGN(indexWithDataFile)
 };
 
-uint32_t const indexWithDataFile::endMark= 0x0FD0FDFD;
-
 
 
 class indexWithDataFileBuilder : public indexWithDataBuilder {
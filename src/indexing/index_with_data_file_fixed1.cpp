@@ -15,44 +15,44 @@ No usage or redistribution is allowed without explicit permission.
 #include "index_with_data_file_fixed1.h"
 
 #include <stdio.h>
+#include <cstring>
 #include <stdexcept>
 #include <algorithm>
 
 
 
-indexWithDataFileFixed1::indexWithDataFileFixed1( std::string fileName ){
-    
-    f= fopen( fileName.c_str(), "rb" );
+uint32_t const indexWithDataFileFixed1::endMark= 0x1FD0FDFD;
+
+
+
+indexWithDataFileFixed1::indexWithDataFileFixed1( std::string fileName ) : file_(fileName.c_str()) {
     
-    uint32_t temp_;
+    if (!file_.isOpen() || file_.size() < 200+4*sizeof(uint32_t))
+        throw std::runtime_error("indexWithDataFileFixed1::indexWithDataFileFixed1: Can't open "+fileName);
     
-    fseeko64(f, -4*sizeof(uint32_t), SEEK_END);
-    temp_= fread( &numIDs_, 1, sizeof(uint32_t), f);
-    temp_= fread( &maxVecID, 1, sizeof(uint32_t), f);
-    temp_= fread( &size_, 1, sizeof(uint32_t), f);
+    char const *end= file_.data() + file_.size();
+    std::memcpy( &numIDs_, end-4*sizeof(uint32_t), sizeof(uint32_t) );
+    std::memcpy( &maxVecID, end-3*sizeof(uint32_t), sizeof(uint32_t) );
+    std::memcpy( &size_, end-2*sizeof(uint32_t), sizeof(uint32_t) );
     
     uint32_t endMark;
-    temp_= fread( &endMark, 1, sizeof(uint32_t), f);
-    if (indexWithDataFileFixed1::endMark!=endMark)
+    std::memcpy( &endMark, end-sizeof(uint32_t), sizeof(uint32_t) );
+    if (indexWithDataFileFixed1::endMark!=endMark ||
+        file_.size() < 200+4*sizeof(uint32_t)+static_cast<uint64_t>(numIDs_)*(sizeof(uint32_t)+size_))
         throw std::runtime_error("indexWithDataFileFixed1::indexWithDataFileFixed1: File is corrupt");
     
-    if (false && temp_) {} // to avoid the warning about not checking temp_
-    
-    f_= fileno(f);
-    
 }
 
 
 
 indexWithDataFileFixed1::~indexWithDataFileFixed1(){
-    fclose(f);
 }
 
 
 
 uint32_t
 indexWithDataFileFixed1::getNumWithID( uint32_t ID ) const {
-    if (ID>numIDs_)
+    if (ID>=numIDs_)
         return 0;
     return 1;
 }
@@ -62,28 +62,45 @@ indexWithDataFileFixed1::getNumWithID( uint32_t ID ) const {
 uint32_t
 indexWithDataFileFixed1::getData( uint32_t ID, std::vector<uint32_t> &vecIDs, unsigned char *&data, uint32_t &size ) const {
     
-    if (ID>numIDs_){
+    if (ID>=numIDs_){
         vecIDs.clear();
         data= new unsigned char[0];
         size= 0;
         return 0;
     }
     
-    uint64_t offset= static_cast<uint64_t>(ID)*(sizeof(uint32_t)+size_) + 200;
-    uint32_t temp_;
+    char const *rec= record(ID);
     size= size_;
     vecIDs.clear(); vecIDs.resize(1);
-    temp_= pread64(f_, &(vecIDs[0]), sizeof(uint32_t), offset);
+    std::memcpy( &(vecIDs[0]), rec, sizeof(uint32_t) );
     data= new unsigned char[size];
-    temp_= pread64(f_, data, size, offset+sizeof(uint32_t));
-    
-    if (false && temp_) {} // to avoid the warning about not checking temp_
+    std::memcpy( data, rec+sizeof(uint32_t), size );
     
     return 1;
 }
 
 
 
+bool
+indexWithDataFileFixed1::getDataNoCopy( uint32_t ID, uint32_t &N, uint32_t const *&vecIDs, unsigned char const *&data, uint32_t &size ) const {
+    
+    if (ID>=numIDs_){
+        N= 0; vecIDs= NULL; data= NULL; size= 0;
+        return true;
+    }
+    
+    if (size_ % sizeof(uint32_t) != 0)
+        return false;
+    
+    N= 1;
+    size= size_;
+    vecIDs= reinterpret_cast<uint32_t const *>(record(ID));
+    data= reinterpret_cast<unsigned char const *>(vecIDs+1);
+    return true;
+}
+
+
+
 indexWithDataFileFixed1Builder::indexWithDataFileFixed1Builder( std::string fileName, uint32_t aSize, std::string desc ) : hasBeenClosed(false), numIDs(0), size_(aSize) {
     
     if (desc.length()>200){
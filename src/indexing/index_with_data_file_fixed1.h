@@ -21,6 +21,7 @@ No usage or redistribution is allowed without explicit permission.
 #include <string>
 
 #include "index_with_data.h"
+#include "mapped_file.h"
 
 /*
 Organization:
@@ -32,6 +33,8 @@ uint32_t numIDs
 uint32_t maxVecID
 uint32_t size
 0x1FD0FDFD (to make sure the file is not currupt)
+
+The file is memory-mapped; getDataNoCopy reads in place if size is a multiple of 4 (records are aligned).
 */
 
 
@@ -53,19 +56,24 @@ class indexWithDataFileFixed1 : public indexWithData {
         uint32_t
             getData( uint32_t ID, std::vector<uint32_t> &vecIDs, unsigned char *&data, uint32_t &size ) const;
         
+        bool
+            getDataNoCopy( uint32_t ID, uint32_t &N, uint32_t const *&vecIDs, unsigned char const *&data, uint32_t &size ) const;
+        
         static uint32_t const endMark;
     
     private:
         
+        inline char const *
+            record( uint32_t ID ) const {
+                return file_.data() + 200 + static_cast<uint64_t>(ID)*(sizeof(uint32_t)+size_);
+            }
+        
+        mappedFile file_;
         uint32_t numIDs_, maxVecID, size_;
-        FILE *f;
-        int f_;
         
-    
+        DISALLOW_COPY_AND_ASSIGN(indexWithDataFileFixed1)
 };
 
-uint32_t const indexWithDataFileFixed1::endMark= 0x1FD0FDFD;
-
 
 
 class indexWithDataFileFixed1Builder : public indexWithDataBuilder {
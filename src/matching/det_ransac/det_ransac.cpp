@@ -116,13 +116,15 @@ detRansac::matchDesc(
     float epsilon,
     
     homography *H,
-    matchesType *inlierInds
+    matchesType *inlierInds,
+    
+    uint32_t numThreads
     
     ){
     
     std::vector< std::pair<uint32_t, uint32_t> > putativeMatches;
     
-    putative_desc<float>::getPutativeMatches( desc1, ellipses1.size(), desc2, ellipses2.size(), nDims, putativeMatches, useLowe, deltaSq, epsilon );
+    putative_desc<float>::getPutativeMatches( desc1, ellipses1.size(), desc2, ellipses2.size(), nDims, putativeMatches, useLowe, deltaSq, epsilon, numThreads );
     
     return detRansac::match( sameRandomObj, nInliers, ellipses1, ellipses2, putativeMatches, NULL, errorThr, lowAreaChange, highAreaChange, nReest, H, inlierInds);
     
@@ -103,7 +103,9 @@ class detRansac {
                 float epsilon= 100.0f,
                 
                 homography *H= NULL,
-                matchesType *inlierInds= NULL
+                matchesType *inlierInds= NULL,
+                
+                uint32_t numThreads= 1
                 
                 );
         
@@ -15,9 +15,17 @@ No usage or redistribution is allowed without explicit permission.
 #include "putative.h"
 #include "argsort.h"
 #include "macros.h"
+#include "thread_queue.h"
 
 #include <map>
 
+#include <Eigen/Dense>
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PUTATIVE_AVX2
+#endif
+
 
 
 void
@@ -172,3 +180,310 @@ indSorter_Soft::isSorted( std::vector<wordWeightPair> const &ids, std::vector<ui
     return true;
     
 }
+
+
+
+
+namespace putativeDescMatcherImpl {
+
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> matrixType;
+typedef Eigen::Map<matrixType const> constMapType;
+typedef std::vector< std::pair<uint32_t, uint32_t> > matchesType;
+
+// rows of image 1 per job and descriptors of image 2 per matrix product,
+// so that a block of distances (128 KB) stays in cache while it is scanned
+static uint32_t const rowBlock= 128;
+static uint32_t const colBlock= 256;
+
+
+
+inline void
+toFloat(float const *in, uint64_t n, std::vector<float> &buf, float const *&out){
+    out= in;
+}
+
+inline void
+toFloat(uint8_t const *in, uint64_t n, std::vector<float> &buf, float const *&out){
+    buf.resize(n);
+    for (uint64_t i= 0; i<n; ++i)
+        buf[i]= in[i];
+    out= n>0 ? &buf[0] : NULL;
+}
+
+
+
+// ------- AVX2 dot products
+// Image 2's descriptors are packed into panels of panelWidth descriptors, stored dimension-major,
+// so that a micro-kernel broadcasts one value of a row of image 1 against a whole panel
+// and accumulates maxPanelRows x panelWidth dot products in registers.
+
+static uint32_t const panelWidth= 16;
+static uint32_t const maxPanelRows= 6;
+
+// packed[panel][dim][0..panelWidth), zero padded
+void
+packPanels(float const *desc, uint32_t size, uint32_t nDims, std::vector<float> &packed){
+    uint32_t const numPanels= (size + panelWidth - 1) / panelWidth;
+    packed.assign(static_cast<uint64_t>(numPanels)*nDims*panelWidth, 0.0f);
+    for (uint32_t j= 0; j<size; ++j){
+        float *out= &packed[0] + static_cast<uint64_t>(j/panelWidth)*nDims*panelWidth + j%panelWidth;
+        float const *in= desc + static_cast<uint64_t>(j)*nDims;
+        for (uint32_t d= 0; d<nDims; ++d, out+= panelWidth)
+            *out= in[d];
+    }
+}
+
+
+
+#ifdef PUTATIVE_AVX2
+
+template<int numRows>
+__attribute__((target("avx2,fma")))
+inline void
+panelKernelAVX2(float const *A, uint32_t nDims, float const *panel, float *out, uint32_t outStride){
+    __m256 acc[numRows][2];
+    for (int r= 0; r<numRows; ++r)
+        acc[r][0]= acc[r][1]= _mm256_setzero_ps();
+    for (uint32_t k= 0; k<nDims; ++k, panel+= panelWidth){
+        __m256 const b0= _mm256_loadu_ps(panel), b1= _mm256_loadu_ps(panel+8);
+        for (int r= 0; r<numRows; ++r){
+            __m256 const a= _mm256_broadcast_ss(A + r*nDims + k);
+            acc[r][0]= _mm256_fmadd_ps(a, b0, acc[r][0]);
+            acc[r][1]= _mm256_fmadd_ps(a, b1, acc[r][1]);
+        }
+    }
+    for (int r= 0; r<numRows; ++r){
+        _mm256_storeu_ps(out + r*outStride, acc[r][0]);
+        _mm256_storeu_ps(out + r*outStride + 8, acc[r][1]);
+    }
+}
+
+
+
+// out[i*outStride + j]= A[i] . B[j] for j < numPanels*panelWidth
+__attribute__((target("avx2,fma")))
+void
+dotsAVX2(float const *A, uint32_t numRows, uint32_t nDims,
+         float const *panels, uint32_t numPanels,
+         float *out, uint32_t outStride){
+    uint64_t const panelSize= static_cast<uint64_t>(nDims)*panelWidth;
+    for (uint32_t p= 0; p<numPanels; ++p){
+        float const *panel= panels + p*panelSize;
+        uint32_t i= 0;
+        for (; i+maxPanelRows<=numRows; i+= maxPanelRows)
+            panelKernelAVX2<maxPanelRows>(A + static_cast<uint64_t>(i)*nDims, nDims, panel, out + i*outStride + p*panelWidth, outStride);
+        float const *Ai= A + static_cast<uint64_t>(i)*nDims;
+        float *outI= out + i*outStride + p*panelWidth;
+        switch (numRows-i){
+            case 5: panelKernelAVX2<5>(Ai, nDims, panel, outI, outStride); break;
+            case 4: panelKernelAVX2<4>(Ai, nDims, panel, outI, outStride); break;
+            case 3: panelKernelAVX2<3>(Ai, nDims, panel, outI, outStride); break;
+            case 2: panelKernelAVX2<2>(Ai, nDims, panel, outI, outStride); break;
+            case 1: panelKernelAVX2<1>(Ai, nDims, panel, outI, outStride); break;
+        }
+    }
+    _mm256_zeroupper();
+}
+
+
+
+bool
+useAVX2(){
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+#else
+
+void
+dotsAVX2(float const *, uint32_t, uint32_t, float const *, uint32_t, float *, uint32_t){
+    ASSERT(false);
+}
+
+bool
+useAVX2(){
+    return false;
+}
+
+#endif
+
+static bool const hasAVX2= useAVX2();
+
+
+
+class matchWorker : public queueWorker<matchesType> {
+    public:
+        
+        // panels2 (see packPanels) selects the AVX2 kernel, otherwise Eigen is used
+        matchWorker(float const *desc1, uint32_t size1,
+                    float const *desc2, uint32_t size2,
+                    float const *panels2,
+                    uint32_t nDims, float const *norms2,
+                    bool useLowe, float deltaSq, float epsilon)
+            : desc1_(desc1), size1_(size1),
+              desc2_(desc2), size2_(size2),
+              panels2_(panels2),
+              nDims_(nDims), norms2_(norms2),
+              useLowe_(useLowe), deltaSq_(deltaSq), epsilonSq_(epsilon*epsilon) {}
+        
+        void
+            operator() ( uint32_t jobID, matchesType &matches ) const {
+                
+                matches.clear();
+                uint32_t const start= jobID*rowBlock;
+                uint32_t const numRows= std::min(rowBlock, size1_-start);
+                
+                constMapType A(desc1_ + static_cast<uint64_t>(start)*nDims_, numRows, nDims_);
+                Eigen::VectorXf const norms1= A.rowwise().squaredNorm();
+                
+                std::vector<uint32_t> nn(numRows, 0);
+                std::vector<float> best1(numRows, std::numeric_limits<float>::max());
+                std::vector<float> best2(numRows, std::numeric_limits<float>::max());
+                
+                matrixType dots(numRows, colBlock);
+                
+                for (uint32_t colStart= 0; colStart<size2_; colStart+= colBlock){
+                    uint32_t const numCols= std::min(colBlock, size2_-colStart);
+                    if (panels2_!=NULL)
+                        dotsAVX2(A.data(), numRows, nDims_,
+                                 panels2_ + static_cast<uint64_t>(colStart/panelWidth)*nDims_*panelWidth,
+                                 (numCols + panelWidth - 1) / panelWidth,
+                                 dots.data(), colBlock);
+                    else {
+                        constMapType B(desc2_ + static_cast<uint64_t>(colStart)*nDims_, numCols, nDims_);
+                        dots.leftCols(numCols).noalias()= A * B.transpose();
+                    }
+                    
+                    for (uint32_t i= 0; i<numRows; ++i){
+                        float const *dotIt= dots.data() + static_cast<uint64_t>(i)*colBlock;
+                        float const *norm2It= norms2_ + colStart;
+                        float const n1= norms1[i];
+                        
+                        if (!useLowe_){
+                            for (uint32_t j= 0; j<numCols; ++j){
+                                float const dsq= std::max(0.0f, n1 + norm2It[j] - 2*dotIt[j]);
+                                if (dsq < epsilonSq_)
+                                    matches.push_back(std::make_pair(start+i, colStart+j));
+                            }
+                        } else {
+                            // same tie breaking as putativeDescMatcher::getPutativeMatchesSlow
+                            float b1= best1[i], b2= best2[i];
+                            uint32_t n= nn[i];
+                            for (uint32_t j= 0; j<numCols; ++j){
+                                float const dsq= std::max(0.0f, n1 + norm2It[j] - 2*dotIt[j]);
+                                if (dsq < b2){
+                                    if (dsq < b1){
+                                        b2= b1; b1= dsq; n= colStart+j;
+                                    } else
+                                        b2= dsq;
+                                }
+                            }
+                            best1[i]= b1; best2[i]= b2; nn[i]= n;
+                        }
+                    }
+                }
+                
+                if (useLowe_)
+                    for (uint32_t i= 0; i<numRows; ++i)
+                        if (best1[i]/best2[i] < deltaSq_)
+                            matches.push_back(std::make_pair(start+i, nn[i]));
+            }
+    
+    private:
+        float const *desc1_;
+        uint32_t const size1_;
+        float const *desc2_;
+        uint32_t const size2_;
+        float const *panels2_;
+        uint32_t const nDims_;
+        float const *norms2_;
+        bool const useLowe_;
+        float const deltaSq_, epsilonSq_;
+        DISALLOW_COPY_AND_ASSIGN(matchWorker)
+};
+
+
+
+class matchManager : public queueManager<matchesType> {
+    public:
+        
+        matchManager(uint32_t nJobs) : blockMatches_(nJobs) {}
+        
+        void
+            operator() ( uint32_t jobID, matchesType &matches ){
+                blockMatches_[jobID].swap(matches);
+            }
+        
+        // concatenates in the order of image 1's descriptors
+        void
+            get( matchesType &putativeMatches ){
+                for (uint32_t i= 0; i<blockMatches_.size(); ++i)
+                    putativeMatches.insert(putativeMatches.end(), blockMatches_[i].begin(), blockMatches_[i].end());
+            }
+    
+    private:
+        std::vector<matchesType> blockMatches_;
+        DISALLOW_COPY_AND_ASSIGN(matchManager)
+};
+
+
+
+template<class DescType>
+void
+getPutativeMatches(
+        DescType const* desc1, uint32_t size1,
+        DescType const* desc2, uint32_t size2,
+        uint32_t nDims,
+        matchesType &putativeMatches,
+        bool useLowe, float deltaSq, float epsilon,
+        uint32_t numThreads ) {
+    
+    if (size1==0 || size2==0 || nDims==0)
+        return;
+    
+    std::vector<float> buf1, buf2;
+    float const *desc1f, *desc2f;
+    toFloat(desc1, static_cast<uint64_t>(size1)*nDims, buf1, desc1f);
+    toFloat(desc2, static_cast<uint64_t>(size2)*nDims, buf2, desc2f);
+    
+    Eigen::VectorXf const norms2= constMapType(desc2f, size2, nDims).rowwise().squaredNorm();
+    
+    std::vector<float> panels2;
+    if (hasAVX2)
+        packPanels(desc2f, size2, nDims, panels2);
+    
+    uint32_t const nJobs= (size1 + rowBlock - 1) / rowBlock;
+    matchWorker worker(desc1f, size1, desc2f, size2, hasAVX2 ? &panels2[0] : NULL,
+                       nDims, norms2.data(), useLowe, deltaSq, epsilon);
+    matchManager manager(nJobs);
+    threadQueue<matchesType>::start( nJobs, worker, manager, std::max(std::min(numThreads, nJobs), static_cast<uint32_t>(1)) );
+    manager.get(putativeMatches);
+}
+
+};
+
+
+
+void
+putativeDescMatcher::getPutativeMatches(
+        float const* desc1, uint32_t size1,
+        float const* desc2, uint32_t size2,
+        uint32_t nDims,
+        std::vector< std::pair<uint32_t, uint32_t> > &putativeMatches,
+        bool useLowe, float deltaSq, float epsilon,
+        uint32_t numThreads ) {
+    putativeDescMatcherImpl::getPutativeMatches(desc1, size1, desc2, size2, nDims, putativeMatches, useLowe, deltaSq, epsilon, numThreads);
+}
+
+
+
+void
+putativeDescMatcher::getPutativeMatches(
+        uint8_t const* desc1, uint32_t size1,
+        uint8_t const* desc2, uint32_t size2,
+        uint32_t nDims,
+        std::vector< std::pair<uint32_t, uint32_t> > &putativeMatches,
+        bool useLowe, float deltaSq, float epsilon,
+        uint32_t numThreads ) {
+    putativeDescMatcherImpl::getPutativeMatches(desc1, size1, desc2, size2, nDims, putativeMatches, useLowe, deltaSq, epsilon, numThreads);
+}
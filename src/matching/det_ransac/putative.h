@@ -63,7 +63,51 @@ class putative_desc {
                     std::vector< std::pair<uint32_t, uint32_t> > &putativeMatches,
                     bool useLowe= true,
                     float deltaSq= 0.81f,
-                    float epsilon= 100.0f );
+                    float epsilon= 100.0f,
+                    uint32_t numThreads= 1 );
+};
+
+
+
+// Brute-force matching behind putative_desc (float and uint8 descriptors).
+// Squared distances are computed a block of rows at a time as ||a||^2 + ||b||^2 - 2ab,
+// with the dot products done by an AVX2 register-blocked kernel (Eigen's matrix product
+// on CPUs without AVX2), and the two nearest neighbours are tracked while scanning each
+// block. Row blocks are spread over numThreads (0 is treated as 1).
+// Distances between uint8 descriptors are exact, float ones can differ from jp_dist_l2 by rounding.
+
+class putativeDescMatcher {
+    
+    public:
+        
+        static void
+            getPutativeMatches(
+                    float const* desc1, uint32_t size1,
+                    float const* desc2, uint32_t size2,
+                    uint32_t nDims,
+                    std::vector< std::pair<uint32_t, uint32_t> > &putativeMatches,
+                    bool useLowe, float deltaSq, float epsilon,
+                    uint32_t numThreads );
+        
+        static void
+            getPutativeMatches(
+                    uint8_t const* desc1, uint32_t size1,
+                    uint8_t const* desc2, uint32_t size2,
+                    uint32_t nDims,
+                    std::vector< std::pair<uint32_t, uint32_t> > &putativeMatches,
+                    bool useLowe, float deltaSq, float epsilon,
+                    uint32_t numThreads );
+        
+        // the original pairwise jp_dist_l2 loop, kept for comparison
+        template<class DescType>
+        static void
+            getPutativeMatchesSlow(
+                    DescType const* desc1, uint32_t size1,
+                    DescType const* desc2, uint32_t size2,
+                    uint32_t nDims,
+                    std::vector< std::pair<uint32_t, uint32_t> > &putativeMatches,
+                    bool useLowe, float deltaSq, float epsilon );
+        
 };
 
 
@@ -124,6 +168,22 @@ class indSorter_Soft {
 template<class DescType>
 void
 putative_desc<DescType>::getPutativeMatches(
+        DescType const* desc1, uint32_t size1,
+        DescType const* desc2, uint32_t size2,
+        uint32_t nDims,
+        std::vector< std::pair<uint32_t, uint32_t> > &putativeMatches,
+        bool useLowe,
+        float deltaSq,
+        float epsilon,
+        uint32_t numThreads ) {
+    putativeDescMatcher::getPutativeMatches(desc1, size1, desc2, size2, nDims, putativeMatches, useLowe, deltaSq, epsilon, numThreads);
+}
+
+
+
+template<class DescType>
+void
+putativeDescMatcher::getPutativeMatchesSlow(
         DescType const* desc1, uint32_t size1,
         DescType const* desc2, uint32_t size2,
         uint32_t nDims,
@@ -155,8 +215,6 @@ putative_desc<DescType>::getPutativeMatches(
             nns[0] = nns[1] = nns[2] = std::make_pair(-1, std::numeric_limits<float>::max());
             for (uint32_t j=0; j<size2; ++j) {
                 
-                // One potential improvement is to copy desc1 into an aligned
-                // buffer...
                 dsq = jp_dist_l2(desc1+i*nDims, desc2+j*nDims, nDims);
                 
                 if (dsq < nns[numnn-1].second) {
@@ -155,7 +155,8 @@ registerImages::registerFromGuess(
                 featGetterObj->numDims(),
                 loopNum_>1?1.0:5.0, 0.0, 1000.0, static_cast<uint32_t>(4),
                 true, 0.81f, 100.0f,
-                &Hnew, &inlierInds
+                &Hnew, &inlierInds,
+                std::max(boost::thread::hardware_concurrency(), 1U)
                 );
             
             bool success= bestNInliers>9;
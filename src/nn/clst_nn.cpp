@@ -0,0 +1,120 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "clst_nn.h"
+
+#include <float.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "kd_forest.h"
+#include "voc_tree.h"
+
+
+
+void
+clstCentresExactNN::add_points( float const *pnts, unsigned N ){
+    throw std::runtime_error("clstCentresExactNN::add_points: Not supported");
+}
+
+
+
+void
+clstCentresExactNN::search_nn( float const *qus, unsigned N, unsigned *argmins, float *mins ) const {
+    search_knn(qus, N, 1, argmins, mins);
+}
+
+
+
+void
+clstCentresExactNN::search_knn( float const *qus, unsigned N, unsigned KNN, unsigned *argmins, float *mins ) const {
+
+    uint32_t const numClst= clstCentres_->numClst, numDims= clstCentres_->numDims;
+    uint32_t const K= std::min(KNN, numClst);
+
+    // distances to a block of centres at a time, the K nearest in a max-heap
+    uint32_t const blockSize= 1024;
+    std::vector<float> distSqs(blockSize);
+    std::vector< std::pair<float, unsigned> > heap;
+    heap.reserve(K);
+
+    for (unsigned iQ= 0; iQ<N; ++iQ){
+
+        float const *qu= qus + static_cast<uint64_t>(iQ)*numDims;
+        heap.clear();
+
+        for (uint32_t begin= 0; begin<numClst; begin+= blockSize){
+            uint32_t const end= std::min(begin+blockSize, numClst);
+            clstCentres_->distSqs(qu, begin, end, &distSqs[0]);
+            for (uint32_t i= begin; i<end; ++i){
+                float const distSq= distSqs[i-begin];
+                if (heap.size()<K){
+                    heap.push_back( std::make_pair(distSq, i) );
+                    std::push_heap(heap.begin(), heap.end());
+                } else if (distSq < heap.front().first){
+                    std::pop_heap(heap.begin(), heap.end());
+                    heap.back()= std::make_pair(distSq, i);
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            }
+        }
+
+        std::sort_heap(heap.begin(), heap.end());
+        for (uint32_t k= 0; k<heap.size(); ++k){
+            argmins[iQ*KNN+k]= heap[k].second;
+            mins[iQ*KNN+k]= heap[k].first;
+        }
+        // fewer than KNN centres: the rest is an invalid ID at an infinite distance
+        for (uint32_t k= heap.size(); k<KNN; ++k){
+            argmins[iQ*KNN+k]= numClst;
+            mins[iQ*KNN+k]= FLT_MAX;
+        }
+    }
+
+}
+
+
+
+fastann::nn_obj<float> *
+clstNN::build( clstCentres const &clstCentres_obj, bool approx, std::string const &clstFn ){
+
+    if (approx && !clstFn.empty() && boost::filesystem::exists(vocTree::getFn(clstFn))){
+        try {
+            return new vocTree(clstCentres_obj, vocTree::getFn(clstFn), clstFn);
+        } catch (std::exception &e){
+            // e.g. clstFn was replaced after training the tree, which needs the descriptors to rebuild
+            std::cerr<<"clstNN::build: "<<e.what()<<", using a kdForest instead\n";
+        }
+    }
+
+    if (approx)
+        return clstFn.empty() ?
+            new kdForest(clstCentres_obj) :
+            new kdForest(clstCentres_obj, kdForest::getFn(clstFn), clstFn);
+
+    if (clstCentres_obj.storage!=clstCentres::floatStorage)
+        return new clstCentresExactNN(clstCentres_obj);
+
+    ASSERT( clstCentres_obj.clstC_flat!=NULL );
+    return fastann::nn_obj_build_exact(
+        clstCentres_obj.clstC_flat,
+        clstCentres_obj.numClst,
+        clstCentres_obj.numDims);
+
+}
@@ -0,0 +1,70 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _CLST_NN_H_
+#define _CLST_NN_H_
+
+#include <stdint.h>
+#include <string>
+
+#include <fastann.hpp>
+
+#include "clst_centres.h"
+#include "macros.h"
+
+
+
+// exact nearest cluster centres using clstCentres::distSqs, i.e. works with compact storage
+class clstCentresExactNN : public fastann::nn_obj<float> {
+
+    public:
+
+        clstCentresExactNN( clstCentres const &clstCentres_obj ) : clstCentres_(&clstCentres_obj) {}
+
+        void
+            add_points( float const *pnts, unsigned N );
+
+        void
+            search_nn( float const *qus, unsigned N, unsigned *argmins, float *mins ) const;
+
+        void
+            search_knn( float const *qus, unsigned N, unsigned KNN, unsigned *argmins, float *mins ) const;
+
+        unsigned
+            ndims() const { return clstCentres_->numDims; }
+
+        unsigned
+            npoints() const { return clstCentres_->numClst; }
+
+    private:
+
+        clstCentres const *clstCentres_;
+
+        DISALLOW_COPY_AND_ASSIGN(clstCentresExactNN)
+};
+
+
+
+namespace clstNN {
+
+    // NN search object for assigning to the clusters (keeps a reference to clstCentres_obj):
+    // vocTree if approx and the vocabulary was trained as one (vocTree::getFn(clstFn) exists and
+    // was trained for this clstFn), otherwise kdForest if approx, otherwise exact. If clstFn is given the forest is saved
+    // next to it (kdForest::getFn) and later memory-mapped instead of rebuilt
+    fastann::nn_obj<float> *
+        build( clstCentres const &clstCentres_obj, bool approx= true, std::string const &clstFn= "" );
+
+};
+
+#endif
@@ -14,9 +14,12 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "coarse_residual.h"
 
-#include <queue>
+#include <algorithm>
+#include <functional>
 
-#include "nn_compressed.h"
+#include <boost/thread.hpp>
+
+#include "thread_queue.h"
 #include "util.h"
 #include "jp_dist2.hpp"
 #include "macros.h"
@@ -43,16 +46,28 @@ coarseResidual::~coarseResidual(){
 
 
 
+// merges vecIDds (sorted by ascending distance) into the max-heap of the KNN nearest
+static void
+mergeIntoHeap( std::vector<nnSearcher::vecIDdist> const &vecIDds, uint32_t KNN, std::vector<nnSearcher::vecIDdist> &heap ){
+    for (std::vector<nnSearcher::vecIDdist>::const_iterator it= vecIDds.begin(); it!=vecIDds.end(); ++it){
+        if (heap.size()<KNN){
+            heap.push_back(*it);
+            std::push_heap(heap.begin(), heap.end());
+        } else if (it->distSq < heap.front().distSq){
+            std::pop_heap(heap.begin(), heap.end());
+            heap.back()= *it;
+            std::push_heap(heap.begin(), heap.end());
+        } else
+            break;
+    }
+}
+
+
+
 void
 coarseResidual::findKNN( float const qVec[], uint32_t KNN, std::vector<vecIDdist> &vecIDdists, uint32_t const *origCoarseID ) const {
     
     vecIDdists.clear();
-    vecIDdists.reserve( KNN>10000? 10000 : KNN );
-    
-    unsigned coarseID;
-    
-    std::vector<vecIDdist> vecIDds;
-    std::priority_queue<vecIDdist> heapVecIDds;
     
     // assign to coarse clusters
     float *distSqs= new float[nVisitCoarse];
@@ -83,75 +98,28 @@ coarseResidual::findKNN( float const qVec[], uint32_t KNN, std::vector<vecIDdist
     
     delete []distSqs;
     
+    std::vector<uint32_t> const queryInds(1, 0);
+    std::vector< std::vector<vecIDdist> > cellVecIDdists;
+    std::vector<vecIDdist> heap;
+    heap.reserve( std::min(KNN, static_cast<uint32_t>(10000)) );
     
     for (uint32_t iCoarse= 0; iCoarse<nVisitCoarse; ++iCoarse){
         
-        coarseID= coarseIDs[iCoarse];
-        
-        std::vector<uint32_t> vecIDs;
-        unsigned char *data;
-        uint32_t size;
-        idx->getData(coarseID, vecIDs, data, size);
-        if (size==0){
-            delete []data;
-            continue;
-        }
-        std::string dataStr(
-                reinterpret_cast<const char*>(&data[0]),
-                size );
-        
-        // compute residual
-        
-        float *qVecRes= new float[coarseClstC_obj.numDims];
-        for (uint32_t iDim= 0; iDim < coarseClstC_obj.numDims; ++iDim)
-            qVecRes[iDim]= qVec[iDim] - *(coarseClstC_obj.clstC_flat + coarseID * coarseClstC_obj.numDims + iDim);
-        
-        
         // find KNN in this coarse cluster
+        findKNNInCell( coarseIDs[iCoarse], qVec, NULL, queryInds, KNN, cellVecIDdists );
         
-        if (nVisitCoarse==1){
-            
-            nnCompressed::findKNN( *compDist, dataStr, qVecRes, KNN, vecIDdists );
-            delete []data;
-            coarseResidual::applyInd( vecIDs, vecIDdists );
-            
-        } else {
-            
-            nnCompressed::findKNN( *compDist, dataStr, qVecRes, KNN, vecIDds );
-            delete []data;
-//             less efficient but clearer: coarseResidual::applyInd( vecIDs, vecIDds ); and then latter heapVecIDds.push( *it )
-            vecIDdist toAdd;
-            
-            std::vector<vecIDdist>::const_iterator it= vecIDds.begin();
-            for (; it!=vecIDds.end() && (heapVecIDds.size()<KNN || heapVecIDds.top().distSq > it->distSq); ++it){
-                
-                if (heapVecIDds.size()==KNN)
-                    heapVecIDds.pop();
-                
-                toAdd.distSq= it->distSq;
-                toAdd.ID= vecIDs[ it->ID ];
-                heapVecIDds.push( toAdd );
-            }
-            
-        }
-        
-        delete []qVecRes;
+        if (nVisitCoarse==1)
+            vecIDdists.swap( cellVecIDdists[0] );
+        else
+            mergeIntoHeap( cellVecIDdists[0], KNN, heap );
         
     }
     
     delete []coarseIDs;
     
     if (nVisitCoarse>1){
-        
-        vecIDdists.clear();
-        vecIDdists.reserve(heapVecIDds.size());
-        
-        while (!heapVecIDds.empty()){
-            vecIDdists.push_back( heapVecIDds.top() );
-            heapVecIDds.pop();
-        }
-        std::reverse(vecIDdists.begin(), vecIDdists.end());
-        
+        std::sort_heap(heap.begin(), heap.end());
+        vecIDdists.swap(heap);
     }
     
 }
@@ -190,9 +158,190 @@ coarseResidual::findKNN( uint32_t coarseID, std::string const &dataRes, uint32_t
 
 
 void
-coarseResidual::applyInd( std::vector<uint32_t> const &origIDs, std::vector<vecIDdist> &inds ){
-    for (uint32_t i= 0; i<inds.size(); ++i)
-        inds[i].ID= origIDs[ inds[i].ID ];
+coarseResidual::findKNNInCell( uint32_t coarseID, float const qVecs[], float const qTerms[], std::vector<uint32_t> const &queryInds, uint32_t KNN, std::vector< std::vector<vecIDdist> > &vecIDdists ) const {
+    
+    uint32_t const numQueries= queryInds.size();
+    vecIDdists.resize(numQueries);
+    for (uint32_t i= 0; i<numQueries; ++i)
+        vecIDdists[i].clear();
+    
+    std::vector<uint32_t> vecIDsBuf;
+    std::vector<unsigned char> dataBuf;
+    uint32_t const *vecIDs;
+    unsigned char const *data;
+    uint32_t size;
+    if (getCell(coarseID, vecIDsBuf, dataBuf, vecIDs, data, size)==0 || size==0 || numQueries==0)
+        return;
+    
+    uint32_t const numDims_= coarseClstC_obj.numDims;
+    float const *centre= coarseClstC_obj.clstC_flat + static_cast<uint64_t>(coarseID) * numDims_;
+    std::vector< std::vector< std::pair<float, uint32_t> > > distSqInds;
+    
+    // one scan of the cell for all queries
+    if (qTerms==NULL){
+        std::vector<float> qVecsRes(numQueries*numDims_);
+        for (uint32_t i= 0; i<numQueries; ++i){
+            float const *qVec= qVecs + static_cast<uint64_t>(queryInds[i]) * numDims_;
+            for (uint32_t iDim= 0; iDim < numDims_; ++iDim)
+                qVecsRes[i*numDims_ + iDim]= qVec[iDim] - centre[iDim];
+        }
+        compDist->getKNNMulti( &qVecsRes[0], numQueries, data, size, KNN, distSqInds );
+    } else {
+        uint32_t const termSize= compDist->residualTermSize();
+        std::vector<float> cellQVecs(numQueries*numDims_), cellQTerms(numQueries*termSize);
+        for (uint32_t i= 0; i<numQueries; ++i){
+            std::copy( qVecs + static_cast<uint64_t>(queryInds[i]) * numDims_,
+                       qVecs + static_cast<uint64_t>(queryInds[i]+1) * numDims_,
+                       cellQVecs.begin() + i*numDims_ );
+            std::copy( qTerms + static_cast<uint64_t>(queryInds[i]) * termSize,
+                       qTerms + static_cast<uint64_t>(queryInds[i]+1) * termSize,
+                       cellQTerms.begin() + i*termSize );
+        }
+        compDist->getKNNResidualMulti( &cellQVecs[0], cellQTerms.empty() ? NULL : &cellQTerms[0], numQueries, centre, data, size, KNN, distSqInds );
+    }
+    
+    for (uint32_t i= 0; i<numQueries; ++i){
+        std::vector< std::pair<float, uint32_t> > const &thisDistSqInds= distSqInds[i];
+        vecIDdists[i].reserve(thisDistSqInds.size());
+        for (uint32_t j= 0; j<thisDistSqInds.size(); ++j)
+            vecIDdists[i].push_back( vecIDdist( vecIDs[thisDistSqInds[j].second], thisDistSqInds[j].first ) );
+    }
+    
+}
+
+
+
+typedef std::vector< std::vector<nnSearcher::vecIDdist> > cellResultType;
+
+
+
+class coarseResidualCellWorker : public queueWorker<cellResultType> {
+    public:
+        
+        coarseResidualCellWorker( coarseResidual const &CR, float const qVecs[], float const qTerms[], std::vector<uint32_t> const &cellIDs, std::vector< std::vector<uint32_t> > const &cellQueries, uint32_t KNN )
+            : CR_(&CR), qVecs_(qVecs), qTerms_(qTerms), cellIDs_(&cellIDs), cellQueries_(&cellQueries), KNN_(KNN) {}
+        
+        void
+            operator() ( uint32_t jobID, cellResultType &result ) const {
+                CR_->findKNNInCell( cellIDs_->at(jobID), qVecs_, qTerms_, cellQueries_->at(jobID), KNN_, result );
+            }
+    
+    private:
+        coarseResidual const *CR_;
+        float const *qVecs_, *qTerms_;
+        std::vector<uint32_t> const *cellIDs_;
+        std::vector< std::vector<uint32_t> > const *cellQueries_;
+        uint32_t const KNN_;
+        DISALLOW_COPY_AND_ASSIGN(coarseResidualCellWorker)
+};
+
+
+
+// merges results of cells into the per-query heaps (only the manager thread touches them)
+class coarseResidualCellManager : public queueManager<cellResultType> {
+    public:
+        
+        coarseResidualCellManager( std::vector< std::vector<uint32_t> > const &cellQueries, uint32_t KNN, std::vector<nnSearcher::vecIDdist> *heaps )
+            : cellQueries_(&cellQueries), KNN_(KNN), heaps_(heaps) {}
+        
+        void
+            operator() ( uint32_t jobID, cellResultType &result ){
+                std::vector<uint32_t> const &queryInds= cellQueries_->at(jobID);
+                for (uint32_t i= 0; i<queryInds.size(); ++i)
+                    mergeIntoHeap( result[i], KNN_, heaps_[queryInds[i]] );
+            }
+    
+    private:
+        std::vector< std::vector<uint32_t> > const *cellQueries_;
+        uint32_t const KNN_;
+        std::vector<nnSearcher::vecIDdist> *heaps_;
+        DISALLOW_COPY_AND_ASSIGN(coarseResidualCellManager)
+};
+
+
+
+void
+coarseResidual::findKNNBatch( float const qVecs[], uint32_t numQueries, uint32_t KNN, std::vector< std::vector<vecIDdist> > &vecIDdists, uint32_t numThreads ) const {
+    
+    vecIDdists.clear();
+    vecIDdists.resize(numQueries);
+    if (numQueries==0)
+        return;
+    
+    if (numThreads==0)
+        numThreads= std::max(boost::thread::hardware_concurrency(), 1U);
+    
+    uint32_t const numDims_= coarseClstC_obj.numDims;
+    uint32_t const termSize= compDist->residualTermSize();
+    // bounds the memory for the per-query data
+    uint32_t const chunkSize= 1024;
+    
+    for (uint32_t chunkStart= 0; chunkStart<numQueries; chunkStart+= chunkSize){
+        
+        uint32_t const numChunk= std::min(chunkSize, numQueries-chunkStart);
+        float const *chunkQVecs= qVecs + static_cast<uint64_t>(chunkStart)*numDims_;
+        
+        // assign to coarse clusters at once
+        std::vector<unsigned> coarseIDs(numChunk*nVisitCoarse);
+        std::vector<float> distSqs(numChunk*nVisitCoarse);
+        nn_obj->search_knn(chunkQVecs, numChunk, nVisitCoarse, &coarseIDs[0], &distSqs[0]);
+        
+        // the part of the lookup tables which depends only on the query, reused for all its cells
+        std::vector<float> qTerms(numChunk*termSize);
+        for (uint32_t iQ= 0; iQ<numChunk && termSize>0; ++iQ)
+            compDist->getResidualTerms( chunkQVecs + iQ*numDims_, &qTerms[iQ*termSize] );
+        
+        // group the queries by cell
+        std::vector< std::vector<uint32_t> > queriesOfCell( coarseClstC_obj.numClst );
+        for (uint32_t i= 0; i<coarseIDs.size(); ++i)
+            // an approximate search can find fewer than nVisitCoarse cells (the rest is numClst)
+            if (coarseIDs[i]<coarseClstC_obj.numClst)
+                queriesOfCell[ coarseIDs[i] ].push_back( i / nVisitCoarse );
+        std::vector< std::pair<uint32_t, uint32_t> > cellSizes; // (number of queries, coarseID)
+        for (uint32_t coarseID= 0; coarseID<coarseClstC_obj.numClst; ++coarseID)
+            if (!queriesOfCell[coarseID].empty())
+                cellSizes.push_back( std::make_pair(queriesOfCell[coarseID].size(), coarseID) );
+        
+        // the most expensive cells first for better load balancing
+        std::sort(cellSizes.begin(), cellSizes.end(), std::greater< std::pair<uint32_t, uint32_t> >());
+        uint32_t const numCells= cellSizes.size();
+        std::vector<uint32_t> cellIDs(numCells);
+        std::vector< std::vector<uint32_t> > cellQueries(numCells);
+        for (uint32_t iCell= 0; iCell<numCells; ++iCell){
+            cellIDs[iCell]= cellSizes[iCell].second;
+            cellQueries[iCell].swap( queriesOfCell[cellIDs[iCell]] );
+        }
+        
+        for (uint32_t iQ= chunkStart; iQ<chunkStart+numChunk; ++iQ)
+            vecIDdists[iQ].reserve( std::min(KNN, static_cast<uint32_t>(10000)) );
+        
+        coarseResidualCellWorker worker(*this, chunkQVecs, termSize>0 ? &qTerms[0] : NULL, cellIDs, cellQueries, KNN);
+        coarseResidualCellManager manager(cellQueries, KNN, &vecIDdists[chunkStart]);
+        threadQueue<cellResultType>::start( numCells, worker, manager, std::max(std::min(numThreads, numCells), static_cast<uint32_t>(1)) );
+    }
+    
+    for (uint32_t iQ= 0; iQ<numQueries; ++iQ)
+        std::sort_heap(vecIDdists[iQ].begin(), vecIDdists[iQ].end());
+    
+}
+
+
+
+uint32_t
+coarseResidual::getCell( uint32_t coarseID, std::vector<uint32_t> &vecIDsBuf, std::vector<unsigned char> &dataBuf, uint32_t const *&vecIDs, unsigned char const *&data, uint32_t &size ) const {
+    
+    uint32_t N;
+    if (idx->getDataNoCopy(coarseID, N, vecIDs, data, size))
+        return N;
+    
+    unsigned char *dataNew;
+    N= idx->getData(coarseID, vecIDsBuf, dataNew, size);
+    dataBuf.assign(dataNew, dataNew+size);
+    delete []dataNew;
+    vecIDs= vecIDsBuf.empty() ? NULL : &vecIDsBuf[0];
+    data= dataBuf.empty() ? NULL : &dataBuf[0];
+    return N;
+    
 }
 
 
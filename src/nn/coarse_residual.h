@@ -52,13 +52,29 @@ class coarseResidual : public nnSearcher {
         void
             findKNN( uint32_t coarseID, std::string const &dataRes, uint32_t KNN, std::vector<vecIDdist> &vecIDdists ) const;
         
+        // findKNN for each of the numQueries vectors in qVecs (numDims() floats each): the queries
+        // are grouped by the coarse cells they visit and the list of each cell is scanned once for
+        // all of its queries, cells are searched in parallel (numThreads= 0 for one per core).
+        // Distances can differ from findKNN by rounding as the lookup tables are built from
+        // per-query and per-cell terms (see compressorWithDistance::getKNNResidualMulti)
+        void
+            findKNNBatch( float const qVecs[], uint32_t numQueries, uint32_t KNN, std::vector< std::vector<vecIDdist> > &vecIDdists, uint32_t numThreads= 0 ) const;
+        
+        // KNN within the coarse cell for the queries qVecs[queryInds[i]*numDims()], in the same order;
+        // the IDs are the original vector IDs. If qTerms is not NULL it holds the
+        // compressorWithDistance::getResidualTerms of each query (residualTermSize() floats each)
+        void
+            findKNNInCell( uint32_t coarseID, float const qVecs[], float const qTerms[], std::vector<uint32_t> const &queryInds, uint32_t KNN, std::vector< std::vector<vecIDdist> > &vecIDdists ) const;
+        
         uint32_t
             numDims() const { return compDist->numDims(); }
     
     private:
         
-        static void
-            applyInd( std::vector<uint32_t> const &origIDs, std::vector<vecIDdist> &inds );
+        // vecIDs and data of the coarse cell, pointing into the index if it supports getDataNoCopy,
+        // otherwise into the buffers; returns the number of vectors
+        uint32_t
+            getCell( uint32_t coarseID, std::vector<uint32_t> &vecIDsBuf, std::vector<unsigned char> &dataBuf, uint32_t const *&vecIDs, unsigned char const *&data, uint32_t &size ) const;
         
         clstCentres const coarseClstC_obj;
         fastann::nn_obj<float> const *nn_obj;
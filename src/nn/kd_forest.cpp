@@ -0,0 +1,456 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "kd_forest.h"
+
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include "compact_dist.h"
+#include "thread_queue.h"
+
+
+
+static char const kdfMagic[8]= {'V','I','S','E','K','D','F','2'};
+
+static inline uint64_t
+headerSize(uint32_t numTrees){
+    return (8 + 4*4 + 2*8 + 4*(static_cast<uint64_t>(numTrees)+1) + 15) / 16 * 16;
+}
+
+// splitmix64
+static inline uint32_t
+nextRand(uint64_t &state){
+    uint64_t z= (state+= 0x9e3779b97f4a7c15ULL);
+    z= (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z= (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return static_cast<uint32_t>( (z ^ (z >> 31)) >> 32 );
+}
+
+// dimension dim of centre clstID, for any storage
+static inline float
+coordinate(clstCentres const &clst, uint32_t clstID, uint32_t dim){
+    uint64_t const i= static_cast<uint64_t>(clstID)*clst.numDims + dim;
+    switch (clst.storage){
+        case clstCentres::uint8Storage:
+            return clst.uint8Offset + clst.clstC_uint8[i]*clst.uint8Scale;
+        case clstCentres::float16Storage:
+            return compactDist::halfToFloat(clst.clstC_float16[i]);
+        default:
+            return clst.clstC_flat!=NULL ? clst.clstC_flat[i] : clst.clstC[clstID][dim];
+    }
+}
+
+
+
+struct kdTree {
+    std::vector<kdForest::node> nodes;
+    std::vector<uint32_t> leafIDs;
+};
+
+// node still to be split, covering leafIDs [begin, end)
+struct kdPending {
+    uint32_t nodeInd, begin, end;
+};
+
+
+
+class coordinateLess {
+    public:
+        coordinateLess(clstCentres const &clst, uint32_t dim) : clst_(&clst), dim_(dim) {}
+        inline bool
+            operator()(uint32_t a, uint32_t b) const { return coordinate(*clst_, a, dim_) < coordinate(*clst_, b, dim_); }
+    private:
+        clstCentres const *clst_;
+        uint32_t dim_;
+};
+
+
+
+static void
+buildTree(clstCentres const &clst, uint32_t leafSize, uint64_t seed, kdTree &tree){
+
+    uint32_t const numClst= clst.numClst, numDims= clst.numDims;
+    uint32_t const sampleSize= 128, numTopDims= std::min(static_cast<uint32_t>(5), numDims);
+    uint64_t state= seed;
+
+    // shuffled so that the first centres of any range are a random sample of it
+    std::vector<uint32_t> &ids= tree.leafIDs;
+    ids.resize(numClst);
+    for (uint32_t i= 0; i<numClst; ++i)
+        ids[i]= i;
+    for (uint32_t i= numClst; i>1; --i)
+        std::swap(ids[i-1], ids[nextRand(state) % i]);
+
+    // breadth-first, i.e. children are appended in the order their parents are split
+    std::vector<kdPending> queue;
+    std::vector<kdForest::node> &nodes= tree.nodes;
+    nodes.assign(1, kdForest::node());
+    kdPending const root= {0, 0, numClst};
+    queue.push_back(root);
+
+    std::vector<double> mean(numDims), var(numDims);
+    std::vector< std::pair<double, uint32_t> > varDim(numDims);
+
+    for (size_t head= 0; head<queue.size(); ++head){
+
+        kdPending const p= queue[head];
+        kdForest::node &n= nodes[p.nodeInd];
+
+        if (p.end-p.begin <= leafSize){
+            n.split= 0;
+            n.dim= kdForest::leafDim;
+            n.first= p.begin;
+            n.count= p.end-p.begin;
+            continue;
+        }
+
+        // split at the mean of a random one of the dimensions with the largest variance (estimated on a sample)
+        uint32_t const numSample= std::min(sampleSize, p.end-p.begin);
+        std::fill(mean.begin(), mean.end(), 0.0);
+        std::fill(var.begin(), var.end(), 0.0);
+        for (uint32_t i= p.begin; i<p.begin+numSample; ++i)
+            for (uint32_t iDim= 0; iDim<numDims; ++iDim){
+                double const v= coordinate(clst, ids[i], iDim);
+                mean[iDim]+= v;
+                var[iDim]+= v*v;
+            }
+        for (uint32_t iDim= 0; iDim<numDims; ++iDim){
+            mean[iDim]/= numSample;
+            varDim[iDim]= std::make_pair(var[iDim]/numSample - mean[iDim]*mean[iDim], iDim);
+        }
+        std::partial_sort(varDim.begin(), varDim.begin()+numTopDims, varDim.end(), std::greater< std::pair<double, uint32_t> >());
+        uint32_t const dim= varDim[ nextRand(state) % numTopDims ].second;
+        float split= static_cast<float>(mean[dim]);
+
+        uint32_t mid= p.begin;
+        for (uint32_t i= p.begin; i<p.end; ++i)
+            if (coordinate(clst, ids[i], dim) < split)
+                std::swap(ids[i], ids[mid++]);
+        if (mid==p.begin || mid==p.end){
+            // everything on one side (e.g. duplicates), split at the median instead
+            mid= p.begin + (p.end-p.begin)/2;
+            std::nth_element(ids.begin()+p.begin, ids.begin()+mid, ids.begin()+p.end, coordinateLess(clst, dim));
+            split= coordinate(clst, ids[mid], dim);
+        }
+
+        uint32_t const first= nodes.size();
+        n.split= split;
+        n.dim= dim;
+        n.first= first;
+        n.count= 0;
+        // n is invalidated from here
+        nodes.resize(first+2);
+        kdPending const left= {first, p.begin, mid}, right= {first+1, mid, p.end};
+        queue.push_back(left);
+        queue.push_back(right);
+    }
+}
+
+
+
+class kdForestWorker : public queueWorker<kdTree> {
+    public:
+        kdForestWorker(clstCentres const &clst, uint32_t leafSize) : clst_(&clst), leafSize_(leafSize) {}
+        void
+            operator() ( uint32_t jobID, kdTree &result ) const {
+                buildTree(*clst_, leafSize_, 12345 + jobID, result);
+            }
+    private:
+        clstCentres const *clst_;
+        uint32_t const leafSize_;
+        DISALLOW_COPY_AND_ASSIGN(kdForestWorker)
+};
+
+
+
+class kdForestManager : public queueManager<kdTree> {
+    public:
+        kdForestManager(std::vector<kdTree> &trees) : trees_(&trees) {}
+        void
+            operator() ( uint32_t jobID, kdTree &result ){
+                trees_->at(jobID).nodes.swap(result.nodes);
+                trees_->at(jobID).leafIDs.swap(result.leafIDs);
+            }
+    private:
+        std::vector<kdTree> *trees_;
+        DISALLOW_COPY_AND_ASSIGN(kdForestManager)
+};
+
+
+
+kdForest::kdForest( clstCentres const &clstCentres_obj, uint32_t numTrees, uint32_t nChecks, uint32_t leafSize, uint32_t numThreads )
+    : clstCentres_(&clstCentres_obj), nChecks_(nChecks), clstSize_(0), clstChecksum_(0), file_(NULL) {
+    build(numTrees, leafSize, numThreads);
+}
+
+
+
+kdForest::kdForest( clstCentres const &clstCentres_obj, std::string const &fileName, std::string const &clstFn, uint32_t numTrees, uint32_t nChecks, uint32_t leafSize, uint32_t numThreads )
+    : clstCentres_(&clstCentres_obj), nChecks_(nChecks), file_(NULL) {
+
+    // the mtime alone misses centres replaced by an older file (e.g. copied with their times kept)
+    getFileChecksum(clstFn.c_str(), clstSize_, clstChecksum_);
+
+    if (boost::filesystem::exists(fileName) &&
+        boost::filesystem::last_write_time(fileName) >= boost::filesystem::last_write_time(clstFn)){
+        file_= new mappedFile(fileName.c_str());
+        if (file_->isOpen() && parse(file_->data(), file_->size()) && numTrees_==numTrees && leafSize_==leafSize)
+            return;
+        delete file_;
+        file_= NULL;
+    }
+
+    std::cout<<"kdForest::kdForest: Building "<<fileName<<"\n";
+    build(numTrees, leafSize, numThreads);
+
+    try {
+        save(fileName);
+        // use the mapping so that processes share the memory
+        file_= new mappedFile(fileName.c_str());
+        if (file_->isOpen() && parse(file_->data(), file_->size())){
+            std::vector<char>().swap(inRam_);
+            return;
+        }
+        delete file_;
+        file_= NULL;
+    } catch (std::exception &e){
+        std::cerr<<"kdForest::kdForest: "<<e.what()<<", keeping the forest in RAM\n";
+    }
+    ASSERT( parse(&inRam_[0], inRam_.size()) );
+}
+
+
+
+kdForest::~kdForest(){
+    if (file_!=NULL)
+        delete file_;
+}
+
+
+
+void
+kdForest::build( uint32_t numTrees, uint32_t leafSize, uint32_t numThreads ){
+
+    ASSERT( numTrees>0 && leafSize>0 );
+    uint32_t const numClst= clstCentres_->numClst;
+
+    if (numThreads==0)
+        numThreads= boost::thread::hardware_concurrency();
+    std::vector<kdTree> trees(numTrees);
+    kdForestWorker worker(*clstCentres_, leafSize);
+    kdForestManager manager(trees);
+    threadQueue<kdTree>::start( numTrees, worker, manager, std::max(static_cast<uint32_t>(1), std::min(numThreads, numTrees)) );
+
+    // serialise
+    std::vector<uint32_t> treeBegin(numTrees+1, 0);
+    for (uint32_t iTree= 0; iTree<numTrees; ++iTree)
+        treeBegin[iTree+1]= treeBegin[iTree] + trees[iTree].nodes.size();
+    uint64_t const hSize= headerSize(numTrees);
+    inRam_.assign( hSize + treeBegin[numTrees]*sizeof(node) + static_cast<uint64_t>(numTrees)*numClst*sizeof(uint32_t), 0 );
+
+    char *out= &inRam_[0];
+    uint32_t const params[4]= {numClst, clstCentres_->numDims, numTrees, leafSize};
+    uint64_t const clstFile[2]= {clstSize_, clstChecksum_};
+    memcpy(out, kdfMagic, 8);
+    memcpy(out+8, params, sizeof(params));
+    memcpy(out+8+sizeof(params), clstFile, sizeof(clstFile));
+    memcpy(out+8+sizeof(params)+sizeof(clstFile), &treeBegin[0], treeBegin.size()*sizeof(uint32_t));
+    out+= hSize;
+    for (uint32_t iTree= 0; iTree<numTrees; ++iTree){
+        memcpy(out, &trees[iTree].nodes[0], trees[iTree].nodes.size()*sizeof(node));
+        out+= trees[iTree].nodes.size()*sizeof(node);
+    }
+    for (uint32_t iTree= 0; iTree<numTrees && numClst>0; ++iTree){
+        memcpy(out, &trees[iTree].leafIDs[0], numClst*sizeof(uint32_t));
+        out+= numClst*sizeof(uint32_t);
+    }
+
+    ASSERT( parse(&inRam_[0], inRam_.size()) );
+}
+
+
+
+bool
+kdForest::parse( char const *data, uint64_t size ){
+    if (size<8+4*4+2*8 || memcmp(data, kdfMagic, 8)!=0)
+        return false;
+    uint32_t params[4];
+    uint64_t clstFile[2];
+    memcpy(params, data+8, sizeof(params));
+    memcpy(clstFile, data+8+sizeof(params), sizeof(clstFile));
+    if (params[0]!=clstCentres_->numClst || params[1]!=clstCentres_->numDims || params[2]==0 || size<headerSize(params[2]) ||
+        clstFile[0]!=clstSize_ || clstFile[1]!=clstChecksum_)
+        return false;
+    numTrees_= params[2];
+    leafSize_= params[3];
+    treeBegin_= reinterpret_cast<uint32_t const *>(data+8+sizeof(params)+sizeof(clstFile));
+    if (size != headerSize(numTrees_) + treeBegin_[numTrees_]*sizeof(node) + static_cast<uint64_t>(numTrees_)*params[0]*sizeof(uint32_t))
+        return false;
+    data_= data;
+    size_= size;
+    nodes_= reinterpret_cast<node const *>(data + headerSize(numTrees_));
+    leafIDs_= reinterpret_cast<uint32_t const *>(nodes_ + treeBegin_[numTrees_]);
+    return true;
+}
+
+
+
+void
+kdForest::save( std::string const &fileName ) const {
+    // write to a temporary file first so that readers never see a partial forest
+    std::string const tempFn= fileName + boost::filesystem::unique_path(".%%%%-%%%%-%%%%-%%%%").native();
+    FILE *f= fopen(tempFn.c_str(), "wb");
+    if (f==NULL)
+        throw std::runtime_error("kdForest::save: Can't write " + tempFn);
+    bool const ok= fwrite(data_, 1, size_, f)==size_;
+    fclose(f);
+    if (!ok){
+        boost::filesystem::remove(tempFn);
+        throw std::runtime_error("kdForest::save: Can't write " + tempFn);
+    }
+    boost::filesystem::rename(tempFn, fileName);
+}
+
+
+
+void
+kdForest::add_points( float const *pnts, unsigned N ){
+    throw std::runtime_error("kdForest::add_points: Not supported");
+}
+
+
+
+void
+kdForest::search_nn( float const *qus, unsigned N, unsigned *argmins, float *mins ) const {
+    search_knn(qus, N, 1, argmins, mins);
+}
+
+
+
+// unexplored branch, ordered by the distance to its splitting plane
+struct kdBranch {
+    float distSq;
+    uint32_t tree, node;
+    inline bool operator>(kdBranch const &rhs) const { return distSq > rhs.distSq; }
+};
+
+
+
+void
+kdForest::search_knn( float const *qus, unsigned N, unsigned KNN, unsigned *argmins, float *mins ) const {
+
+    uint32_t const numClst= clstCentres_->numClst, numDims= clstCentres_->numDims;
+    uint32_t const K= std::min(KNN, numClst);
+
+    std::vector<float> q(numDims);
+    std::vector< std::pair<float, unsigned> > heap; // the K nearest, max-heap
+    heap.reserve(K+1);
+    std::vector<kdBranch> branches; // min-heap
+    branches.reserve(nChecks_);
+
+    // checked centres (as ID+1) in an open addressing table, at most half full
+    uint32_t const maxChecked= nChecks_ + (numTrees_+1)*leafSize_;
+    uint32_t tableSize= 16;
+    for (; tableSize < 2*maxChecked; tableSize*= 2);
+    std::vector<uint32_t> checked(tableSize);
+
+    for (unsigned iQ= 0; iQ<N; ++iQ){
+
+        float const *qu= qus + static_cast<uint64_t>(iQ)*numDims;
+        clstCentres_->prepareQuery(qu, &q[0]);
+        heap.clear();
+        branches.clear();
+        std::fill(checked.begin(), checked.end(), 0);
+        uint32_t numChecks= 0;
+
+        // descend from all roots first, then from the closest unexplored branches
+        for (uint32_t iBranch= 0; ; ++iBranch){
+
+            uint32_t iTree, nodeInd;
+            if (iBranch<numTrees_){
+                iTree= iBranch;
+                nodeInd= 0;
+            } else {
+                if (branches.empty() || numChecks>=nChecks_)
+                    break;
+                std::pop_heap(branches.begin(), branches.end(), std::greater<kdBranch>());
+                kdBranch const b= branches.back();
+                branches.pop_back();
+                if (heap.size()==K && b.distSq >= heap.front().first)
+                    break;
+                iTree= b.tree;
+                nodeInd= b.node;
+            }
+
+            node const *treeNodes= nodes_ + treeBegin_[iTree];
+            for (node const *n= treeNodes + nodeInd; n->dim!=leafDim; ){
+                float const diff= qu[n->dim] - n->split;
+                uint32_t const nearInd= n->first + (diff>=0), farInd= n->first + (diff<0);
+                if (heap.size()<K || diff*diff < heap.front().first){
+                    kdBranch const b= {diff*diff, iTree, farInd};
+                    branches.push_back(b);
+                    std::push_heap(branches.begin(), branches.end(), std::greater<kdBranch>());
+                }
+                n= treeNodes + nearInd;
+                if (n->dim==leafDim)
+                    nodeInd= nearInd;
+            }
+            node const &leaf= treeNodes[nodeInd];
+
+            uint32_t const *ids= leafIDs_ + static_cast<uint64_t>(iTree)*numClst + leaf.first;
+            for (uint32_t i= 0; i<leaf.count; ++i){
+                uint32_t const clstID= ids[i];
+                // skip if already checked in another tree
+                uint32_t h= (clstID*2654435761u) & (tableSize-1);
+                for (; checked[h]!=0 && checked[h]!=clstID+1; h= (h+1) & (tableSize-1));
+                if (checked[h]!=0)
+                    continue;
+                checked[h]= clstID+1;
+                ++numChecks;
+
+                float const distSq= clstCentres_->distSqPrepared(&q[0], clstID);
+                if (heap.size()<K){
+                    heap.push_back( std::make_pair(distSq, clstID) );
+                    std::push_heap(heap.begin(), heap.end());
+                } else if (distSq < heap.front().first){
+                    std::pop_heap(heap.begin(), heap.end());
+                    heap.back()= std::make_pair(distSq, clstID);
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            }
+        }
+
+        std::sort_heap(heap.begin(), heap.end());
+        for (uint32_t k= 0; k<heap.size(); ++k){
+            argmins[iQ*KNN+k]= heap[k].second;
+            mins[iQ*KNN+k]= heap[k].first;
+        }
+        // as clstCentresExactNN, unfound neighbours are numClst at FLT_MAX
+        for (uint32_t k= heap.size(); k<KNN; ++k){
+            argmins[iQ*KNN+k]= numClst;
+            mins[iQ*KNN+k]= FLT_MAX;
+        }
+    }
+
+}
@@ -0,0 +1,121 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _KD_FOREST_H_
+#define _KD_FOREST_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <fastann.hpp>
+
+#include "clst_centres.h"
+#include "macros.h"
+#include "mapped_file.h"
+
+
+
+/*
+Randomized kd-forest over cluster centres (approximate NN as fastann's kdtree): each tree
+splits at the mean of a dimension picked randomly among the ones with the largest variance,
+search descends all trees and then explores the closest unexplored branches of any tree
+until nChecks distances have been computed. Works with any clstCentres storage.
+
+The trees are built in parallel and can be saved, a saved forest is memory-mapped and
+searched in place. Organization (native byte order):
+
+char[8] magic "VISEKDF2"
+uint32_t numClst, numDims, numTrees, leafSize
+uint64_t clstSize, clstChecksum   of the centres file (0 if not built from a file)
+uint32_t treeBegin[numTrees+1]    nodes of tree t are [treeBegin[t], treeBegin[t+1])
+zero padding to a multiple of 16 bytes
+node nodes[treeBegin[numTrees]]   per tree in breadth-first order, i.e. the top levels share cache lines
+uint32_t leafIDs[numTrees*numClst] centre IDs of the leaves, tree by tree
+*/
+
+class kdForest : public fastann::nn_obj<float> {
+
+    public:
+
+        struct node {
+            // internal: children are nodes first and first+1 (relative to the tree),
+            // leaf (dim==leafDim): centres leafIDs[first, first+count) (relative to the tree)
+            float split;
+            uint32_t dim, first, count;
+        };
+
+        static uint32_t const leafDim= 0xFFFFFFFF;
+
+        // builds the forest with numThreads (0: one per core)
+        kdForest( clstCentres const &clstCentres_obj, uint32_t numTrees= 8, uint32_t nChecks= 1024, uint32_t leafSize= 8, uint32_t numThreads= 0 );
+
+        // memory-maps the forest saved in fileName, if it is missing, out of date (older than
+        // clstFn or of a clstFn with a different size/checksum) or has different parameters,
+        // builds and saves it first
+        kdForest( clstCentres const &clstCentres_obj, std::string const &fileName, std::string const &clstFn, uint32_t numTrees= 8, uint32_t nChecks= 1024, uint32_t leafSize= 8, uint32_t numThreads= 0 );
+
+        ~kdForest();
+
+        // a forest not built from a clstFn is saved with a zero checksum, so the
+        // constructor above rebuilds it rather than trusting it
+        void
+            save( std::string const &fileName ) const;
+
+        static inline std::string
+            getFn( std::string const &clstFn ) { return clstFn + ".kdf"; }
+
+        void
+            add_points( float const *pnts, unsigned N );
+
+        void
+            search_nn( float const *qus, unsigned N, unsigned *argmins, float *mins ) const;
+
+        void
+            search_knn( float const *qus, unsigned N, unsigned KNN, unsigned *argmins, float *mins ) const;
+
+        unsigned
+            ndims() const { return clstCentres_->numDims; }
+
+        unsigned
+            npoints() const { return clstCentres_->numClst; }
+
+    private:
+
+        // builds into inRam_
+        void
+            build( uint32_t numTrees, uint32_t leafSize, uint32_t numThreads );
+
+        // points the members into a serialised forest, false if it is malformed
+        bool
+            parse( char const *data, uint64_t size );
+
+        clstCentres const *clstCentres_;
+        uint32_t const nChecks_;
+        uint32_t numTrees_, leafSize_;
+        uint64_t clstSize_, clstChecksum_;
+
+        mappedFile *file_;
+        std::vector<char> inRam_;
+
+        char const *data_;
+        uint64_t size_;
+        uint32_t const *treeBegin_;
+        node const *nodes_;
+        uint32_t const *leafIDs_;
+
+        DISALLOW_COPY_AND_ASSIGN(kdForest)
+};
+
+#endif
@@ -22,21 +22,13 @@ No usage or redistribution is allowed without explicit permission.
 void
 nnCompressed::findKNN( compressorWithDistance const &compDist, std::string const &data, float const qVec[], uint32_t KNN, std::vector<vecIDdist> &vecIDdists ) {
     
-    std::vector<float> dsSq;
-    compDist.getDistsSq(qVec, data, dsSq);
-    KNN= KNN<dsSq.size() ? KNN : dsSq.size();
+    // the compressor keeps only the KNN (e.g. productQuant scans the codes with lookup tables into a heap)
+    std::vector< std::pair<float, uint32_t> > distSqInds;
+    compDist.getKNN(qVec, data, KNN, distSqInds);
     
     vecIDdists.clear();
-    vecIDdists.reserve(dsSq.size());
-    for (uint32_t i= 0; i<dsSq.size(); ++i)
-        vecIDdists.push_back( vecIDdist(i, dsSq[i]) );
-    
-    std::partial_sort( vecIDdists.begin(), vecIDdists.begin()+KNN, vecIDdists.end() );
-    
-    // I expected this to be faster than partial_sort, but it doesn't seem to be
-    // seems like I want findKNN to return sorted vecIDs anyway
-    // std::nth_element( vecIDdists.begin(), vecIDdists.begin()+KNN, vecIDdists.end() );
-    
-    vecIDdists.resize( KNN );
+    vecIDdists.reserve(distSqInds.size());
+    for (uint32_t i= 0; i<distSqInds.size(); ++i)
+        vecIDdists.push_back( vecIDdist(distSqInds[i].second, distSqInds[i].first) );
     
 }
@@ -0,0 +1,174 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "voc_tree.h"
+
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "compact_dist.h"
+
+
+
+static char const vtreeMagic[8]= {'V','I','S','E','V','T','R','2'};
+static uint64_t const vtreeHeaderSize= 48;
+
+
+
+vocTree::vocTree( clstCentres const &clstCentres_obj, std::string const &fileName, std::string const &clstFn, uint32_t beam )
+    : clstCentres_(&clstCentres_obj), file_(new mappedFile(fileName.c_str())) {
+
+    if (!file_->isOpen() || file_->size()<vtreeHeaderSize || memcmp(file_->data(), vtreeMagic, 8)!=0){
+        delete file_;
+        throw std::runtime_error("vocTree::vocTree: Missing or corrupt " + fileName);
+    }
+    uint32_t params[4];
+    uint64_t clstFile[2];
+    memcpy(params, file_->data()+8, sizeof(params));
+    memcpy(clstFile, file_->data()+8+sizeof(params), sizeof(clstFile));
+    branching_= params[1];
+    depth_= params[2];
+    if (depth_>32){
+        delete file_;
+        throw std::runtime_error("vocTree::vocTree: Corrupt " + fileName);
+    }
+    beam_= beam>0 ? beam : std::max(params[3], static_cast<uint32_t>(1));
+
+    // levels 1..depth-1 are internal, level depth are the words
+    uint64_t numWords= 1;
+    levelBegin_.assign(depth_+1, 0);
+    for (uint32_t level= 1; level<=depth_ && branching_>1 && numWords<=0xFFFFFFFFULL; ++level){
+        levelBegin_[level]= (level==1) ? 0 : levelBegin_[level-1] + numWords;
+        numWords*= branching_;
+    }
+    if (params[0]!=clstCentres_->numDims || branching_<2 || depth_==0 || numWords!=clstCentres_->numClst ||
+        file_->size() != vtreeHeaderSize + levelBegin_[depth_]*params[0]*sizeof(float)){
+        delete file_;
+        throw std::runtime_error("vocTree::vocTree: " + fileName + " does not match the cluster centres");
+    }
+    // numWords alone misses a vocabulary of the same size replaced by other centres
+    uint64_t clstSize, clstChecksum;
+    getFileChecksum(clstFn.c_str(), clstSize, clstChecksum);
+    if (clstFile[0]!=clstSize || clstFile[1]!=clstChecksum){
+        delete file_;
+        throw std::runtime_error("vocTree::vocTree: " + fileName + " was trained for a different " + clstFn);
+    }
+    centres_= reinterpret_cast<float const *>(file_->data() + vtreeHeaderSize);
+}
+
+
+
+vocTree::~vocTree(){
+    delete file_;
+}
+
+
+
+void
+vocTree::save( std::string const &fileName, std::string const &clstFn, uint32_t numDims, uint32_t branching, uint32_t depth, uint32_t beam, std::vector<float> const &internalCentres ){
+
+    std::string const tempFn= fileName + boost::filesystem::unique_path(".%%%%-%%%%-%%%%-%%%%").native();
+    FILE *f= fopen(tempFn.c_str(), "wb");
+    if (f==NULL)
+        throw std::runtime_error("vocTree::save: Can't write " + tempFn);
+    uint32_t const params[4]= {numDims, branching, depth, beam}, padding[2]= {0, 0};
+    uint64_t clstFile[2];
+    getFileChecksum(clstFn.c_str(), clstFile[0], clstFile[1]);
+    bool ok= fwrite(vtreeMagic, 1, 8, f)==8 &&
+             fwrite(params, sizeof(uint32_t), 4, f)==4 &&
+             fwrite(clstFile, sizeof(uint64_t), 2, f)==2 &&
+             fwrite(padding, sizeof(uint32_t), 2, f)==2;
+    if (ok && !internalCentres.empty())
+        ok= fwrite(&internalCentres[0], sizeof(float), internalCentres.size(), f)==internalCentres.size();
+    fclose(f);
+    if (!ok){
+        boost::filesystem::remove(tempFn);
+        throw std::runtime_error("vocTree::save: Can't write " + tempFn);
+    }
+    boost::filesystem::rename(tempFn, fileName);
+}
+
+
+
+void
+vocTree::add_points( float const *pnts, unsigned N ){
+    throw std::runtime_error("vocTree::add_points: Not supported");
+}
+
+
+
+void
+vocTree::search_nn( float const *qus, unsigned N, unsigned *argmins, float *mins ) const {
+    search_knn(qus, N, 1, argmins, mins);
+}
+
+
+
+void
+vocTree::search_knn( float const *qus, unsigned N, unsigned KNN, unsigned *argmins, float *mins ) const {
+
+    uint32_t const numDims= clstCentres_->numDims;
+    uint32_t const K= std::min(KNN, clstCentres_->numClst);
+    // enough parents of the words to produce K of them
+    uint32_t const lastBeam= std::max(beam_, (K+branching_-1)/branching_);
+
+    std::vector<float> q(numDims);
+    std::vector< std::pair<float, uint32_t> > nodes, children; // (distSq, node within the level)
+    nodes.reserve(lastBeam);
+    children.reserve(lastBeam*branching_);
+
+    for (unsigned iQ= 0; iQ<N; ++iQ){
+
+        float const *qu= qus + static_cast<uint64_t>(iQ)*numDims;
+        clstCentres_->prepareQuery(qu, &q[0]);
+        nodes.assign(1, std::make_pair(0.0f, 0));
+
+        for (uint32_t level= 1; level<=depth_; ++level){
+
+            children.clear();
+            for (uint32_t iNode= 0; iNode<nodes.size(); ++iNode){
+                uint32_t const childBegin= nodes[iNode].second*branching_;
+                for (uint32_t child= childBegin; child<childBegin+branching_; ++child)
+                    children.push_back( std::make_pair(
+                        level<depth_ ?
+                            compactDist::l2(qu, centres_ + (levelBegin_[level]+child)*numDims, numDims) :
+                            clstCentres_->distSqPrepared(&q[0], child),
+                        child) );
+            }
+
+            uint32_t const keep= std::min( static_cast<uint32_t>(children.size()),
+                                           level==depth_ ? K : (level+1==depth_ ? lastBeam : beam_) );
+            std::partial_sort(children.begin(), children.begin()+keep, children.end());
+            children.resize(keep);
+            nodes.swap(children);
+        }
+
+        for (uint32_t k= 0; k<nodes.size(); ++k){
+            argmins[iQ*KNN+k]= nodes[k].second;
+            mins[iQ*KNN+k]= nodes[k].first;
+        }
+        // as clstCentresExactNN, unfound neighbours are numClst at FLT_MAX
+        for (uint32_t k= nodes.size(); k<KNN; ++k){
+            argmins[iQ*KNN+k]= clstCentres_->numClst;
+            mins[iQ*KNN+k]= FLT_MAX;
+        }
+    }
+
+}
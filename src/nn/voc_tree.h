@@ -0,0 +1,99 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _VOC_TREE_H_
+#define _VOC_TREE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <fastann.hpp>
+
+#include "clst_centres.h"
+#include "macros.h"
+#include "mapped_file.h"
+
+
+
+/*
+Vocabulary tree (hierarchical k-means, Nister & Stewenius) with branching^depth words.
+The words are the leaves, i.e. the clstCentres of clstFn in breadth-first order, so the
+word IDs are the same as for a flat vocabulary; the internal nodes are kept in
+getFn(clstFn), which is only valid for the clstFn it was trained with. Assignment descends the tree keeping the beam closest nodes at every level,
+i.e. costs beam*branching*depth distances (beam=1: greedy).
+
+Organization of the internal nodes file (native byte order):
+
+char[8] magic "VISEVTR2"
+uint32_t numDims, branching, depth, beam (default for assignment)
+uint64_t clstSize, clstChecksum   of clstFn (see getFileChecksum)
+uint32_t zero padding (to 48 bytes)
+float centres[numDims*(branching + branching^2 + ... + branching^(depth-1))]
+    level by level, children of node i of a level are nodes [i*branching, (i+1)*branching) of the next
+*/
+
+class vocTree : public fastann::nn_obj<float> {
+
+    public:
+
+        // memory-maps fileName, the leaves are clstCentres_obj (any storage) loaded from clstFn,
+        // beam=0: use the saved one. Throws std::runtime_error if fileName is missing, corrupt or
+        // doesn't match clstFn (e.g. the vocabulary was retrained or replaced since), the tree
+        // can't be rebuilt without the training descriptors
+        vocTree( clstCentres const &clstCentres_obj, std::string const &fileName, std::string const &clstFn, uint32_t beam= 0 );
+
+        ~vocTree();
+
+        // internalCentres as in the file, for the leaves in clstFn, written to a temporary file first
+        static void
+            save( std::string const &fileName, std::string const &clstFn, uint32_t numDims, uint32_t branching, uint32_t depth, uint32_t beam, std::vector<float> const &internalCentres );
+
+        static inline std::string
+            getFn( std::string const &clstFn ) { return clstFn + ".vtree"; }
+
+        void
+            add_points( float const *pnts, unsigned N );
+
+        void
+            search_nn( float const *qus, unsigned N, unsigned *argmins, float *mins ) const;
+
+        void
+            search_knn( float const *qus, unsigned N, unsigned KNN, unsigned *argmins, float *mins ) const;
+
+        unsigned
+            ndims() const { return clstCentres_->numDims; }
+
+        unsigned
+            npoints() const { return clstCentres_->numClst; }
+
+        inline uint32_t
+            branching() const { return branching_; }
+
+        inline uint32_t
+            depth() const { return depth_; }
+
+    private:
+
+        clstCentres const *clstCentres_;
+        mappedFile *file_;
+        uint32_t branching_, depth_, beam_;
+        // centres of the internal nodes, levelBegin_[l]: first node of level l (l>=1)
+        float const *centres_;
+        std::vector<uint64_t> levelBegin_;
+
+        DISALLOW_COPY_AND_ASSIGN(vocTree)
+};
+
+#endif
@@ -16,80 +16,80 @@ No usage or redistribution is allowed without explicit permission.
 
 #include <string>
 #include <stdio.h>
+#include <string.h>
 
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
 
+#include "feat_file.h"
+#include "harlap_sift.h"
+#include "hesaff_sift.h"
 #include "image_util.h"
 #include "macros.h"
 
 
 
+// colorDescriptor --outputFormat binary, read through a memory map
 void readRegsAndDescs( const char fileName[], uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs, uint32_t const expectDim ){
     
-    int ret;
     uint32_t numDims, elementsPerPoint, bytesPerElement;
     
-    FILE *fin= fopen(fileName, "rb");
+    mappedFile f(fileName);
     
-    if (fin==NULL){
+    if (!f.isOpen() || f.size()<32){
         regions.clear();
         numFeats= 0;
         descs= new float[0];
         return;
     }
     
-    {
-        uint8_t temp[16];
-        ret= fread(temp, 1, 16, fin); // ignore headers
-    }
+    char const *in= f.data() + 16; // ignore headers
     
-    ret= fread(&elementsPerPoint, sizeof(elementsPerPoint), 1, fin);
+    memcpy(&elementsPerPoint, in, sizeof(elementsPerPoint)); in+= sizeof(elementsPerPoint);
     ASSERT( elementsPerPoint == 5); // x y scale orientation cornerness
-    ret= fread(&numDims, sizeof(numDims), 1, fin);
-    ret= fread(&numFeats, sizeof(numFeats), 1, fin);
+    memcpy(&numDims, in, sizeof(numDims)); in+= sizeof(numDims);
+    memcpy(&numFeats, in, sizeof(numFeats)); in+= sizeof(numFeats);
     if (numFeats==0){
         regions.clear();
         descs= new float[0];
         return;
     }
     ASSERT(numDims == expectDim);
-    ret= fread(&bytesPerElement, sizeof(numFeats), 1, fin);
+    memcpy(&bytesPerElement, in, sizeof(bytesPerElement)); in+= sizeof(bytesPerElement);
     ASSERT(bytesPerElement == 8);
+    ASSERT( f.size() >= 32 + static_cast<uint64_t>(elementsPerPoint + numDims) * numFeats * sizeof(double) );
     
-    double *regsRaw= new double[elementsPerPoint*numFeats];
-    ret= fread(regsRaw, sizeof(double), elementsPerPoint*numFeats, fin);
-    
-    double *itRegs= regsRaw;
+    double reg[5];
     double r, a;
     regions.resize( numFeats );
-    for (uint32_t i=0; i<numFeats; ++i, itRegs+= 5){
-        r= *(itRegs+2);
+    for (uint32_t i=0; i<numFeats; ++i, in+= sizeof(reg)){
+        memcpy(reg, in, sizeof(reg));
+        r= reg[2];
         a= 1.0/(r*r);
-        regions[i].set( *itRegs, *(itRegs+1), a, 0.0, a);
+        regions[i].set( reg[0], reg[1], a, 0.0, a);
     }
     
-    delete []regsRaw;
-    
-    double *descsRaw= new double[numDims*numFeats];
-    ret= fread(descsRaw, sizeof(double), numDims*numFeats, fin);
-    fclose(fin);
-    REMOVE_UNUSED_WARNING(ret);
-    
     descs= new float[numDims*numFeats];
     float *descsEnd= descs + numDims*numFeats;
-    double *descsRawIt= descsRaw;
-    for (float *descsIt= descs; descsIt != descsEnd; ++descsIt, ++descsRawIt)
-        *descsIt= *descsRawIt;
-    delete []descsRaw;
+    double v;
+    for (float *descsIt= descs; descsIt != descsEnd; ++descsIt, in+= sizeof(double)){
+        memcpy(&v, in, sizeof(double));
+        *descsIt= v;
+    }
 }
 
 
 
-vanDeSande::vanDeSande(std::string descriptor, double harrisK, double laplaceThreshold)
+// measurement region of the descriptor relative to the detected scale, as in James's engine_3
+static float const scaleMulti= 1.732;
+
+
+
+vanDeSande::vanDeSande(std::string descriptor, double harrisK, double laplaceThreshold, bool external)
         : descriptor_(descriptor),
           harrisK_(harrisK),
-          laplaceThreshold_(laplaceThreshold) {
+          laplaceThreshold_(laplaceThreshold),
+          external_(external) {
     if (descriptor=="opponentsift")
         numDims_= 384;
     else if (descriptor=="sift")
@@ -102,6 +102,38 @@ vanDeSande::vanDeSande(std::string descriptor, double harrisK, double laplaceThr
 
 void vanDeSande::getFeats( const char fileName[], uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const {
     
+    if (external_){
+        getFeatsExternal(fileName, numFeats, regions, descs);
+        return;
+    }
+    
+    bool const opponent= (descriptor_=="opponentsift");
+    
+    // decode the image only once: JPEGs by the KMCode, the rest by Magick++ (no temporary JPEG)
+    uint32_t width, height;
+    std::string format;
+    bool const isJpeg= imageUtil::readHeader(fileName, width, height, format) && format=="JPEG";
+    
+    if (isJpeg && KM_hesaff_sift::isJpegFilename(fileName)){
+        // a JPEG the KMCode can't decode (corrupt, not gray/RGB) gives no features
+        KM_harlap_sift::extract(fileName, opponent, harrisK_, laplaceThreshold_, scaleMulti, regions, numFeats, descs);
+    } else {
+        std::vector<uint8_t> rgb;
+        if (!imageUtil::decodeRGB(fileName, width, height, rgb)){
+            numFeats= 0;
+            regions.clear();
+            descs= new float[0];
+            return;
+        }
+        KM_harlap_sift::extract(&rgb[0], width, height, opponent, harrisK_, laplaceThreshold_, scaleMulti, regions, numFeats, descs);
+    }
+    
+}
+
+
+
+void vanDeSande::getFeatsExternal( const char fileName[], uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const {
+    
     std::string tempDescsFn= boost::filesystem::unique_path("/tmp/rr_feat_%%%%-%%%%-%%%%-%%%%.txt").native();
     
     // convert to jpg if it isn't jpg already
@@ -25,13 +25,16 @@ No usage or redistribution is allowed without explicit permission.
 
 
 // (Colour)SIFT by van de Sande: harrislaplace + descriptor
-// NOTE: don't use when memory consumption is large - all those should be compiled as libraries into the code, as there is a massive overhead for calling system
+// Computed by van de Sande's colorDescriptor binary; external==false computes them in-process
+// instead (KM_harlap_sift, thread-safe, the image is decoded once), which is a reimplementation
+// and not bit-exact (see tests/colour_sift_compare)
+// NOTE: don't use the external one when memory consumption is large, as there is a massive overhead for calling system
 class vanDeSande : public featGetter {
     
     public:
         
         // defaults are harrisK==0.06, laplaceThreshold==0.03, but those give too many descriptors
-        vanDeSande(std::string descriptor, double harrisK= 0.1, double laplaceThreshold= 0.04);
+        vanDeSande(std::string descriptor, double harrisK= 0.1, double laplaceThreshold= 0.04, bool external= true);
         
         void
             getFeats( const char fileName[], uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const;
@@ -45,9 +48,14 @@ class vanDeSande : public featGetter {
         inline uint8_t getDtypeCode() const { return 0; /* uint8 */ }
         
     private:
+        
+        void
+            getFeatsExternal( const char fileName[], uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const;
+        
         uint32_t numDims_;
         std::string const descriptor_;
         double const harrisK_, laplaceThreshold_;
+        bool const external_;
 };
 
 #endif
@@ -0,0 +1,134 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "feat_cache.h"
+
+#include <stdio.h>
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+
+#include "desc_to_hell.h"
+#include "feat_file.h"
+
+
+
+featCache::featCache(featGetter const *featGetterObj, std::string const &spec, std::string const &cacheDir, bool RootSIFT)
+        : featGetterObj_(featGetterObj),
+          spec_(spec),
+          cacheDir_(cacheDir),
+          RootSIFT_(RootSIFT) {
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(cacheDir_, ec);
+    if (ec)
+        std::cout<<"featCache::featCache: warning can't create "<<cacheDir_<<" ("<<ec.message()<<"), features will be extracted without caching\n";
+}
+
+
+
+featCache::~featCache(){
+    delete featGetterObj_;
+}
+
+
+
+// two independent 64-bit FNV-1a style hashes of the contents
+static void
+contentHash(char const *data, size_t size, uint64_t &h1, uint64_t &h2){
+    h1= 14695981039346656037ULL;
+    h2= 0x9ae16a3b2f90404fULL;
+    for (char const *it= data, *end= data+size; it!=end; ++it){
+        uint8_t const c= static_cast<uint8_t>(*it);
+        h1= (h1 ^ c) * 1099511628211ULL;
+        h2= (h2 ^ c) * 0x100000001b3ULL + (h2 >> 29);
+    }
+}
+
+
+
+std::string
+featCache::getCacheFn( const char fileName[] ) const {
+    mappedFile f(fileName);
+    if (!f.isOpen() || f.size()==0)
+        return "";
+    uint64_t h1, h2;
+    contentHash(f.data(), f.size(), h1, h2);
+    char key[64];
+    sprintf(key, "%016llx%016llx_%llu",
+            static_cast<unsigned long long>(h1), static_cast<unsigned long long>(h2),
+            static_cast<unsigned long long>(f.size()));
+    // shard into subdirectories to keep them small
+    return cacheDir_ + "/" + std::string(key, 2) + "/" + key + "_" + spec_ + ".feat";
+}
+
+
+
+void
+featCache::getFeats( const char fileName[], uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const {
+
+    std::string const cacheFn= getCacheFn(fileName);
+
+    bool cached= false;
+    if (!cacheFn.empty()){
+        cached= featFile::read(cacheFn.c_str(), numFeats, regions, descs, featGetterObj_->numDims());
+        if (!cached)
+            delete []descs;
+    }
+
+    if (!cached){
+
+        featGetterObj_->getFeats(fileName, numFeats, regions, descs);
+
+        if (!cacheFn.empty()){
+            // write to a temporary file first so that concurrent readers never see a partial entry;
+            // the cache is only an optimisation so failing to write it doesn't fail the extraction
+            boost::filesystem::path const p(cacheFn);
+            std::string const tempFn= cacheFn + boost::filesystem::unique_path(".%%%%-%%%%-%%%%-%%%%").native();
+            boost::system::error_code ec;
+            boost::filesystem::create_directories(p.parent_path(), ec);
+            if (!ec && !featFile::write(tempFn.c_str(), regions, descs, featGetterObj_->numDims(), featGetterObj_->getDtypeCode()))
+                ec= boost::system::errc::make_error_code(boost::system::errc::io_error);
+            if (!ec)
+                boost::filesystem::rename(tempFn, cacheFn, ec);
+            if (ec){
+                std::cout<<"featCache::getFeats: warning can't write "<<cacheFn<<" ("<<ec.message()<<")\n";
+                boost::system::error_code ecRemove;
+                boost::filesystem::remove(tempFn, ecRemove);
+            }
+        }
+    }
+
+    if (RootSIFT_)
+        descToHell::convertToHell( numDims(), numFeats, descs );
+}
+
+
+
+void
+featCache::getFeats( const char fileName[], uint32_t xl, uint32_t xu, uint32_t yl, uint32_t yu, uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const {
+    featGetterObj_->getFeats(fileName, xl, xu, yl, yu, numFeats, regions, descs);
+    if (RootSIFT_)
+        descToHell::convertToHell( numDims(), numFeats, descs );
+}
+
+
+
+std::string
+featCache::getRawDescs(float const *descs, uint32_t numFeats) const {
+    if (RootSIFT_)
+        return std::string(
+                   reinterpret_cast<const char*>(descs),
+                   numFeats*numDims()*sizeof(float)/sizeof(char) );
+    return featGetterObj_->getRawDescs(descs, numFeats);
+}
@@ -0,0 +1,72 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _FEAT_CACHE_H_
+#define _FEAT_CACHE_H_
+
+#include <string>
+
+#include "feat_getter.h"
+#include "macros.h"
+
+
+
+// Persistent content-addressed feature store wrapping a featGetter:
+// features of an image are kept in cacheDir as a binary feature file (see feat_file.h),
+// keyed by a hash of the image file contents and the extractor spec, so any stage
+// (training, indexing, querying) or a rebuild with a different vocabulary reuses them.
+// Entries are written atomically, so processes/threads can share a cache directory.
+// The directory is not size-limited; if it can't be written the features are
+// extracted as usual (with a warning) instead of failing.
+// Crops (getFeats with a bounding box) are not cached.
+class featCache : public featGetter {
+
+    public:
+
+        // takes ownership of featGetterObj, spec has to uniquely identify its output.
+        // RootSIFT: featGetterObj produces SIFT which is stored as such and converted
+        // to RootSIFT after loading, so that SIFT and RootSIFT users share the entries.
+        featCache(featGetter const *featGetterObj, std::string const &spec, std::string const &cacheDir, bool RootSIFT= false);
+
+        ~featCache();
+
+        void
+            getFeats( const char fileName[], uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const;
+
+        void
+            getFeats( const char fileName[], uint32_t xl, uint32_t xu, uint32_t yl, uint32_t yu, uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const;
+
+        inline uint32_t
+            numDims() const { return featGetterObj_->numDims(); }
+
+        std::string
+            getRawDescs(float const *descs, uint32_t numFeats) const;
+
+        inline uint8_t
+            getDtypeCode() const { return RootSIFT_ ? 4 /* float32 */ : featGetterObj_->getDtypeCode(); }
+
+        // empty if the image can't be read
+        std::string
+            getCacheFn( const char fileName[] ) const;
+
+    private:
+
+        featGetter const *featGetterObj_;
+        std::string const spec_, cacheDir_;
+        bool const RootSIFT_;
+
+        DISALLOW_COPY_AND_ASSIGN(featCache)
+};
+
+#endif
@@ -0,0 +1,320 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "feat_file.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+
+
+
+namespace featFile {
+
+static char const magic[8]= {'V','I','S','E','F','E','A','T'};
+
+
+
+inline uint32_t
+dtypeSize(uint8_t dtypeCode){
+    return dtypeCode==0 ? 1 : (dtypeCode==4 ? 4 : 0);
+}
+
+
+
+uint64_t
+fileSize(uint32_t numFeats, uint32_t numDims, uint8_t dtypeCode){
+    return headerSize() +
+        static_cast<uint64_t>(numFeats) * (ellipse::getSize() + numDims * dtypeSize(dtypeCode));
+}
+
+
+
+bool
+isBinary(char const fileName[]){
+    char buf[8];
+    FILE *f= fopen(fileName, "rb");
+    if (f==NULL)
+        return false;
+    bool res= fread(buf, 1, 8, f)==8 && memcmp(buf, magic, 8)==0;
+    fclose(f);
+    return res;
+}
+
+
+
+// writes size bytes, false on a short write
+static inline bool
+writeAll(FILE *f, void const *data, size_t size){
+    return size==0 || fwrite(data, 1, size, f)==size;
+}
+
+
+
+bool
+write(char const fileName[],
+      std::vector<ellipse> const &regions,
+      float const *descs, uint32_t numDims,
+      uint8_t dtypeCode){
+
+    ASSERT( dtypeSize(dtypeCode)>0 );
+    uint32_t const numFeats= regions.size();
+
+    // plain buffered writes, every one checked: a full disk has to give false rather than
+    // the SIGBUS a memory-mapped sparse file would get
+    FILE *f= fopen(fileName, "wb");
+    if (f==NULL)
+        return false;
+
+    char header[24];
+    memcpy(header, magic, 8);
+    memcpy(header+8, &version, sizeof(uint32_t));
+    memcpy(header+12, &numFeats, sizeof(uint32_t));
+    memcpy(header+16, &numDims, sizeof(uint32_t));
+    memset(header+20, 0, 4);
+    header[20]= dtypeCode;
+    bool ok= writeAll(f, header, headerSize());
+
+    std::vector<char> buf(static_cast<size_t>(numFeats) * ellipse::getSize());
+    char *bufIter= buf.empty() ? NULL : &buf[0];
+    for (uint32_t i= 0; i<numFeats; ++i)
+        regions[i].setMem(bufIter);
+    ok= ok && writeAll(f, buf.empty() ? NULL : &buf[0], buf.size());
+
+    uint64_t const numElements= static_cast<uint64_t>(numFeats)*numDims;
+    if (dtypeCode==4)
+        ok= ok && writeAll(f, descs, numElements*sizeof(float));
+    else {
+        // convert in chunks to avoid a second copy of all descriptors
+        uint64_t const chunkSize= 1<<20;
+        std::vector<uint8_t> chunk(std::min(numElements, chunkSize));
+        for (uint64_t start= 0; ok && start<numElements; start+= chunkSize){
+            uint64_t const end= std::min(start+chunkSize, numElements);
+            float const *inIter= descs + start, *inIterEnd= descs + end;
+            for (uint8_t *outIter= &chunk[0]; inIter!=inIterEnd; ++inIter, ++outIter)
+                *outIter= static_cast<uint8_t>(*inIter + 0.1); // +0.1 is to counter numerical issues because cast does floor()
+            ok= writeAll(f, &chunk[0], end-start);
+        }
+    }
+
+    // fclose flushes the buffer so it can also hit the full disk
+    ok= (fclose(f)==0) && ok;
+    if (!ok)
+        unlink(fileName);
+    return ok;
+}
+
+
+
+// parses the header and checks the size, pointer to the regions or NULL if malformed
+static char const *
+parseHeader(mappedFile const &f, uint32_t &numFeats, uint32_t &numDims, uint8_t &dtypeCode){
+    if (f.size()<headerSize() || memcmp(f.data(), magic, 8)!=0)
+        return NULL;
+    uint32_t fileVersion;
+    memcpy(&fileVersion, f.data()+8, sizeof(uint32_t));
+    memcpy(&numFeats, f.data()+12, sizeof(uint32_t));
+    memcpy(&numDims, f.data()+16, sizeof(uint32_t));
+    dtypeCode= f.data()[20];
+    if (fileVersion!=version || dtypeSize(dtypeCode)==0 ||
+        f.size()!=fileSize(numFeats, numDims, dtypeCode))
+        return NULL;
+    return f.data() + headerSize();
+}
+
+
+
+bool
+read(char const fileName[],
+     uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs,
+     uint32_t expectDim){
+
+    numFeats= 0;
+    regions.clear();
+    descs= NULL;
+
+    mappedFile f(fileName);
+    uint32_t numDims;
+    uint8_t dtypeCode;
+    char const *in= f.isOpen() ? parseHeader(f, numFeats, numDims, dtypeCode) : NULL;
+
+    if (in==NULL){
+        numFeats= 0;
+        if (f.isOpen() && f.size()>0 && !isBinary(fileName))
+            return readText(fileName, numFeats, regions, descs);
+        descs= new float[0];
+        return false;
+    }
+
+    if (expectDim!=0 && numFeats>0 && numDims!=expectDim){
+        numFeats= 0;
+        descs= new float[0];
+        return false;
+    }
+
+    regions.resize(numFeats);
+    char *inIter= const_cast<char*>(in);
+    for (uint32_t i= 0; i<numFeats; ++i)
+        regions[i].setMem(inIter);
+
+    uint64_t const numElements= static_cast<uint64_t>(numFeats)*numDims;
+    descs= new float[numElements];
+    if (dtypeCode==4)
+        memcpy(descs, inIter, numElements*sizeof(float));
+    else {
+        uint8_t const *uIter= reinterpret_cast<uint8_t const *>(inIter);
+        float *descsEnd= descs + numElements;
+        for (float *descsIt= descs; descsIt!=descsEnd; ++descsIt, ++uIter)
+            *descsIt= static_cast<float>(*uIter);
+    }
+    return true;
+}
+
+
+
+bool
+readRegions(char const fileName[], uint32_t &numRegs, std::vector<ellipse> &regions){
+
+    numRegs= 0;
+    regions.clear();
+
+    mappedFile f(fileName);
+    uint32_t numDims;
+    uint8_t dtypeCode;
+    char const *in= f.isOpen() ? parseHeader(f, numRegs, numDims, dtypeCode) : NULL;
+
+    if (in==NULL){
+        numRegs= 0;
+        if (f.isOpen() && f.size()>0 && !isBinary(fileName))
+            return readRegionsText(fileName, numRegs, regions);
+        return false;
+    }
+
+    regions.resize(numRegs);
+    char *inIter= const_cast<char*>(in);
+    for (uint32_t i= 0; i<numRegs; ++i)
+        regions[i].setMem(inIter);
+    return true;
+}
+
+
+
+void
+writeRegionsText(char const fileName[], std::vector<ellipse> const &regions){
+
+    std::ofstream fout( fileName );
+
+    double x, y, a, b, c;
+    fout<<"1.0\n";
+    fout<<regions.size()<<"\n";
+    for (uint32_t i=0; i<regions.size(); ++i){
+        regions[i].get(x,y,a,b,c);
+        fout<<x<<" "<<y<<" "<<a<<" "<<b<<" "<<c<<"\n";
+    }
+
+    fout.close();
+
+}
+
+
+
+bool
+readRegionsText(char const fileName[], uint32_t &numRegs, std::vector<ellipse> &regions){
+
+    std::ifstream fin( fileName );
+    if (!fin.is_open()){
+        regions.clear();
+        numRegs= 0;
+        return false;
+    }
+
+    double temp_, x, y, a, b, c;
+    fin>>temp_;
+    fin>>numRegs;
+    regions.resize( numRegs );
+    for (uint32_t i=0; i<numRegs; ++i){
+        fin>>x>>y>>a>>b>>c;
+        regions[i].set(x,y,a,b,c);
+    }
+
+    fin.close();
+    return true;
+
+}
+
+
+
+void
+writeText(char const fileName[],
+          std::vector<ellipse> const &regions,
+          float const *descs, uint32_t numDims){
+
+    std::ofstream fout( fileName );
+
+    double x, y, a, b, c;
+    fout<<numDims<<" "<<regions.size()<<"\n";
+    float const *descIter= descs;
+    for (uint32_t i=0; i<regions.size(); ++i){
+        regions[i].get(x,y,a,b,c);
+        fout<<x<<" "<<y<<" 0 "<<a<<" "<<b<<" "<<c;
+        for (uint32_t iDim=0; iDim<numDims; ++iDim, ++descIter)
+            fout<<" "<< *descIter;
+        fout<<"\n";
+    }
+
+    fout.close();
+
+}
+
+
+
+bool
+readText(char const fileName[],
+         uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs){
+
+    double temp_, x, y, a, b, c;
+    uint32_t numDims;
+
+    std::ifstream fin( fileName );
+    if (!fin.is_open()){
+        regions.clear();
+        numFeats= 0;
+        descs= new float[0];
+        return false;
+    }
+
+    fin>>numDims>>numFeats;
+
+    regions.resize( numFeats );
+    uint32_t iDim;
+
+    descs= new float[numFeats*numDims];
+    float *descIter= descs;
+
+    for (uint32_t i=0; i<numFeats; ++i){
+        fin>>x>>y>>temp_>>a>>b>>c;
+        regions[i].set(x,y,a,b,c);
+        for (iDim=0; iDim<numDims; ++iDim, ++descIter)
+            fin>> *descIter;
+    }
+
+    fin.close();
+    return true;
+
+}
+
+};
@@ -0,0 +1,95 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _FEAT_FILE_H_
+#define _FEAT_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "ellipse.h"
+#include "macros.h"
+#include "mapped_file.h"
+
+
+
+// Binary feature file (regions + descriptors of one image), native byte order:
+//
+//   char[8] magic "VISEFEAT", uint32 version, uint32 numFeats, uint32 numDims,
+//   uint8 dtypeCode (0: uint8, 4: float32, as featGetter::getDtypeCode), 3 bytes padding,
+//   numFeats regions as 5 x float32 (x y a b c, as ellipse::setMem),
+//   numFeats x numDims descriptors of dtypeCode
+//
+// numDims can be 0 for region-only files.
+// The text formats (as produced by KMCode's detect_points / compute_descriptors -o3)
+// are kept for import/export, and read() accepts them as well.
+
+namespace featFile {
+
+    uint32_t const version= 1;
+
+    inline uint32_t
+        headerSize() { return 24; }
+
+    // bytes needed for a file with these parameters
+    uint64_t
+        fileSize(uint32_t numFeats, uint32_t numDims, uint8_t dtypeCode);
+
+    bool
+        isBinary(char const fileName[]);
+
+    // dtypeCode 0 stores descriptors as uint8 (they are assumed to be integers in [0,255], e.g. SIFT),
+    // 4 as float32. Returns false if the file can't be written (e.g. no space left)
+    bool
+        write(char const fileName[],
+              std::vector<ellipse> const &regions,
+              float const *descs, uint32_t numDims,
+              uint8_t dtypeCode= 4);
+
+    // descs is allocated with new[] (also when there are no features);
+    // expectDim==0 accepts any dimensionality, otherwise files with different (and non-zero) numDims are rejected.
+    // Returns false and no features if the file can't be opened or is malformed.
+    // Text files (compute_descriptors -o3 format) are imported transparently.
+    bool
+        read(char const fileName[],
+             uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs,
+             uint32_t expectDim= 0);
+
+    // regions only (also works with files containing descriptors)
+    bool
+        readRegions(char const fileName[], uint32_t &numRegs, std::vector<ellipse> &regions);
+
+    // ------- text import/export
+
+    // detect_points format: "1.0\n<numRegs>\n" then "x y a b c" per line
+    void
+        writeRegionsText(char const fileName[], std::vector<ellipse> const &regions);
+
+    bool
+        readRegionsText(char const fileName[], uint32_t &numRegs, std::vector<ellipse> &regions);
+
+    // compute_descriptors -o3 format: "<numDims> <numFeats>\n" then "x y theta a b c desc..." per line
+    void
+        writeText(char const fileName[],
+                  std::vector<ellipse> const &regions,
+                  float const *descs, uint32_t numDims);
+
+    bool
+        readText(char const fileName[],
+                 uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs);
+
+};
+
+#endif
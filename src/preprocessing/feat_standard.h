@@ -18,13 +18,16 @@ No usage or redistribution is allowed without explicit permission.
 #include <stdexcept>
 #include <set>
 
+#include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
+#include <boost/thread.hpp>
 
 #include "colour_sift.h"
 #include "desc_to_hell.h"
 #include "ellipse.h"
+#include "feat_cache.h"
 #include "feat_getter.h"
 #include "holidays_public.h"
 #include "macros.h"
@@ -53,11 +56,32 @@ class desc_KM_SIFT : public descGetter {
 
 
 
+// Hessian-Affine + SIFT by Krystian Mikolajczyk in a single in-process pass:
+// the image is decoded once and the detected regions are passed to SIFT in memory,
+// as opposed to splitRegDesc(reg_KM_HessAff, desc_KM_SIFT) which decodes it twice and
+// goes through temporary text files. Thread-safe.
+class feat_KM_HessAffSIFT : public featGetter {
+    public:
+        // numThreads>1: detection of a single image is multithreaded (e.g. for queries)
+        feat_KM_HessAffSIFT(float aScaleMulti= 3.0, bool aUpright= false, bool aRootSIFT= false, int aNumThreads= 1) : scaleMulti(aScaleMulti), upright(aUpright), RootSIFT(aRootSIFT), numThreads(aNumThreads) {}
+        void getFeats( const char fileName[], uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const;
+        std::string getRawDescs(float const *descs, uint32_t numFeats) const;
+        inline uint8_t getDtypeCode() const { return RootSIFT ? 4 /* float32 */ : 0 /* uint8 */; }
+        uint32_t numDims() const { return 128; }
+    private:
+        float const scaleMulti;
+        bool const upright, RootSIFT;
+        int const numThreads;
+};
+
+
+
 class featGetter_standard : public featGetter {
     
     public:
         
-        featGetter_standard( const char id[] ) :
+        // non-empty cacheDir: features are stored in / loaded from a featCache there
+        featGetter_standard( const char id[], std::string const &cacheDir= "" ) :
             featGetterObj(NULL), regionGetterObj(NULL), descGetterObj(NULL) {
             
             bool correctSpec= false;
@@ -68,37 +92,47 @@ class featGetter_standard : public featGetter {
             
             bool SIFTscale3= optionSet.count("scale3");
             
+            // identifies the features in the cache ("mt" doesn't change them)
+            std::string cacheSpec;
+            bool cacheRootSIFT= false;
+            
             if ( optionSet.count("hesaff") ){
                 
-                regionGetterObj= new reg_KM_HessAff();
                 bool upright= optionSet.count("up");
                 
-                if (SIFTscale3)
-                    descGetterObj= new desc_KM_SIFT(3, upright);
-                else
-                    // for some reason this was the original setting in James's engine_3, but 3 is default and works better
-                    descGetterObj= new desc_KM_SIFT(1.732, upright);
+                // for some reason 1.732 was the original setting in James's engine_3, but 3 is default and works better
+                float scaleMulti= SIFTscale3 ? 3 : 1.732;
                 
+                bool RootSIFT= false;
                 if ( optionSet.count("sift") ){
                     
                     correctSpec= true;
                     
                 } else if ( optionSet.count("rootsift") ) {
                     
-                    descGetter *dg= descGetterObj;
-                    descGetterObj= new descToHell(dg,true);
+                    RootSIFT= true;
                     correctSpec= true;
                 }
                 
-                featGetterObj= new splitRegDesc( regionGetterObj, descGetterObj );
+                int numThreads= optionSet.count("mt") ? boost::thread::hardware_concurrency() : 1;
+                
+                // cache SIFT for both SIFT and RootSIFT
+                cacheRootSIFT= RootSIFT && !cacheDir.empty();
+                cacheSpec= std::string("hesaff-sift") + (SIFTscale3 ? "-scale3" : "") + (upright ? "-up" : "");
+                
+                featGetterObj= new feat_KM_HessAffSIFT(scaleMulti, upright, RootSIFT && !cacheRootSIFT, numThreads);
                 
             } else if ( optionSet.count("sande") ) {
                 
+                // van de Sande's colorDescriptor binary unless "inproc", which uses the in-process
+                // reimplementation (not bit-exact, so engines indexed with one can't be queried with the other)
+                bool external= !optionSet.count("inproc");
+                
                 if (optionSet.count("sift")){
-                    featGetterObj= new vanDeSande("sift");
+                    featGetterObj= new vanDeSande("sift", 0.1, 0.04, external);
                     correctSpec= true;
                 } else if (optionSet.count("opponentsift")){
-                    featGetterObj= new vanDeSande("opponentsift");
+                    featGetterObj= new vanDeSande("opponentsift", 0.1, 0.04, external);
                     correctSpec= true;
                 }
                 
@@ -118,6 +152,14 @@ class featGetter_standard : public featGetter {
                 throw std::runtime_error( "Unknown standard featGetter" );
             }
             
+            if (!cacheDir.empty()){
+                if (cacheSpec.empty()){
+                    optionSet.erase("mt");
+                    cacheSpec= boost::join(optionSet, "-");
+                }
+                featGetterObj= new featCache(featGetterObj, cacheSpec, cacheDir, cacheRootSIFT);
+            }
+            
         }
         
         ~featGetter_standard(){
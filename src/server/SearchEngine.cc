@@ -54,6 +54,115 @@ void SearchEngine::Init(std::string name, boost::filesystem::path basedir) {
 //
 // Workers for each state
 //
+//
+// Parallel image preprocessing (used by SearchEngine::Preprocess())
+//
+typedef std::pair< unsigned int, std::string > PreprocessResult; // transformed file size, error message
+
+class PreprocessWorker : public queueWorker<PreprocessResult> {
+public:
+  PreprocessWorker(const std::vector< std::string > &imglist,
+                   boost::filesystem::path original_imgdir,
+                   boost::filesystem::path transformed_imgdir,
+                   unsigned int new_width)
+    : imglist_(&imglist),
+      original_imgdir_(original_imgdir),
+      transformed_imgdir_(transformed_imgdir),
+      new_width_(new_width) {}
+
+  void operator() ( uint32_t jobID, PreprocessResult &result ) const {
+    boost::filesystem::path src_fn  = original_imgdir_ / imglist_->at(jobID);
+    boost::filesystem::path dest_fn = transformed_imgdir_ / imglist_->at(jobID);
+    result.first = 0;
+    result.second.clear();
+
+    try {
+      if ( boost::filesystem::exists( dest_fn ) ) {
+        result.first = boost::filesystem::file_size( dest_fn );
+        return;
+      }
+
+      // other threads might be creating the same directory
+      boost::system::error_code ec;
+      boost::filesystem::create_directories( dest_fn.parent_path(), ec );
+
+      if ( new_width_ != 0 ) {
+        // only read the header to decide if resizing is needed
+        Magick::Image im;
+        im.ping( src_fn.string() );
+        Magick::Geometry size = im.size();
+
+        if ( new_width_ < size.width() ) {
+          double aspect_ratio =  ((double) size.height()) / ((double) size.width());
+          unsigned int new_height = (unsigned int) (new_width_ * aspect_ratio);
+
+          // for jpeg, let libjpeg decode directly at 1/2, 1/4 or 1/8 of the size (in the DCT domain)
+          // as long as the decoded image is not smaller than the final size
+          std::ostringstream jpeg_size;
+          jpeg_size << new_width_ << "x" << new_height;
+          Magick::Image im_full;
+          im_full.defineValue( "jpeg", "size", jpeg_size.str() );
+          im_full.read( src_fn.string() );
+
+          Magick::Geometry resize = Magick::Geometry(new_width_, new_height);
+          im_full.zoom( resize );
+          im_full.write( dest_fn.string() );
+          result.first = boost::filesystem::file_size( dest_fn );
+          return;
+        }
+      }
+
+      // copy the original image (without decoding and re-encoding) since it is already
+      // smaller than requested size, or the original size was requested
+      boost::filesystem::copy_file( src_fn, dest_fn );
+      result.first = boost::filesystem::file_size( dest_fn );
+    } catch (std::exception &error) {
+      result.second = src_fn.string() + " : Error [" + error.what() + "]";
+    }
+  }
+
+private:
+  const std::vector< std::string > *imglist_;
+  boost::filesystem::path original_imgdir_;
+  boost::filesystem::path transformed_imgdir_;
+  unsigned int new_width_; // 0 for "original"
+};
+
+class PreprocessManager : public queueManager<PreprocessResult> {
+public:
+  PreprocessManager(std::vector< unsigned int > &transformed_size)
+    : transformed_size_(&transformed_size),
+      completed_(0),
+      t0_(timing::tic()) {}
+
+  void operator() ( uint32_t jobID, PreprocessResult &result ) {
+    transformed_size_->at(jobID) = result.first;
+    if ( !result.second.empty() ) {
+      ViseMessageQueue::Instance()->Push( "Preprocess log \n" + result.second );
+    }
+
+    ++completed_;
+    // to avoid overflow of the message queue
+    if ( (completed_ % 50) == 0 || completed_ == transformed_size_->size() ) {
+      std::ostringstream s;
+      s << "Preprocess progress " << completed_ << "/" << transformed_size_->size();
+      ViseMessageQueue::Instance()->Push( s.str() );
+    }
+    if ( (completed_ % 1000) == 0 || completed_ == transformed_size_->size() ) {
+      std::ostringstream s;
+      double elapsed = timing::toc(t0_) / 1000.0;
+      s << "Preprocess log \n" << completed_ << " images in " << elapsed << "s ("
+        << completed_ / std::max(elapsed, 1e-3) << " images/s)";
+      ViseMessageQueue::Instance()->Push( s.str() );
+    }
+  }
+
+private:
+  std::vector< unsigned int > *transformed_size_;
+  unsigned int completed_;
+  double t0_;
+};
+
 void SearchEngine::Preprocess() {
   if ( imglist_.empty() ) {
     CreateFileList();
@@ -64,79 +173,21 @@ void SearchEngine::Preprocess() {
     SendCommand("Preprocess", "_progress reset show");
 
     std::string transformed_img_width = GetEngineConfigParam("transformed_img_width");
+    unsigned int new_width = 0;
     if (transformed_img_width != "original") {
       // scale and copy image to transformed_imgdir_
       SendLog("Preprocess", "\nSaving transformed images to [" + transformed_imgdir_.string() + "] ");
+      std::stringstream s;
+      s << transformed_img_width;
+      s >> new_width;
     } else {
       SendLog("Preprocess", "\nCopying original images to [" + transformed_imgdir_.string() + "] ");
     }
-    for ( unsigned int i=0; i<imglist_.size(); i++ ) {
-      boost::filesystem::path img_rel_path = imglist_.at(i);
-      boost::filesystem::path src_fn  = original_imgdir_ / img_rel_path;
-      boost::filesystem::path dest_fn = transformed_imgdir_ / img_rel_path;
-
-      if ( !boost::filesystem::exists( dest_fn ) ) {
-        try {
-          // check if image path exists
-          if ( ! boost::filesystem::is_directory( dest_fn.parent_path() ) ) {
-            boost::filesystem::create_directories( dest_fn.parent_path() );
-          }
 
-          if (transformed_img_width != "original") {
-            Magick::Image im;
-            im.read( src_fn.string() );
-            Magick::Geometry size = im.size();
-
-            double aspect_ratio =  ((double) size.height()) / ((double) size.width());
-
-            std::stringstream s;
-            s << transformed_img_width;
-            unsigned int new_width;
-            s >> new_width;
-
-            if ( new_width < size.width() ) {
-              unsigned int new_height = (unsigned int) (new_width * aspect_ratio);
-
-              Magick::Geometry resize = Magick::Geometry(new_width, new_height);
-              im.zoom( resize );
-
-              im.write( dest_fn.string() );
-              imglist_fn_transformed_size_.at(i) = boost::filesystem::file_size(dest_fn.string().c_str());
-              // to avoid overflow of the message queue
-              if ( (i % 5) == 0 ) {
-                SendProgress( "Preprocess", i+1, imglist_.size() );
-              }
-            } else {
-              // copy the original image since original image is already smaller than requested size
-              boost::filesystem::copy_file( src_fn, dest_fn );
-              imglist_fn_transformed_size_.at(i) = imglist_fn_original_size_.at(i);
-
-              // to avoid overflow of the message queue
-              if ( (i % 50) == 0 ) {
-                SendProgress( "Preprocess", i+1, imglist_.size() );
-              }
-            }
-          } else {
-            // just copy the files
-            boost::filesystem::copy_file( src_fn, dest_fn );
-            imglist_fn_transformed_size_.at(i) = imglist_fn_original_size_.at(i);
-
-            // to avoid overflow of the message queue
-            if ( (i % 50) == 0 ) {
-              SendProgress( "Preprocess", i+1, imglist_.size() );
-            }
-          }
-          if ( (i % 50) == 0 ) {
-            SendLog("Preprocess", ".");
-          }
-        } catch (std::exception &error) {
-          SendLog("Preprocess", "\n" + src_fn.string() + " : Error [" + error.what() + "]" );
-        }
-      }
-    }
-    if (transformed_img_width != "original") {
-      SendProgress( "Preprocess", imglist_.size(), imglist_.size() );
-    }
+    unsigned int num_threads = std::max( boost::thread::hardware_concurrency(), 1U );
+    PreprocessWorker worker( imglist_, original_imgdir_, transformed_imgdir_, new_width );
+    PreprocessManager manager( imglist_fn_transformed_size_ );
+    threadQueue<PreprocessResult>::start( imglist_.size(), worker, manager, num_threads );
 
     SendLog("Preprocess", "[Done]");
     // this is needed to unblock the ViseMessageQueue (sometimes)
@@ -186,7 +237,8 @@ void SearchEngine::Descriptor() {
                                                std::string("hesaff-") +
                                                "sift" +
                                                std::string(SIFTscale3 ? "-scale3" : "")
-                                               ).c_str() );
+                                               ).c_str(),
+                                              GetEngineConfigParam("featCacheDir") );
 
     buildIndex::computeTrainDescs(trainImagelistFn, trainDatabasePath,
                                   trainDescsFn,
@@ -198,7 +250,9 @@ void SearchEngine::Descriptor() {
   SendCommand("Cluster", "_progress reset hide");
 }
 
-// ensure that you install the dkmeans_relja as follows
+// clustering is done in-process by buildIndex::computeClusters(), the old python
+// implementation is still available with clusterWithPython=on in the engine config
+// but requires dkmeans_relja to be installed as follows
 // $ cd src/external/dkmeans_relja/
 // $ python setup.py build
 // $ sudo python setup.py install
@@ -209,7 +263,71 @@ void SearchEngine::Cluster( boost::filesystem::path vise_src_code_dir ) {
     SendCommand("Cluster", "_progress reset show");
     SendProgressMessage("Descriptor", "Starting clustering of descriptors");
 
-    RunClusterCommand( vise_src_code_dir );
+    if ( GetEngineConfigParam("clusterWithPython") == "on" ) {
+      RunClusterCommand( vise_src_code_dir );
+      return;
+    }
+
+    bool useRootSIFT = false;
+    if ( GetEngineConfigParam("RootSIFT") == "on" ) {
+      useRootSIFT = true;
+    }
+
+    uint32_t vocSize;
+    std::istringstream voc_size( GetEngineConfigParam("vocSize") );
+    voc_size >> vocSize;
+
+    uint32_t clusterNumIteration = 30;
+    if ( EngineConfigParamExists("clusterNumIteration") ) {
+      std::istringstream num_itr( GetEngineConfigParam("clusterNumIteration") );
+      num_itr >> clusterNumIteration;
+    }
+
+    uint32_t clusterMiniBatchSize = 0;
+    if ( EngineConfigParamExists("clusterMiniBatchSize") ) {
+      std::istringstream mini_batch( GetEngineConfigParam("clusterMiniBatchSize") );
+      mini_batch >> clusterMiniBatchSize;
+    }
+
+    // vocabulary tree instead of flat k-means, vocSize is rounded to a power of the branching factor
+    uint32_t vocTreeBranching = 0;
+    if ( EngineConfigParamExists("vocTreeBranching") ) {
+      std::istringstream branching( GetEngineConfigParam("vocTreeBranching") );
+      branching >> vocTreeBranching;
+    }
+
+    if ( vocTreeBranching > 0 ) {
+      uint32_t vocTreeBeam = 2;
+      if ( EngineConfigParamExists("vocTreeBeam") ) {
+        std::istringstream beam( GetEngineConfigParam("vocTreeBeam") );
+        beam >> vocTreeBeam;
+      }
+      if ( vocTreeBranching < 2 ) {
+        vocTreeBranching = 2;
+      }
+      uint32_t depth = std::max(1, (int) round( log((double) vocSize) / log((double) vocTreeBranching) ));
+      vocSize = (uint32_t) round( pow((double) vocTreeBranching, (double) depth) );
+      std::ostringstream voc_tree_size;
+      voc_tree_size << vocSize;
+      SetEngineConfigParam( "vocSize", voc_tree_size.str() );
+      WriteConfigToFile();
+      buildIndex::computeVocTree(GetEngineConfigParam("clstFn"),
+                                 useRootSIFT,
+                                 GetEngineConfigParam("descFn"),
+                                 vocSize,
+                                 vocTreeBranching,
+                                 clusterNumIteration,
+                                 2000000,
+                                 vocTreeBeam);
+    } else {
+      buildIndex::computeClusters(GetEngineConfigParam("clstFn"),
+                                  useRootSIFT,
+                                  GetEngineConfigParam("descFn"),
+                                  vocSize,
+                                  clusterNumIteration,
+                                  clusterMiniBatchSize);
+    }
+    SendCommand("Cluster", "_progress reset hide");
   }
 }
 
@@ -327,7 +445,8 @@ void SearchEngine::Index() {
     if (SIFTscale3) {
       feat_getter_config << "-scale3";
     }
-    featGetter_standard const featGetter_obj( feat_getter_config.str().c_str() );
+    featGetter_standard const featGetter_obj( feat_getter_config.str().c_str(),
+                                              GetEngineConfigParam("featCacheDir") );
 
     // embedder
     uint32_t hammEmbBits;
@@ -342,6 +461,12 @@ void SearchEngine::Index() {
       embFactory= new noEmbedderFactory;
     }
 
+    // full forward index makes internal queries faster but is about as large as the inverted index
+    bool fullFidx = false;
+    if ( GetEngineConfigParam("fullFidx") == "on" ) {
+      fullFidx = true;
+    }
+
     buildIndex::build(GetEngineConfigParam("imagelistFn"),
                       GetEngineConfigParam("databasePath"),
                       GetEngineConfigParam("dsetFn"),
@@ -350,7 +475,9 @@ void SearchEngine::Index() {
                       GetEngineConfigParam("tmpDir"),
                       featGetter_obj,
                       GetEngineConfigParam("clstFn"),
-                      embFactory);
+                      embFactory,
+                      fullFidx,
+                      GetEngineConfigParam("wghtFn"));
 
     delete embFactory;
   }
@@ -21,6 +21,7 @@
 #include <map>
 #include <set>
 #include <algorithm>
+#include <cmath>                 // for log(), pow()
 #include <unistd.h>
 #include <locale>                // for std::tolower
 #include <cassert>               // for assert()
@@ -35,8 +36,12 @@
 #include "train_descs.h"
 #include "train_assign.h"
 #include "train_hamming.h"
+#include "train_kmeans.h"
 #include "build_index.h"
 #include "hamming_embedder.h"
+#include "par_queue.h"
+#include "thread_queue.h"
+#include "timing.h"
 
 class SearchEngine {
 public:
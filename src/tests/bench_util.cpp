@@ -0,0 +1,100 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "bench_util.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <boost/filesystem.hpp>
+
+#include "macros.h"
+
+
+
+std::string
+benchUtil::tempFn(std::string const &pattern){
+    return (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path(pattern)).native();
+}
+
+
+
+void
+benchUtil::rootSIFTLike(sameRandomStreamUint32 &randStream, float *vec, uint32_t numDims){
+    float sum= 0;
+    for (uint32_t iDim= 0; iDim<numDims; ++iDim){
+        // skewed towards small values as SIFT
+        vec[iDim]= randStream.getNext0ToN(256) * randStream.getNext0ToN(256) / 256.0f;
+        sum+= vec[iDim];
+    }
+    for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+        vec[iDim]= sqrt(vec[iDim]/sum);
+}
+
+
+
+void
+benchUtil::writeCentres(std::string const &fn, uint32_t numClst, uint32_t numDims, float const *centres){
+    FILE *f= fopen(fn.c_str(), "wb");
+    ASSERT(f!=NULL);
+    uint8_t const dtypeCode= 4;
+    uint32_t const zeros[6]= {0, 0, 0, 0, 0, 0};
+    uint64_t const size= static_cast<uint64_t>(numClst)*numDims;
+    ASSERT( fwrite(&dtypeCode, 1, 1, f)==1 );
+    ASSERT( fwrite(&numClst, 4, 1, f)==1 );
+    ASSERT( fwrite(&numDims, 4, 1, f)==1 );
+    ASSERT( fwrite(zeros, 4, 6, f)==6 );
+    ASSERT( fwrite(centres, sizeof(float), size, f)==size );
+    fclose(f);
+}
+
+
+
+void
+benchUtil::writeRandomCentres(std::string const &fn, uint32_t numClst, uint32_t numDims,
+                              float offset, float scale,
+                              sameRandomStreamUint32 &randStream,
+                              std::vector<float> &centres){
+    centres.resize(static_cast<uint64_t>(numClst)*numDims);
+    for (uint64_t i= 0; i<centres.size(); ++i)
+        centres[i]= offset + scale * randStream.getNext0ToN(1000) / 1000.0f;
+    writeCentres(fn, numClst, numDims, &centres[0]);
+}
+
+
+
+// header (numDims, dtypeCode) followed by the raw descriptors
+static void
+writeFlatDescsRaw(std::string const &fn, uint32_t numDims, uint8_t dtypeCode, void const *data, uint64_t numBytes){
+    FILE *f= fopen(fn.c_str(), "wb");
+    ASSERT(f!=NULL);
+    ASSERT( fwrite(&numDims, 4, 1, f)==1 );
+    ASSERT( fwrite(&dtypeCode, 1, 1, f)==1 );
+    ASSERT( fwrite(data, 1, numBytes, f)==numBytes );
+    fclose(f);
+}
+
+
+
+void
+benchUtil::writeFlatDescs(std::string const &fn, uint32_t numDims, uint64_t numDescs, float const *descs){
+    writeFlatDescsRaw(fn, numDims, 4, descs, numDescs*numDims*sizeof(float));
+}
+
+
+
+void
+benchUtil::writeFlatDescs(std::string const &fn, uint32_t numDims, uint64_t numDescs, uint8_t const *descs){
+    writeFlatDescsRaw(fn, numDims, 0, descs, numDescs*numDims);
+}
@@ -0,0 +1,57 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _BENCH_UTIL_H_
+#define _BENCH_UTIL_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "same_random.h"
+
+
+
+// synthetic data and files shared by the benchmarks in tests/
+namespace benchUtil {
+    
+    // unique filename in the temp directory, pattern as for boost::filesystem::unique_path
+    std::string
+        tempFn(std::string const &pattern);
+    
+    // non-negative, L2-normalized vector skewed towards small values, as RootSIFT
+    void
+        rootSIFTLike(sameRandomStreamUint32 &randStream, float *vec, uint32_t numDims= 128);
+    
+    // numClst x numDims float centres in the .e3bin format of clstCentres
+    void
+        writeCentres(std::string const &fn, uint32_t numClst, uint32_t numDims, float const *centres);
+    
+    // numClst x numDims random centres in [offset, offset+scale), written as writeCentres
+    void
+        writeRandomCentres(std::string const &fn, uint32_t numClst, uint32_t numDims,
+                           float offset, float scale,
+                           sameRandomStreamUint32 &randStream,
+                           std::vector<float> &centres);
+    
+    // numDescs x numDims descriptors in the buildIndex::flatDescsFile format
+    void
+        writeFlatDescs(std::string const &fn, uint32_t numDims, uint64_t numDescs, float const *descs);
+    
+    void
+        writeFlatDescs(std::string const &fn, uint32_t numDims, uint64_t numDescs, uint8_t const *descs);
+    
+};
+
+#endif
@@ -0,0 +1,118 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "bench_util.h"
+#include "clst_centres.h"
+#include "clst_nn.h"
+#include "compact_dist.h"
+#include "macros.h"
+#include "same_random.h"
+#include "timing.h"
+
+
+// Exact assignment to cluster centres kept as float, uint8 and float16: throughput, memory,
+// and how often the compact storages agree with float, on RootSIFT-like centres and queries.
+// usage: clst_storage_bench [numClst numQueries]
+
+uint32_t const numDims= 128;
+
+
+
+void
+checkHalf(){
+    // all finite halves survive the round trip, conversions round to nearest even
+    for (uint32_t h= 0; h<0x10000; ++h)
+        if ((h & 0x7C00)!=0x7C00)
+            ASSERT( compactDist::floatToHalf(compactDist::halfToFloat(h))==h );
+    ASSERT( compactDist::floatToHalf(1.0f + 1.0f/2048)==0x3C00 );
+    ASSERT( compactDist::floatToHalf(1.0f + 3.0f/2048)==0x3C02 );
+    ASSERT( compactDist::floatToHalf(65520.0f)==0x7C00 );
+    ASSERT( compactDist::floatToHalf(5.96e-8f)==0x0001 );
+    std::vector<float> in(1000);
+    std::vector<uint16_t> out(in.size());
+    for (uint32_t i= 0; i<in.size(); ++i)
+        in[i]= (static_cast<float>(i)-500)/7.3f;
+    compactDist::floatToHalf(&in[0], in.size(), &out[0]);
+    for (uint32_t i= 0; i<in.size(); ++i)
+        ASSERT( out[i]==compactDist::floatToHalf(in[i]) );
+}
+
+
+
+int main(int argc, char **argv){
+
+    uint32_t const numClst= argc>1 ? atoi(argv[1]) : 20000;
+    uint32_t const numQueries= argc>2 ? atoi(argv[2]) : 2000;
+
+    checkHalf();
+
+    sameRandomUint32 rand((numClst+numQueries)*(2*numDims+1), 43);
+    sameRandomStreamUint32 randStream(rand);
+
+    // centres in the .e3bin format of clstCentres
+    std::string const clstFn= benchUtil::tempFn("clst_storage_bench_%%%%-%%%%.e3bin");
+    std::vector<float> centres(numClst*numDims);
+    for (uint32_t iClst= 0; iClst<numClst; ++iClst)
+        benchUtil::rootSIFTLike(randStream, &centres[iClst*numDims], numDims);
+    benchUtil::writeCentres(clstFn, numClst, numDims, &centres[0]);
+
+    // queries are mostly random with a bias towards one centre, so that many are close to cell boundaries
+    std::vector<float> queries(numQueries*numDims), noise(numDims);
+    for (uint32_t iQ= 0; iQ<numQueries; ++iQ){
+        uint32_t const iClst= randStream.getNext0ToN(numClst);
+        benchUtil::rootSIFTLike(randStream, &noise[0], numDims);
+        for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+            queries[iQ*numDims+iDim]= 0.2f*centres[iClst*numDims+iDim] + 0.8f*noise[iDim];
+    }
+
+    char const *names[3]= {"float", "uint8", "float16"};
+    uint32_t const bytes[3]= {4, 1, 2};
+    std::vector<unsigned> assignsFloat;
+
+    std::cout<<numClst<<" centres, "<<numQueries<<" queries\n";
+
+    for (uint32_t iStorage= 0; iStorage<3; ++iStorage){
+
+        clstCentres clst(clstFn.c_str(), true, clstCentres::storageFromString(names[iStorage]));
+        clstCentresExactNN nn(clst);
+
+        std::vector<unsigned> assigns(numQueries);
+        std::vector<float> distSqs(numQueries);
+        double const t0= timing::tic();
+        nn.search_nn(&queries[0], numQueries, &assigns[0], &distSqs[0]);
+        double const t= timing::toc(t0);
+
+        uint32_t numAgree= 0;
+        if (iStorage==0)
+            assignsFloat= assigns;
+        for (uint32_t iQ= 0; iQ<numQueries; ++iQ)
+            numAgree+= assigns[iQ]==assignsFloat[iQ];
+
+        std::cout<<names[iStorage]<<": "<<static_cast<uint64_t>(numClst)*numDims*bytes[iStorage]/1024<<" KB, "
+                 <<numQueries/t*1000<<" assignments/s, agreement with float "
+                 <<100.0*numAgree/numQueries<<"%\n";
+        ASSERT( numAgree >= 0.95*numQueries );
+    }
+
+    boost::filesystem::remove(clstFn);
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "colour_sift.h"
+#include "ellipse.h"
+#include "macros.h"
+#include "timing.h"
+
+
+// In-process vanDeSande vs van de Sande's colorDescriptor binary: per-image latency,
+// number of features, how many in-process regions have a colorDescriptor one at the same
+// position (within 2 pixels) and the ratio of their scales, and the L2 distance between
+// the descriptors of those (relative to the average distance between unrelated ones).
+// Also checks that the in-process one gives identical results when run from several threads.
+// The external side is skipped if colorDescriptor isn't on the PATH.
+// usage: colour_sift_compare sift|opponentsift numThreads image1.jpg [image2.jpg ...]
+
+struct featsType {
+    uint32_t numFeats;
+    std::vector<ellipse> regions;
+    float *descs;
+};
+
+
+
+void
+extractAll(featGetter const *featGetterObj, std::vector<std::string> const *fns, std::vector<featsType> *feats, uint32_t first, uint32_t step){
+    for (uint32_t i= first; i<fns->size(); i+= step)
+        featGetterObj->getFeats( fns->at(i).c_str(), feats->at(i).numFeats, feats->at(i).regions, feats->at(i).descs );
+}
+
+
+
+inline double
+radius(ellipse const &region){
+    double x, y, a, b, c;
+    region.get(x, y, a, b, c);
+    return 1.0/sqrt(a);
+}
+
+
+
+inline double
+descDist(float const *d1, float const *d2, uint32_t numDims){
+    double dist= 0;
+    for (uint32_t i= 0; i<numDims; ++i)
+        dist+= (d1[i]-d2[i])*(d1[i]-d2[i]);
+    return sqrt(dist);
+}
+
+
+
+int main(int argc, char **argv) {
+
+    if (argc<4){
+        std::cerr<<"usage: "<<argv[0]<<" sift|opponentsift numThreads image1.jpg [image2.jpg ...]\n";
+        return 1;
+    }
+
+    std::string const descriptor= argv[1];
+    uint32_t const numThreads= atoi(argv[2]);
+    std::vector<std::string> fns(argv+3, argv+argc);
+
+    bool const haveExternal= system("which colorDescriptor > /dev/null 2>&1")==0;
+    if (!haveExternal)
+        std::cout<<"colorDescriptor not found, skipping the comparison\n";
+
+    vanDeSande inProcess(descriptor, 0.1, 0.04, false);
+    vanDeSande external(descriptor, 0.1, 0.04, true);
+    uint32_t const numDims= inProcess.numDims();
+
+    std::vector<featsType> feats(fns.size());
+    double tIn= 0, tExt= 0, sumRatio= 0, sumDist= 0, sumRandDist= 0;
+    uint32_t numIn= 0, numExt= 0, numSamePos= 0, numRand= 0;
+
+    for (uint32_t i= 0; i<fns.size(); ++i){
+
+        double t0= timing::tic();
+        inProcess.getFeats( fns[i].c_str(), feats[i].numFeats, feats[i].regions, feats[i].descs );
+        tIn+= timing::toc(t0);
+        numIn+= feats[i].numFeats;
+
+        if (!haveExternal)
+            continue;
+
+        featsType ext;
+        t0= timing::tic();
+        external.getFeats( fns[i].c_str(), ext.numFeats, ext.regions, ext.descs );
+        tExt+= timing::toc(t0);
+        numExt+= ext.numFeats;
+
+        // closest colorDescriptor region for each in-process one (brute force, for testing only)
+        for (uint32_t j= 0; j<feats[i].numFeats; ++j){
+            double bestDistSq= 4.0*4.0;
+            uint32_t best= ext.numFeats;
+            for (uint32_t k= 0; k<ext.numFeats; ++k){
+                double distSq= (feats[i].regions[j].x - ext.regions[k].x)*(feats[i].regions[j].x - ext.regions[k].x) +
+                               (feats[i].regions[j].y - ext.regions[k].y)*(feats[i].regions[j].y - ext.regions[k].y);
+                if (distSq<bestDistSq){
+                    bestDistSq= distSq;
+                    best= k;
+                }
+            }
+            if (best==ext.numFeats)
+                continue;
+            ++numSamePos;
+            sumRatio+= radius(feats[i].regions[j]) / radius(ext.regions[best]);
+            sumDist+= descDist(feats[i].descs + j*numDims, ext.descs + best*numDims, numDims);
+            if (ext.numFeats>1){
+                sumRandDist+= descDist(feats[i].descs + j*numDims, ext.descs + ((best + ext.numFeats/2) % ext.numFeats)*numDims, numDims);
+                ++numRand;
+            }
+        }
+
+        delete []ext.descs;
+    }
+
+    std::cout<<"in-process:      "<<tIn/fns.size()<<" ms/image, "<<numIn<<" features\n";
+    if (haveExternal){
+        std::cout<<"colorDescriptor: "<<tExt/fns.size()<<" ms/image, "<<numExt<<" features\n";
+        std::cout<<"same position: "<<numSamePos<<" ("<<100.0*numSamePos/std::max(numIn, 1U)<<"% of in-process)"
+                 <<", mean scale ratio "<<sumRatio/std::max(numSamePos, 1U)
+                 <<", mean descriptor distance "<<sumDist/std::max(numSamePos, 1U)
+                 <<" (unrelated "<<sumRandDist/std::max(numRand, 1U)<<")\n";
+    }
+
+    if (numThreads>1){
+        std::vector<featsType> featsMT(fns.size());
+        double t0= timing::tic();
+        boost::thread_group threads;
+        for (uint32_t iThread= 0; iThread<numThreads; ++iThread)
+            threads.create_thread( boost::bind(extractAll, &inProcess, &fns, &featsMT, iThread, numThreads) );
+        threads.join_all();
+        double t= timing::toc(t0);
+        std::cout<<"in-process with "<<numThreads<<" threads: "<<t/fns.size()<<" ms/image\n";
+        for (uint32_t i= 0; i<fns.size(); ++i){
+            ASSERT( featsMT[i].numFeats==feats[i].numFeats );
+            ASSERT( memcmp(featsMT[i].descs, feats[i].descs, feats[i].numFeats*numDims*sizeof(float))==0 );
+            delete []featsMT[i].descs;
+        }
+    }
+
+    for (uint32_t i= 0; i<fns.size(); ++i)
+        delete []feats[i].descs;
+
+    return 0;
+
+}
@@ -0,0 +1,179 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "feat_cache.h"
+#include "feat_file.h"
+#include "macros.h"
+
+
+
+// featCache has to fall back to the extracted features when its entry can't be written:
+// a short write (simulated with RLIMIT_FSIZE, as a full disk) makes featFile::write return false
+// and remove the partial file, and nothing is left in the cache
+
+uint32_t const numFeats= 2000, numDimsSIFT= 128;
+
+
+
+// SIFT-like features which depend only on the file name length, counts extractions
+class fakeFeatGetter : public featGetter {
+
+    public:
+
+        fakeFeatGetter() : numCalls(0) {}
+
+        void
+            getFeats( const char fileName[], uint32_t &numFeats_, std::vector<ellipse> &regions, float *&descs ) const {
+                ++numCalls;
+                uint32_t const seed= std::string(fileName).length();
+                numFeats_= numFeats;
+                regions.resize(numFeats);
+                descs= new float[numFeats*numDimsSIFT];
+                for (uint32_t i= 0; i<numFeats; ++i){
+                    regions[i].set(i+seed, 2*i, 1.0, 0.0, 1.0);
+                    for (uint32_t iDim= 0; iDim<numDimsSIFT; ++iDim)
+                        descs[i*numDimsSIFT+iDim]= (i*7 + iDim + seed) % 256;
+                }
+            }
+
+        inline uint32_t
+            numDims() const { return numDimsSIFT; }
+
+        std::string
+            getRawDescs(float const *descs, uint32_t numFeats_) const { return ""; }
+
+        inline uint8_t
+            getDtypeCode() const { return 0; } // uint8
+
+        mutable uint32_t numCalls;
+
+};
+
+
+
+void
+setFileSizeLimit(rlim_t limit){
+    rlimit l;
+    ASSERT( getrlimit(RLIMIT_FSIZE, &l)==0 );
+    l.rlim_cur= limit;
+    ASSERT( setrlimit(RLIMIT_FSIZE, &l)==0 );
+}
+
+
+
+uint32_t
+numFilesIn(boost::filesystem::path const &dir){
+    uint32_t num= 0;
+    for (boost::filesystem::recursive_directory_iterator it(dir), end; it!=end; ++it)
+        if (boost::filesystem::is_regular_file(it->path()))
+            ++num;
+    return num;
+}
+
+
+
+// features as extracted by fakeFeatGetter
+void
+checkFeats(featGetter const &featGetterObj, fakeFeatGetter const &expectedObj, std::string const &imageFn){
+    uint32_t numFeats1, numFeats2;
+    std::vector<ellipse> regions1, regions2;
+    float *descs1, *descs2;
+    featGetterObj.getFeats(imageFn.c_str(), numFeats1, regions1, descs1);
+    uint32_t const numCalls= expectedObj.numCalls;
+    expectedObj.getFeats(imageFn.c_str(), numFeats2, regions2, descs2);
+    expectedObj.numCalls= numCalls;
+    ASSERT( numFeats1==numFeats2 && regions1==regions2 );
+    for (uint32_t i= 0; i<numFeats1*numDimsSIFT; ++i)
+        ASSERT( descs1[i]==descs2[i] );
+    delete []descs1;
+    delete []descs2;
+}
+
+
+
+int main() {
+
+    boost::filesystem::path const dir= boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("feat_cache_test_%%%%-%%%%");
+    boost::filesystem::path const cacheDir= dir / "cache";
+    boost::filesystem::create_directories(dir);
+
+    // "images" are only hashed
+    std::string imageFns[3];
+    for (uint32_t i= 0; i<3; ++i){
+        imageFns[i]= (dir / ("image" + std::string(i+1, 'x') + ".jpg")).native();
+        std::ofstream(imageFns[i].c_str())<<"image "<<i<<"\n";
+    }
+
+    fakeFeatGetter *fakeObj= new fakeFeatGetter();
+    featCache const cache(fakeObj, "fake", cacheDir.native());
+
+    // written and reused
+    checkFeats(cache, *fakeObj, imageFns[0]);
+    checkFeats(cache, *fakeObj, imageFns[0]);
+    ASSERT( fakeObj->numCalls==1 );
+    ASSERT( numFilesIn(cacheDir)==1 );
+
+    // short writes: the file limit is below the size of an entry, writes beyond it fail with EFBIG
+    signal(SIGXFSZ, SIG_IGN);
+    uint64_t const entrySize= featFile::fileSize(numFeats, numDimsSIFT, 0);
+    rlim_t const limits[]= {0, featFile::headerSize(), entrySize/2, entrySize-1};
+    for (uint32_t iLimit= 0; iLimit<sizeof(limits)/sizeof(limits[0]); ++iLimit){
+        setFileSizeLimit(limits[iLimit]);
+
+        // directly
+        std::string const fn= (dir / "direct.feat").native();
+        std::vector<ellipse> regions(numFeats);
+        std::vector<float> descs(numFeats*numDimsSIFT, 1.0f);
+        ASSERT( !featFile::write(fn.c_str(), regions, &descs[0], numDimsSIFT, 0) );
+        ASSERT( !boost::filesystem::exists(fn) );
+
+        // through the cache: the extracted features are returned and nothing is cached
+        uint32_t const numCalls= fakeObj->numCalls;
+        checkFeats(cache, *fakeObj, imageFns[1]);
+        checkFeats(cache, *fakeObj, imageFns[1]);
+        ASSERT( fakeObj->numCalls==numCalls+2 );
+        // an already cached entry is still read
+        checkFeats(cache, *fakeObj, imageFns[0]);
+        ASSERT( fakeObj->numCalls==numCalls+2 );
+        ASSERT( numFilesIn(cacheDir)==1 );
+    }
+
+    // exactly enough space
+    setFileSizeLimit(entrySize);
+    checkFeats(cache, *fakeObj, imageFns[2]);
+    setFileSizeLimit(RLIM_INFINITY);
+    checkFeats(cache, *fakeObj, imageFns[1]);
+    uint32_t const numCalls= fakeObj->numCalls;
+    checkFeats(cache, *fakeObj, imageFns[1]);
+    checkFeats(cache, *fakeObj, imageFns[2]);
+    ASSERT( fakeObj->numCalls==numCalls );
+    ASSERT( numFilesIn(cacheDir)==3 );
+
+    boost::filesystem::remove_all(dir);
+
+    std::cout<<"featCache: extracted features returned and nothing cached on short writes\n";
+
+    return 0;
+
+}
@@ -12,14 +12,23 @@ The library belongs to Relja Arandjelovic and the University of Oxford.
 No usage or redistribution is allowed without explicit permission.
 */
 
+#include <math.h>
 #include <vector>
 #include <iostream>
 
+#include <boost/algorithm/string/predicate.hpp>
+
 #include "ellipse.h"
+#include "feat_file.h"
 #include "feat_getter.h"
 #include "feat_standard.h"
 
 
+// usage: feat_extract image.jpg [out.feat|out.txt]
+// optionally saves the features as a binary feature file (or text if the name ends with .txt)
+// and checks that they load back the same
+
+
 int main(int argc, char **argv) {
     
     featGetter *featGetterObj= new featGetter_standard( "hesaff-sift" );
@@ -46,6 +55,30 @@ int main(int argc, char **argv) {
         std::cout<<"\n";
     }
     
+    if (argc>2){
+        if (boost::ends_with(argv[2], ".txt"))
+            featFile::writeText( argv[2], regions, descs, numDims );
+        else
+            ASSERT( featFile::write( argv[2], regions, descs, numDims, featGetterObj->getDtypeCode() ) );
+        
+        uint32_t numFeats2;
+        std::vector<ellipse> regions2;
+        float *descs2;
+        ASSERT( featFile::read( argv[2], numFeats2, regions2, descs2, numDims ) );
+        ASSERT( numFeats2==numFeats );
+        // regions are stored as float (text: 6 significant digits)
+        for (uint32_t i=0; i<numFeats; ++i){
+            ASSERT( fabs(regions[i].x-regions2[i].x) < 1e-2 && fabs(regions[i].y-regions2[i].y) < 1e-2 );
+            ASSERT( fabs(regions[i].a-regions2[i].a) <= 1e-5*fabs(regions[i].a) );
+            ASSERT( fabs(regions[i].b-regions2[i].b) <= 1e-5*fabs(regions[i].b) );
+            ASSERT( fabs(regions[i].c-regions2[i].c) <= 1e-5*fabs(regions[i].c) );
+        }
+        for (uint32_t i=0; i<numFeats*numDims; ++i)
+            ASSERT( fabs(descs[i]-descs2[i]) < 1e-3 );
+        std::cout<<"saved to "<<argv[2]<<"\n";
+        delete []descs2;
+    }
+    
     delete []descs;
     delete featGetterObj;
     
@@ -0,0 +1,108 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "ellipse.h"
+#include "feat_getter.h"
+#include "feat_standard.h"
+#include "timing.h"
+
+
+// Per-image latency of hesaff-sift through splitRegDesc (two decodes)
+// vs the single-decode in-process feat_KM_HessAffSIFT, and the throughput of the latter
+// with several threads.
+// usage: feat_extract_bench numThreads image1.jpg [image2.jpg ...]
+
+void
+extractAll(featGetter const *featGetterObj, std::vector<std::string> const *fns, uint32_t first, uint32_t step){
+    uint32_t numFeats;
+    std::vector<ellipse> regions;
+    float *descs;
+    for (uint32_t i= first; i<fns->size(); i+= step){
+        featGetterObj->getFeats( fns->at(i).c_str(), numFeats, regions, descs );
+        delete []descs;
+    }
+}
+
+
+
+int main(int argc, char **argv) {
+
+    if (argc<3){
+        std::cerr<<"usage: "<<argv[0]<<" numThreads image1.jpg [image2.jpg ...]\n";
+        return 1;
+    }
+
+    uint32_t const numThreads= atoi(argv[1]);
+    std::vector<std::string> fns(argv+2, argv+argc);
+
+    reg_KM_HessAff regionGetterObj;
+    desc_KM_SIFT descGetterObj(3, false);
+    splitRegDesc oldFeat(&regionGetterObj, &descGetterObj);
+    feat_KM_HessAffSIFT newFeat(3, false);
+
+    double tOld= 0, tNew= 0, maxDiff= 0;
+    uint32_t numOld= 0, numNew= 0;
+
+    for (uint32_t i= 0; i<fns.size(); ++i){
+        uint32_t numFeats1, numFeats2;
+        std::vector<ellipse> regions1, regions2;
+        float *descs1, *descs2;
+
+        double t0= timing::tic();
+        oldFeat.getFeats( fns[i].c_str(), numFeats1, regions1, descs1 );
+        tOld+= timing::toc(t0);
+
+        t0= timing::tic();
+        newFeat.getFeats( fns[i].c_str(), numFeats2, regions2, descs2 );
+        tNew+= timing::toc(t0);
+
+        numOld+= numFeats1;
+        numNew+= numFeats2;
+        // the descriptors should be identical, regions are passed on with double precision
+        if (numFeats1==numFeats2)
+            for (uint32_t j= 0; j<numFeats1*128; ++j)
+                maxDiff= std::max(maxDiff, static_cast<double>(fabs(descs1[j]-descs2[j])));
+        else
+            std::cout<<fns[i]<<": number of features differs "<<numFeats1<<" vs "<<numFeats2<<"\n";
+
+        delete []descs1;
+        delete []descs2;
+    }
+
+    std::cout<<"splitRegDesc:        "<<tOld/fns.size()<<" ms/image, "<<numOld<<" features\n";
+    std::cout<<"feat_KM_HessAffSIFT: "<<tNew/fns.size()<<" ms/image, "<<numNew<<" features\n";
+    std::cout<<"max abs descriptor difference: "<<maxDiff<<"\n";
+
+    if (numThreads>1){
+        double t0= timing::tic();
+        boost::thread_group threads;
+        for (uint32_t iThread= 0; iThread<numThreads; ++iThread)
+            threads.create_thread( boost::bind(extractAll, &newFeat, &fns, iThread, numThreads) );
+        threads.join_all();
+        double t= timing::toc(t0);
+        std::cout<<"feat_KM_HessAffSIFT with "<<numThreads<<" threads: "<<t/fns.size()<<" ms/image ("<<fns.size()*1000.0/t<<" images/s)\n";
+    }
+
+    return 0;
+
+}
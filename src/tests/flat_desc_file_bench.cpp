@@ -0,0 +1,166 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include "bench_util.h"
+#include "desc_to_hell.h"
+#include "flat_desc_file.h"
+#include "macros.h"
+#include "same_random.h"
+#include "timing.h"
+
+
+// Reading uint8 SIFT training descriptors as RootSIFT: the memory-mapped flatDescsFile (fused conversion,
+// lock-free sharded reads by many threads) vs pread + conversion + descToHell as it was done before.
+// usage: flat_desc_file_bench [numDescs numThreads]
+
+uint32_t const numDims= 128, chunkSize= 10000;
+
+
+
+// as flatDescsFile::getDescs was: pread, convert to float, then Hellinger
+void
+readPread(int fd, uint32_t start, uint32_t end, float *descs){
+    std::vector<uint8_t> raw((end-start)*numDims);
+    ASSERT( pread(fd, &raw[0], raw.size(), static_cast<uint64_t>(start)*numDims + 5)==static_cast<ssize_t>(raw.size()) );
+    for (uint32_t i= 0; i<raw.size(); ++i)
+        descs[i]= static_cast<float>(raw[i]);
+    descToHell::convertToHell(numDims, end-start, descs);
+}
+
+
+
+class shardReader {
+    public:
+        shardReader(buildIndex::flatDescsFile const &descFile, uint32_t iShard, uint32_t numShards, double &sum)
+            : descFile_(&descFile), iShard_(iShard), numShards_(numShards), sum_(&sum) {}
+        void
+            operator()() const {
+                uint32_t start, end;
+                descFile_->getShard(iShard_, numShards_, start, end);
+                std::vector<float> descs(chunkSize*numDims);
+                double sum= 0;
+                for (; start<end; start+= chunkSize){
+                    uint32_t const count= std::min(chunkSize, end-start);
+                    descFile_->readDescs(start, start+count, &descs[0]);
+                    for (uint32_t i= 0; i<count*numDims; ++i)
+                        sum+= descs[i];
+                }
+                *sum_= sum;
+            }
+    private:
+        buildIndex::flatDescsFile const *descFile_;
+        uint32_t iShard_, numShards_;
+        double *sum_;
+};
+
+
+
+int main(int argc, char **argv){
+
+    uint32_t const numDescs= argc>1 ? atoi(argv[1]) : 500000;
+    uint32_t const numThreads= argc>2 ? atoi(argv[2]) : std::max(boost::thread::hardware_concurrency(), 1U);
+
+    std::string const descsFn= benchUtil::tempFn("flat_desc_file_bench_%%%%-%%%%.e3bin");
+    {
+        // SIFT-like, i.e. mostly small values, from a pool of random bytes
+        uint32_t const poolSize= 1000003;
+        sameRandomUint32 rand(2*poolSize, 46);
+        sameRandomStreamUint32 randStream(rand);
+        std::vector<uint8_t> pool(poolSize);
+        for (uint32_t i= 0; i<poolSize; ++i)
+            pool[i]= (randStream.getNext0ToN(256) * randStream.getNext0ToN(256)) >> 8;
+        std::vector<uint8_t> raw(static_cast<uint64_t>(numDescs)*numDims);
+        for (uint64_t i= 0; i<raw.size(); ++i)
+            raw[i]= pool[i % poolSize];
+        benchUtil::writeFlatDescs(descsFn, numDims, numDescs, &raw[0]);
+    }
+    std::cout<<numDescs<<" descriptors ("<<static_cast<uint64_t>(numDescs)*numDims/1024/1024<<" MB), "<<numThreads<<" threads\n";
+
+    buildIndex::flatDescsFile const descFile(descsFn, true);
+    ASSERT( descFile.numDescs()==numDescs && descFile.numDims()==numDims && descFile.isUint8() );
+    FILE *f= fopen(descsFn.c_str(), "rb");
+    ASSERT(f!=NULL);
+    int const fd= fileno(f);
+
+    // same values
+    {
+        std::vector<float> a(chunkSize*numDims), b(chunkSize*numDims);
+        uint32_t const count= std::min(chunkSize, numDescs);
+        readPread(fd, numDescs-count, numDescs, &a[0]);
+        descFile.readDescs(numDescs-count, numDescs, &b[0]);
+        for (uint32_t i= 0; i<count*numDims; ++i)
+            ASSERT( fabs(a[i]-b[i]) <= 1e-6f );
+        buildIndex::flatDescsFile const rawFile(descsFn, false);
+        uint8_t const *view= rawFile.getDescsUint8(numDescs-count);
+        rawFile.readDescs(numDescs-count, numDescs, &b[0]);
+        for (uint32_t i= 0; i<count*numDims; ++i)
+            ASSERT( b[i]==view[i] );
+    }
+
+    std::vector<float> descs(chunkSize*numDims);
+    double sumPread= 0, sumMapped= 0;
+
+    double t0= timing::tic();
+    for (uint32_t start= 0; start<numDescs; start+= chunkSize){
+        uint32_t const count= std::min(chunkSize, numDescs-start);
+        readPread(fd, start, start+count, &descs[0]);
+        for (uint32_t i= 0; i<count*numDims; ++i)
+            sumPread+= descs[i];
+    }
+    double const tPread= timing::toc(t0);
+
+    t0= timing::tic();
+    for (uint32_t start= 0; start<numDescs; start+= chunkSize){
+        uint32_t const count= std::min(chunkSize, numDescs-start);
+        descFile.readDescs(start, start+count, &descs[0]);
+        for (uint32_t i= 0; i<count*numDims; ++i)
+            sumMapped+= descs[i];
+    }
+    double const tMapped= timing::toc(t0);
+
+    std::vector<double> sums(numThreads, 0);
+    t0= timing::tic();
+    {
+        boost::thread_group threads;
+        for (uint32_t iThread= 0; iThread<numThreads; ++iThread)
+            threads.create_thread( shardReader(descFile, iThread, numThreads, sums[iThread]) );
+        threads.join_all();
+    }
+    double const tSharded= timing::toc(t0);
+    double sumSharded= 0;
+    for (uint32_t iThread= 0; iThread<numThreads; ++iThread)
+        sumSharded+= sums[iThread];
+
+    ASSERT( fabs(sumPread-sumMapped) <= 1e-6*sumPread && fabs(sumSharded-sumMapped) <= 1e-6*sumPread );
+
+    std::cout<<"pread + convert + descToHell: "<<numDescs/tPread*1000<<" descs/s\n";
+    std::cout<<"flatDescsFile::readDescs:     "<<numDescs/tMapped*1000<<" descs/s\n";
+    std::cout<<"sharded over "<<numThreads<<" threads:      "<<numDescs/tSharded*1000<<" descs/s\n";
+
+    fclose(f);
+    boost::filesystem::remove(descsFn);
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <iostream>
+
+#include "KMCode_relja/gauss_iir/gauss_iir.h"
+
+#include "macros.h"
+#include "same_random.h"
+#include "timing.h"
+
+
+// Per-filter microbenchmark of the KMCode fixed-kernel filters: original scalar loops vs
+// the vectorised (and optionally multithreaded) ones, checking that the results match.
+// usage: gauss_iir_bench [width height numThreads numRepeat]
+
+typedef void (*filterFn)(DARY*, DARY*);
+
+
+
+double
+timeFilter(filterFn fn, DARY *image, DARY *result, uint32_t numRepeat){
+    double t0= timing::tic();
+    for (uint32_t i= 0; i<numRepeat; ++i)
+        fn(image, result);
+    return timing::toc(t0)/numRepeat;
+}
+
+
+
+double
+maxAbsDiff(DARY const *a, DARY const *b){
+    double diff= 0;
+    for (uint32_t i= 0; i<a->size(); ++i)
+        diff= std::max(diff, static_cast<double>(fabs(a->fel[0][i] - b->fel[0][i])));
+    return diff;
+}
+
+
+
+int main(int argc, char **argv){
+
+    uint32_t const width= argc>1 ? atoi(argv[1]) : 1024;
+    uint32_t const height= argc>2 ? atoi(argv[2]) : 768;
+    int const numThreads= argc>3 ? atoi(argv[3]) : 4;
+    uint32_t const numRepeat= argc>4 ? atoi(argv[4]) : 10;
+
+    DARY image(height, width);
+    sameRandomUint32 rand(width*height, 43);
+    sameRandomStreamUint32 randStream(rand);
+    for (uint32_t i= 0; i<image.size(); ++i)
+        image.fel[0][i]= randStream.getNext0ToN(256);
+
+    char const *names[]= {"HorConvSqrt2", "VerConvSqrt2", "smoothXXH9", "smoothYYV9", "DerXXH9", "DerYYV9",
+                          "DerHConv8", "DerVConv8", "DerXXH7", "DerYYV7", "DerHConv6", "DerVConv6",
+                          "DerHConv4", "DerVConv4", "HorConv5", "VerConv5", "HorConv3", "VerConv3"};
+    filterFn fns[]= {HorConvSqrt2, VerConvSqrt2, smoothXXH9, smoothYYV9, DerXXH9, DerYYV9,
+                     DerHConv8, DerVConv8, DerXXH7, DerYYV7, DerHConv6, DerVConv6,
+                     DerHConv4, DerVConv4, HorConv5, VerConv5, HorConv3, VerConv3};
+    uint32_t const numFns= sizeof(fns)/sizeof(filterFn);
+
+    std::cout<<width<<"x"<<height<<", ms per call: original / fast / fast with "<<numThreads<<" threads\n";
+
+    DARY resOrig(height, width), resFast(height, width), resFastMT(height, width);
+    double totOrig= 0, totFast= 0, totFastMT= 0;
+
+    for (uint32_t iFn= 0; iFn<numFns; ++iFn){
+        setFilterThreads(1);
+        setFastFilters(false);
+        double tOrig= timeFilter(fns[iFn], &image, &resOrig, numRepeat);
+        setFastFilters(true);
+        double tFast= timeFilter(fns[iFn], &image, &resFast, numRepeat);
+        setFilterThreads(numThreads);
+        double tFastMT= timeFilter(fns[iFn], &image, &resFastMT, numRepeat);
+
+        double diff= std::max(maxAbsDiff(&resOrig, &resFast), maxAbsDiff(&resOrig, &resFastMT));
+        std::cout<<names[iFn]<<": "<<tOrig<<" / "<<tFast<<" / "<<tFastMT
+                 <<" ms, speedup "<<tOrig/tFast<<" / "<<tOrig/tFastMT<<", max abs diff "<<diff<<"\n";
+        ASSERT(diff < 1e-4);
+
+        totOrig+= tOrig; totFast+= tFast; totFastMT+= tFastMT;
+    }
+
+    std::cout<<"total: "<<totOrig<<" / "<<totFast<<" / "<<totFastMT<<" ms\n";
+
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "bench_util.h"
+#include "image_graph.h"
+#include "index_entry.pb.h"
+#include "macros.h"
+#include "proto_db_file.h"
+#include "proto_index.h"
+#include "same_random.h"
+#include "tfidf_v2.h"
+#include "timing.h"
+
+
+// tf-idf image graph on a synthetic collection of scenes where documents of a scene share words:
+// 1) imageGraph::computeParallel querying a tfidfV2 once per document vs imageGraph::computeTfidfBatch
+//    (tiled sparse A*A'), checks that the two graphs are the same
+// 2) adding 10% of documents with imageGraph::computeIncremental vs recomputing the whole graph,
+//    checks the delta/compacted files and reports how many edges of the recomputed graph are found
+// usage: image_graph_bench [numDocs featsPerDoc maxNeighs]
+
+uint32_t const numWords= 50000, wordsPerScene= 2000;
+
+
+
+// the same up to ties in score (which may be ordered differently or cut at maxNeighs),
+// tfidfV2 keeps the query weights as float in rr::indexEntry so scores differ a bit
+void
+compareNeighs(std::vector<indScorePair> const &nA, std::vector<indScorePair> const &nB){
+    ASSERT( nA.size()==nB.size() );
+    for (uint32_t i= 0; i<nA.size(); ++i){
+        ASSERT( fabs(nA[i].second-nB[i].second) <= 1e-6*nA[i].second );
+        bool const tied= (i>0 && fabs(nA[i].second-nA[i-1].second) <= 1e-6*nA[i].second) ||
+                         (i+1<nA.size() && fabs(nA[i].second-nA[i+1].second) <= 1e-6*nA[i].second) ||
+                         i+1==nA.size();
+        ASSERT( tied || nA[i].first==nB[i].first );
+    }
+}
+
+
+
+void
+compareGraphs(imageGraph const &a, imageGraph const &b){
+    ASSERT( a.graph_.size()==b.graph_.size() );
+    uint64_t numEdges= 0;
+    for (imageGraph::imageGraphType::const_iterator itA= a.graph_.begin(), itB= b.graph_.begin();
+         itA!=a.graph_.end(); ++itA, ++itB){
+        ASSERT( itA->first==itB->first );
+        compareNeighs(itA->second, itB->second);
+        numEdges+= itA->second.size();
+    }
+    std::cout<<"    same graph: "<<a.graph_.size()<<" nodes, "<<numEdges<<" edges\n";
+}
+
+
+
+// iidx (one entry per feature, as buildIndex) and fidx (unique words) of documents [0, numDocs)
+void
+writeIndexes(std::vector< std::vector<uint32_t> > const &postings, uint32_t numDocs,
+             std::string const &iidxFn, std::string const &fidxFn){
+
+    std::vector< std::vector<uint32_t> > docWords(numDocs);
+    protoDbFileBuilder dbBuilder(iidxFn, "iidx");
+    indexBuilder idxBuilder(dbBuilder, true, false, false);
+    for (uint32_t wordID= 0; wordID<numWords; ++wordID){
+        std::vector<uint32_t> const &p= postings[wordID];
+        rr::indexEntry entry;
+        for (uint32_t i= 0; i<p.size() && p[i]<numDocs; ++i){
+            entry.add_id(p[i]);
+            if (i==0 || p[i]!=p[i-1])
+                docWords[p[i]].push_back(wordID);
+        }
+        if (entry.id_size()>0)
+            idxBuilder.addEntry(wordID, entry);
+    }
+    idxBuilder.close();
+
+    protoDbFileBuilder fidxDbBuilder(fidxFn, "fidx");
+    indexBuilder fidxBuilder(fidxDbBuilder, true, false, false);
+    for (uint32_t docID= 0; docID<numDocs; ++docID){
+        rr::indexEntry entry;
+        for (uint32_t i= 0; i<docWords[docID].size(); ++i)
+            entry.add_id(docWords[docID][i]);
+        fidxBuilder.addEntry(docID, entry);
+    }
+    fidxBuilder.close();
+}
+
+
+
+int main(int argc, char **argv){
+
+    uint32_t const numDocs= argc>1 ? atoi(argv[1]) : 4000;
+    uint32_t const featsPerDoc= argc>2 ? atoi(argv[2]) : 500;
+    uint32_t const maxNeighs= argc>3 ? atoi(argv[3]) : 100;
+    uint32_t const numScenes= std::max(numDocs/20, 1U);
+
+    sameRandomUint32 rand(numScenes + static_cast<uint64_t>(numDocs)*(2*featsPerDoc+1) + 1, 47);
+    sameRandomStreamUint32 randStream(rand);
+
+    // features of each document: mostly words of its scene, some random ones
+    std::vector< std::vector<uint32_t> > postings(numWords);
+    std::vector<uint32_t> sceneFirstWord(numScenes);
+    for (uint32_t iScene= 0; iScene<numScenes; ++iScene)
+        sceneFirstWord[iScene]= randStream.getNext0ToN(numWords-wordsPerScene);
+    for (uint32_t docID= 0; docID<numDocs; ++docID){
+        uint32_t const iScene= randStream.getNext0ToN(numScenes);
+        for (uint32_t iFeat= 0; iFeat<featsPerDoc; ++iFeat){
+            uint32_t const wordID= randStream.getNext0ToN(4)==0 ?
+                randStream.getNext0ToN(numWords) :
+                sceneFirstWord[iScene] + randStream.getNext0ToN(wordsPerScene);
+            postings[wordID].push_back(docID);
+        }
+    }
+
+    std::string const iidxFn= benchUtil::tempFn("image_graph_bench_%%%%-%%%%.iidx");
+    std::string const fidxFn= benchUtil::tempFn("image_graph_bench_%%%%-%%%%.fidx");
+    writeIndexes(postings, numDocs, iidxFn, fidxFn);
+
+    protoDbFile iidxDb(iidxFn), fidxDb(fidxFn);
+    protoIndex iidx(iidxDb, false), fidx(fidxDb, false);
+    tfidfV2 tfidfObj(&iidx, &fidx);
+
+    std::cout<<numDocs<<" documents, "<<featsPerDoc<<" features each, "<<numWords<<" words, maxNeighs "<<maxNeighs<<"\n";
+
+    std::string const graphFn= benchUtil::tempFn("image_graph_bench_%%%%-%%%%.v2bin");
+    std::string const batchGraphFn= benchUtil::tempFn("image_graph_bench_%%%%-%%%%.v2bin");
+    double const scoreThrs[2]= {0.05, 1e-9};
+
+    for (uint32_t iThr= 0; iThr<2; ++iThr){
+
+        double const scoreThr= scoreThrs[iThr];
+        std::cout<<"scoreThr "<<scoreThr<<"\n";
+
+        imageGraph graph;
+        double t0= timing::tic();
+        graph.computeParallel(graphFn, numDocs, tfidfObj, maxNeighs, scoreThr);
+        double const tQuery= timing::toc(t0);
+
+        imageGraph batchGraph;
+        t0= timing::tic();
+        batchGraph.computeTfidfBatch(batchGraphFn, iidx, fidx, tfidfObj.getIdf(), tfidfObj.getDocL2(), maxNeighs, scoreThr);
+        double const tBatch= timing::toc(t0);
+
+        compareGraphs(graph, batchGraph);
+        // and as loaded from the files
+        imageGraph loaded(graphFn), batchLoaded(batchGraphFn);
+        compareGraphs(loaded, batchLoaded);
+
+        std::cout<<"    computeParallel (tfidfV2):  "<<numDocs/tQuery*1000<<" docs/s\n";
+        std::cout<<"    computeTfidfBatch:          "<<numDocs/tBatch*1000<<" docs/s\n";
+    }
+
+    // incremental: the collection without the last 10% of documents, then they are added
+
+    uint32_t const numOld= numDocs - numDocs/10;
+    double const scoreThr= scoreThrs[0];
+    std::cout<<"adding "<<numDocs-numOld<<" documents to "<<numOld<<", scoreThr "<<scoreThr<<"\n";
+    {
+        std::string const oldIidxFn= benchUtil::tempFn("image_graph_bench_%%%%-%%%%.iidx");
+        std::string const oldFidxFn= benchUtil::tempFn("image_graph_bench_%%%%-%%%%.fidx");
+        writeIndexes(postings, numOld, oldIidxFn, oldFidxFn);
+        protoDbFile oldIidxDb(oldIidxFn), oldFidxDb(oldFidxFn);
+        protoIndex oldIidx(oldIidxDb, false), oldFidx(oldFidxDb, false);
+        tfidfV2 oldTfidfObj(&oldIidx, &oldFidx);
+        imageGraph oldGraph;
+        oldGraph.computeParallel(graphFn, numOld, oldTfidfObj, maxNeighs, scoreThr);
+        boost::filesystem::remove(oldIidxFn);
+        boost::filesystem::remove(oldFidxFn);
+    }
+
+    imageGraph graph(graphFn);
+    std::string const deltaFn= benchUtil::tempFn("image_graph_bench_%%%%-%%%%.delta");
+    double t0= timing::tic();
+    graph.computeIncremental(deltaFn, numOld, numDocs, tfidfObj, maxNeighs, scoreThr);
+    double const tIncremental= timing::toc(t0);
+
+    imageGraph fullGraph;
+    t0= timing::tic();
+    fullGraph.computeParallel(batchGraphFn, numDocs, tfidfObj, maxNeighs, scoreThr);
+    double const tFull= timing::toc(t0);
+
+    // new documents are queried as in the full computation, the existing ones keep their
+    // (old idf) lists with edges to the new ones inserted
+    uint64_t numNewEdges= 0, numNewEdgesFound= 0;
+    for (imageGraph::imageGraphType::const_iterator itG= graph.graph_.begin(); itG!=graph.graph_.end(); ++itG){
+        uint32_t const docID= itG->first;
+        std::vector<indScorePair> const &neighs= itG->second;
+        imageGraph::imageGraphType::const_iterator itFull= fullGraph.graph_.find(docID);
+        if (docID>=numOld){
+            ASSERT( itFull!=fullGraph.graph_.end() );
+            compareNeighs(neighs, itFull->second);
+            continue;
+        }
+        ASSERT( maxNeighs==0 || neighs.size()<=maxNeighs );
+        for (uint32_t i= 0; i<neighs.size(); ++i)
+            ASSERT( neighs[i].second>=scoreThr && (i==0 || neighs[i-1].second>=neighs[i].second) );
+        if (itFull==fullGraph.graph_.end())
+            continue;
+        for (uint32_t i= 0; i<itFull->second.size(); ++i)
+            if (itFull->second[i].first>=numOld){
+                ++numNewEdges;
+                for (uint32_t j= 0; j<neighs.size(); ++j)
+                    numNewEdgesFound+= neighs[j].first==itFull->second[i].first;
+            }
+    }
+    std::cout<<"    edges from existing to new documents found: "<<numNewEdgesFound<<" / "<<numNewEdges<<"\n";
+
+    // base + delta, and compacted
+    {
+        imageGraph loaded(graphFn);
+        loaded.applyDelta(deltaFn);
+        compareGraphs(graph, loaded);
+        imageGraph::compact(graphFn, std::vector<std::string>(1, deltaFn));
+        ASSERT( !boost::filesystem::exists(deltaFn) );
+        imageGraph compacted(graphFn);
+        compareGraphs(graph, compacted);
+    }
+
+    std::cout<<"    computeIncremental: "<<tIncremental<<" ms\n";
+    std::cout<<"    computeParallel:    "<<tFull<<" ms\n";
+
+    boost::filesystem::remove(iidxFn);
+    boost::filesystem::remove(fidxFn);
+    boost::filesystem::remove(graphFn);
+    boost::filesystem::remove(batchGraphFn);
+
+    return 0;
+}
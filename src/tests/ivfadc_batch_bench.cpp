@@ -0,0 +1,170 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "bench_util.h"
+#include "coarse_residual.h"
+#include "index_with_data.h"
+#include "index_with_data_file.h"
+#include "jp_dist2.hpp"
+#include "macros.h"
+#include "product_quant.h"
+#include "same_random.h"
+#include "timing.h"
+
+
+// IVF-ADC search with coarseResidual: one findKNN per query vs findKNNBatch, on random
+// coarse and product quantizer centres, with the index loaded into RAM and memory-mapped.
+// usage: ivfadc_batch_bench [numVecs numQueries nVisitCoarse numThreads]
+
+uint32_t const numDims= 128, numCoarse= 256, nSubQuant= 8, subQuantK= 256, KNN= 100;
+
+
+
+int main(int argc, char **argv){
+    
+    uint32_t const numVecs= argc>1 ? atoi(argv[1]) : 500000;
+    uint32_t const numQueries= argc>2 ? atoi(argv[2]) : 2000;
+    uint32_t const nVisitCoarse= argc>3 ? atoi(argv[3]) : 8;
+    uint32_t const numThreads= argc>4 ? atoi(argv[4]) : 4;
+    
+    sameRandomUint32 rand((numVecs+numQueries)*(numDims+1) + (numCoarse+subQuantK)*numDims, 43);
+    sameRandomStreamUint32 randStream(rand);
+    
+    // quantizers
+    
+    std::vector<float> coarse, sub;
+    std::string const coarseClstFn= benchUtil::tempFn("ivfadc_batch_bench_%%%%-%%%%.e3bin");
+    benchUtil::writeRandomCentres(coarseClstFn, numCoarse, numDims, 0.0f, 1.0f, randStream, coarse);
+    std::vector<std::string> clstFns(nSubQuant);
+    for (uint32_t iSub= 0; iSub<nSubQuant; ++iSub){
+        clstFns[iSub]= benchUtil::tempFn("ivfadc_batch_bench_%%%%-%%%%.e3bin");
+        // residuals are small
+        benchUtil::writeRandomCentres(clstFns[iSub], subQuantK, numDims/nSubQuant, -0.125f, 0.25f, randStream, sub);
+    }
+    productQuant pq(clstFns, true);
+    
+    // inverted index of residuals: vectors near the coarse centres
+    
+    std::vector< std::vector<uint32_t> > cellVecIDs(numCoarse);
+    std::vector< std::vector<float> > cellResiduals(numCoarse);
+    std::vector<float> vec(numDims);
+    for (uint32_t vecID= 0; vecID<numVecs; ++vecID){
+        uint32_t const coarseID= randStream.getNext0ToN(numCoarse);
+        for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+            vec[iDim]= coarse[coarseID*numDims+iDim] + (randStream.getNext0ToN(1000)/1000.0f - 0.5f)/4;
+        uint32_t nearest= 0;
+        float nearestDistSq= jp_dist_l2(&vec[0], &coarse[0], numDims);
+        for (uint32_t c= 1; c<numCoarse; ++c){
+            float const distSq= jp_dist_l2(&vec[0], &coarse[c*numDims], numDims);
+            if (distSq<nearestDistSq){ nearest= c; nearestDistSq= distSq; }
+        }
+        cellVecIDs[nearest].push_back(vecID);
+        for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+            cellResiduals[nearest].push_back(vec[iDim] - coarse[nearest*numDims+iDim]);
+    }
+    
+    std::string const iidxFn= benchUtil::tempFn("ivfadc_batch_bench_%%%%-%%%%.iidx");
+    {
+        indexWithDataFileBuilder iidxBuilder(iidxFn);
+        for (uint32_t coarseID= 0; coarseID<numCoarse; ++coarseID){
+            if (cellVecIDs[coarseID].empty())
+                continue;
+            std::string data;
+            uint32_t const size= pq.compress(&cellResiduals[coarseID][0], cellVecIDs[coarseID].size(), data);
+            iidxBuilder.addData(coarseID, cellVecIDs[coarseID], reinterpret_cast<unsigned char const *>(data.data()), size);
+        }
+        iidxBuilder.close();
+    }
+    double t0= timing::tic();
+    indexWithDataFile iidxOnDisk(iidxFn);
+    double const tOpen= timing::toc(t0);
+    t0= timing::tic();
+    indexWithDataInRam iidx(iidxOnDisk);
+    double const tLoad= timing::toc(t0);
+    
+    coarseResidual CR(coarseClstFn, pq, iidx, nVisitCoarse, false);
+    
+    std::vector<float> queries(numQueries*numDims);
+    for (uint32_t iQ= 0; iQ<numQueries; ++iQ){
+        uint32_t const coarseID= randStream.getNext0ToN(numCoarse);
+        for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+            queries[iQ*numDims+iDim]= coarse[coarseID*numDims+iDim] + (randStream.getNext0ToN(1000)/1000.0f - 0.5f)/4;
+    }
+    
+    // one query at a time
+    t0= timing::tic();
+    std::vector< std::vector<nnSearcher::vecIDdist> > single(numQueries);
+    for (uint32_t iQ= 0; iQ<numQueries; ++iQ)
+        CR.findKNN(&queries[iQ*numDims], KNN, single[iQ]);
+    double const tSingle= timing::toc(t0);
+    
+    // batched
+    t0= timing::tic();
+    std::vector< std::vector<nnSearcher::vecIDdist> > batch1;
+    CR.findKNNBatch(&queries[0], numQueries, KNN, batch1, 1);
+    double const tBatch1= timing::toc(t0);
+    
+    t0= timing::tic();
+    std::vector< std::vector<nnSearcher::vecIDdist> > batch;
+    CR.findKNNBatch(&queries[0], numQueries, KNN, batch, numThreads);
+    double const tBatch= timing::toc(t0);
+    
+    // the batch builds the lookup tables differently, so distances are equal up to rounding
+    double maxRelDiff= 0;
+    for (uint32_t iQ= 0; iQ<numQueries; ++iQ){
+        ASSERT( single[iQ].size()==batch[iQ].size() && batch1[iQ].size()==batch[iQ].size() );
+        for (uint32_t i= 0; i<batch[iQ].size(); ++i){
+            // IDs of equally distant vectors depend on the order in which cells are merged
+            ASSERT( batch1[iQ][i].distSq==batch[iQ][i].distSq );
+            maxRelDiff= std::max(maxRelDiff, static_cast<double>( fabs(single[iQ][i].distSq - batch[iQ][i].distSq) / std::max(single[iQ][i].distSq, 1e-6f) ));
+        }
+    }
+    ASSERT( maxRelDiff < 1e-3 );
+    
+    // directly on the memory-mapped file
+    coarseResidual CRMapped(coarseClstFn, pq, iidxOnDisk, nVisitCoarse, false);
+    t0= timing::tic();
+    std::vector< std::vector<nnSearcher::vecIDdist> > batchMapped;
+    CRMapped.findKNNBatch(&queries[0], numQueries, KNN, batchMapped, 1);
+    double const tBatchMapped= timing::toc(t0);
+    for (uint32_t iQ= 0; iQ<numQueries; ++iQ){
+        ASSERT( batchMapped[iQ].size()==batch1[iQ].size() );
+        for (uint32_t i= 0; i<batch1[iQ].size(); ++i)
+            ASSERT( batchMapped[iQ][i].distSq==batch1[iQ][i].distSq && batchMapped[iQ][i].ID==batch1[iQ][i].ID );
+    }
+    
+    std::cout<<numVecs<<" vectors, "<<numQueries<<" queries, "<<nVisitCoarse<<" of "<<numCoarse<<" coarse cells, ms/query:\n"
+             <<"findKNN:                  "<<tSingle/numQueries<<"\n"
+             <<"findKNNBatch:             "<<tBatch1/numQueries<<" (speedup "<<tSingle/tBatch1<<")\n"
+             <<"findKNNBatch, "<<numThreads<<" threads: "<<tBatch/numQueries<<" (speedup "<<tSingle/tBatch<<")\n"
+             <<"findKNNBatch, memory-mapped index: "<<tBatchMapped/numQueries<<"\n"
+             <<"max relative difference of distances: "<<maxRelDiff<<"\n"
+             <<"opening the index: "<<tOpen<<" ms memory-mapped, "<<tLoad<<" ms loading into RAM\n";
+    
+    boost::filesystem::remove(iidxFn);
+    boost::filesystem::remove(coarseClstFn);
+    for (uint32_t iSub= 0; iSub<nSubQuant; ++iSub)
+        boost::filesystem::remove(clstFns[iSub]);
+    
+    return 0;
+}
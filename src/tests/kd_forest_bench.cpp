@@ -0,0 +1,148 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include <fastann.hpp>
+
+#include "bench_util.h"
+#include "clst_centres.h"
+#include "clst_nn.h"
+#include "kd_forest.h"
+#include "macros.h"
+#include "same_random.h"
+#include "timing.h"
+
+
+// kdForest vs fastann's kd-tree for assigning to the vocabulary: build time (single / multithreaded),
+// startup time when the saved forest is memory-mapped, throughput and agreement with exact search,
+// on RootSIFT-like centres and queries.
+// usage: kd_forest_bench [numClst numQueries]
+
+uint32_t const numDims= 128;
+
+
+
+// assignments per second and the fraction equal to the exact ones
+void
+evaluate(char const *name, fastann::nn_obj<float> const &nn, std::vector<float> const &queries, std::vector<unsigned> const &exact){
+    uint32_t const numQueries= exact.size();
+    std::vector<unsigned> assigns(numQueries);
+    std::vector<float> distSqs(numQueries);
+    double const t0= timing::tic();
+    nn.search_nn(&queries[0], numQueries, &assigns[0], &distSqs[0]);
+    double const t= timing::toc(t0);
+    uint32_t numAgree= 0;
+    for (uint32_t iQ= 0; iQ<numQueries; ++iQ)
+        numAgree+= assigns[iQ]==exact[iQ];
+    std::cout<<"  "<<name<<": "<<numQueries/t*1000<<" assignments/s, agreement with exact "<<100.0*numAgree/numQueries<<"%\n";
+}
+
+
+
+int main(int argc, char **argv){
+
+    uint32_t const numClst= argc>1 ? atoi(argv[1]) : 100000;
+    uint32_t const numQueries= argc>2 ? atoi(argv[2]) : 2000;
+
+    sameRandomUint32 rand((numClst+numQueries)*(2*numDims+1), 44);
+    sameRandomStreamUint32 randStream(rand);
+
+    // centres in the .e3bin format of clstCentres
+    boost::filesystem::path const tempDir= boost::filesystem::temp_directory_path();
+    std::string const clstFn= (tempDir / boost::filesystem::unique_path("kd_forest_bench_%%%%-%%%%.e3bin")).native();
+    std::vector<float> centres(static_cast<uint64_t>(numClst)*numDims);
+    for (uint32_t iClst= 0; iClst<numClst; ++iClst)
+        benchUtil::rootSIFTLike(randStream, &centres[static_cast<uint64_t>(iClst)*numDims], numDims);
+    benchUtil::writeCentres(clstFn, numClst, numDims, &centres[0]);
+
+    // queries near a centre
+    std::vector<float> queries(numQueries*numDims), noise(numDims);
+    for (uint32_t iQ= 0; iQ<numQueries; ++iQ){
+        uint32_t const iClst= randStream.getNext0ToN(numClst);
+        benchUtil::rootSIFTLike(randStream, &noise[0], numDims);
+        for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+            queries[iQ*numDims+iDim]= 0.7f*centres[static_cast<uint64_t>(iClst)*numDims+iDim] + 0.3f*noise[iDim];
+    }
+
+    std::cout<<numClst<<" centres, "<<numQueries<<" queries, "<<boost::thread::hardware_concurrency()<<" cores\n";
+
+    char const *names[2]= {"float", "uint8"};
+
+    for (uint32_t iStorage= 0; iStorage<2; ++iStorage){
+
+        std::cout<<names[iStorage]<<" storage\n";
+        clstCentres clst(clstFn.c_str(), true, clstCentres::storageFromString(names[iStorage]));
+
+        std::vector<unsigned> exact(numQueries);
+        {
+            std::vector<float> distSqs(numQueries);
+            clstCentresExactNN exactNN(clst);
+            double const t0= timing::tic();
+            exactNN.search_nn(&queries[0], numQueries, &exact[0], &distSqs[0]);
+            std::cout<<"  exact: "<<numQueries/timing::toc(t0)*1000<<" assignments/s\n";
+        }
+
+        if (iStorage==0){
+            double t0= timing::tic();
+            fastann::nn_obj<float> *fastannNN= fastann::nn_obj_build_kdtree(clst.clstC_flat, numClst, numDims, 8, 1024);
+            std::cout<<"  fastann kd-tree build: "<<timing::toc(t0)<<" ms\n";
+            evaluate("fastann kd-tree", *fastannNN, queries, exact);
+            delete fastannNN;
+        }
+
+        double t0= timing::tic();
+        kdForest single(clst, 8, 1024, 8, 1);
+        std::cout<<"  kdForest build, 1 thread: "<<timing::toc(t0)<<" ms\n";
+        t0= timing::tic();
+        kdForest multi(clst);
+        std::cout<<"  kdForest build, "<<boost::thread::hardware_concurrency()<<" threads: "<<timing::toc(t0)<<" ms\n";
+
+        // built by the file constructor so that the saved forest records clstFn's checksum
+        std::string const kdfFn= kdForest::getFn(clstFn);
+        t0= timing::tic();
+        {
+            kdForest built(clst, kdfFn, clstFn);
+        }
+        std::cout<<"  kdForest build and save: "<<timing::toc(t0)<<" ms\n";
+        t0= timing::tic();
+        kdForest mapped(clst, kdfFn, clstFn);
+        std::cout<<"  kdForest startup from the saved file: "<<timing::toc(t0)<<" ms\n";
+
+        evaluate("kdForest", mapped, queries, exact);
+
+        // same seeds, so all three are the same forest
+        std::vector<unsigned> a1(numQueries*3), a2(numQueries*3), a3(numQueries*3);
+        std::vector<float> d1(numQueries*3), d2(numQueries*3), d3(numQueries*3);
+        single.search_knn(&queries[0], numQueries, 3, &a1[0], &d1[0]);
+        multi.search_knn(&queries[0], numQueries, 3, &a2[0], &d2[0]);
+        mapped.search_knn(&queries[0], numQueries, 3, &a3[0], &d3[0]);
+        ASSERT( a1==a2 && a2==a3 && d1==d2 && d2==d3 );
+        for (uint32_t i= 0; i<numQueries*3; i+=3)
+            ASSERT( d3[i]<=d3[i+1] && d3[i+1]<=d3[i+2] );
+
+        boost::filesystem::remove(kdfFn);
+    }
+
+    boost::filesystem::remove(clstFn);
+
+    return 0;
+}
@@ -0,0 +1,211 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <stdint.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "bitcount.h"
+#include "index_entry.pb.h"
+#include "macros.h"
+#include "mq_filter_outliers.h"
+#include "same_random.h"
+
+
+
+// Hamming matching of mqFilterOutliers: countAVX2 has to count as countScalar, and pairScores
+// (features grouped by word, in parallel) has to give the score matrix of the original
+// merge of the word lists of every pair of queries
+
+uint32_t const numBits= 64;
+
+
+
+uint64_t
+randomSig(sameRandomStreamUint32 &randStream){
+    return (static_cast<uint64_t>(randStream.getNextUint32())<<32) | randStream.getNextUint32();
+}
+
+
+
+// sig with numFlips random bits flipped (possibly the same bit twice)
+uint64_t
+nearSig(sameRandomStreamUint32 &randStream, uint64_t sig, uint32_t numFlips){
+    for (uint32_t i= 0; i<numFlips; ++i)
+        sig^= static_cast<uint64_t>(1) << randStream.getNext0ToN(numBits);
+    return sig;
+}
+
+
+
+// as mqFilterOutliers::queryExecute did before pairScores
+void
+pairScoresMerge(std::vector<rr::indexEntry> const &queryReps,
+                std::vector< std::vector<uint64_t> > const &hammingSigs,
+                int distThr,
+                std::vector<uint32_t> &score){
+
+    uint32_t const nQ= queryReps.size();
+    score.assign(nQ*nQ, 0);
+
+    for (uint32_t iQ1= 0; iQ1<nQ; ++iQ1){
+
+        rr::indexEntry const &q1= queryReps[iQ1];
+        std::vector<uint64_t> const &sig1= hammingSigs[iQ1];
+
+        score[ iQ1*nQ + iQ1 ]= q1.id_size();
+
+        for (uint32_t iQ2= iQ1+1; iQ2<nQ; ++iQ2){
+
+            rr::indexEntry const &q2= queryReps[iQ2];
+            std::vector<uint64_t> const &sig2= hammingSigs[iQ2];
+
+            uint32_t thisScore= 0;
+            int i1= 0, i1end;
+            int i2= 0, i2end;
+
+            while (i1 < q1.id_size() && i2 < q2.id_size()){
+                while(i1 < q1.id_size() && i2 < q2.id_size() &&
+                      q1.id(i1) != q2.id(i2)) {
+                    if (q1.id(i1) < q2.id(i2))
+                        ++i1;
+                    else
+                        ++i2;
+                }
+                if (i1 < q1.id_size() && i2 < q2.id_size()){
+                    for (i1end= i1; i1end < q1.id_size() && q1.id(i1)==q1.id(i1end); ++i1end);
+                    for (i2end= i2; i2end < q2.id_size() && q2.id(i2)==q2.id(i2end); ++i2end);
+                    for (int j1= i1; j1<i1end; ++j1)
+                        for (int j2= i2; j2<i2end; ++j2)
+                            if ( bitcount64(sig1[j1]^sig2[j2]) <= distThr )
+                                ++thisScore;
+                    i1= i1end;
+                    i2= i2end;
+                }
+            }
+
+            score[ iQ1*nQ + iQ2 ]= thisScore;
+            score[ iQ2*nQ + iQ1 ]= thisScore;
+        }
+    }
+}
+
+
+
+void
+checkCount(sameRandomStreamUint32 &randStream){
+
+    using namespace mqFilterOutliersImpl;
+
+    if (!hasAVX2()){
+        std::cout<<"countAVX2: no AVX2 on this CPU, skipping\n";
+        return;
+    }
+
+    int const distThrs[]= {0, 1, 16, 32, 63, 64};
+    uint32_t numChecks= 0;
+
+    for (uint32_t n= 0; n<=67; ++n)
+        for (uint32_t bursty= 0; bursty<2; ++bursty){
+            uint64_t const sig= randomSig(randStream);
+            std::vector<uint64_t> sigs(n+1); // +1 so that &sigs[0] is valid for n=0
+            for (uint32_t i= 0; i<n; ++i){
+                if (!bursty)
+                    sigs[i]= randomSig(randStream);
+                else {
+                    // a bursty word: many copies of the same feature, some identical to sig
+                    uint32_t const r= randStream.getNext0ToN(4);
+                    sigs[i]= r==0 ? sig : nearSig(randStream, sig, r==1 ? 1 : randStream.getNext0ToN(24));
+                }
+            }
+            for (uint32_t iThr= 0; iThr<sizeof(distThrs)/sizeof(distThrs[0]); ++iThr){
+                uint32_t const expected= countScalar(sig, &sigs[0], n, distThrs[iThr]);
+                ASSERT( countAVX2(sig, &sigs[0], n, distThrs[iThr])==expected );
+                // every signature is within 64 bits
+                if (distThrs[iThr]==64)
+                    ASSERT( expected==n );
+                ++numChecks;
+            }
+        }
+
+    std::cout<<"countAVX2: same as countScalar in "<<numChecks<<" checks\n";
+}
+
+
+
+void
+checkPairScores(sameRandomStreamUint32 &randStream){
+
+    using namespace mqFilterOutliersImpl;
+
+    uint32_t const nQ= 23, numWords= 300, numBurstyWords= 5;
+
+    // features of a query are sorted by word, a few words are very frequent
+    // and their features similar to each other
+    std::vector<uint64_t> wordSig(numWords);
+    for (uint32_t wordID= 0; wordID<numWords; ++wordID)
+        wordSig[wordID]= randomSig(randStream);
+
+    std::vector<rr::indexEntry> queryReps(nQ);
+    std::vector< std::vector<uint64_t> > hammingSigs(nQ);
+    for (uint32_t iQ= 0; iQ<nQ; ++iQ){
+        // some queries are empty, to check those as well
+        uint32_t const numFeats= (iQ%7==3) ? 0 : randStream.getNext0ToN(400);
+        std::vector<uint32_t> words(numFeats);
+        for (uint32_t i= 0; i<numFeats; ++i)
+            words[i]= randStream.getNext0ToN(4)==0 ?
+                randStream.getNext0ToN(numBurstyWords) :
+                randStream.getNext0ToN(numWords);
+        std::sort(words.begin(), words.end());
+        for (uint32_t i= 0; i<numFeats; ++i){
+            queryReps[iQ].add_id(words[i]);
+            hammingSigs[iQ].push_back( nearSig(randStream, wordSig[words[i]], randStream.getNext0ToN(40)) );
+        }
+    }
+
+    int const distThrs[]= {0, 8, 16, 64};
+    uint32_t const numThreads[]= {1, 3, 8};
+
+    for (uint32_t iThr= 0; iThr<sizeof(distThrs)/sizeof(distThrs[0]); ++iThr){
+        std::vector<uint32_t> expected;
+        pairScoresMerge(queryReps, hammingSigs, distThrs[iThr], expected);
+        for (uint32_t iNT= 0; iNT<sizeof(numThreads)/sizeof(numThreads[0]); ++iNT){
+            std::vector<uint32_t> score;
+            pairScores(queryReps, hammingSigs, distThrs[iThr], numThreads[iNT], score);
+            ASSERT( score==expected );
+        }
+    }
+
+    // no queries
+    std::vector<uint32_t> score;
+    pairScores(std::vector<rr::indexEntry>(), std::vector< std::vector<uint64_t> >(), 16, 8, score);
+    ASSERT( score.empty() );
+
+    std::cout<<"pairScores: same as the pairwise merge for "<<nQ<<" queries\n";
+}
+
+
+
+int main() {
+
+    sameRandomUint32 rand(2000000, 43);
+    sameRandomStreamUint32 randStream(rand);
+
+    checkCount(randStream);
+    checkPairScores(randStream);
+
+    return 0;
+
+}
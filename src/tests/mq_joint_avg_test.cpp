@@ -0,0 +1,247 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+
+#include "char_streams.h"
+#include "hamming_data.pb.h"
+#include "hamming_embedder.h"
+#include "index_entry.pb.h"
+#include "macros.h"
+#include "mq_joint_avg.h"
+#include "same_random.h"
+
+
+
+// joint query of multiQueryJointAvg: with a Hamming embedding the k-way merge has to give the
+// features of the original concatenate + argsort by word, for BoW each word has to be one feature
+// weighted by its average count over the examples
+
+uint32_t const numBits= 64, numWords= 200;
+
+typedef boost::tuple<uint32_t, uint32_t, uint32_t, uint64_t> featType; // word, qx, qy, signature
+
+
+
+class wordLess {
+    public:
+        wordLess(rr::indexEntry const &rep) : rep_(&rep) {}
+        inline bool
+            operator()( int left, int right ) const { return rep_->id(left) < rep_->id(right); }
+    private:
+        rr::indexEntry const *rep_;
+};
+
+
+
+// as multiQueryJointAvg::queryExecute did before mergeReps, but with a stable argsort by word
+// (indexEntryUtil::argSort breaks ties by geometry) which is the order of the merge
+void
+mergeRepsArgSort(std::vector<rr::indexEntry> const &queryReps,
+                 embedderFactory const &eF,
+                 rr::indexEntry &queryRep){
+
+    rr::indexEntry queryRepTemp;
+    embedder *embTemp= eF.getEmbedder();
+    for (uint32_t iQuery= 0; iQuery<queryReps.size(); ++iQuery){
+        rr::indexEntry const &thisQueryRep= queryReps[iQuery];
+        if (thisQueryRep.id_size()==0)
+            continue;
+        for (int i= 0; i<thisQueryRep.id_size(); ++i){
+            queryRepTemp.add_id(thisQueryRep.id(i));
+            queryRepTemp.add_qx(thisQueryRep.qx(i));
+            queryRepTemp.add_qy(thisQueryRep.qy(i));
+        }
+        embedder *embThis= eF.getEmbedder();
+        embThis->setDataCopy(thisQueryRep.data());
+        embTemp->copyRangeFrom(*embThis, 0, thisQueryRep.id_size());
+        delete embThis;
+    }
+
+    std::vector<int> inds(queryRepTemp.id_size());
+    for (uint32_t i= 0; i<inds.size(); ++i)
+        inds[i]= i;
+    std::stable_sort(inds.begin(), inds.end(), wordLess(queryRepTemp));
+
+    queryRep.Clear();
+    embedder *emb= eF.getEmbedder();
+    for (uint32_t i= 0; i<inds.size(); ++i){
+        queryRep.add_id(queryRepTemp.id(inds[i]));
+        queryRep.add_qx(queryRepTemp.qx(inds[i]));
+        queryRep.add_qy(queryRepTemp.qy(inds[i]));
+        emb->copyFrom(*embTemp, inds[i]);
+    }
+    queryRep.set_data(emb->getEncoding());
+    delete emb;
+    delete embTemp;
+}
+
+
+
+// features of an embedded rep, in order
+void
+getFeats(rr::indexEntry const &rep, std::vector<featType> &feats){
+    ASSERT( rep.qx_size()==rep.id_size() && rep.qy_size()==rep.id_size() );
+    std::vector<uint64_t> sigs(rep.id_size());
+    charStreamView const view(numBits, rep.data());
+    ASSERT( view.getNum()==static_cast<uint32_t>(rep.id_size()) );
+    if (!sigs.empty())
+        view.decode(0, sigs.size(), &sigs[0]);
+    feats.clear();
+    for (int i= 0; i<rep.id_size(); ++i){
+        // sorted by word
+        ASSERT( i==0 || rep.id(i-1)<=rep.id(i) );
+        feats.push_back( boost::make_tuple(rep.id(i), rep.qx(i), rep.qy(i), sigs[i]) );
+    }
+}
+
+
+
+// random example reps sorted by word: about half of the features are of a few words, some examples are empty;
+// fields: 0 none, 1 count, 2 weight
+void
+makeReps(sameRandomStreamUint32 &randStream, embedderFactory const *eF, uint32_t nQ, uint32_t fields,
+         std::vector<rr::indexEntry> &queryReps){
+    queryReps.assign(nQ, rr::indexEntry());
+    for (uint32_t iQuery= 0; iQuery<nQ; ++iQuery){
+        uint32_t const numFeats= (iQuery%5==2) ? 0 : randStream.getNext0ToN(300);
+        std::vector<uint32_t> words(numFeats);
+        for (uint32_t i= 0; i<numFeats; ++i)
+            words[i]= randStream.getNext0ToN(2)==0 ? randStream.getNext0ToN(3) : randStream.getNext0ToN(numWords);
+        std::sort(words.begin(), words.end());
+
+        rr::indexEntry &rep= queryReps[iQuery];
+        embedder *emb= eF==NULL ? NULL : eF->getEmbedder();
+        for (uint32_t i= 0; i<numFeats; ++i){
+            rep.add_id(words[i]);
+            if (eF!=NULL){
+                rep.add_qx(randStream.getNext0ToN(4));
+                rep.add_qy(randStream.getNext0ToN(4));
+                uint64_t const sig= (static_cast<uint64_t>(randStream.getNextUint32())<<32) | randStream.getNextUint32();
+                static_cast<hammingEmbedder*>(emb)->getCharStream()->add(sig);
+            }
+            if (fields==1)
+                rep.add_count(1 + randStream.getNext0ToN(3));
+            else if (fields==2)
+                rep.add_weight(randStream.getNext0ToN(1000) / 1000.0f);
+        }
+        if (eF!=NULL){
+            rep.set_data(emb->getEncoding());
+            delete emb;
+        }
+    }
+}
+
+
+
+void
+checkEmbedded(sameRandomStreamUint32 &randStream, embedderFactory const &eF){
+    uint32_t const nQs[]= {1, 2, 7, 20};
+    for (uint32_t iNQ= 0; iNQ<sizeof(nQs)/sizeof(nQs[0]); ++iNQ){
+        std::vector<rr::indexEntry> queryReps;
+        makeReps(randStream, &eF, nQs[iNQ], 0, queryReps);
+
+        rr::indexEntry merged, argSorted;
+        mqJointAvgImpl::mergeReps(queryReps, &eF, merged);
+        mergeRepsArgSort(queryReps, eF, argSorted);
+
+        std::vector<featType> featsMerged, featsArgSorted;
+        getFeats(merged, featsMerged);
+        getFeats(argSorted, featsArgSorted);
+        ASSERT( featsMerged==featsArgSorted );
+        // nothing combined or weighted
+        ASSERT( merged.weight_size()==0 );
+    }
+    std::cout<<"embedded: same features as concatenate + argsort\n";
+}
+
+
+
+void
+checkBoW(sameRandomStreamUint32 &randStream){
+    uint32_t const nQ= 9;
+    for (uint32_t fields= 0; fields<3; ++fields){
+        std::vector<rr::indexEntry> queryReps;
+        makeReps(randStream, NULL, nQ, fields, queryReps);
+
+        // each feature contributes its weight, count or 1, divided by the number of examples
+        std::map<uint32_t, double> expected;
+        for (uint32_t iQuery= 0; iQuery<nQ; ++iQuery){
+            rr::indexEntry const &rep= queryReps[iQuery];
+            for (int i= 0; i<rep.id_size(); ++i)
+                expected[rep.id(i)]+= ( fields==2 ? rep.weight(i) : (fields==1 ? rep.count(i) : 1.0) ) / nQ;
+        }
+
+        rr::indexEntry merged;
+        mqJointAvgImpl::mergeReps(queryReps, NULL, merged);
+
+        ASSERT( merged.id_size()==static_cast<int>(expected.size()) );
+        ASSERT( merged.weight_size()==merged.id_size() );
+        ASSERT( !merged.has_data() && merged.qx_size()==0 );
+        std::map<uint32_t, double>::const_iterator it= expected.begin();
+        for (int i= 0; i<merged.id_size(); ++i, ++it){
+            // one feature per word, in word order
+            ASSERT( merged.id(i)==it->first );
+            ASSERT( fabs(merged.weight(i) - it->second) <= 1e-5 * std::max(it->second, 1.0) );
+        }
+    }
+
+    // only empty examples
+    rr::indexEntry merged;
+    mqJointAvgImpl::mergeReps(std::vector<rr::indexEntry>(3), NULL, merged);
+    ASSERT( merged.id_size()==0 );
+
+    std::cout<<"BoW: one feature per word with the average count / weight\n";
+}
+
+
+
+int main() {
+
+    // identity Hamming parameters, only the signatures set directly are used
+    std::string const hammFn= (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("mq_joint_avg_test_%%%%-%%%%.bin")).native();
+    {
+        rr::hammingData hamm;
+        hamm.set_k(1);
+        hamm.set_numdims(numBits);
+        hamm.set_numbits(numBits);
+        for (uint32_t i= 0; i<numBits; ++i)
+            hamm.add_median(0.0f);
+        for (uint32_t i= 0; i<numBits*numBits; ++i)
+            hamm.add_rotation( i%(numBits+1)==0 ? 1.0f : 0.0f );
+        std::ofstream out(hammFn.c_str(), std::ios::binary);
+        ASSERT( hamm.SerializeToOstream(&out) );
+    }
+    hammingEmbedderFactory const eF(hammFn, numBits);
+    boost::filesystem::remove(hammFn);
+
+    sameRandomUint32 rand(1000000, 43);
+    sameRandomStreamUint32 randStream(rand);
+
+    checkEmbedded(randStream, eF);
+    checkBoW(randStream);
+
+    return 0;
+
+}
@@ -0,0 +1,115 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+
+#include "bench_util.h"
+#include "macros.h"
+#include "nn_compressed.h"
+#include "product_quant.h"
+#include "same_random.h"
+#include "timing.h"
+
+
+// productQuant distance computation: the original lazy getDistsSq + partial_sort vs the
+// lookup-table scan into a top-k heap (getKNN, as used by nnCompressed and coarseResidual),
+// on random centres and codes. The two have to return the same neighbours.
+// usage: pq_adc_bench [subQuantK numVecs nSubQuant KNN]
+
+
+
+int main(int argc, char **argv){
+    
+    uint32_t const subQuantK= argc>1 ? atoi(argv[1]) : 256;
+    uint32_t const numVecs= argc>2 ? atoi(argv[2]) : 1000000;
+    uint32_t const nSubQuant= argc>3 ? atoi(argv[3]) : 8;
+    uint32_t const KNN= std::min(numVecs, argc>4 ? static_cast<uint32_t>(atoi(argv[4])) : 100);
+    uint32_t const subDims= 128/nSubQuant, numQueries= 20;
+    ASSERT(numVecs>0);
+    
+    sameRandomUint32 rand(numVecs*nSubQuant + subQuantK*128 + numQueries*128, 43);
+    sameRandomStreamUint32 randStream(rand);
+    
+    std::vector<std::string> clstFns(nSubQuant);
+    std::vector<float> centres;
+    for (uint32_t iSub= 0; iSub<nSubQuant; ++iSub){
+        clstFns[iSub]= benchUtil::tempFn("pq_adc_bench_%%%%-%%%%.e3bin");
+        benchUtil::writeRandomCentres(clstFns[iSub], subQuantK, subDims, 0.0f, 1.0f, randStream, centres);
+    }
+    productQuant pq(clstFns);
+    
+    charStream *charStream_obj= pq.charStreamFactoryCreate();
+    charStream_obj->reserve(numVecs*nSubQuant);
+    for (uint32_t i= 0; i<numVecs*nSubQuant; ++i)
+        charStream_obj->add( randStream.getNext0ToN(subQuantK) );
+    std::string const data= charStream_obj->getDataCopy();
+    delete charStream_obj;
+    
+    std::vector<float> queries(numQueries*128);
+    for (uint32_t i= 0; i<queries.size(); ++i)
+        queries[i]= randStream.getNext0ToN(1000) / 1000.0f;
+    
+    double tSlow= 0, tDists= 0, tKNN= 0;
+    
+    for (uint32_t iQ= 0; iQ<numQueries; ++iQ){
+        float const *qVec= &queries[iQ*128];
+        
+        // original
+        double t0= timing::tic();
+        float *distsSqSlow;
+        uint32_t const n= pq.getDistsSqSlow(qVec, data, distsSqSlow);
+        std::vector< std::pair<float, uint32_t> > slow(n);
+        for (uint32_t i= 0; i<n; ++i)
+            slow[i]= std::make_pair(distsSqSlow[i], i);
+        std::partial_sort(slow.begin(), slow.begin()+KNN, slow.end());
+        slow.resize(KNN);
+        tSlow+= timing::toc(t0);
+        
+        // all distances through the lookup table
+        t0= timing::tic();
+        float *distsSq;
+        ASSERT( pq.getDistsSq(qVec, data, distsSq)==n );
+        tDists+= timing::toc(t0);
+        for (uint32_t i= 0; i<n; ++i)
+            ASSERT( distsSq[i]==distsSqSlow[i] );
+        delete []distsSq;
+        delete []distsSqSlow;
+        
+        // scan into the heap
+        t0= timing::tic();
+        std::vector<nnSearcher::vecIDdist> vecIDdists;
+        nnCompressed::findKNN(pq, data, qVec, KNN, vecIDdists);
+        tKNN+= timing::toc(t0);
+        ASSERT( vecIDdists.size()==KNN );
+        for (uint32_t i= 0; i<KNN; ++i)
+            ASSERT( vecIDdists[i].distSq==slow[i].first );
+    }
+    
+    std::cout<<subQuantK<<" clusters x "<<nSubQuant<<" subquantizers, "<<numVecs<<" vectors, "<<KNN<<"-NN, ms/query:\n";
+    std::cout<<"original getDistsSq + partial_sort: "<<tSlow/numQueries<<"\n";
+    std::cout<<"lookup table getDistsSq:            "<<tDists/numQueries<<"\n";
+    std::cout<<"getKNN (nnCompressed::findKNN):     "<<tKNN/numQueries<<" (speedup "<<tSlow/tKNN<<")\n";
+    
+    for (uint32_t iSub= 0; iSub<nSubQuant; ++iSub)
+        boost::filesystem::remove(clstFns[iSub]);
+    
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+
+#include "macros.h"
+#include "putative.h"
+#include "same_random.h"
+#include "timing.h"
+
+
+// Brute-force putative matching: the original jp_dist_l2 loop vs the blocked matcher,
+// on synthetic SIFT-like descriptors where half of image 1 are noisy copies from image 2.
+// uint8 results must be identical, float (RootSIFT) ones may differ on ratio-test ties.
+// usage: putative_desc_bench [size1 size2 numThreads]
+
+typedef std::vector< std::pair<uint32_t, uint32_t> > matchesType;
+
+uint32_t const nDims= 128;
+
+
+
+void
+makeDescs(uint32_t size1, uint32_t size2, std::vector<uint8_t> &desc1, std::vector<uint8_t> &desc2){
+    sameRandomUint32 rand((size1+size2)*nDims*2, 43);
+    sameRandomStreamUint32 randStream(rand);
+    desc1.resize(size1*nDims);
+    desc2.resize(size2*nDims);
+    // skewed towards small values as SIFT
+    for (uint32_t i= 0; i<desc2.size(); ++i)
+        desc2[i]= randStream.getNext0ToN(256) * randStream.getNext0ToN(256) / 256;
+    for (uint32_t i= 0; i<size1; ++i)
+        for (uint32_t d= 0; d<nDims; ++d){
+            int v= (i%2==0) ?
+                static_cast<int>(desc2[(i/2 % size2)*nDims+d]) + static_cast<int>(randStream.getNext0ToN(41)) - 20 :
+                randStream.getNext0ToN(256) * randStream.getNext0ToN(256) / 256;
+            desc1[i*nDims+d]= std::max(0, std::min(255, v));
+        }
+}
+
+
+
+void
+toRootSIFT(std::vector<uint8_t> const &in, std::vector<float> &out){
+    out.resize(in.size());
+    for (uint32_t i= 0; i<in.size(); i+= nDims){
+        float sum= 0;
+        for (uint32_t d= 0; d<nDims; ++d)
+            sum+= in[i+d];
+        for (uint32_t d= 0; d<nDims; ++d)
+            out[i+d]= sqrt(in[i+d]/std::max(sum, 1.0f));
+    }
+}
+
+
+
+uint32_t
+numCommon(matchesType a, matchesType b){
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    matchesType common;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(common));
+    return common.size();
+}
+
+
+
+template<class DescType>
+void
+bench(char const name[], DescType const *desc1, uint32_t size1, DescType const *desc2, uint32_t size2, uint32_t numThreads){
+    matchesType mSlow, mFast, mFastMT;
+
+    double t0= timing::tic();
+    putativeDescMatcher::getPutativeMatchesSlow(desc1, size1, desc2, size2, nDims, mSlow, true, 0.81f, 100.0f);
+    double const tSlow= timing::toc(t0);
+
+    t0= timing::tic();
+    putative_desc<DescType>::getPutativeMatches(desc1, size1, desc2, size2, nDims, mFast, true, 0.81f, 100.0f, 1);
+    double const tFast= timing::toc(t0);
+
+    t0= timing::tic();
+    putative_desc<DescType>::getPutativeMatches(desc1, size1, desc2, size2, nDims, mFastMT, true, 0.81f, 100.0f, numThreads);
+    double const tFastMT= timing::toc(t0);
+
+    std::cout<<name<<": "<<tSlow<<" / "<<tFast<<" / "<<tFastMT<<" ms, speedup "
+             <<tSlow/tFast<<" / "<<tSlow/tFastMT<<"; matches "<<mSlow.size()<<" / "<<mFast.size()
+             <<", common "<<numCommon(mSlow, mFast)<<"\n";
+    ASSERT(mFast==mFastMT);
+}
+
+
+
+int main(int argc, char **argv){
+
+    uint32_t const size1= argc>1 ? atoi(argv[1]) : 3000;
+    uint32_t const size2= argc>2 ? atoi(argv[2]) : 3000;
+    uint32_t const numThreads= argc>3 ? atoi(argv[3]) : 4;
+
+    std::vector<uint8_t> desc1, desc2;
+    makeDescs(size1, size2, desc1, desc2);
+    std::vector<float> desc1f, desc2f;
+    toRootSIFT(desc1, desc1f);
+    toRootSIFT(desc2, desc2f);
+
+    std::cout<<size1<<" x "<<size2<<", ms: original / blocked / blocked with "<<numThreads<<" threads\n";
+
+    bench("uint8 SIFT", &desc1[0], size1, &desc2[0], size2, numThreads);
+
+    // the uint8 matcher computes exact distances
+    matchesType mSlow, mFast;
+    putativeDescMatcher::getPutativeMatchesSlow(&desc1[0], size1, &desc2[0], size2, nDims, mSlow, true, 0.81f, 100.0f);
+    putative_desc<uint8_t>::getPutativeMatches(&desc1[0], size1, &desc2[0], size2, nDims, mFast, true, 0.81f, 100.0f, numThreads);
+    ASSERT(mSlow==mFast);
+
+    bench("float RootSIFT", &desc1f[0], size1, &desc2f[0], size2, numThreads);
+
+    // epsilon matching
+    mSlow.clear(); mFast.clear();
+    putativeDescMatcher::getPutativeMatchesSlow(&desc1[0], size1, &desc2[0], size2, nDims, mSlow, false, 0.81f, 300.0f);
+    putative_desc<uint8_t>::getPutativeMatches(&desc1[0], size1, &desc2[0], size2, nDims, mFast, false, 0.81f, 300.0f, numThreads);
+    std::cout<<"epsilon: matches "<<mSlow.size()<<" / "<<mFast.size()<<"\n";
+    ASSERT(mSlow==mFast);
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "bench_util.h"
+#include "clst_centres.h"
+#include "clst_nn.h"
+#include "kd_forest.h"
+#include "macros.h"
+#include "same_random.h"
+#include "timing.h"
+#include "train_kmeans.h"
+#include "voc_tree.h"
+
+
+// Vocabulary trees of different shapes (branching^depth words) trained with buildIndex::computeVocTree
+// on RootSIFT-like descriptors: training time, assignment throughput for several beam widths, and
+// quality as agreement with / quantization error relative to the exact nearest word (and kdForest).
+// usage: voc_tree_bench [numTrainDescs numQueries]
+
+uint32_t const numDims= 128;
+
+
+
+// descriptors scattered around numModes random modes
+void
+makeDescs(sameRandomStreamUint32 &randStream, std::vector<float> const &modes, uint32_t numDescs, std::vector<float> &descs){
+    uint32_t const numModes= modes.size()/numDims;
+    std::vector<float> noise(numDims);
+    descs.resize(numDescs*numDims);
+    for (uint32_t iDesc= 0; iDesc<numDescs; ++iDesc){
+        uint32_t const iMode= randStream.getNext0ToN(numModes);
+        benchUtil::rootSIFTLike(randStream, &noise[0], numDims);
+        for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+            descs[iDesc*numDims+iDim]= 0.6f*modes[iMode*numDims+iDim] + 0.4f*noise[iDim];
+    }
+}
+
+
+
+// assignments per second, agreement with the exact nearest word and mean squared distance to the assigned word
+void
+evaluate(char const *name, fastann::nn_obj<float> const &nn, std::vector<float> const &queries,
+         std::vector<unsigned> const &exact, std::vector<float> const &exactDistSqs){
+    uint32_t const numQueries= exact.size();
+    std::vector<unsigned> assigns(numQueries);
+    std::vector<float> distSqs(numQueries);
+    double const t0= timing::tic();
+    nn.search_nn(&queries[0], numQueries, &assigns[0], &distSqs[0]);
+    double const t= timing::toc(t0);
+    uint32_t numAgree= 0;
+    double sumDistSq= 0, sumExactDistSq= 0;
+    for (uint32_t iQ= 0; iQ<numQueries; ++iQ){
+        numAgree+= assigns[iQ]==exact[iQ];
+        sumDistSq+= distSqs[iQ];
+        sumExactDistSq+= exactDistSqs[iQ];
+        ASSERT( assigns[iQ]<nn.npoints() );
+    }
+    std::cout<<"    "<<name<<": "<<numQueries/t*1000<<" assignments/s, agreement with exact "<<100.0*numAgree/numQueries
+             <<"%, quantization error "<<sumDistSq/sumExactDistSq<<" x exact\n";
+}
+
+
+
+int main(int argc, char **argv){
+
+    uint32_t const numTrainDescs= argc>1 ? atoi(argv[1]) : 200000;
+    uint32_t const numQueries= argc>2 ? atoi(argv[2]) : 5000;
+    uint32_t const numModes= 2000;
+
+    sameRandomUint32 rand((numModes+numTrainDescs+numQueries)*(2*numDims+2), 45);
+    sameRandomStreamUint32 randStream(rand);
+
+    std::vector<float> modes(numModes*numDims), trainDescs, queries;
+    for (uint32_t iMode= 0; iMode<numModes; ++iMode)
+        benchUtil::rootSIFTLike(randStream, &modes[iMode*numDims], numDims);
+    makeDescs(randStream, modes, numTrainDescs, trainDescs);
+    makeDescs(randStream, modes, numQueries, queries);
+
+    // training descriptors in the flatDescsFile format
+    boost::filesystem::path const tempDir= boost::filesystem::temp_directory_path();
+    std::string const descsFn= (tempDir / boost::filesystem::unique_path("voc_tree_bench_%%%%-%%%%_descs.e3bin")).native();
+    benchUtil::writeFlatDescs(descsFn, numDims, numTrainDescs, &trainDescs[0]);
+
+    std::cout<<numTrainDescs<<" training descriptors, "<<numQueries<<" queries\n";
+
+    uint32_t const branchings[3]= {8, 16, 64}, vocSize= 4096;
+
+    for (uint32_t iShape= 0; iShape<3; ++iShape){
+
+        uint32_t const branching= branchings[iShape];
+        std::string const clstFn= (tempDir / boost::filesystem::unique_path("voc_tree_bench_%%%%-%%%%_clst.e3bin")).native();
+
+        double t0= timing::tic();
+        buildIndex::computeVocTree(clstFn, false, descsFn, vocSize, branching, 10);
+        double const tTrain= timing::toc(t0);
+
+        clstCentres clst(clstFn.c_str(), true);
+        ASSERT( clst.numClst==vocSize );
+        vocTree tree1(clst, vocTree::getFn(clstFn), clstFn, 1);
+        std::cout<<"branching "<<branching<<", depth "<<tree1.depth()<<": training "<<tTrain/1000<<" s\n";
+
+        std::vector<unsigned> exact(numQueries);
+        std::vector<float> exactDistSqs(numQueries);
+        {
+            clstCentresExactNN exactNN(clst);
+            t0= timing::tic();
+            exactNN.search_nn(&queries[0], numQueries, &exact[0], &exactDistSqs[0]);
+            std::cout<<"    exact: "<<numQueries/timing::toc(t0)*1000<<" assignments/s\n";
+        }
+
+        evaluate("vocTree, beam 1", tree1, queries, exact, exactDistSqs);
+        for (uint32_t beam= 2; beam<=8; beam*= 2){
+            vocTree tree(clst, vocTree::getFn(clstFn), clstFn, beam);
+            std::string const name= "vocTree, beam " + std::string(1, '0'+beam);
+            evaluate(name.c_str(), tree, queries, exact, exactDistSqs);
+        }
+        kdForest forest(clst);
+        evaluate("kdForest", forest, queries, exact, exactDistSqs);
+
+        // clstNN picks the vocabulary tree up by itself, with the saved beam
+        fastann::nn_obj<float> *nn= clstNN::build(clst, true, clstFn);
+        ASSERT( dynamic_cast<vocTree*>(nn)!=NULL );
+        std::vector<unsigned> a1(numQueries*3), a2(numQueries*3);
+        std::vector<float> d1(numQueries*3), d2(numQueries*3);
+        vocTree tree2(clst, vocTree::getFn(clstFn), clstFn, 2);
+        nn->search_knn(&queries[0], numQueries, 3, &a1[0], &d1[0]);
+        tree2.search_knn(&queries[0], numQueries, 3, &a2[0], &d2[0]);
+        ASSERT( a1==a2 && d1==d2 );
+        for (uint32_t i= 0; i<numQueries*3; i+=3)
+            ASSERT( d1[i]<=d1[i+1] && d1[i+1]<=d1[i+2] );
+        delete nn;
+
+        // the tree next to other centres of the same shape (e.g. a replaced vocabulary) isn't used
+        std::string const otherFn= clstFn + "_other.e3bin";
+        benchUtil::writeCentres(otherFn, vocSize, numDims, &trainDescs[0]);
+        boost::filesystem::copy_file(vocTree::getFn(clstFn), vocTree::getFn(otherFn));
+        {
+            clstCentres otherClst(otherFn.c_str(), true);
+            nn= clstNN::build(otherClst, true, otherFn);
+            ASSERT( dynamic_cast<vocTree*>(nn)==NULL );
+            delete nn;
+        }
+        boost::filesystem::remove(otherFn);
+        boost::filesystem::remove(vocTree::getFn(otherFn));
+        boost::filesystem::remove(kdForest::getFn(otherFn));
+
+        boost::filesystem::remove(clstFn);
+        boost::filesystem::remove(vocTree::getFn(clstFn));
+    }
+
+    boost::filesystem::remove(descsFn);
+
+    return 0;
+}
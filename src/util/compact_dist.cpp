@@ -0,0 +1,254 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "compact_dist.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && (defined(__x86_64__) || defined(__i386__))
+#define COMPACT_DIST_SIMD
+#include <immintrin.h>
+#endif
+
+
+
+namespace compactDist {
+
+    uint16_t
+    floatToHalf(float x){
+        uint32_t f;
+        memcpy(&f, &x, sizeof(f));
+        uint16_t const sign= (f>>16) & 0x8000;
+        uint32_t const absF= f & 0x7FFFFFFF;
+
+        if (absF >= 0x7F800000) // inf or NaN
+            return sign | 0x7C00 | (absF>0x7F800000 ? 0x200 : 0);
+        if (absF >= 0x477FF000) // rounds to more than 65504
+            return sign | 0x7C00;
+
+        // round to nearest even
+        if (absF < 0x38800000){
+            // subnormal half, in units of 2^-24
+            if (absF < 0x33000000)
+                return sign;
+            uint32_t const shift= 126 - (absF>>23);
+            uint32_t const m= (absF & 0x7FFFFF) | 0x800000;
+            uint32_t r= m >> shift;
+            uint32_t const rem= m & ((1u<<shift)-1), halfway= 1u<<(shift-1);
+            if (rem>halfway || (rem==halfway && (r&1)))
+                ++r;
+            return sign | r;
+        }
+
+        uint32_t h= (absF - 0x38000000) >> 13;
+        uint32_t const rem= absF & 0x1FFF;
+        if (rem>0x1000 || (rem==0x1000 && (h&1)))
+            ++h;
+        return sign | h;
+    }
+
+
+
+    float
+    halfToFloat(uint16_t h){
+        uint32_t const sign= static_cast<uint32_t>(h & 0x8000) << 16;
+        uint32_t e= (h>>10) & 0x1F, m= h & 0x3FF;
+        uint32_t f;
+
+        if (e==0){
+            if (m==0)
+                f= sign;
+            else {
+                // subnormal, normalise
+                e= 113;
+                for (; !(m & 0x400); m<<= 1, --e);
+                f= sign | (e<<23) | ((m & 0x3FF)<<13);
+            }
+        } else if (e==31)
+            f= sign | 0x7F800000 | (m<<13);
+        else
+            f= sign | ((e+112)<<23) | (m<<13);
+
+        float x;
+        memcpy(&x, &f, sizeof(x));
+        return x;
+    }
+
+
+
+    #ifdef COMPACT_DIST_SIMD
+
+    __attribute__((target("avx,f16c")))
+    uint32_t
+    floatToHalfF16C(float const *in, uint32_t n, uint16_t *out){
+        uint32_t i= 0;
+        for (; i+8<=n; i+= 8)
+            _mm_storeu_si128( reinterpret_cast<__m128i *>(out+i),
+                              _mm256_cvtps_ph(_mm256_loadu_ps(in+i), _MM_FROUND_TO_NEAREST_INT) );
+        _mm256_zeroupper();
+        return i;
+    }
+
+
+
+    __attribute__((target("avx")))
+    float
+    l2AVX(float const *a, float const *b, uint32_t D){
+        __m256 sum0= _mm256_setzero_ps(), sum1= _mm256_setzero_ps();
+        uint32_t d= 0;
+        for (; d+16<=D; d+= 16){
+            __m256 const d0= _mm256_sub_ps(_mm256_loadu_ps(a+d), _mm256_loadu_ps(b+d));
+            __m256 const d1= _mm256_sub_ps(_mm256_loadu_ps(a+d+8), _mm256_loadu_ps(b+d+8));
+            sum0= _mm256_add_ps(sum0, _mm256_mul_ps(d0, d0));
+            sum1= _mm256_add_ps(sum1, _mm256_mul_ps(d1, d1));
+        }
+        __m256 const sum= _mm256_add_ps(sum0, sum1);
+        __m128 s= _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        s= _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s= _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        float res= _mm_cvtss_f32(s);
+        _mm256_zeroupper();
+        for (; d<D; ++d)
+            res+= (a[d]-b[d])*(a[d]-b[d]);
+        return res;
+    }
+
+
+
+    __attribute__((target("avx2")))
+    float
+    l2AVX2(float const *a, uint8_t const *b, uint32_t D){
+        __m256 sum0= _mm256_setzero_ps(), sum1= _mm256_setzero_ps();
+        uint32_t d= 0;
+        for (; d+16<=D; d+= 16){
+            __m256 const b0= _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( _mm_loadl_epi64(reinterpret_cast<__m128i const *>(b+d)) ) );
+            __m256 const b1= _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( _mm_loadl_epi64(reinterpret_cast<__m128i const *>(b+d+8)) ) );
+            __m256 const d0= _mm256_sub_ps(_mm256_loadu_ps(a+d), b0);
+            __m256 const d1= _mm256_sub_ps(_mm256_loadu_ps(a+d+8), b1);
+            sum0= _mm256_add_ps(sum0, _mm256_mul_ps(d0, d0));
+            sum1= _mm256_add_ps(sum1, _mm256_mul_ps(d1, d1));
+        }
+        __m256 const sum= _mm256_add_ps(sum0, sum1);
+        __m128 s= _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        s= _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s= _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        float res= _mm_cvtss_f32(s);
+        _mm256_zeroupper();
+        for (; d<D; ++d)
+            res+= (a[d]-b[d])*(a[d]-b[d]);
+        return res;
+    }
+
+
+
+    __attribute__((target("avx,f16c")))
+    float
+    l2F16C(float const *a, uint16_t const *b, uint32_t D){
+        __m256 sum0= _mm256_setzero_ps(), sum1= _mm256_setzero_ps();
+        uint32_t d= 0;
+        for (; d+16<=D; d+= 16){
+            __m256 const b0= _mm256_cvtph_ps( _mm_loadu_si128(reinterpret_cast<__m128i const *>(b+d)) );
+            __m256 const b1= _mm256_cvtph_ps( _mm_loadu_si128(reinterpret_cast<__m128i const *>(b+d+8)) );
+            __m256 const d0= _mm256_sub_ps(_mm256_loadu_ps(a+d), b0);
+            __m256 const d1= _mm256_sub_ps(_mm256_loadu_ps(a+d+8), b1);
+            sum0= _mm256_add_ps(sum0, _mm256_mul_ps(d0, d0));
+            sum1= _mm256_add_ps(sum1, _mm256_mul_ps(d1, d1));
+        }
+        __m256 const sum= _mm256_add_ps(sum0, sum1);
+        __m128 s= _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        s= _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s= _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        float res= _mm_cvtss_f32(s);
+        _mm256_zeroupper();
+        for (; d<D; ++d){
+            float const diff= a[d]-halfToFloat(b[d]);
+            res+= diff*diff;
+        }
+        return res;
+    }
+
+
+
+    bool
+    useAVX2(){
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+
+
+
+    static bool const hasAVX2= useAVX2();
+    // not queryable with older compilers, but all CPUs with AVX2 have it
+    static bool const hasF16C= hasAVX2;
+
+    #endif
+
+
+
+    void
+    floatToHalf(float const *in, uint32_t n, uint16_t *out){
+        uint32_t i= 0;
+        #ifdef COMPACT_DIST_SIMD
+        if (hasF16C)
+            i= floatToHalfF16C(in, n, out);
+        #endif
+        for (; i<n; ++i)
+            out[i]= floatToHalf(in[i]);
+    }
+
+
+
+    float
+    l2(float const *a, float const *b, uint32_t D){
+        #ifdef COMPACT_DIST_SIMD
+        if (hasAVX2)
+            return l2AVX(a, b, D);
+        #endif
+        float res= 0;
+        for (uint32_t d= 0; d<D; ++d)
+            res+= (a[d]-b[d])*(a[d]-b[d]);
+        return res;
+    }
+
+
+
+    float
+    l2(float const *a, uint8_t const *b, uint32_t D){
+        #ifdef COMPACT_DIST_SIMD
+        if (hasAVX2)
+            return l2AVX2(a, b, D);
+        #endif
+        float res= 0;
+        for (uint32_t d= 0; d<D; ++d)
+            res+= (a[d]-b[d])*(a[d]-b[d]);
+        return res;
+    }
+
+
+
+    float
+    l2(float const *a, uint16_t const *b, uint32_t D){
+        #ifdef COMPACT_DIST_SIMD
+        if (hasF16C)
+            return l2F16C(a, b, D);
+        #endif
+        float res= 0;
+        for (uint32_t d= 0; d<D; ++d){
+            float const diff= a[d]-halfToFloat(b[d]);
+            res+= diff*diff;
+        }
+        return res;
+    }
+
+};
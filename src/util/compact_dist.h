@@ -0,0 +1,47 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _COMPACT_DIST_H_
+#define _COMPACT_DIST_H_
+
+#include <stdint.h>
+
+
+
+// Squared L2 distances (as jp_dist_l2) between a float vector and a float or compactly stored one,
+// uint8 or IEEE float16; AVX2 / F16C kernels are used if the CPU supports them
+namespace compactDist {
+
+    uint16_t
+        floatToHalf(float x);
+
+    float
+        halfToFloat(uint16_t h);
+
+    void
+        floatToHalf(float const *in, uint32_t n, uint16_t *out);
+
+    float
+        l2(float const *a, float const *b, uint32_t D);
+
+    float
+        l2(float const *a, uint8_t const *b, uint32_t D);
+
+    // b is float16
+    float
+        l2(float const *a, uint16_t const *b, uint32_t D);
+
+};
+
+#endif
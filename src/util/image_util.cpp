@@ -14,6 +14,11 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "image_util.h"
 
+#include <ctype.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+
 #include <iostream>
 #include <stdexcept>
 
@@ -21,6 +26,205 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "util.h"
 
+extern "C" {
+#include <jpeglib.h>
+}
+
+
+
+static inline uint32_t
+readBE16(uint8_t const *p){ return (static_cast<uint32_t>(p[0])<<8) | p[1]; }
+
+static inline uint32_t
+readBE32(uint8_t const *p){ return (readBE16(p)<<16) | readBE16(p+2); }
+
+static inline uint32_t
+readLE16(uint8_t const *p){ return (static_cast<uint32_t>(p[1])<<8) | p[0]; }
+
+static inline uint32_t
+readLE32(uint8_t const *p){ return (readLE16(p+2)<<16) | readLE16(p); }
+
+
+
+// walks the JPEG segments up to the first SOFn, skipping (possibly large, e.g. EXIF) others
+static bool
+readJpegSize(FILE *f, uint32_t &width, uint32_t &height){
+    uint8_t buf[8];
+    if (fseek(f, 2, SEEK_SET)!=0)
+        return false;
+    while (true){
+        int c= fgetc(f);
+        if (c==EOF)
+            return false;
+        if (c!=0xFF)
+            continue;
+        int marker;
+        do { marker= fgetc(f); } while (marker==0xFF); // fill bytes
+        if (marker==EOF || marker==0xD9 || marker==0xDA) // EOI, SOS: no SOF before the data
+            return false;
+        if (marker==0x01 || (marker>=0xD0 && marker<=0xD8)) // TEM, RSTn, SOI: no length
+            continue;
+        if (fread(buf, 1, 2, f)!=2)
+            return false;
+        uint32_t const len= readBE16(buf);
+        if (len<2)
+            return false;
+        if (marker>=0xC0 && marker<=0xCF && marker!=0xC4 && marker!=0xC8 && marker!=0xCC){
+            // SOFn: precision, height, width
+            if (fread(buf, 1, 5, f)!=5)
+                return false;
+            height= readBE16(buf+1);
+            width= readBE16(buf+3);
+            return true;
+        }
+        if (fseek(f, len-2, SEEK_CUR)!=0)
+            return false;
+    }
+}
+
+
+
+// next ASCII integer of a PNM header, skipping whitespace and comments
+static bool
+readPnmInt(FILE *f, uint32_t &value){
+    int c= fgetc(f);
+    while (c!=EOF && (isspace(c) || c=='#')){
+        if (c=='#')
+            while (c!=EOF && c!='\n')
+                c= fgetc(f);
+        c= fgetc(f);
+    }
+    if (c==EOF || !isdigit(c))
+        return false;
+    value= 0;
+    for (; c!=EOF && isdigit(c); c= fgetc(f))
+        value= value*10 + (c-'0');
+    return true;
+}
+
+
+
+bool
+imageUtil::readHeader(std::string imageFn, uint32_t &width, uint32_t &height, std::string &format){
+
+    FILE *f= fopen(imageFn.c_str(), "rb");
+    if (f==NULL)
+        return false;
+
+    uint8_t h[26];
+    size_t const n= fread(h, 1, sizeof(h), f);
+    bool ok= false;
+
+    if (n>=3 && h[0]==0xFF && h[1]==0xD8 && h[2]==0xFF){
+        format= "JPEG";
+        ok= readJpegSize(f, width, height);
+    } else if (n>=24 && memcmp(h, "\x89PNG\r\n\x1a\n", 8)==0 && memcmp(h+12, "IHDR", 4)==0){
+        format= "PNG";
+        width= readBE32(h+16);
+        height= readBE32(h+20);
+        ok= true;
+    } else if (n>=10 && (memcmp(h, "GIF87a", 6)==0 || memcmp(h, "GIF89a", 6)==0)){
+        format= "GIF";
+        width= readLE16(h+6);
+        height= readLE16(h+8);
+        ok= true;
+    } else if (n>=26 && h[0]=='B' && h[1]=='M'){
+        format= "BMP";
+        if (readLE32(h+14)==12){ // OS/2 BITMAPCOREHEADER
+            width= readLE16(h+18);
+            height= readLE16(h+20);
+        } else {
+            int32_t const w= static_cast<int32_t>(readLE32(h+18)), hh= static_cast<int32_t>(readLE32(h+22));
+            width= w<0 ? -w : w;
+            height= hh<0 ? -hh : hh; // negative for top-down
+        }
+        ok= true;
+    } else if (n>=2 && h[0]=='P' && h[1]>='1' && h[1]<='6'){
+        format= "PNM";
+        ok= fseek(f, 2, SEEK_SET)==0 && readPnmInt(f, width) && readPnmInt(f, height);
+    }
+
+    fclose(f);
+    return ok && width>0 && height>0;
+}
+
+
+
+// libjpeg's default error_exit calls exit(), so jump back to checkJpeg instead
+struct jpegCheckErrorMgr {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmpBuffer;
+};
+
+static void
+jpegCheckErrorExit(j_common_ptr cinfo){
+    longjmp( reinterpret_cast<jpegCheckErrorMgr*>(cinfo->err)->setjmpBuffer, 1 );
+}
+
+// warnings (e.g. premature end of data) are not fatal for the KMCode decoder either
+static void
+jpegCheckOutputMessage(j_common_ptr){}
+
+
+
+// only plain C locals as there is a setjmp
+static bool
+checkJpegFile(FILE *f){
+    
+    struct jpeg_decompress_struct cinfo;
+    jpegCheckErrorMgr jerr;
+    cinfo.err= jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit= jpegCheckErrorExit;
+    jerr.pub.output_message= jpegCheckOutputMessage;
+    
+    if (setjmp(jerr.setjmpBuffer)){
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, f);
+    jpeg_read_header(&cinfo, TRUE);
+    
+    // all entropy-coded data is decoded (which is where a corrupt body fails),
+    // but the image is only reconstructed at 1/8 of its size
+    cinfo.scale_num= 1;
+    cinfo.scale_denom= 8;
+    cinfo.dct_method= JDCT_FASTEST;
+    cinfo.do_fancy_upsampling= FALSE;
+    jpeg_start_decompress(&cinfo);
+    
+    // the KMCode decoder aborts on anything but gray and RGB
+    if (cinfo.output_components!=1 && cinfo.output_components!=3){
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    
+    JSAMPARRAY row= (*cinfo.mem->alloc_sarray)(
+        reinterpret_cast<j_common_ptr>(&cinfo), JPOOL_IMAGE,
+        cinfo.output_width * cinfo.output_components, 1 );
+    while (cinfo.output_scanline < cinfo.output_height)
+        jpeg_read_scanlines(&cinfo, row, 1);
+    
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+
+
+bool
+imageUtil::checkJpeg(std::string imageFn){
+    FILE *f= fopen(imageFn.c_str(), "rb");
+    if (f==NULL)
+        return false;
+    bool const ok= checkJpegFile(f);
+    fclose(f);
+    if (!ok)
+        std::cerr<< "imageUtil::checkJpeg: "<<imageFn<<" is corrupt or not gray/RGB\n";
+    return ok;
+}
+
 
 #ifdef RR_MAGICK
 
@@ -64,9 +268,48 @@ imageUtil::convertToJpegTemp(std::string inFn, std::string &outFn, bool &created
 
 
 
+bool
+imageUtil::decodeRGB(std::string imageFn, uint32_t &width, uint32_t &height, std::vector<uint8_t> &rgb){
+    try {
+        Magick::Image im;
+        im.read(imageFn);
+        width= im.columns();
+        height= im.rows();
+        rgb.resize(3*static_cast<size_t>(width)*height);
+        im.write(0, 0, width, height, "RGB", Magick::CharPixel, &rgb[0]);
+        return true;
+    } catch (std::exception &error) {
+        std::cerr<< "imageUtil::decodeRGB: Exception= "<<error.what()<<"\n";
+        return false;
+    }
+}
+
+
+
+bool
+imageUtil::decodeGray(std::string imageFn, uint32_t &width, uint32_t &height, std::vector<uint8_t> &gray){
+    std::vector<uint8_t> rgb;
+    if (!decodeRGB(imageFn, width, height, rgb))
+        return false;
+    gray.resize(static_cast<size_t>(width)*height);
+    uint8_t const *in= gray.empty() ? NULL : &rgb[0];
+    for (std::vector<uint8_t>::iterator it= gray.begin(); it!=gray.end(); ++it, in+= 3)
+        *it= static_cast<uint8_t>( (in[0]+in[1]+in[2])/3.0 );
+    return true;
+}
+
+
+
 bool
 imageUtil::checkAndConvertToJpegTemp(std::string inFn, std::string &outFn, bool &createdJpeg){
     createdJpeg= false;
+    uint32_t width, height;
+    std::string format;
+    if (readHeader(inFn, width, height, format) && format=="JPEG"){
+        // no need to convert, but make sure the KMCode can decode it
+        outFn= inFn;
+        return width>=10 && height>=10 && checkJpeg(inFn);
+    }
     try {
         Magick::Image im;
         im.read(inFn);
@@ -91,6 +334,10 @@ imageUtil::checkAndConvertToJpegTemp(std::string inFn, std::string &outFn, bool
 
 std::pair<uint32_t, uint32_t>
 imageUtil::getWidthHeight(std::string imageFn){
+    uint32_t width, height;
+    std::string format;
+    if (readHeader(imageFn, width, height, format))
+        return std::make_pair(width, height);
     try {
         Magick::Image im;
         im.read(imageFn);
@@ -106,7 +353,7 @@ imageUtil::getWidthHeight(std::string imageFn){
 #else
 
 
-#warning Unable to get image width/height without Magick++
+#warning Unable to get image width/height of formats other than JPEG, PNG, GIF, BMP, PNM without Magick++
 #warning Unable to convert images without Magick++
 
 
@@ -133,8 +380,31 @@ imageUtil::convertToJpegTemp(std::string inFn, std::string &outFn, bool &created
 
 
 
+bool
+imageUtil::decodeRGB(std::string imageFn, uint32_t &width, uint32_t &height, std::vector<uint8_t> &rgb){
+    std::cerr<< "imageUtil::decodeRGB: Need Magick++ for this\n";
+    return false;
+}
+
+
+
+bool
+imageUtil::decodeGray(std::string imageFn, uint32_t &width, uint32_t &height, std::vector<uint8_t> &gray){
+    std::cerr<< "imageUtil::decodeGray: Need Magick++ for this\n";
+    return false;
+}
+
+
+
 bool
 imageUtil::checkAndConvertToJpegTemp(std::string inFn, std::string &outFn, bool &createdJpeg){
+    uint32_t width, height;
+    std::string format;
+    if (readHeader(inFn, width, height, format) && format=="JPEG"){
+        createdJpeg= false;
+        outFn= inFn;
+        return width>=10 && height>=10 && checkJpeg(inFn);
+    }
     return convertToJpegTemp(inFn, outFn, createdJpeg);
 }
 
@@ -142,7 +412,11 @@ imageUtil::checkAndConvertToJpegTemp(std::string inFn, std::string &outFn, bool
 
 std::pair<uint32_t, uint32_t>
 imageUtil::getWidthHeight(std::string imageFn){
-    std::cerr<< "imageUtil::getWidthHeight: Need Magick++ for this so returning (0,0)\n";
+    uint32_t width, height;
+    std::string format;
+    if (readHeader(imageFn, width, height, format))
+        return std::make_pair(width, height);
+    std::cerr<< "imageUtil::getWidthHeight: Need Magick++ for this format so returning (0,0)\n";
     return std::make_pair(0,0);
 }
 
@@ -17,11 +17,32 @@ No usage or redistribution is allowed without explicit permission.
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 
 
 namespace imageUtil {
     
+    // format ("JPEG", "PNG", "GIF", "BMP" or "PNM") and size read from the file header only,
+    // without decoding the image; false if the format isn't one of those or the header is corrupt
+    bool
+        readHeader(std::string imageFn, uint32_t &width, uint32_t &height, std::string &format);
+    
+    // decodes the whole JPEG with libjpeg (at reduced size), catching its errors instead of
+    // exiting, and checks it is gray or RGB; i.e. can the KMCode decode it? success?
+    bool
+        checkJpeg(std::string imageFn);
+    
+    // decodes the image (any format Magick++ reads) once, to interleaved 8-bit RGB;
+    // success?
+    bool
+        decodeRGB(std::string imageFn, uint32_t &width, uint32_t &height, std::vector<uint8_t> &rgb);
+    
+    // as decodeRGB, to 8-bit gray as the mean of R, G and B;
+    // success?
+    bool
+        decodeGray(std::string imageFn, uint32_t &width, uint32_t &height, std::vector<uint8_t> &gray);
+    
     // success?
     bool
         convert(std::string inFn, std::string outFn);
@@ -30,10 +51,13 @@ namespace imageUtil {
     bool
         convertToJpegTemp(std::string inFn, std::string &outFn, bool &createdJpeg);
     
-    // success?
+    // success? (also fails for images smaller than 10x10)
+    // JPEGs are only checked (see checkJpeg), other formats are decoded and written to a temporary JPEG
     bool
         checkAndConvertToJpegTemp(std::string inFn, std::string &outFn, bool &createdJpeg);
     
+    // from the header if possible (see readHeader, the image isn't decoded so a corrupt body
+    // isn't detected), otherwise by decoding the image; (0,0) on failure
     std::pair<uint32_t, uint32_t>
         getWidthHeight(std::string imageFn);
     
@@ -0,0 +1,73 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+mappedFile::mappedFile(char const fileName[]) : fd_(-1), data_(NULL), size_(0) {
+    fd_= open(fileName, O_RDONLY);
+    if (fd_<0)
+        return;
+    struct stat st;
+    if (fstat(fd_, &st)!=0){
+        close(fd_);
+        fd_= -1;
+        return;
+    }
+    size_= st.st_size;
+    if (size_==0)
+        return;
+    void *p= mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (p==MAP_FAILED){
+        close(fd_);
+        fd_= -1;
+        size_= 0;
+        return;
+    }
+    data_= static_cast<char const *>(p);
+}
+
+
+
+mappedFile::~mappedFile(){
+    if (data_!=NULL)
+        munmap(const_cast<char*>(data_), size_);
+    if (fd_>=0)
+        close(fd_);
+}
+
+
+
+void
+getFileChecksum(char const fileName[], uint64_t &size, uint64_t &checksum){
+    mappedFile f(fileName);
+    size= f.size();
+    checksum= 0xcbf29ce484222325ULL ^ size;
+    uint64_t const numWords= size/8;
+    for (uint64_t i= 0; i<numWords; ++i){
+        uint64_t w;
+        memcpy(&w, f.data() + i*8, 8);
+        checksum= (checksum ^ w) * 0x100000001b3ULL;
+        checksum^= checksum >> 29;
+    }
+    for (uint64_t i= numWords*8; i<size; ++i)
+        checksum= (checksum ^ static_cast<unsigned char>(f.data()[i])) * 0x100000001b3ULL;
+}
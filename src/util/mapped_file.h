@@ -0,0 +1,57 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macros.h"
+
+
+
+// read-only memory map of a whole file
+class mappedFile {
+    
+    public:
+        
+        mappedFile(char const fileName[]);
+        
+        ~mappedFile();
+        
+        inline bool
+            isOpen() const { return fd_>=0; }
+        
+        inline char const *
+            data() const { return data_; }
+        
+        inline size_t
+            size() const { return size_; }
+        
+    private:
+        int fd_;
+        char const *data_;
+        size_t size_;
+        DISALLOW_COPY_AND_ASSIGN(mappedFile)
+};
+
+
+
+// size and checksum (64-bit words multiplied in, as FNV-1a) of a whole file, e.g. to tell
+// whether a structure saved for it is stale; size 0 if it can't be read
+void
+getFileChecksum(char const fileName[], uint64_t &size, uint64_t &checksum);
+
+#endif
@@ -36,6 +36,7 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "ViseMessageQueue.h"
 #include "clst_centres.h"
+#include "clst_nn.h"
 #include "dataset_v2.h"
 #include "feat_getter.h"
 #include "feat_standard.h"
@@ -177,34 +178,26 @@ void api_v2(std::vector< std::string > argv) {
         
         // feature getter
         bool SIFTscale3= pt.get<bool>( dsetname+".SIFTscale3", true);
+        std::string const featCacheDir= util::expandUser(pt.get<std::string>( dsetname+".featCacheDir", "" ));
         featGetter_obj= new featGetter_standard( (
             std::string("hesaff-") +
             std::string((useRootSIFT ? "rootsift" : "sift")) +
-            std::string(SIFTscale3 ? "-scale3" : "")
-            ).c_str() );
+            std::string(SIFTscale3 ? "-scale3" : "") +
+            std::string("-mt") // single query image at a time, use all cores for it
+            ).c_str(), featCacheDir );
         
         // clusters
         std::cout<<"apiV2::main: Loading cluster centres\n";
         double t0= timing::tic();
-        clstCentres_obj= new clstCentres( util::expandUser(*clstFn).c_str(), true );
+        clstCentres_obj= new clstCentres( util::expandUser(*clstFn).c_str(), true,
+                                          clstCentres::storageFromString(pt.get<std::string>( dsetname+".clstStorage", "float" )) );
 	//std::cout<<"Yes:"<<clstFn<<'\n';
         std::cout<<"apiV2::main: Loading cluster centres - DONE ("<< timing::toc(t0) <<" ms)\n";
         
         std::cout<<"apiV2::main: Constructing NN search object\n";
         t0= timing::tic();
         
-        nn=
-        #if 1
-            fastann::nn_obj_build_kdtree(
-                clstCentres_obj->clstC_flat,
-                clstCentres_obj->numClst,
-                clstCentres_obj->numDims, 8, 1024);
-        #else
-            fastann::nn_obj_build_exact(
-                clstCentres_obj->clstC_flat,
-                clstCentres_obj->numClst,
-                clstCentres_obj->numDims);
-        #endif
+        nn= clstNN::build(*clstCentres_obj, true, util::expandUser(*clstFn));
         std::cout<<"apiV2::main: Constructing NN search object - DONE ("<< timing::toc(t0) << " ms)\n";
         
         // soft assigner
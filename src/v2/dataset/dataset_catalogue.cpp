@@ -0,0 +1,294 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "dataset_catalogue.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "dataset_entry.pb.h"
+#include "proto_db_file.h"
+
+
+
+static char const catMagic[8]= {'V','I','S','E','C','A','T','1'};
+static uint32_t const directSlot= 0x80000000;
+
+static inline uint64_t
+mix64(uint64_t h){
+    // splitmix64 finaliser
+    h^= h >> 30; h*= 0xbf58476d1ce4e5b9ULL;
+    h^= h >> 27; h*= 0x94d049bb133111ebULL;
+    h^= h >> 31;
+    return h;
+}
+
+static inline uint32_t
+slotOf(uint64_t h, uint32_t d, uint32_t numDocs){
+    return static_cast<uint32_t>( mix64(h + d * 0x9e3779b97f4a7c15ULL) % numDocs );
+}
+
+static inline uint32_t
+bucketOf(uint64_t h, uint32_t numBuckets){
+    return static_cast<uint32_t>( (h >> 32) % numBuckets );
+}
+
+
+
+uint64_t
+datasetCatalogue::hashFn(std::string const &prefix, char const *fn, size_t len){
+    uint64_t h= 14695981039346656037ULL;
+    for (std::string::const_iterator it= prefix.begin(); it!=prefix.end(); ++it)
+        h= (h ^ static_cast<uint8_t>(*it)) * 1099511628211ULL;
+    for (char const *it= fn, *end= fn+len; it!=end; ++it)
+        h= (h ^ static_cast<uint8_t>(*it)) * 1099511628211ULL;
+    return mix64(h);
+}
+
+
+
+// serialises the catalogue of the dataset into buf
+static void
+buildInRam(std::string const &dsetFn, std::vector<char> &buf){
+
+    protoDbFile db(dsetFn);
+    uint32_t const numIDs= db.numIDs();
+
+    // ------- filenames, widths, heights
+
+    std::vector<uint64_t> offsets(1, 0);
+    std::vector<uint32_t> width, height;
+    std::string blob;
+    std::vector<rr::datasetEntry> entries;
+
+    for (uint32_t ID= 0; ID<numIDs; ++ID){
+        db.getProtos(ID, entries);
+        ASSERT(entries.size()==1);
+        rr::datasetEntry const &entry= entries[0];
+        for (int i= 0; i<entry.filename_size(); ++i){
+            blob+= entry.filename(i);
+            offsets.push_back(blob.size());
+            width.push_back(entry.width(i));
+            height.push_back(entry.height(i));
+        }
+    }
+    uint32_t const numDocs= width.size();
+    ASSERT(numDocs < directSlot);
+    uint32_t const numBuckets= std::max(static_cast<uint32_t>(1), (numDocs+1)/2);
+
+    // ------- minimal perfect hash
+
+    std::vector<uint64_t> hashes(numDocs);
+    std::vector< std::pair<uint32_t, uint32_t> > bucketDoc(numDocs);
+    std::string const noPrefix;
+    for (uint32_t docID= 0; docID<numDocs; ++docID){
+        hashes[docID]= datasetCatalogue::hashFn(noPrefix, blob.data() + offsets[docID], offsets[docID+1] - offsets[docID]);
+        bucketDoc[docID]= std::make_pair(bucketOf(hashes[docID], numBuckets), docID);
+    }
+    std::sort(bucketDoc.begin(), bucketDoc.end());
+
+    // buckets as (size, begin) into bucketDoc, largest first
+    std::vector< std::pair<uint32_t, uint32_t> > buckets;
+    for (uint32_t i= 0; i<numDocs; ){
+        uint32_t j= i;
+        for (; j<numDocs && bucketDoc[j].first==bucketDoc[i].first; ++j);
+        buckets.push_back(std::make_pair(j-i, i));
+        i= j;
+    }
+    std::sort(buckets.begin(), buckets.end(), std::greater< std::pair<uint32_t, uint32_t> >());
+
+    std::vector<uint32_t> displacement(numBuckets, 0);
+    std::vector<uint32_t> slotToDoc(numDocs, numDocs);
+    uint32_t nextFree= 0;
+    std::vector<uint32_t> docs, slots;
+
+    for (uint32_t iB= 0; iB<buckets.size(); ++iB){
+        uint32_t const bucket= bucketDoc[buckets[iB].second].first;
+
+        // duplicate filenames: as with a std::map, the last one wins
+        docs.clear();
+        for (uint32_t i= buckets[iB].second; i<buckets[iB].second + buckets[iB].first; ++i){
+            uint32_t const docID= bucketDoc[i].second;
+            bool duplicate= false;
+            for (uint32_t k= 0; k<docs.size(); ++k)
+                if (hashes[docs[k]]==hashes[docID]){
+                    ASSERT( blob.compare(offsets[docs[k]], offsets[docs[k]+1]-offsets[docs[k]],
+                                         blob, offsets[docID], offsets[docID+1]-offsets[docID])==0 );
+                    docs[k]= std::max(docs[k], docID);
+                    duplicate= true;
+                }
+            if (!duplicate)
+                docs.push_back(docID);
+        }
+
+        if (docs.size()==1){
+            // single key: point directly to a free slot
+            for (; slotToDoc[nextFree]!=numDocs; ++nextFree);
+            displacement[bucket]= directSlot | nextFree;
+            slotToDoc[nextFree]= docs[0];
+            continue;
+        }
+
+        for (uint32_t d= 0; ; ++d){
+            ASSERT(d < directSlot);
+            slots.clear();
+            bool ok= true;
+            for (uint32_t k= 0; ok && k<docs.size(); ++k){
+                uint32_t const slot= slotOf(hashes[docs[k]], d, numDocs);
+                ok= slotToDoc[slot]==numDocs && std::find(slots.begin(), slots.end(), slot)==slots.end();
+                slots.push_back(slot);
+            }
+            if (ok){
+                displacement[bucket]= d;
+                for (uint32_t k= 0; k<docs.size(); ++k)
+                    slotToDoc[slots[k]]= docs[k];
+                break;
+            }
+        }
+    }
+
+    // ------- serialise
+
+    uint64_t const blobSize= blob.size();
+    uint64_t const size= 24 + 8*(static_cast<uint64_t>(numDocs)+1) + 4*(3*static_cast<uint64_t>(numDocs) + numBuckets) + blobSize;
+    buf.resize(size);
+    char *out= &buf[0];
+    memcpy(out, catMagic, 8); out+= 8;
+    memcpy(out, &numDocs, 4); out+= 4;
+    memcpy(out, &numBuckets, 4); out+= 4;
+    memcpy(out, &blobSize, 8); out+= 8;
+    memcpy(out, &offsets[0], 8*offsets.size()); out+= 8*offsets.size();
+    if (numDocs>0){
+        memcpy(out, &width[0], 4*numDocs); out+= 4*numDocs;
+        memcpy(out, &height[0], 4*numDocs); out+= 4*numDocs;
+    }
+    memcpy(out, &displacement[0], 4*numBuckets); out+= 4*numBuckets;
+    if (numDocs>0){
+        memcpy(out, &slotToDoc[0], 4*numDocs); out+= 4*numDocs;
+    }
+    if (blobSize>0)
+        memcpy(out, blob.data(), blobSize);
+}
+
+
+
+void
+datasetCatalogue::build(std::string const &dsetFn, std::string const &catFn){
+    std::vector<char> buf;
+    buildInRam(dsetFn, buf);
+    // write to a temporary file first so that readers never see a partial catalogue
+    std::string const tempFn= catFn + boost::filesystem::unique_path(".%%%%-%%%%-%%%%-%%%%").native();
+    FILE *f= fopen(tempFn.c_str(), "wb");
+    if (f==NULL)
+        throw std::runtime_error("datasetCatalogue::build: Can't write " + tempFn);
+    bool const ok= fwrite(&buf[0], 1, buf.size(), f)==buf.size();
+    fclose(f);
+    if (!ok){
+        boost::filesystem::remove(tempFn);
+        throw std::runtime_error("datasetCatalogue::build: Can't write " + tempFn);
+    }
+    boost::system::error_code ec;
+    boost::filesystem::rename(tempFn, catFn, ec);
+    if (ec){
+        boost::filesystem::remove(tempFn, ec);
+        throw std::runtime_error("datasetCatalogue::build: Can't replace " + catFn);
+    }
+}
+
+
+
+datasetCatalogue::datasetCatalogue(std::string const &dsetFn) : file_(NULL) {
+
+    std::string const catFn= getCatFn(dsetFn);
+
+    if (boost::filesystem::exists(catFn) &&
+        boost::filesystem::last_write_time(catFn) >= boost::filesystem::last_write_time(dsetFn)){
+        file_= new mappedFile(catFn.c_str());
+        if (file_->isOpen() && parse(file_->data(), file_->size()))
+            return;
+        delete file_;
+        file_= NULL;
+    }
+
+    std::cout<<"datasetCatalogue::datasetCatalogue: Building "<<catFn<<"\n";
+    try {
+        build(dsetFn, catFn);
+        file_= new mappedFile(catFn.c_str());
+        if (file_->isOpen() && parse(file_->data(), file_->size()))
+            return;
+        delete file_;
+        file_= NULL;
+    } catch (std::exception &e){
+        std::cerr<<"datasetCatalogue::datasetCatalogue: "<<e.what()<<", keeping the catalogue in RAM\n";
+    }
+
+    buildInRam(dsetFn, inRam_);
+    ASSERT( parse(&inRam_[0], inRam_.size()) );
+}
+
+
+
+datasetCatalogue::~datasetCatalogue(){
+    if (file_!=NULL)
+        delete file_;
+}
+
+
+
+bool
+datasetCatalogue::parse(char const *data, uint64_t size){
+    if (size<24 || memcmp(data, catMagic, 8)!=0)
+        return false;
+    uint64_t blobSize;
+    memcpy(&numDocs_, data+8, 4);
+    memcpy(&numBuckets_, data+12, 4);
+    memcpy(&blobSize, data+16, 8);
+    if (size != 24 + 8*(static_cast<uint64_t>(numDocs_)+1) + 4*(3*static_cast<uint64_t>(numDocs_) + numBuckets_) + blobSize)
+        return false;
+    offsets_= reinterpret_cast<uint64_t const *>(data+24);
+    width_= reinterpret_cast<uint32_t const *>(offsets_ + numDocs_ + 1);
+    height_= width_ + numDocs_;
+    displacement_= height_ + numDocs_;
+    slotToDoc_= displacement_ + numBuckets_;
+    blob_= reinterpret_cast<char const *>(slotToDoc_ + numDocs_);
+    return offsets_[numDocs_]==blobSize;
+}
+
+
+
+uint32_t
+datasetCatalogue::lookup(std::string const &prefix, std::string const &fn) const {
+    if (numDocs_==0)
+        return numDocs_;
+    uint64_t const h= hashFn(prefix, fn.data(), fn.length());
+    uint32_t const d= displacement_[bucketOf(h, numBuckets_)];
+    uint32_t const slot= (d & directSlot) ? (d & ~directSlot) : slotOf(h, d, numDocs_);
+    uint32_t const docID= slotToDoc_[slot];
+    if (docID>=numDocs_)
+        return numDocs_;
+    // check it is really this filename
+    char const *candidate= blob_ + offsets_[docID];
+    uint64_t const len= offsets_[docID+1] - offsets_[docID];
+    if (len != prefix.length() + fn.length() ||
+        memcmp(candidate, prefix.data(), prefix.length())!=0 ||
+        memcmp(candidate + prefix.length(), fn.data(), fn.length())!=0)
+        return numDocs_;
+    return docID;
+}
@@ -0,0 +1,116 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _DATASET_CATALOGUE_H_
+#define _DATASET_CATALOGUE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "macros.h"
+#include "mapped_file.h"
+
+
+
+/*
+Columnar, memory-mapped form of a dataset (see datasetV2), stored next to it as <dsetFn>.cat
+
+Organization (native byte order):
+
+char[8] magic "VISECAT1"
+uint32_t numDocs
+uint32_t numBuckets
+uint64_t blobSize
+uint64_t offsets[numDocs+1]      filename of docID is blob[offsets[docID], offsets[docID+1])
+uint32_t width[numDocs]
+uint32_t height[numDocs]
+uint32_t displacement[numBuckets] minimal perfect hash of the filenames (see below)
+uint32_t slotToDoc[numDocs]
+char blob[blobSize]
+
+Filename -> docID uses a static minimal perfect hash (hash and displace): a key's
+bucket is given by its hash, each bucket stores a displacement which maps all its keys
+to distinct slots in [0, numDocs), or (top bit set) directly the slot of a single-key bucket.
+Lookups are O(1), don't allocate, and check the filename so unknown ones are rejected.
+*/
+
+class datasetCatalogue {
+
+    public:
+
+        // uses <dsetFn>.cat, (re)building it first if it is missing or older than dsetFn;
+        // if it can't be written the catalogue is kept in RAM
+        datasetCatalogue(std::string const &dsetFn);
+
+        ~datasetCatalogue();
+
+        // builds the catalogue file from datasetV2's protoDb file
+        static void
+            build(std::string const &dsetFn, std::string const &catFn);
+
+        static inline std::string
+            getCatFn(std::string const &dsetFn) { return dsetFn + ".cat"; }
+
+        inline uint32_t
+            numDocs() const { return numDocs_; }
+
+        // zero-copy view of the filename
+        inline void
+            getFn(uint32_t docID, char const *&fn, uint32_t &len) const {
+                ASSERT(docID<numDocs_);
+                fn= blob_ + offsets_[docID];
+                len= static_cast<uint32_t>(offsets_[docID+1] - offsets_[docID]);
+            }
+
+        inline std::string
+            getFn(uint32_t docID) const {
+                char const *fn;
+                uint32_t len;
+                getFn(docID, fn, len);
+                return std::string(fn, len);
+            }
+
+        inline std::pair<uint32_t, uint32_t>
+            getWidthHeight(uint32_t docID) const {
+                ASSERT(docID<numDocs_);
+                return std::make_pair(width_[docID], height_[docID]);
+            }
+
+        // docID of the filename prefix+fn, or numDocs() if there is no such one
+        uint32_t
+            lookup(std::string const &prefix, std::string const &fn) const;
+
+        // hash of prefix+fn
+        static uint64_t
+            hashFn(std::string const &prefix, char const *fn, size_t len);
+
+    private:
+
+        // parses the catalogue at data_, false if it is malformed
+        bool
+            parse(char const *data, uint64_t size);
+
+        mappedFile *file_;
+        std::vector<char> inRam_;
+
+        uint32_t numDocs_, numBuckets_;
+        uint64_t const *offsets_;
+        uint32_t const *width_, *height_, *displacement_, *slotToDoc_;
+        char const *blob_;
+
+        DISALLOW_COPY_AND_ASSIGN(datasetCatalogue)
+};
+
+#endif
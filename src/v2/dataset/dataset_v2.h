@@ -15,14 +15,11 @@ No usage or redistribution is allowed without explicit permission.
 #ifndef _DATASET_V2_H_
 #define _DATASET_V2_H_
 
-#include <limits>
-#include <map>
 #include <stdint.h>
 #include <string>
 
-#include <boost/functional/hash.hpp>
-
 #include "dataset_abs.h"
+#include "dataset_catalogue.h"
 #include "dataset_entry.pb.h"
 #include "macros.h"
 #include "proto_db_file.h"
@@ -64,21 +61,15 @@ class datasetV2 : public datasetAbs {
     
     private:
         
-        // NULL if not found, if not NULL caller should NOT delete
-        uint32_t const *
-            lookupFn(std::string const &fn) const;
+        // numDocs_ if not found
+        inline uint32_t
+            lookupFn(std::string const &fn) const {
+                return catalogue_.lookup(removePrefix_, fn);
+            }
         
-        protoDbInRam *db_;
-        uint32_t addPrefixFullLen_, removePrefixLen_, numIDs_, numDocs_;
+        datasetCatalogue const catalogue_;
+        uint32_t addPrefixFullLen_, removePrefixLen_, numDocs_;
         std::string const addPrefix_, removePrefix_;
-        
-        uint32_t numPerID_;
-        
-        bool memoryEffLookup_;
-        std::map<std::string, uint32_t> fn2ID_;
-        std::vector<uint32_t> hashTable_;
-        boost::hash<std::string> hashFunc_;
-        static uint32_t const emptyEntry_;
     
     private:
         DISALLOW_COPY_AND_ASSIGN(datasetV2)
@@ -109,6 +100,7 @@ class datasetBuilder {
             save(bool isLast= false);
         
         bool hasBeenClosed_;
+        std::string const fileName_;
         protoDbFileBuilder dbBuilder_;
         rr::datasetEntry buffer_;
         uint32_t entriesID_;
@@ -0,0 +1,279 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <stdio.h>
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+
+#include "dataset_catalogue.h"
+#include "dataset_v2.h"
+#include "macros.h"
+
+
+
+// filename and size of the i-th image of the large dataset
+std::string
+getTestFn(uint32_t i){
+    return ( boost::format("dir%d/img%07d.jpg") % (i%37) % i ).str();
+}
+
+std::pair<uint32_t, uint32_t>
+getTestWH(uint32_t i){
+    return std::make_pair(100 + i%1000, 50 + i%777);
+}
+
+
+
+// every document is found at its docID with the right size and name
+void
+checkAll( datasetV2 const &dset, uint32_t numDocs ){
+    ASSERT( dset.getNumDoc()==numDocs );
+    for (uint32_t i= 0; i<numDocs; ++i){
+        std::string const fn= getTestFn(i);
+        ASSERT( dset.getInternalFn(i)==fn );
+        ASSERT( dset.getDocID(fn)==i );
+        ASSERT( dset.getWidthHeight(i)==getTestWH(i) );
+    }
+}
+
+
+
+bool
+throwsUnknown( datasetV2 const &dset, std::string const &fn ){
+    try {
+        dset.getDocID(fn);
+    } catch (std::runtime_error &e){
+        return true;
+    }
+    return false;
+}
+
+
+
+void
+buildTestDataset( std::string const &dsetFn, uint32_t numDocs ){
+    datasetBuilder dB(dsetFn);
+    for (uint32_t i= 0; i<numDocs; ++i){
+        std::pair<uint32_t, uint32_t> const wh= getTestWH(i);
+        dB.add( getTestFn(i), wh.first, wh.second );
+    }
+    dB.close();
+}
+
+
+
+std::string
+readFile( std::string const &fn ){
+    std::ifstream f(fn.c_str(), std::ios::binary);
+    ASSERT( f.is_open() );
+    return std::string( std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>() );
+}
+
+
+
+void
+writeFile( std::string const &fn, std::string const &data ){
+    FILE *f= fopen(fn.c_str(), "wb");
+    ASSERT( f!=NULL );
+    ASSERT( fwrite(data.data(), 1, data.size(), f)==data.size() );
+    fclose(f);
+}
+
+
+
+void
+datasetCatalogue_test( std::string const &tempDir ){
+
+    namespace bfs= boost::filesystem;
+
+    // ------- large N
+    {
+        std::cout<<"large dataset\n";
+        std::string const dsetFn= tempDir + "/large.v2bin";
+        uint32_t const numDocs= 250000;
+        buildTestDataset(dsetFn, numDocs);
+        ASSERT( bfs::exists(datasetCatalogue::getCatFn(dsetFn)) );
+
+        datasetV2 dset(dsetFn);
+        checkAll(dset, numDocs);
+
+        // unknown names, prefixes and extensions of known ones
+        ASSERT( !dset.containsFn("") );
+        ASSERT( !dset.containsFn("dir1") );
+        ASSERT( !dset.containsFn("dir1/img0000001") );
+        ASSERT( !dset.containsFn("dir1/img0000001.jp") );
+        ASSERT( !dset.containsFn("dir1/img0000001.jpgx") );
+        ASSERT( !dset.containsFn("dir2/img0000001.jpg") );
+        ASSERT( !dset.containsFn(getTestFn(numDocs)) );
+        ASSERT( dset.containsFn(getTestFn(1)) );
+        ASSERT( throwsUnknown(dset, "dir1/img0000001") );
+        ASSERT( throwsUnknown(dset, getTestFn(numDocs)) );
+        for (uint32_t i= numDocs; i<2*numDocs; ++i)
+            ASSERT( !dset.containsFn(getTestFn(i)) );
+    }
+
+    // ------- duplicates: the last one wins, as with a std::map
+    {
+        std::cout<<"duplicate filenames\n";
+        std::string const dsetFn= tempDir + "/dup.v2bin";
+        datasetBuilder dB(dsetFn);
+        dB.add("a.jpg", 10, 10);
+        dB.add("b.jpg", 20, 20);
+        dB.add("a.jpg", 30, 30);
+        dB.add("c.jpg", 40, 40);
+        dB.add("a.jpg", 50, 50);
+        dB.add("b.jpg", 60, 60);
+        // more than one entry block of datasetBuilder
+        for (uint32_t i= 0; i<2500; ++i)
+            dB.add( (boost::format("d%d.jpg") % (i%1000)).str(), i, i );
+        dB.close();
+
+        datasetV2 dset(dsetFn);
+        ASSERT( dset.getNumDoc()==2506 );
+        ASSERT( dset.getDocID("a.jpg")==4 );
+        ASSERT( dset.getDocID("b.jpg")==5 );
+        ASSERT( dset.getDocID("c.jpg")==3 );
+        ASSERT( dset.getWidthHeight(dset.getDocID("a.jpg"))==std::make_pair(50u, 50u) );
+        // earlier duplicates are still there by docID
+        ASSERT( dset.getInternalFn(0)=="a.jpg" && dset.getWidthHeight(0)==std::make_pair(10u, 10u) );
+        for (uint32_t i= 0; i<1000; ++i)
+            ASSERT( dset.getDocID( (boost::format("d%d.jpg") % i).str() ) == 6 + (i<500 ? 2000 + i : 1000 + i) );
+        ASSERT( !dset.containsFn("d1000.jpg") );
+    }
+
+    // ------- stale or corrupt catalogue files are rebuilt
+    {
+        std::cout<<"stale and corrupt catalogues\n";
+        std::string const dsetFn= tempDir + "/stale.v2bin";
+        std::string const catFn= datasetCatalogue::getCatFn(dsetFn);
+        std::string const oldCatFn= tempDir + "/stale_old.cat";
+
+        // catalogue of a different dataset, older than the dataset file
+        buildTestDataset(dsetFn, 1000);
+        bfs::copy_file(catFn, oldCatFn);
+        buildTestDataset(dsetFn, 2000);
+        bfs::remove(catFn);
+        bfs::copy_file(oldCatFn, catFn);
+        bfs::last_write_time(catFn, bfs::last_write_time(dsetFn) - 10);
+        {
+            datasetV2 dset(dsetFn);
+            checkAll(dset, 2000);
+        }
+        ASSERT( bfs::last_write_time(catFn) >= bfs::last_write_time(dsetFn) );
+
+        // truncated
+        std::string const good= readFile(catFn);
+        writeFile(catFn, good.substr(0, good.size()/2));
+        bfs::last_write_time(catFn, bfs::last_write_time(dsetFn) + 10);
+        {
+            datasetV2 dset(dsetFn);
+            checkAll(dset, 2000);
+        }
+
+        // wrong magic
+        std::string bad= good;
+        bad[0]= 'X';
+        writeFile(catFn, bad);
+        bfs::last_write_time(catFn, bfs::last_write_time(dsetFn) + 10);
+        {
+            datasetV2 dset(dsetFn);
+            checkAll(dset, 2000);
+        }
+
+        // empty
+        writeFile(catFn, "");
+        bfs::last_write_time(catFn, bfs::last_write_time(dsetFn) + 10);
+        {
+            datasetV2 dset(dsetFn);
+            checkAll(dset, 2000);
+        }
+
+        // missing
+        bfs::remove(catFn);
+        {
+            datasetV2 dset(dsetFn);
+            checkAll(dset, 2000);
+        }
+        ASSERT( bfs::exists(catFn) );
+    }
+
+    // ------- catalogue can't be written: kept in RAM
+    {
+        std::cout<<"in RAM catalogue\n";
+        std::string const dsetFn= tempDir + "/ram.v2bin";
+        std::string const catFn= datasetCatalogue::getCatFn(dsetFn);
+        buildTestDataset(dsetFn, 3000);
+        // a directory in place of the catalogue can be neither mapped nor replaced
+        bfs::remove(catFn);
+        bfs::create_directory(catFn);
+        bfs::last_write_time(catFn, bfs::last_write_time(dsetFn) + 10);
+        {
+            datasetV2 dset(dsetFn);
+            checkAll(dset, 3000);
+            ASSERT( !dset.containsFn(getTestFn(3000)) );
+        }
+        ASSERT( bfs::is_directory(catFn) );
+        // and no temporary files are left behind
+        uint32_t numFiles= 0;
+        for (bfs::directory_iterator it(tempDir); it!=bfs::directory_iterator(); ++it)
+            if (it->path().filename().string().compare(0, 8, "ram.v2bi")==0)
+                ++numFiles;
+        ASSERT( numFiles==2 );
+    }
+
+    // ------- lookup with a prefix (datasetV2's removePrefix)
+    {
+        std::cout<<"prefixed lookup\n";
+        std::string const dsetFn= tempDir + "/prefix.v2bin";
+        datasetBuilder dB(dsetFn);
+        dB.add("/data/a.jpg", 1, 1);
+        dB.add("/data/b.jpg", 2, 2);
+        dB.add("/other/a.jpg", 3, 3);
+        dB.close();
+
+        datasetCatalogue cat(dsetFn);
+        ASSERT( cat.numDocs()==3 );
+        ASSERT( cat.lookup("/data/", "a.jpg")==0 );
+        ASSERT( cat.lookup("/data/", "b.jpg")==1 );
+        ASSERT( cat.lookup("/other/", "a.jpg")==2 );
+        ASSERT( cat.lookup("", "/data/a.jpg")==0 );
+        ASSERT( cat.lookup("/data", "a.jpg")==3 );
+        ASSERT( cat.lookup("/other/", "b.jpg")==3 );
+        ASSERT( cat.lookup("/data/a.jpg", "")==0 );
+        ASSERT( cat.lookup("/data/a.jp", "")==3 );
+    }
+}
+
+
+
+int main(){
+
+    namespace bfs= boost::filesystem;
+    std::string const tempDir= ( bfs::temp_directory_path() / bfs::unique_path("rr_dset_test_%%%%-%%%%-%%%%-%%%%") ).string();
+    bfs::create_directory(tempDir);
+
+    datasetCatalogue_test(tempDir);
+
+    bfs::remove_all(tempDir);
+    std::cout<<"datasetCatalogue_test: OK\n";
+
+    google::protobuf::ShutdownProtobufLibrary();
+    return 0;
+}
@@ -30,6 +30,9 @@ int main(){
     datasetV2 d("/home/relja/Relja/Temp/dset.v2bin");
     std::cout<< d.getFn(0) <<"\n";
     std::cout<< d.getDocID("relja") <<"\n";
+    ASSERT( d.getDocID("relja3")==3 );
+    ASSERT( d.getWidthHeight(1)==std::make_pair(120u, 50u) );
+    ASSERT( !d.containsFn("relja5") && !d.containsFn("relj") );
     
     datasetV2 df("/home/relja/Relja/Data/tmp/indexing_v2/indexing_mini/dset_oxMini20.v2bin");
 //     datasetV2 df("/home/relja/Relja/Data/tmp/indexing_v2/indexing_ox5k/dset_oxc1_5k.v2bin");
@@ -38,9 +38,11 @@ void
 rawEmbedder::copyFrom(embedder &emb, uint32_t index){
     reserveAdditional(1);
     rawEmbedder* thisEmb= dynamic_cast<rawEmbedder*>( &emb );
-    thisEmb->charStream_->setIter(index*dim_);
-    for (uint32_t i= 0; i<dim_; ++i)
-        charStream_->add( thisEmb->charStream_->getNextUnsafe() );
+    std::vector<uint64_t> values(dim_);
+    if (!values.empty())
+        thisEmb->charStream_->getView().decode(index*dim_, dim_, &values[0]);
+    for (std::vector<uint64_t>::const_iterator it= values.begin(); it!=values.end(); ++it)
+        charStream_->add(*it);
 }
 
 
@@ -49,10 +51,11 @@ void
 rawEmbedder::copyRangeFrom(embedder &emb, uint32_t start, uint32_t end){
     reserveAdditional(end-start);
     rawEmbedder* thisEmb= dynamic_cast<rawEmbedder*>( &emb );
-    thisEmb->charStream_->setIter(start*dim_);
-    for (; start<end; ++start)
-        for (uint32_t i= 0; i<dim_; ++i)
-            charStream_->add( thisEmb->charStream_->getNextUnsafe() );
+    std::vector<uint64_t> values((end-start)*dim_);
+    if (!values.empty())
+        thisEmb->charStream_->getView().decode(start*dim_, values.size(), &values[0]);
+    for (std::vector<uint64_t>::const_iterator it= values.begin(); it!=values.end(); ++it)
+        charStream_->add(*it);
 }
 
 
@@ -71,8 +71,9 @@ hammingEmbedder::add(float vector[], uint32_t clusterID){
 void
 hammingEmbedder::copyFrom(embedder &emb, uint32_t index){
     hammingEmbedder* thisEmb= dynamic_cast<hammingEmbedder*>( &emb );
-    thisEmb->charStream_->setIter(index);
-    charStream_->add( thisEmb->charStream_->getNextUnsafe() );
+    uint64_t value;
+    thisEmb->charStream_->getView().decode(index, 1, &value);
+    charStream_->add(value);
 }
 
 
@@ -81,9 +82,11 @@ void
 hammingEmbedder::copyRangeFrom(embedder &emb, uint32_t start, uint32_t end){
     reserveAdditional(end-start);
     hammingEmbedder* thisEmb= dynamic_cast<hammingEmbedder*>( &emb );
-    thisEmb->charStream_->setIter(start);
-    for (; start<end; ++start)
-        charStream_->add( thisEmb->charStream_->getNextUnsafe() );
+    std::vector<uint64_t> values(end-start);
+    if (!values.empty())
+        thisEmb->charStream_->getView().decode(start, values.size(), &values[0]);
+    for (std::vector<uint64_t>::const_iterator it= values.begin(); it!=values.end(); ++it)
+        charStream_->add(*it);
 }
 
 
@@ -73,14 +73,6 @@ class hammingEmbedder : public embedder {
                 return numBits_;
             }
         
-        inline void
-            hammingDist(uint64_t val, int *itResult){
-                charStream_->resetIter();
-                uint32_t const n= charStream_->getNum();
-                for (uint32_t i= 0; i<n; ++i, ++itResult)
-                    *itResult= __builtin_popcountll(val ^ charStream_->getNextUnsafe());
-            }
-        
         inline charStream *
             getCharStream() const { return charStream_; }
     
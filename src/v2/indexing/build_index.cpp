@@ -33,6 +33,7 @@ No usage or redistribution is allowed without explicit permission.
 #include "ViseMessageQueue.h"
 #include "build_index_status.pb.h"
 #include "clst_centres.h"
+#include "clst_nn.h"
 #include "dataset_v2.h"
 #include "image_util.h"
 #include "index_entry_util.h"
@@ -41,6 +42,7 @@ No usage or redistribution is allowed without explicit permission.
 #include "protobuf_util.h"
 #include "proto_db_file.h"
 #include "proto_index.h"
+#include "tfidf_stats.h"
 #include "timing.h"
 #include "util.h"
 
@@ -82,6 +84,25 @@ saveStatus(std::string const indexingStatusFn, rr::buildIndexStatus const &statu
 
 
 
+uint32_t
+getNumDocs(std::string const imagelistFn){
+    uint32_t numDocs= 0;
+    std::ifstream fImagelist(imagelistFn.c_str());
+    std::string imageFn;
+    bool emptyline= false;
+    while (std::getline(fImagelist, imageFn)){
+        if (imageFn.length()>1) {
+            ++numDocs;
+            ASSERT(!emptyline); // i.e. empty lines can only appear at end of file
+        } else
+            emptyline= true;
+    }
+    fImagelist.close();
+    return numDocs;
+}
+
+
+
 class buildManagerFiles : public managerWithTiming<std::string> {
     public:
 
@@ -240,7 +261,8 @@ class buildWorkerSemiSorted : public queueWorker<buildResultSemiSorted> {
                               featGetter const &featGetter_obj,
                               fastann::nn_obj<float> const &nn_obj,
                               clstCentres const *clstCentres_obj= NULL,
-                              embedderFactory const *embFactory= NULL);
+                              embedderFactory const *embFactory= NULL,
+                              bool fullFidx= false);
 
         ~buildWorkerSemiSorted() {
             finish();
@@ -275,6 +297,10 @@ class buildWorkerSemiSorted : public queueWorker<buildResultSemiSorted> {
         void
             save() const;
 
+        // fidx entry with all features of the last document, i.e. indexEntry_[begin:]
+        void
+            getFullFidxEntry( int begin, rr::indexEntry &fidxEntry ) const;
+
         mutable std::ifstream fImagelist_;
         std::string const databasePath_;
 
@@ -285,6 +311,7 @@ class buildWorkerSemiSorted : public queueWorker<buildResultSemiSorted> {
         embedderFactory const *embFactory_;
         bool delEmbF_;
         embedder *emb_;
+        bool const fullFidx_;
         mutable rr::indexEntry indexEntry_;
 
         std::string const outDir_;
@@ -306,7 +333,8 @@ buildWorkerSemiSorted::buildWorkerSemiSorted(
         featGetter const &featGetter_obj,
         fastann::nn_obj<float> const &nn_obj,
         clstCentres const *clstCentres_obj,
-        embedderFactory const *embFactory)
+        embedderFactory const *embFactory,
+        bool fullFidx)
         : fidx_fn_( util::getTempFileName( outDir, "fidxpart_", ".bin" ) ),
           fImagelist_(imagelistFn.c_str()),
           databasePath_(databasePath),
@@ -314,6 +342,7 @@ buildWorkerSemiSorted::buildWorkerSemiSorted(
           numDims_(featGetter_obj.numDims()),
           nn_(&nn_obj),
           clstCentres_(clstCentres_obj),
+          fullFidx_(fullFidx),
           outDir_(outDir),
           dbBuilder_(NULL),
           indexBuilder_(NULL),
@@ -373,6 +402,7 @@ buildWorkerSemiSorted::operator() ( uint32_t jobID, buildResultSemiSorted &resul
     totalFeats_+= numFeats;
 
     // prepare memory
+    int const docBegin= indexEntry_.id_size();
     uint32_t reserveCount= static_cast<uint32_t>(indexEntry_.id_size()) + numFeats;
     google::protobuf::RepeatedField<uint32_t> *wordIDs= indexEntry_.mutable_id();
     google::protobuf::RepeatedField<uint32_t> *qx= indexEntry_.mutable_qx();
@@ -394,15 +424,18 @@ buildWorkerSemiSorted::operator() ( uint32_t jobID, buildResultSemiSorted &resul
     protobufUtil::addManyToEnd<uint32_t>( docID, numFeats, *(indexEntry_.mutable_docid()) );
 
     float *itD= descs;
+    // for decoding compactly stored centres
+    std::vector<float> centreBuf(numDims_);
 
-    for (uint32_t iFeat=0; iFeat<numFeats; ++iFeat){
-
-        // assign to clusters
+    // assign to clusters, all features at once
+    std::vector<unsigned> clusterIDs(numFeats);
+    std::vector<float> distSqs(numFeats);
+    if (numFeats>0)
+        nn_->search_nn(descs, numFeats, &clusterIDs[0], &distSqs[0]);
 
-        unsigned clusterID;
-        float distSq;
+    for (uint32_t iFeat=0; iFeat<numFeats; ++iFeat){
 
-        nn_->search_nn(descs+iFeat*numDims_, 1, &clusterID, &distSq);
+        unsigned const clusterID= clusterIDs[iFeat];
 
         ellipse const &region= regions[iFeat];
 
@@ -416,7 +449,7 @@ buildWorkerSemiSorted::operator() ( uint32_t jobID, buildResultSemiSorted &resul
 
         if (emb_->doesSomething()){
             float *thisDesc= itD;
-            float const *itC= clstCentres_->clstC_flat + clusterID * numDims_;
+            float const *itC= clstCentres_->getCentre(clusterID, &centreBuf[0]);
             float const *endC= itC + numDims_;
             for (; itC!=endC; ++itC, ++itD)
                 *itD -= *itC;
@@ -428,27 +461,86 @@ buildWorkerSemiSorted::operator() ( uint32_t jobID, buildResultSemiSorted &resul
     // cleanup
     delete []descs;
 
+    rr::indexEntry fidxEntry;
+
+    if (fullFidx_)
+        // needs to be done before save() as it clears indexEntry_
+        getFullFidxEntry(docBegin, fidxEntry);
+
     // protobufs are not designed for more
     if (indexEntry_.ByteSize() + static_cast<int>(emb_->getByteSize()) > semiSortedProtoByteSizeLim)
         save();
 
     // save fidx
-    std::sort(wordIDsUnique.begin(), wordIDsUnique.end());
-    std::vector<uint32_t>::const_iterator newEnd= std::unique(wordIDsUnique.begin(), wordIDsUnique.end());
-    rr::indexEntry fidxEntry;
-    google::protobuf::RepeatedField<uint32_t> *fidxWordID= fidxEntry.mutable_id();
-    fidxWordID->Reserve(newEnd - wordIDsUnique.begin());
-
-    for (std::vector<uint32_t>::const_iterator it= wordIDsUnique.begin();
-         it!=newEnd;
-         ++it){
-        fidxWordID->AddAlreadyReserved(*it);
+    if (!fullFidx_){
+        std::sort(wordIDsUnique.begin(), wordIDsUnique.end());
+        std::vector<uint32_t>::const_iterator newEnd= std::unique(wordIDsUnique.begin(), wordIDsUnique.end());
+        google::protobuf::RepeatedField<uint32_t> *fidxWordID= fidxEntry.mutable_id();
+        fidxWordID->Reserve(newEnd - wordIDsUnique.begin());
+
+        for (std::vector<uint32_t>::const_iterator it= wordIDsUnique.begin();
+             it!=newEnd;
+             ++it){
+            fidxWordID->AddAlreadyReserved(*it);
+        }
     }
     findexBuilder_.addEntry(docID, fidxEntry);
 }
 
 
 
+void
+buildWorkerSemiSorted::getFullFidxEntry( int begin, rr::indexEntry &fidxEntry ) const {
+
+    int const end= indexEntry_.id_size();
+    ASSERT( begin <= end );
+    ASSERT( !emb_->doesSomething() || static_cast<int>(emb_->getNum()) == end );
+
+    // copy this document's features
+    rr::indexEntry docEntry;
+    docEntry.mutable_id()->Reserve(end-begin);
+    for (int i= begin; i<end; ++i)
+        docEntry.mutable_id()->AddAlreadyReserved( indexEntry_.id(i) );
+
+    // sort according to clusterID
+    std::vector<int> inds;
+    indexEntryUtil::argSort::sort(docEntry, inds);
+
+    // apply the sort
+    int const size= end-begin;
+    google::protobuf::RepeatedField<uint32_t> *wordID= fidxEntry.mutable_id();
+    google::protobuf::RepeatedField<uint32_t> *qx= fidxEntry.mutable_qx();
+    google::protobuf::RepeatedField<uint32_t> *qy= fidxEntry.mutable_qy();
+    google::protobuf::RepeatedField<float> *a= fidxEntry.mutable_a();
+    google::protobuf::RepeatedField<float> *b= fidxEntry.mutable_b();
+    google::protobuf::RepeatedField<float> *c= fidxEntry.mutable_c();
+    wordID->Reserve(size);
+    qx->Reserve(size);
+    qy->Reserve(size);
+    a->Reserve(size);
+    b->Reserve(size);
+    c->Reserve(size);
+    embedder *emb= embFactory_->getEmbedder();
+    emb->reserve(size);
+
+    for (int i= 0; i<size; ++i){
+        int ind= begin + inds[i];
+        wordID->AddAlreadyReserved( indexEntry_.id(ind) );
+        qx->AddAlreadyReserved( indexEntry_.qx(ind) );
+        qy->AddAlreadyReserved( indexEntry_.qy(ind) );
+        a->AddAlreadyReserved( indexEntry_.a(ind) );
+        b->AddAlreadyReserved( indexEntry_.b(ind) );
+        c->AddAlreadyReserved( indexEntry_.c(ind) );
+        emb->copyFrom(*emb_, ind);
+    }
+
+    if (emb->getByteSize()>0)
+        fidxEntry.set_data( emb->getEncoding() );
+    delete emb;
+}
+
+
+
 void
 buildWorkerSemiSorted::save() const {
 
@@ -711,7 +803,9 @@ mergeSortedFiles(
         std::vector<std::string> const &fns,
         std::string const iidxFn,
         uint32_t const totalFeats,
-        embedderFactory const *embFactory= NULL){
+        embedderFactory const *embFactory= NULL,
+        uint32_t const numDocs= 0,
+        std::string const wghtFn= ""){
 
     bool delEmbF= false;
     if (embFactory==NULL){
@@ -788,6 +882,9 @@ mergeSortedFiles(
     embedder *emb= embFactory->getEmbedder();
     emb->reserve(100000);
 
+    // idf and docL2 are computed while merging so that retrieval doesn't need to scan the iidx
+    tfidfStatsBuilder *stats= (wghtFn.length()>0) ? new tfidfStatsBuilder(numDocs) : NULL;
+
     while (queue.size()){
 
         progressPrint.inc();
@@ -820,6 +917,8 @@ mergeSortedFiles(
         merged.mutable_qel_ratio()->append( &(entry.qel_ratio()[ind]), 1 );
         merged.mutable_qel_angle()->append( &(entry.qel_angle()[ind]), 1 );
         emb->copyFrom(*embedders[iEntry], ind);
+        if (stats!=NULL)
+            stats->add( ID, entry.docid(ind) );
 
         // protobufs are not designed for more
         if (merged.id_size()%100==0 && // to avoid doing ByteSize() all the time
@@ -886,6 +985,14 @@ mergeSortedFiles(
 
     idxBuilder.close();
 
+    if (stats!=NULL){
+        // same as what tfidfV2 would compute and save to the weights file
+        std::vector<double> idf, docL2;
+        stats->finish(idf, docL2);
+        tfidfStats::save(wghtFn, idf, docL2);
+        delete stats;
+    }
+
     util::delPointerVector(inIdxs);
     util::delPointerVector(inDbs);
     if (delEmbF) delete embFactory;
@@ -904,6 +1011,40 @@ mergeSortedFiles(
 
 
 
+// number of IDs the fidx merged from fns by mergePartialFidx will have, i.e. the largest docID
+// with features + 1, which is what tfidfV2 uses as the number of documents
+uint32_t
+getFidxNumIDs(std::vector<std::string> const &fns) {
+
+    uint32_t numIDs= 0;
+    std::vector<std::string> data;
+
+    for (uint32_t iFile= 0; iFile<fns.size(); ++iFile){
+        protoDbFile const db(fns[iFile]);
+        // images without features are skipped in mergePartialFidx
+        for (uint32_t ID= db.numIDs(); ID>numIDs; --ID){
+            if (!db.contains(ID-1))
+                continue;
+            db.getData(ID-1, data);
+            bool hasFeatures= false;
+            for (uint32_t i= 0; i<data.size() && !hasFeatures; ++i){
+                rr::indexEntry entry;
+                ASSERT(entry.ParseFromString(data[i]));
+                hasFeatures= entry.id_size()>0 || entry.diffid_size()>0;
+            }
+            data.clear();
+            if (hasFeatures){
+                numIDs= ID;
+                break;
+            }
+        }
+    }
+
+    return numIDs;
+}
+
+
+
 void
 mergePartialFidx(std::vector<std::string> const &fns, std::string const fidxFn) {
 
@@ -1017,7 +1158,10 @@ build(
         std::string const tmpDir,
         featGetter const &featGetter_obj,
         std::string const clstFn,
-        embedderFactory const *embFactory) {
+        embedderFactory const *embFactory,
+        bool fullFidx,
+        std::string const wghtFn,
+        clstCentres::storageType clstStorage) {
 
     MPI_GLOBAL_ALL
     bool useThreads= detectUseThreads();
@@ -1047,7 +1191,7 @@ build(
     if (status.state()==rr::buildIndexStatus::beginning){
 
         // extract features, assign to clusters, save to files sorted by clusterID within each indexEntry
-        // also save the bare fidx (i.e. list of unique wordIDs)
+        // also save the bare fidx (i.e. list of unique wordIDs), or if fullFidx the full fidx (i.e. all features with geometry and embedding data, sorted by wordID)
         // also construct the dataset info (i.e. list of images, width/height)
 
         if (rank==0) {
@@ -1059,7 +1203,7 @@ build(
             ViseMessageQueue::Instance()->Push( "Index log \nLoading cluster centres ... " );
         }
         double t0= timing::tic();
-        clstCentres clstCentres_obj( clstFn.c_str(), true );
+        clstCentres clstCentres_obj( clstFn.c_str(), true, clstStorage );
         if (rank==0) {
             //std::cout<<"buildIndex::build: Loading cluster centres - DONE ("<< timing::toc(t0) <<" ms)\n";
             s.str("");
@@ -1073,18 +1217,7 @@ build(
         }
         t0= timing::tic();
 
-        fastann::nn_obj<float> const *nn_obj=
-        #if 1
-            fastann::nn_obj_build_kdtree(
-                clstCentres_obj.clstC_flat,
-                clstCentres_obj.numClst,
-                clstCentres_obj.numDims, 8, 1024);
-        #else
-            fastann::nn_obj_build_exact(
-                clstCentres_obj.clstC_flat,
-                clstCentres_obj.numClst,
-                clstCentres_obj.numDims);
-        #endif
+        fastann::nn_obj<float> const *nn_obj= clstNN::build(clstCentres_obj, true, clstFn);
         if (rank==0) {
             //std::cout<<"buildIndex::build: Constructing NN search object - DONE ("<< timing::toc(t0) << " ms)\n";
             s.str("");
@@ -1095,19 +1228,8 @@ build(
 
         // get number of documents
         uint32_t numDocs= 0;
-        if (rank==0){
-            std::ifstream fImagelist(imagelistFn.c_str());
-            std::string imageFn;
-            bool emptyline= false;
-            while (std::getline(fImagelist, imageFn)){
-                if (imageFn.length()>1) {
-                    ++numDocs;
-                    ASSERT(!emptyline); // i.e. empty lines can only appear at end of file
-                } else
-                    emptyline= true;
-            }
-            fImagelist.close();
-        }
+        if (rank==0)
+            numDocs= getNumDocs(imagelistFn);
 
         // communicate numDocs to everyone
         #ifdef RR_MPI
@@ -1131,7 +1253,8 @@ build(
                     featGetter_obj,
                     *nn_obj,
                     &clstCentres_obj,
-                    embFactory) );
+                    embFactory,
+                    fullFidx) );
 
             // start feature extraction + assignment
             threadQueue<buildResultSemiSorted>::start( numDocs, workers, *manager );
@@ -1158,7 +1281,8 @@ build(
                 featGetter_obj,
                 *nn_obj,
                 &clstCentres_obj,
-                embFactory);
+                embFactory,
+                fullFidx);
             mpiQueue<buildResultSemiSorted>::start( numDocs, worker, manager );
             worker.finish();
 
@@ -1289,13 +1413,17 @@ build(
         for (int i= 0; i < status.fidx_filename_size(); ++i)
             fidxFns.push_back(status.fidx_filename(i));
 
+        // for the weights file, the same number of documents as tfidfV2 gets from the fidx
+        // (differs from the number of images if trailing images have no features)
+        uint32_t const numDocs= getFidxNumIDs(fidxFns);
+
         if (useThreads){
 
             // merge fidx
             boost::thread thread1( boost::bind(mergePartialFidx, fidxFns, fidxFn) );
 
             // merge iidx
-            boost::thread thread2( boost::bind(mergeSortedFiles, fns, iidxFn, status.totalfeats(), embFactory) );
+            boost::thread thread2( boost::bind(mergeSortedFiles, fns, iidxFn, status.totalfeats(), embFactory, numDocs, wghtFn) );
 
             thread1.join();
             thread2.join();
@@ -1311,7 +1439,7 @@ build(
 
             if ((numProc==1 && rank==0) || rank==1){
                 // merge iidx
-                mergeSortedFiles(fns, iidxFn, status.totalfeats(), embFactory);
+                mergeSortedFiles(fns, iidxFn, status.totalfeats(), embFactory, numDocs, wghtFn);
             }
 
             comm.barrier();
@@ -1322,6 +1450,9 @@ build(
 
         }
 
+        if (rank==0 && wghtFn.length()>0)
+            ASSERT( protoDbFile(fidxFn).numIDs()==numDocs );
+
         // update status
         if (rank==0){
             status.set_state( rr::buildIndexStatus::done );
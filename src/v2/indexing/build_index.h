@@ -17,10 +17,15 @@ No usage or redistribution is allowed without explicit permission.
 
 #include <string>
 
+#include "clst_centres.h"
 #include "embedder.h"
 #include "feat_getter.h"
 
 namespace buildIndex {
+    // wghtFn: if not empty, the weights file (idf, docL2 as used by tfidfV2) is computed while merging the iidx
+    // fullFidx: store all features (quantized geometry + embedding data) in the fidx instead of just the list of unique words,
+    // such that internal queries don't need to scan the iidx (retrieverV2::getQueryRep), at the cost of a fidx roughly as large as the iidx
+    // clstStorage: how the cluster centres are kept in RAM for assignment (see clstCentres::storageType)
     void
         build(std::string const imagelistFn, std::string const databasePath,
               std::string const dsetFn,
@@ -29,7 +34,10 @@ namespace buildIndex {
               std::string const tmpDir,
               featGetter const &featGetter_obj,
               std::string const clstFn,
-              embedderFactory const *embFactory= NULL);
+              embedderFactory const *embFactory= NULL,
+              bool fullFidx= false,
+              std::string const wghtFn= "",
+              clstCentres::storageType clstStorage= clstCentres::floatStorage);
 };
 
 #endif
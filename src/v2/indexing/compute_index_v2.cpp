@@ -29,6 +29,7 @@ No usage or redistribution is allowed without explicit permission.
 #include "train_assign.h"
 #include "train_descs.h"
 #include "train_hamming.h"
+#include "train_kmeans.h"
 #include "util.h"
 
 
@@ -63,6 +64,10 @@ int main(int argc, char* argv[]){
     
     bool const useRootSIFT= pt.get<bool>(dsetname+".RootSIFT", true);
     bool const SIFTscale3= pt.get<bool>( dsetname+".SIFTscale3", true);
+    // optional, shared by trainDescs, index and querying: features are only extracted once
+    std::string const featCacheDir= util::expandUser(pt.get<std::string>( dsetname+".featCacheDir", "" ));
+    // float, uint8 or float16: compact storage of the cluster centres for assignment
+    clstCentres::storageType const clstStorage= clstCentres::storageFromString(pt.get<std::string>( dsetname+".clstStorage", "float" ));
     
     
     if (stage=="trainDescs"){
@@ -74,7 +79,7 @@ int main(int argc, char* argv[]){
                 std::string("hesaff-") +
                 "sift" +
                 std::string(SIFTscale3 ? "-scale3" : "")
-                ).c_str() );
+                ).c_str(), featCacheDir );
         
         std::string const imagelistFn= util::expandUser(pt.get<std::string>( dsetname+".imagelistFn", "" ));
         std::string const trainImagelistFn= util::expandUser(pt.get<std::string>( dsetname+".trainImagelistFn", imagelistFn));
@@ -90,6 +95,23 @@ int main(int argc, char* argv[]){
             trainNumDescs,
             featGetter_obj);
         
+    } else if (stage=="trainClusters"){
+        // ------------------------------------ cluster training descs (instead of compute_clusters.py)
+        
+        std::string const trainFilesPrefix= util::expandUser(pt.get<std::string>( dsetname+".trainFilesPrefix" ));
+        std::string const trainDescsFn= trainFilesPrefix+"descs.e3bin";
+        uint32_t const clusterNumIteration= pt.get<uint32_t>( dsetname+".clusterNumIteration", 30 );
+        uint32_t const clusterMiniBatchSize= pt.get<uint32_t>( dsetname+".clusterMiniBatchSize", 0 );
+        // >0: vocabulary tree with this branching factor (vocSize has to be a power of it) instead of flat k-means
+        uint32_t const vocTreeBranching= pt.get<uint32_t>( dsetname+".vocTreeBranching", 0 );
+        
+        if (vocTreeBranching>0)
+            buildIndex::computeVocTree( clstFn, useRootSIFT, trainDescsFn, vocSize, vocTreeBranching, clusterNumIteration,
+                                        pt.get<uint32_t>( dsetname+".vocTreeNumTrainDescs", 2000000 ),
+                                        pt.get<uint32_t>( dsetname+".vocTreeBeam", 2 ) );
+        else
+            buildIndex::computeClusters( clstFn, useRootSIFT, trainDescsFn, vocSize, clusterNumIteration, clusterMiniBatchSize );
+        
     } else if (stage=="trainAssign"){
         // ------------------------------------ assign training descs to clusters
         
@@ -97,7 +119,7 @@ int main(int argc, char* argv[]){
         std::string const trainDescsFn= trainFilesPrefix+"descs.e3bin";
         std::string const trainAssignsFn= trainFilesPrefix + util::uintToShortStr(vocSize) + "_assigns.bin";
         
-        buildIndex::computeTrainAssigns( clstFn, useRootSIFT, trainDescsFn, trainAssignsFn);
+        buildIndex::computeTrainAssigns( clstFn, useRootSIFT, trainDescsFn, trainAssignsFn, clstStorage);
         
     } else if (stage=="trainHamm"){
         // ------------------------------------ compute hamming stuff
@@ -121,13 +143,15 @@ int main(int argc, char* argv[]){
         std::string const iidxFn= util::expandUser(pt.get<std::string>( dsetname+".iidxFn" ));
         std::string const fidxFn= util::expandUser(pt.get<std::string>( dsetname+".fidxFn" ));
         std::string const tmpDir= util::expandUser(pt.get<std::string>( dsetname+".tmpDir" ));
+        std::string const wghtFn= util::expandUser(pt.get<std::string>( dsetname+".wghtFn", "" ));
+        bool const fullFidx= pt.get<bool>( dsetname+".fullFidx", false );
         
         // feature getter
         featGetter_standard const featGetter_obj( (
                 std::string("hesaff-") +
                 std::string((useRootSIFT ? "rootsift" : "sift")) +
                 std::string(SIFTscale3 ? "-scale3" : "")
-                ).c_str() );
+                ).c_str(), featCacheDir );
         
         // embedder
         embedderFactory *embFactory= NULL;
@@ -148,7 +172,10 @@ int main(int argc, char* argv[]){
                           tmpDir,
                           featGetter_obj,
                           clstFn,
-                          embFactory );
+                          embFactory,
+                          fullFidx,
+                          wghtFn,
+                          clstStorage );
         
         delete embFactory;
     } else {
@@ -14,31 +14,149 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "flat_desc_file.h"
 
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
 #include "desc_to_hell.h"
 
+#if defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && (defined(__x86_64__) || defined(__i386__))
+#define FLAT_DESC_FILE_SIMD
+#include <immintrin.h>
+#endif
+
 
 namespace buildIndex {
 
 
 
 flatDescsFile::flatDescsFile(std::string const descsFn, bool const doHellinger)
-        : doHellinger_(doHellinger) {
-    f_= fopen(descsFn.c_str(), "rb");
-    ASSERT(f_!=NULL);
-    uint64_t fileSize= util::fileSize(descsFn);
+        : file_(descsFn.c_str()), doHellinger_(doHellinger) {
+    ASSERT(file_.isOpen());
+    ASSERT(file_.size()>=5);
     
-    int temp_;
-    temp_= fread(&numDims_, sizeof(numDims_), 1, f_);
-    temp_= fread(&dtypeCode_, sizeof(dtypeCode_), 1, f_);
-    REMOVE_UNUSED_WARNING(temp_);
+    memcpy(&numDims_, file_.data(), sizeof(numDims_));
+    memcpy(&dtypeCode_, file_.data()+sizeof(numDims_), sizeof(dtypeCode_));
     
     ASSERT( dtypeCode_==0 || dtypeCode_==4 );
     
     uint8_t size= dtypeCode_==0 ? 1 : sizeof(float);
-    ASSERT( (fileSize-5) % (numDims_*size) == 0 );
-    numDescs_= static_cast<uint32_t>( (fileSize-5) / (numDims_*size) );
+    ASSERT( numDims_>0 && (file_.size()-5) % (numDims_*size) == 0 );
+    numDescs_= static_cast<uint32_t>( (file_.size()-5) / (numDims_*size) );
+}
+
+
+
+uint8_t const *
+flatDescsFile::getDescsUint8(uint32_t start) const {
+    ASSERT(dtypeCode_==0 && !doHellinger_ && start<=numDescs_);
+    return reinterpret_cast<uint8_t const *>(file_.data()) + 5 + static_cast<uint64_t>(start)*numDims_;
+}
+
+
+
+// convert one descriptor to float, and optionally to Hellinger (as descToHell::convertToHell:
+// L1-normalise, square root), in two passes over the input which is in L1 cache for the second
+
+template <class T>
+static inline void
+convertDesc(T const *in, uint32_t numDims, bool doHellinger, float *out){
+    for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+        out[iDim]= static_cast<float>(in[iDim]);
+    if (doHellinger)
+        descToHell::convertToHell(numDims, out);
+}
+
+
+
+#ifdef FLAT_DESC_FILE_SIMD
+
+__attribute__((target("avx2")))
+static inline __m256
+load8(uint8_t const *in){
+    return _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( _mm_loadl_epi64(reinterpret_cast<__m128i const *>(in)) ) );
+}
+
+__attribute__((target("avx2")))
+static inline __m256
+load8(float const *in){
+    return _mm256_loadu_ps(in);
+}
+
+
+
+// numDims has to be a multiple of 8
+template <class T>
+__attribute__((target("avx2")))
+static void
+convertDescsAVX2(T const *in, uint32_t numDims, uint32_t count, bool doHellinger, float *out){
+    __m256 const zero= _mm256_setzero_ps();
+    for (uint32_t iDesc= 0; iDesc<count; ++iDesc, in+= numDims, out+= numDims){
+        if (!doHellinger){
+            for (uint32_t d= 0; d<numDims; d+= 8)
+                _mm256_storeu_ps(out+d, load8(in+d));
+            continue;
+        }
+        __m256 sum= zero;
+        for (uint32_t d= 0; d<numDims; d+= 8)
+            sum= _mm256_add_ps(sum, load8(in+d));
+        __m128 s= _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        s= _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s= _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        float l1norm= _mm_cvtss_f32(s);
+        l1norm= (l1norm>1e-6)?l1norm:1;
+        __m256 const inv= _mm256_set1_ps(1.0f/l1norm);
+        for (uint32_t d= 0; d<numDims; d+= 8)
+            _mm256_storeu_ps(out+d, _mm256_sqrt_ps( _mm256_max_ps(_mm256_mul_ps(load8(in+d), inv), zero) ));
+    }
+    _mm256_zeroupper();
+}
+
+
+
+static bool
+useAVX2(){
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static bool const hasAVX2= useAVX2();
+
+#endif
+
+
+
+template <class T>
+static void
+convertDescs(T const *in, uint32_t numDims, uint32_t count, bool doHellinger, float *out){
+    #ifdef FLAT_DESC_FILE_SIMD
+    if (hasAVX2 && numDims%8==0){
+        convertDescsAVX2(in, numDims, count, doHellinger, out);
+        return;
+    }
+    #endif
+    for (uint32_t iDesc= 0; iDesc<count; ++iDesc)
+        convertDesc(in + static_cast<uint64_t>(iDesc)*numDims, numDims, doHellinger, out + static_cast<uint64_t>(iDesc)*numDims);
+}
+
+
+
+void
+flatDescsFile::readDescs(uint32_t start, uint32_t end, float *descs) const {
+    ASSERT(end>=start && end<=numDescs_);
     
-    fd_= fileno(f_);
+    uint64_t const offset= static_cast<uint64_t>(start)*numDims_;
+    if (dtypeCode_==0)
+        convertDescs( reinterpret_cast<uint8_t const *>(file_.data()) + 5 + offset,
+                      numDims_, end-start, doHellinger_, descs );
+    else if (!doHellinger_)
+        // not 4-byte aligned in the file
+        memcpy( descs, file_.data() + 5 + offset*sizeof(float), static_cast<uint64_t>(end-start)*numDims_*sizeof(float) );
+    else {
+        memcpy( descs, file_.data() + 5 + offset*sizeof(float), static_cast<uint64_t>(end-start)*numDims_*sizeof(float) );
+        convertDescs( descs, numDims_, end-start, true, descs );
+    }
 }
 
 
@@ -46,40 +164,17 @@ flatDescsFile::flatDescsFile(std::string const descsFn, bool const doHellinger)
 void
 flatDescsFile::getDescs(uint32_t start, uint32_t end, float *&descs) const {
     ASSERT(end>=start);
-    descs= new float[(end-start)*numDims_];
-    
-    int temp_;
-    
-    if (dtypeCode_==0){
-        
-        uint8_t *descsRaw= new uint8_t[(end-start)*numDims_];
-        temp_= pread64(fd_, descsRaw,
-                       (end-start)*numDims_,
-                       static_cast<uint64_t>(start)*numDims_ + 5 );
-        
-        uint8_t const *inIter= descsRaw;
-        float *outIter= descs;
-        float *outIterEnd= descs + (end-start)*numDims_;
-        for (; outIter!=outIterEnd; ++inIter, ++outIter)
-            *outIter= static_cast<float>(*inIter);
-        
-        delete []descsRaw;
-        
-    } else if (dtypeCode_==4) {
-        
-        temp_= pread64(fd_, descs,
-                       (end-start)*numDims_*sizeof(float),
-                       5 + start*numDims_*sizeof(float) );
-        
-    } else ASSERT(0);
-    
-    if (doHellinger_){
-        float *thisDesc= descs;
-        for (; start!=end; ++start, thisDesc+=numDims_)
-            descToHell::convertToHell(numDims_, thisDesc);
-    }
-    
-    REMOVE_UNUSED_WARNING(temp_);
+    descs= new float[static_cast<uint64_t>(end-start)*numDims_];
+    readDescs(start, end, descs);
+}
+
+
+
+void
+flatDescsFile::getShard(uint32_t iShard, uint32_t numShards, uint32_t &start, uint32_t &end) const {
+    ASSERT(iShard<numShards);
+    start= static_cast<uint32_t>( static_cast<uint64_t>(numDescs_)*iShard/numShards );
+    end= static_cast<uint32_t>( static_cast<uint64_t>(numDescs_)*(iShard+1)/numShards );
 }
 
 
@@ -16,10 +16,10 @@ No usage or redistribution is allowed without explicit permission.
 #define _FLAT_DESC_FILE_H_
 
 #include <stdint.h>
-#include <stdio.h>
 #include <string>
 
 #include "macros.h"
+#include "mapped_file.h"
 
 
 
@@ -28,6 +28,9 @@ namespace buildIndex {
 
 
 
+// Training descriptors (numDims, dtypeCode, then uint8 or float descriptors), memory-mapped:
+// reads are lock-free and need no syscalls, so any number of threads can read any
+// ranges (e.g. getShard) concurrently
 class flatDescsFile {
     public:
         flatDescsFile(std::string const descsFn, bool const doHellinger);
@@ -38,12 +41,28 @@ class flatDescsFile {
         uint32_t
             numDims() const { return numDims_; }
         
+        // stored as uint8 (SIFT), otherwise float
+        bool
+            isUint8() const { return dtypeCode_==0; }
+        
+        // descriptors from start on as stored, without a copy (only if isUint8, no Hellinger)
+        uint8_t const *
+            getDescsUint8(uint32_t start) const;
+        
+        // descriptors [start, end) as float into descs, converted and Hellinger-normalised in one pass
+        void
+            readDescs(uint32_t start, uint32_t end, float *descs) const;
+        
+        // as readDescs but allocates descs (delete [] by the caller)
         void
             getDescs(uint32_t start, uint32_t end, float *&descs) const;
         
+        // contiguous range of descriptors [start, end) of shard iShard out of numShards (balanced)
+        void
+            getShard(uint32_t iShard, uint32_t numShards, uint32_t &start, uint32_t &end) const;
+        
     private:
-        FILE *f_;
-        int fd_;
+        mappedFile file_;
         uint8_t dtypeCode_;
         uint32_t numDims_, numDescs_;
         bool const doHellinger_;
@@ -24,6 +24,7 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "ViseMessageQueue.h"
 #include "clst_centres.h"
+#include "clst_nn.h"
 #include "flat_desc_file.h"
 #include "mpi_queue.h"
 #include "par_queue.h"
@@ -105,11 +106,10 @@ class trainAssignsWorker : public queueWorker<trainAssignsResult> {
 
         trainAssignsWorker(fastann::nn_obj<float> const &nn_obj,
                            flatDescsFile const &descFile,
-                           uint32_t chunkSize)
+                           uint32_t nJobs)
             : nn_obj_(&nn_obj),
               descFile_(&descFile),
-              chunkSize_(chunkSize),
-              numDescs_(descFile.numDescs())
+              nJobs_(nJobs)
             {}
 
         void
@@ -119,7 +119,7 @@ class trainAssignsWorker : public queueWorker<trainAssignsResult> {
 
         fastann::nn_obj<float> const *nn_obj_;
         flatDescsFile const *descFile_;
-        uint32_t const chunkSize_, numDescs_;
+        uint32_t const nJobs_;
 
         DISALLOW_COPY_AND_ASSIGN(trainAssignsWorker)
 };
@@ -131,19 +131,19 @@ trainAssignsWorker::operator() ( uint32_t jobID, trainAssignsResult &result ) co
 
     result.clear();
 
-    uint32_t start= jobID*chunkSize_;
-    uint32_t end= std::min( (jobID+1)*chunkSize_, numDescs_ );
+    // jobs are shards of the memory-mapped file, read without any locking
+    uint32_t start, end;
+    descFile_->getShard(jobID, nJobs_, start, end);
+    if (end==start)
+        return;
 
-    float *descs;
-    descFile_->getDescs(start, end, descs);
+    std::vector<float> descs(static_cast<uint64_t>(end-start)*descFile_->numDims());
+    descFile_->readDescs(start, end, &descs[0]);
 
     result.resize(end-start);
-    float *distSq= new float[end-start];
-
-    nn_obj_->search_nn(descs, end-start, &result[0], distSq);
-    delete []distSq;
+    std::vector<float> distSq(end-start);
 
-    delete []descs;
+    nn_obj_->search_nn(&descs[0], end-start, &result[0], &distSq[0]);
 }
 
 
@@ -153,7 +153,8 @@ computeTrainAssigns(
         std::string const clstFn,
         bool const RootSIFT,
         std::string const trainDescsFn,
-        std::string const trainAssignsFn){
+        std::string const trainAssignsFn,
+        clstCentres::storageType clstStorage){
 
     MPI_GLOBAL_ALL;
 
@@ -173,7 +174,7 @@ computeTrainAssigns(
         ViseMessageQueue::Instance()->Push( "Assignment log \nLoading cluster centers ..." );
     }
     double t0= timing::tic();
-    clstCentres clstCentres_obj( clstFn.c_str(), true );
+    clstCentres clstCentres_obj( clstFn.c_str(), true, clstStorage );
     if (rank==0) {
         //std::cout<<"buildIndex::computeTrainAssigns: Loading cluster centres - DONE ("<< timing::toc(t0) <<" ms)\n";
         std::ostringstream s;
@@ -186,18 +187,7 @@ computeTrainAssigns(
     }
 
     t0= timing::tic();
-    fastann::nn_obj<float> const *nn_obj=
-    #if 1
-        fastann::nn_obj_build_kdtree(
-            clstCentres_obj.clstC_flat,
-            clstCentres_obj.numClst,
-            clstCentres_obj.numDims, 8, 1024);
-    #else
-        fastann::nn_obj_build_exact(
-            clstCentres_obj.clstC_flat,
-            clstCentres_obj.numClst,
-            clstCentres_obj.numDims);
-    #endif
+    fastann::nn_obj<float> const *nn_obj= clstNN::build(clstCentres_obj, true, clstFn);
     if (rank==0) {
       //std::cout<<"buildIndex::computeTrainAssigns: Constructing NN search object - DONE ("<< timing::toc(t0) << " ms)\n";
       std::ostringstream s;
@@ -228,7 +218,7 @@ computeTrainAssigns(
         new trainAssignsManager(nJobs, trainAssignsFn) :
         NULL;
 
-    trainAssignsWorker worker(*nn_obj, descFile, chunkSize);
+    trainAssignsWorker worker(*nn_obj, descFile, nJobs);
 
     if (useThreads)
         threadQueue<trainAssignsResult>::start( nJobs, worker, *manager, numWorkerThreads );
@@ -17,13 +17,16 @@ No usage or redistribution is allowed without explicit permission.
 
 #include <string>
 
+#include "clst_centres.h"
+
 namespace buildIndex {
     
     void
         computeTrainAssigns(std::string const clstFn,
                             bool const RootSIFT,
                             std::string const trainDescsFn,
-                            std::string const trainAssignsFn);
+                            std::string const trainAssignsFn,
+                            clstCentres::storageType clstStorage= clstCentres::floatStorage);
 }
 
 #endif
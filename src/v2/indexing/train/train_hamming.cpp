@@ -15,14 +15,19 @@ No usage or redistribution is allowed without explicit permission.
 #include "train_hamming.h"
 
 #include <fstream>
+#include <map>
 #include <vector>
 
 #include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/serialization/utility.hpp> // for std::pair
+#include <boost/serialization/vector.hpp>
 
 #ifdef RR_MPI
 #include <boost/mpi/collectives.hpp>
 #endif
 
+#include <Eigen/Core>
 #include <Eigen/SVD>
 
 #include "ViseMessageQueue.h"
@@ -35,6 +40,7 @@ No usage or redistribution is allowed without explicit permission.
 #include "protobuf_util.h"
 #include "same_random.h"
 #include "timing.h"
+#include "util.h"
 
 
 
@@ -131,109 +137,225 @@ trainHammingManager::compute( uint32_t jobID, trainHammingResult &result ){
 
 
 
-class trainHammingWorker : public queueWorker<trainHammingResult> {
+// clusterIDs and projections (hammEmbBits per descriptor) of descriptor residuals
+typedef std::pair< std::vector<uint32_t>, std::vector<float> > hammBucketResult;
+
+
+
+static std::string
+getBucketFn(std::string const trainHammFn, uint32_t bucketID){
+    return trainHammFn + "_bucket" + boost::lexical_cast<std::string>(bucketID) + ".tmp";
+}
+
+
+
+class hammBucketManager : public managerWithTiming<hammBucketResult> {
     public:
-        trainHammingWorker(std::string const trainDescsFn,
-                           std::string const trainAssignsFn,
-                           bool const RootSIFT,
-                           std::vector<float> const &rot,
-                           clstCentres const &clstCentres_obj,
-                           uint32_t const vocChunkSize)
-                           : descFile_(trainDescsFn, RootSIFT),
-                             hammEmbBits_(rot.size() / descFile_.numDims()),
-                             numClst_(clstCentres_obj.numClst),
-                             vocChunkSize_(vocChunkSize),
-                             numDims_(descFile_.numDims()),
-                             numDescs_(descFile_.numDescs()),
-                             rot_(&rot),
-                             clstCentres_obj_(&clstCentres_obj){
+
+        hammBucketManager(uint32_t const nJobs,
+                          std::string const trainHammFn,
+                          uint32_t const numBuckets,
+                          uint32_t const vocChunkSize,
+                          uint32_t const hammEmbBits)
+                          : managerWithTiming<hammBucketResult>(nJobs, "hammBucketManager"),
+                            nextID_(0),
+                            vocChunkSize_(vocChunkSize),
+                            hammEmbBits_(hammEmbBits) {
+                for (uint32_t bucketID= 0; bucketID<numBuckets; ++bucketID){
+                    f_.push_back( fopen(getBucketFn(trainHammFn, bucketID).c_str(), "wb") );
+                    ASSERT(f_.back()!=NULL);
+                }
+            }
+
+        // a bucket truncated by a full disk would silently train the medians on part of the data
+        ~hammBucketManager(){
+            for (uint32_t bucketID= 0; bucketID<f_.size(); ++bucketID)
+                ASSERT( fclose(f_[bucketID])==0 );
+        }
+
+        void
+            compute( uint32_t jobID, hammBucketResult &result );
+
+    private:
+        std::vector<FILE*> f_;
+        uint32_t nextID_;
+        std::map<uint32_t, hammBucketResult> results_;
+        uint32_t const vocChunkSize_, hammEmbBits_;
+
+        DISALLOW_COPY_AND_ASSIGN(hammBucketManager)
+};
+
+
+
+void
+hammBucketManager::compute( uint32_t jobID, hammBucketResult &result ){
+    // make sure results are saved sorted by job, so that medianComputer sees
+    // the values in the same order as if the descriptors were read sequentially
+    results_[jobID]= result;
+    if (jobID!=nextID_)
+        return;
+
+    for (std::map<uint32_t, hammBucketResult>::iterator it= results_.begin();
+         it!=results_.end() && it->first==nextID_;
+         ++nextID_){
+
+        std::vector<uint32_t> const &clusterIDs= it->second.first;
+        float const *itProj= &(it->second.second[0]);
+        ASSERT(it->second.second.size() == clusterIDs.size()*hammEmbBits_);
+
+        // scatter into the bucket of the corresponding vocabulary chunk
+        for (uint32_t iDesc= 0; iDesc<clusterIDs.size(); ++iDesc, itProj+= hammEmbBits_){
+            FILE *f= f_[ clusterIDs[iDesc] / vocChunkSize_ ];
+            ASSERT( fwrite( &clusterIDs[iDesc], sizeof(uint32_t), 1, f ) == 1 );
+            ASSERT( fwrite( itProj, sizeof(float), hammEmbBits_, f ) == hammEmbBits_ );
+        }
+
+        results_.erase(it++);
+    }
+}
+
+
+
+class hammBucketWorker : public queueWorker<hammBucketResult> {
+    public:
+        hammBucketWorker(std::string const trainDescsFn,
+                         std::string const trainAssignsFn,
+                         bool const RootSIFT,
+                         std::vector<float> const &rot,
+                         clstCentres const &clstCentres_obj,
+                         uint32_t const descChunkSize)
+                         : descFile_(trainDescsFn, RootSIFT),
+                           hammEmbBits_(rot.size() / descFile_.numDims()),
+                           descChunkSize_(descChunkSize),
+                           numDims_(descFile_.numDims()),
+                           numDescs_(descFile_.numDescs()),
+                           rot_(&rot),
+                           clstCentres_obj_(&clstCentres_obj){
                   ASSERT(clstCentres_obj_->numDims==numDims_);
                   ASSERT(rot.size() % numDims_==0);
                   f_= fopen(trainAssignsFn.c_str(), "rb");
+                  ASSERT(f_!=NULL);
                   fd_= fileno(f_);
             }
 
-        ~trainHammingWorker(){ fclose(f_); }
+        ~hammBucketWorker(){ fclose(f_); }
 
         void
-            operator() ( uint32_t jobID, trainHammingResult &result ) const;
+            operator() ( uint32_t jobID, hammBucketResult &result ) const;
 
     private:
         flatDescsFile const descFile_;
         FILE *f_;
         int fd_;
-        uint32_t const hammEmbBits_, numClst_, vocChunkSize_, numDims_, numDescs_;
+        uint32_t const hammEmbBits_, descChunkSize_, numDims_, numDescs_;
         std::vector<float> const *rot_;
         clstCentres const *clstCentres_obj_;
 
-        DISALLOW_COPY_AND_ASSIGN(trainHammingWorker)
+        DISALLOW_COPY_AND_ASSIGN(hammBucketWorker)
 };
 
 
 
 void
-trainHammingWorker::operator() ( uint32_t jobID, trainHammingResult &result ) const {
+hammBucketWorker::operator() ( uint32_t jobID, hammBucketResult &result ) const {
 
-    result.clear();
+    uint32_t const iDescStart= jobID*descChunkSize_;
+    uint32_t const iDescEnd= std::min(iDescStart + descChunkSize_, numDescs_);
+    uint32_t const count= iDescEnd-iDescStart;
 
-    uint32_t wordStart= jobID*vocChunkSize_;
-    uint32_t const wordEnd= std::min( (jobID+1)*vocChunkSize_, numClst_ );
-    std::vector<medianComputer> medianComp( (wordEnd-wordStart)*hammEmbBits_ );
+    // descriptors
+    std::vector<float> descsBuf(static_cast<uint64_t>(count)*numDims_);
+    float *descs= &descsBuf[0];
+    descFile_.readDescs(iDescStart, iDescEnd, descs);
+    // clusters
+    std::vector<uint32_t> &clusterIDs= result.first;
+    clusterIDs.resize(count);
+    ASSERT( pread64(fd_, &clusterIDs[0],
+                    count*sizeof(uint32_t),
+                    static_cast<uint64_t>(iDescStart)*sizeof(uint32_t)) > 0 );
+
+    // subtract cluster centres
+    float *itDesc= descs;
+    for (uint32_t iDesc= 0; iDesc<count; ++iDesc){
+        float const *itC= clstCentres_obj_->clstC_flat + clusterIDs[iDesc] * numDims_;
+        for (uint32_t iDim= 0; iDim<numDims_; ++iDim, ++itDesc, ++itC)
+            *itDesc-= *itC;
+    }
 
-    uint32_t const descChunkSize= 1000;
-    uint32_t clusterIDs[descChunkSize];
+    // rotate all residuals at once: (hammEmbBits x numDims) * (numDims x count),
+    // Eigen does a cache-blocked GEMM which is much faster than a dot product per descriptor and bit
+    result.second.resize(count*hammEmbBits_);
+    Eigen::Map< Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> const >
+        R(&((*rot_)[0]), hammEmbBits_, numDims_);
+    Eigen::Map<Eigen::MatrixXf const> residuals(descs, numDims_, count);
+    Eigen::Map<Eigen::MatrixXf> projections(&(result.second[0]), hammEmbBits_, count);
+    projections.noalias()= R * residuals;
+}
 
-    for (uint32_t iDescStart= 0; iDescStart<numDescs_; ){
-        uint32_t iDescEnd= std::min(iDescStart + descChunkSize, numDescs_);
 
-        // descriptors
-        float *descs;
-        descFile_.getDescs(iDescStart, iDescEnd, descs);
-        // clusters
-        ASSERT( pread64(fd_, clusterIDs,
-                       (iDescEnd-iDescStart)*sizeof(uint32_t),
-                       static_cast<uint64_t>(iDescStart)*sizeof(uint32_t)) > 0 );
 
-        uint32_t const count= iDescEnd-iDescStart;
-        float *itDesc= descs;
-        uint32_t *itClusterID= clusterIDs;
+class trainHammingWorker : public queueWorker<trainHammingResult> {
+    public:
+        trainHammingWorker(std::string const trainHammFn,
+                           uint32_t const hammEmbBits,
+                           uint32_t const numClst,
+                           uint32_t const vocChunkSize)
+                           : trainHammFn_(trainHammFn),
+                             hammEmbBits_(hammEmbBits),
+                             numClst_(numClst),
+                             vocChunkSize_(vocChunkSize) {}
 
-        for (uint32_t iDesc= 0; iDesc<count; ++iDesc, ++itClusterID){
-            // process only the descriptors with cluster inside [wordStart,wordEnd)
-            if (*itClusterID < wordStart || *itClusterID >= wordEnd){
-                itDesc+= numDims_;
-                continue;
-            }
+        void
+            operator() ( uint32_t jobID, trainHammingResult &result ) const;
 
-            float * const thisDesc= itDesc;
+    private:
+        std::string const trainHammFn_;
+        uint32_t const hammEmbBits_, numClst_, vocChunkSize_;
 
-            // subtract cluster centres
-            float const *itC= clstCentres_obj_->clstC_flat + (*itClusterID) * numDims_;
-            for (uint32_t iDim= 0; iDim<numDims_; ++iDim, ++itDesc, ++itC)
-                *itDesc-= *itC;
-
-            // rotate and add to median computer for every projection dimension
-            medianComputer *itMC= &medianComp[0] + (*itClusterID-wordStart) * hammEmbBits_;
-            float projection;
-            float const *itDescEnd= thisDesc+numDims_;
-            float const *itDescC;
-            float const *itRot= &((*rot_)[0]);
-
-            for (uint32_t iDim= 0; iDim < hammEmbBits_; ++iDim, ++itMC){
-                projection= 0.0f;
-                for (itDescC= thisDesc; itDescC!=itDescEnd; ++itDescC, ++itRot)
-                    projection+= *itDescC * (*itRot);
-
-                itMC->add(projection);
-            }
-        }
+        DISALLOW_COPY_AND_ASSIGN(trainHammingWorker)
+};
 
-        delete []descs;
 
-        iDescStart= iDescEnd;
-    }
+
+void
+trainHammingWorker::operator() ( uint32_t jobID, trainHammingResult &result ) const {
 
     result.clear();
+
+    uint32_t wordStart= jobID*vocChunkSize_;
+    uint32_t const wordEnd= std::min( (jobID+1)*vocChunkSize_, numClst_ );
+    std::vector<medianComputer> medianComp( (wordEnd-wordStart)*hammEmbBits_ );
+
+    // the bucket contains only the projections of descriptors assigned to [wordStart,wordEnd)
+    std::string const bucketFn= getBucketFn(trainHammFn_, jobID);
+    FILE *f= fopen(bucketFn.c_str(), "rb");
+    ASSERT(f!=NULL);
+
+    uint32_t const recordSize= 1 + hammEmbBits_; // clusterID followed by projections
+    uint64_t const numRecords= util::fileSize(bucketFn) / (recordSize*sizeof(float));
+    uint32_t const recordChunkSize= 10000;
+    std::vector<float> records(recordChunkSize * recordSize);
+
+    for (uint64_t iRecStart= 0; iRecStart<numRecords; ){
+        uint32_t const count= std::min( static_cast<uint64_t>(recordChunkSize), numRecords-iRecStart );
+        ASSERT( fread(&records[0], sizeof(float), count*recordSize, f) == count*recordSize );
+
+        float const *itRecord= &records[0];
+        for (uint32_t iRec= 0; iRec<count; ++iRec){
+            uint32_t clusterID;
+            std::memcpy(&clusterID, itRecord, sizeof(uint32_t));
+            ++itRecord;
+            ASSERT(clusterID>=wordStart && clusterID<wordEnd);
+
+            medianComputer *itMC= &medianComp[0] + (clusterID-wordStart) * hammEmbBits_;
+            for (uint32_t iDim= 0; iDim < hammEmbBits_; ++iDim, ++itMC, ++itRecord)
+                itMC->add(*itRecord);
+        }
+
+        iRecStart+= count;
+    }
+    fclose(f);
+
     result.reserve( (wordEnd-wordStart)*hammEmbBits_ );
     for (medianComputer *itMC= &medianComp[0]; wordStart<wordEnd; ++wordStart){
         for (uint32_t iDim= 0; iDim < hammEmbBits_; ++iDim, ++itMC)
@@ -317,6 +439,7 @@ computeHamming(
         float *itDesc= descs;
         float const *descsEnd= descs + numTrainDescsPCA*numDims;
         uint32_t *clusterIDs= new uint32_t[blockSize];
+        std::vector<float> blockDescs(blockSize*numDims);
 
         //std::cout<<"buildIndex::computeHamming: Reading training "<<numTrainDescsPCA<<" descriptors for PCA\n";
         s.str("");
@@ -325,10 +448,9 @@ computeHamming(
         ViseMessageQueue::Instance()->Push( s.str() );
 
         for (uint32_t iDescStart= 0; itDesc!=descsEnd; iDescStart+= blockStep){
-            float *thisBlockDescs;
             // descriptors
-            descFile.getDescs(iDescStart, iDescStart+blockSize, thisBlockDescs);
-            float const *thisDescIt= thisBlockDescs;
+            descFile.readDescs(iDescStart, iDescStart+blockSize, &blockDescs[0]);
+            float const *thisDescIt= &blockDescs[0];
             // clusters
             ASSERT( pread64(fd, clusterIDs,
                             blockSize*sizeof(uint32_t),
@@ -340,7 +462,6 @@ computeHamming(
                 for (uint32_t iDim= 0; iDim<numDims; ++iDim, ++itDesc, ++itC, ++thisDescIt)
                     *itDesc= *thisDescIt - *itC;
             }
-            delete []thisBlockDescs;
         }
         fclose(f);
         delete []clusterIDs;
@@ -427,33 +548,71 @@ computeHamming(
     #endif
 
     // Parallelization is done a bit differently than normally, due to memory:
-    // Each worker will process a range of visual words to find the medians
+    // Each median worker will process a range of visual words (a bucket) to find the medians
     uint32_t const vocChunkSize=
         std::min( static_cast<uint32_t>(5000),
                   static_cast<uint32_t>(
                       std::ceil(static_cast<double>(numClst)/std::max(numWorkerThreads, numProc))) );
     uint32_t const nJobs= static_cast<uint32_t>( std::ceil(static_cast<double>(numClst)/vocChunkSize) );
 
-    // compute hamming stuff
+    #ifdef RR_MPI
+    if (!useThreads) comm.barrier();
+    #endif
+
+    // --- bucketing: stream all training descriptors once, project their residuals
+    // and scatter the projections into one spill file per range of visual words
+
+    {
+        uint32_t const descChunkSize= 10000;
+        uint32_t numDescs;
+        {
+            flatDescsFile descFile(trainDescsFn, RootSIFT);
+            numDescs= descFile.numDescs();
+        }
+        uint32_t const nBucketJobs= static_cast<uint32_t>( std::ceil(static_cast<double>(numDescs)/descChunkSize) );
+
+        if (rank==0)
+            ViseMessageQueue::Instance()->Push( "Hamm log \nBucketing projected residuals" );
+
+        hammBucketManager *manager= (rank==0) ?
+            new hammBucketManager(nBucketJobs, trainHammFn, nJobs, vocChunkSize, rot.size() / numDims) :
+            NULL;
+
+        hammBucketWorker worker(trainDescsFn, trainAssignsFn,
+                                RootSIFT,
+                                rot, clstCentres_obj, descChunkSize);
+
+        if (useThreads)
+            threadQueue<hammBucketResult>::start( nBucketJobs, worker, *manager, numWorkerThreads );
+        else
+            mpiQueue<hammBucketResult>::start( nBucketJobs, worker, manager );
+
+        // closes the bucket files
+        if (rank==0) delete manager;
+    }
 
     #ifdef RR_MPI
     if (!useThreads) comm.barrier();
     #endif
 
+    // --- compute medians, each job only reads its own bucket
+
     trainHammingManager *manager= (rank==0) ?
         new trainHammingManager(nJobs, trainHammFn, rot, numDims, numClst, vocChunkSize) :
         NULL;
 
-    trainHammingWorker worker(trainDescsFn, trainAssignsFn,
-                              RootSIFT,
-                              rot, clstCentres_obj, vocChunkSize);
+    trainHammingWorker worker(trainHammFn, rot.size() / numDims, numClst, vocChunkSize);
 
     if (useThreads)
         threadQueue<trainHammingResult>::start( nJobs, worker, *manager, numWorkerThreads );
     else
         mpiQueue<trainHammingResult>::start( nJobs, worker, manager );
 
-    if (rank==0) delete manager;
+    if (rank==0){
+        delete manager;
+        for (uint32_t bucketID= 0; bucketID<nJobs; ++bucketID)
+            boost::filesystem::remove( getBucketFn(trainHammFn, bucketID) );
+    }
 
 }
 
@@ -0,0 +1,764 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "train_kmeans.h"
+
+#include <algorithm>
+#include <functional>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#ifdef RR_MPI
+#include <boost/mpi/collectives.hpp>
+#endif
+
+#include <fastann.hpp>
+
+#include "ViseMessageQueue.h"
+#include "compact_dist.h"
+#include "flat_desc_file.h"
+#include "mpi_queue.h"
+#include "par_queue.h"
+#include "same_random.h"
+#include "timing.h"
+#include "util.h"
+#include "voc_tree.h"
+
+
+
+
+namespace buildIndex {
+
+
+typedef double trainKMeansResult; // sum of squared distances to the nearest centre
+
+
+
+// organization (same as dkmeans_relja's dkmeans3_save_clusters, and what clstCentres reads):
+// dtypeCode, numClst, numDims, iter, numIter, numDescs, numDims, seed, distortion, centres
+// checkpoints of the mini-batch mode additionally contain the per-centre total counts at the end
+static uint32_t const clstHeaderSize= 1 + 4*2 + 5*4 + 4;
+
+
+
+static void
+saveClusters(std::string const fn,
+             std::vector<float> const &centres,
+             uint32_t const numDims,
+             uint32_t const iter,
+             uint32_t const numIter,
+             uint32_t const numDescs,
+             uint32_t const seed,
+             float const distortion,
+             std::vector<uint32_t> const *totalCounts= NULL){
+
+    uint32_t const numClst= centres.size() / numDims;
+    uint8_t const dtypeCode= 4;
+    uint32_t const header[7]= {numClst, numDims, iter, numIter, numDescs, numDims, seed};
+
+    // write to a temporary file first so that a crash never leaves a corrupt checkpoint
+    std::string const tmpFn= fn + ".tmp";
+    FILE *f= fopen(tmpFn.c_str(), "wb");
+    ASSERT(f!=NULL);
+
+    fwrite( &dtypeCode, sizeof(uint8_t), 1, f );
+    fwrite( header, sizeof(uint32_t), 7, f );
+    fwrite( &distortion, sizeof(float), 1, f );
+    fwrite( &centres[0], sizeof(float), centres.size(), f );
+    if (totalCounts!=NULL)
+        fwrite( &((*totalCounts)[0]), sizeof(uint32_t), totalCounts->size(), f );
+
+    fclose(f);
+    boost::filesystem::rename(tmpFn, fn);
+}
+
+
+
+static bool
+loadCheckpoint(std::string const fn,
+               uint32_t const numClst,
+               uint32_t const numDims,
+               uint32_t &iter,
+               float &distortion,
+               std::vector<float> &centres,
+               std::vector<uint32_t> *totalCounts){
+
+    if (!boost::filesystem::exists(fn))
+        return false;
+
+    uint64_t const fileSize= util::fileSize(fn);
+    uint64_t const centresEnd= clstHeaderSize + static_cast<uint64_t>(numClst)*numDims*sizeof(float);
+    bool const hasCounts= (fileSize == centresEnd + numClst*sizeof(uint32_t));
+    if (fileSize!=centresEnd && !hasCounts){
+        std::cerr<<"buildIndex::computeClusters: Ignoring corrupt checkpoint "<<fn<<"\n";
+        return false;
+    }
+    if (totalCounts!=NULL && !hasCounts){
+        std::cerr<<"buildIndex::computeClusters: Ignoring checkpoint without mini-batch counts "<<fn<<"\n";
+        return false;
+    }
+
+    FILE *f= fopen(fn.c_str(), "rb");
+    ASSERT(f!=NULL);
+    uint8_t dtypeCode;
+    uint32_t header[7];
+    bool ok= fread( &dtypeCode, sizeof(uint8_t), 1, f )==1 &&
+             fread( header, sizeof(uint32_t), 7, f )==7 &&
+             fread( &distortion, sizeof(float), 1, f )==1;
+    ok= ok && dtypeCode==4 && header[0]==numClst && header[1]==numDims;
+    if (ok){
+        iter= header[2];
+        centres.resize(numClst*numDims);
+        ok= fread( &centres[0], sizeof(float), centres.size(), f )==centres.size();
+        if (ok && totalCounts!=NULL){
+            totalCounts->resize(numClst);
+            ok= fread( &((*totalCounts)[0]), sizeof(uint32_t), numClst, f )==numClst;
+        }
+    }
+    fclose(f);
+
+    if (!ok)
+        std::cerr<<"buildIndex::computeClusters: Ignoring incompatible checkpoint "<<fn<<"\n";
+    return ok;
+}
+
+
+
+class trainKMeansManager : public queueManager<trainKMeansResult> {
+    public:
+
+        trainKMeansManager() : distortion_(0.0) {}
+
+        void
+            operator() ( uint32_t jobID, trainKMeansResult &result ){
+                distortion_+= result;
+            }
+
+        double distortion_;
+
+    private:
+        DISALLOW_COPY_AND_ASSIGN(trainKMeansManager)
+};
+
+
+
+// assigns descriptors to the nearest centre and accumulates the per-centre sums,
+// each thread has its own worker (and therefore its own sums) so no locking is needed
+class trainKMeansWorker : public queueWorker<trainKMeansResult> {
+    public:
+
+        trainKMeansWorker(flatDescsFile const &descFile, uint32_t const numClst)
+            : sums_(numClst*descFile.numDims(), 0.0f),
+              counts_(numClst, 0),
+              descFile_(&descFile),
+              numDims_(descFile.numDims()),
+              nn_obj_(NULL),
+              ranges_(NULL)
+            {}
+
+        void
+            setIteration(fastann::nn_obj<float> const &nn_obj,
+                         std::vector< std::pair<uint32_t, uint32_t> > const &ranges){
+                nn_obj_= &nn_obj;
+                ranges_= &ranges;
+                std::fill(sums_.begin(), sums_.end(), 0.0f);
+                std::fill(counts_.begin(), counts_.end(), 0);
+            }
+
+        void
+            operator() ( uint32_t jobID, trainKMeansResult &result ) const;
+
+        mutable std::vector<float> sums_;
+        mutable std::vector<uint32_t> counts_;
+
+    private:
+        flatDescsFile const *descFile_;
+        uint32_t const numDims_;
+        fastann::nn_obj<float> const *nn_obj_;
+        std::vector< std::pair<uint32_t, uint32_t> > const *ranges_;
+
+        DISALLOW_COPY_AND_ASSIGN(trainKMeansWorker)
+};
+
+
+
+void
+trainKMeansWorker::operator() ( uint32_t jobID, trainKMeansResult &result ) const {
+
+    uint32_t const start= (*ranges_)[jobID].first;
+    uint32_t const end= (*ranges_)[jobID].second;
+    uint32_t const count= end-start;
+
+    std::vector<float> descs(static_cast<uint64_t>(count)*numDims_);
+    descFile_->readDescs(start, end, &descs[0]);
+
+    std::vector<unsigned> clusterIDs(count);
+    std::vector<float> distSq(count);
+    nn_obj_->search_nn(&descs[0], count, &clusterIDs[0], &distSq[0]);
+
+    result= 0.0;
+    float const *itDesc= &descs[0];
+    for (uint32_t iDesc= 0; iDesc<count; ++iDesc){
+        float *itSum= &sums_[0] + clusterIDs[iDesc] * numDims_;
+        for (uint32_t iDim= 0; iDim<numDims_; ++iDim, ++itSum, ++itDesc)
+            *itSum+= *itDesc;
+        ++counts_[clusterIDs[iDesc]];
+        result+= distSq[iDesc];
+    }
+}
+
+
+
+// reduces the per-thread sums and updates the centres, parallelized over ranges of centres
+class kMeansUpdateWorker : public queueWorker<bool> {
+    public:
+
+        kMeansUpdateWorker(std::vector<trainKMeansWorker*> const &workers,
+                           std::vector<float> &centres,
+                           std::vector<uint32_t> *totalCounts,
+                           uint32_t const numDims,
+                           uint32_t const clstChunkSize)
+            : workers_(&workers),
+              centres_(&centres),
+              totalCounts_(totalCounts),
+              numDims_(numDims),
+              numClst_(centres.size()/numDims),
+              clstChunkSize_(clstChunkSize)
+            {}
+
+        void
+            operator() ( uint32_t jobID, bool &result ) const;
+
+    private:
+        std::vector<trainKMeansWorker*> const *workers_;
+        std::vector<float> *centres_;
+        std::vector<uint32_t> *totalCounts_;
+        uint32_t const numDims_, numClst_, clstChunkSize_;
+
+        DISALLOW_COPY_AND_ASSIGN(kMeansUpdateWorker)
+};
+
+
+
+void
+kMeansUpdateWorker::operator() ( uint32_t jobID, bool &result ) const {
+
+    uint32_t const clstStart= jobID*clstChunkSize_;
+    uint32_t const clstEnd= std::min( (jobID+1)*clstChunkSize_, numClst_ );
+
+    // reduce into the first worker
+    trainKMeansWorker &acc= *(workers_->at(0));
+    for (uint32_t iWorker= 1; iWorker<workers_->size(); ++iWorker){
+        trainKMeansWorker const &other= *(workers_->at(iWorker));
+        for (uint32_t iClst= clstStart; iClst<clstEnd; ++iClst)
+            acc.counts_[iClst]+= other.counts_[iClst];
+        float *itSum= &acc.sums_[0] + clstStart*numDims_;
+        float const *itSumEnd= &acc.sums_[0] + clstEnd*numDims_;
+        float const *itOther= &other.sums_[0] + clstStart*numDims_;
+        for (; itSum!=itSumEnd; ++itSum, ++itOther)
+            *itSum+= *itOther;
+    }
+
+    // update centres, empty clusters are taken care of afterwards
+    for (uint32_t iClst= clstStart; iClst<clstEnd; ++iClst){
+        uint32_t const n= acc.counts_[iClst];
+        if (n==0)
+            continue;
+        float *itC= &(*centres_)[0] + iClst*numDims_;
+        float const *itSum= &acc.sums_[0] + iClst*numDims_;
+
+        if (totalCounts_==NULL){
+            // standard k-means: mean of the assigned descriptors
+            for (uint32_t iDim= 0; iDim<numDims_; ++iDim, ++itC, ++itSum)
+                *itC= *itSum / n;
+        } else {
+            // mini-batch: move towards the mean of the batch with learning rate n/totalCount
+            (*totalCounts_)[iClst]+= n;
+            float const rate= 1.0f / (*totalCounts_)[iClst];
+            for (uint32_t iDim= 0; iDim<numDims_; ++iDim, ++itC, ++itSum)
+                *itC+= ( *itSum - n * (*itC) ) * rate;
+        }
+    }
+
+    result= true;
+}
+
+
+
+static void
+setToDescriptor(flatDescsFile const &descFile, uint32_t iDesc, float *centre){
+    descFile.readDescs(iDesc, iDesc+1, centre);
+}
+
+
+
+void
+computeClusters(
+        std::string const clstFn,
+        bool const RootSIFT,
+        std::string const trainDescsFn,
+        uint32_t const vocSize,
+        uint32_t const numIter,
+        uint32_t const miniBatchSize,
+        uint32_t const seed){
+
+    MPI_GLOBAL_ALL;
+    std::ostringstream s;
+
+    if (boost::filesystem::exists(clstFn)){
+        if (rank==0)
+            ViseMessageQueue::Instance()->Push( "Cluster log \nfile already exists!" );
+        return;
+    }
+    ASSERT( boost::filesystem::exists(trainDescsFn) );
+
+    bool useThreads= detectUseThreads();
+    uint32_t numWorkerThreads= 8;
+
+    flatDescsFile const descFile(trainDescsFn, RootSIFT);
+    uint32_t const numDescs= descFile.numDescs();
+    uint32_t const numDims= descFile.numDims();
+    uint32_t const numClst= vocSize;
+    ASSERT(numDescs>=numClst);
+
+    bool const miniBatch= (miniBatchSize>0 && miniBatchSize<numDescs);
+    uint32_t const miniBlockSize= std::min(numDescs, static_cast<uint32_t>(1000));
+    uint32_t const descChunkSize= 10000;
+    uint32_t const clstChunkSize= 1000;
+
+    if (rank==0){
+        s.str(""); s.clear();
+        s << "Cluster log \nClustering "<<numDescs<<" x "<<numDims<<" descriptors into "<<numClst<<" clusters";
+        if (miniBatch)
+            s << " (mini-batch of "<<miniBatchSize<<")";
+        ViseMessageQueue::Instance()->Push( s.str() );
+    }
+
+    // --- initialize centres, either from the checkpoint or as random distinct descriptors
+
+    std::string const checkpointFn= clstFn + ".checkpoint";
+    std::vector<float> centres(numClst*numDims);
+    std::vector<uint32_t> totalCounts(miniBatch ? numClst : 0, 0);
+    std::vector<uint32_t> *totalCountsPtr= miniBatch ? &totalCounts : NULL;
+    uint32_t startIter= 0;
+    float distortion= 0.0f;
+
+    if (rank==0){
+        if (loadCheckpoint(checkpointFn, numClst, numDims, startIter, distortion, centres, totalCountsPtr)){
+            s.str(""); s.clear();
+            s << "Cluster log \nRestarting from checkpoint. Start iteration = "<<startIter;
+            ViseMessageQueue::Instance()->Push( s.str() );
+        } else {
+            std::vector<uint32_t> inds(numDescs);
+            for (uint32_t iDesc= 0; iDesc<numDescs; ++iDesc)
+                inds[iDesc]= iDesc;
+            sameRandomUint32 sr(numDescs, seed);
+            sr.shuffle<uint32_t>(inds.begin(), inds.end());
+            inds.resize(numClst);
+            std::sort(inds.begin(), inds.end());
+            for (uint32_t iClst= 0; iClst<numClst; ++iClst)
+                setToDescriptor(descFile, inds[iClst], &centres[iClst*numDims]);
+        }
+    }
+
+    #ifdef RR_MPI
+    if (!useThreads)
+        boost::mpi::broadcast(comm, startIter, 0);
+    #endif
+
+    std::vector<trainKMeansWorker*> workers;
+    std::vector<queueWorker<trainKMeansResult> const *> workersQ;
+    for (uint32_t i= 0; i < (useThreads ? numWorkerThreads : 1); ++i){
+        workers.push_back( new trainKMeansWorker(descFile, numClst) );
+        workersQ.push_back( workers.back() );
+    }
+
+    std::vector< std::pair<uint32_t, uint32_t> > ranges;
+    if (!miniBatch)
+        for (uint32_t iDescStart= 0; iDescStart<numDescs; iDescStart+= descChunkSize)
+            ranges.push_back( std::make_pair(iDescStart, std::min(iDescStart+descChunkSize, numDescs)) );
+
+    for (uint32_t iter= startIter; iter<numIter; ++iter){
+
+        double t0= timing::tic();
+
+        #ifdef RR_MPI
+        if (!useThreads)
+            boost::mpi::broadcast(comm, &centres[0], centres.size(), 0);
+        #endif
+
+        if (miniBatch){
+            // random blocks of consecutive descriptors as reading them is much faster,
+            // seeded by the iteration so that resuming from a checkpoint is deterministic
+            uint32_t const nBlocks= static_cast<uint32_t>( std::ceil(static_cast<double>(miniBatchSize)/miniBlockSize) );
+            sameRandomUint32 sr(nBlocks, seed + 2*iter + 1);
+            sameRandomStreamUint32 srS(sr);
+            ranges.clear();
+            for (uint32_t iBlock= 0; iBlock<nBlocks; ++iBlock){
+                uint32_t const iDescStart= srS.getNext0ToN(numDescs - miniBlockSize + 1);
+                ranges.push_back( std::make_pair(iDescStart, iDescStart + miniBlockSize) );
+            }
+        }
+        uint32_t const nJobs= ranges.size();
+
+        // --- assign
+
+        fastann::nn_obj<float> const *nn_obj=
+            fastann::nn_obj_build_kdtree(&centres[0], numClst, numDims, 8, 512);
+
+        for (uint32_t i= 0; i<workers.size(); ++i)
+            workers[i]->setIteration(*nn_obj, ranges);
+
+        trainKMeansManager *manager= (rank==0) ? new trainKMeansManager() : NULL;
+
+        if (useThreads)
+            threadQueue<trainKMeansResult>::start( nJobs, workersQ, *manager );
+        else
+            mpiQueue<trainKMeansResult>::start( nJobs, *workers[0], manager );
+
+        if (rank==0){
+            distortion= manager->distortion_;
+            delete manager;
+        }
+        delete nn_obj;
+
+        #ifdef RR_MPI
+        if (!useThreads){
+            // sum the per-process partial results
+            if (rank==0){
+                std::vector<float> sums(workers[0]->sums_.size());
+                std::vector<uint32_t> counts(numClst);
+                boost::mpi::reduce(comm, &(workers[0]->sums_[0]), sums.size(), &sums[0], std::plus<float>(), 0);
+                boost::mpi::reduce(comm, &(workers[0]->counts_[0]), numClst, &counts[0], std::plus<uint32_t>(), 0);
+                workers[0]->sums_.swap(sums);
+                workers[0]->counts_.swap(counts);
+            } else {
+                boost::mpi::reduce(comm, &(workers[0]->sums_[0]), workers[0]->sums_.size(), std::plus<float>(), 0);
+                boost::mpi::reduce(comm, &(workers[0]->counts_[0]), numClst, std::plus<uint32_t>(), 0);
+            }
+        }
+        #endif
+
+        if (rank!=0)
+            continue;
+
+        // --- update centres
+
+        {
+            uint32_t const nUpdateJobs= static_cast<uint32_t>( std::ceil(static_cast<double>(numClst)/clstChunkSize) );
+            kMeansUpdateWorker updateWorker(workers, centres, totalCountsPtr, numDims, clstChunkSize);
+            queueManager<bool> updateManager;
+            threadQueue<bool>::start( nUpdateJobs, updateWorker, updateManager, useThreads ? numWorkerThreads : 1 );
+        }
+
+        // check for clusters with no assignments, replace them with random descriptors
+        std::vector<uint32_t> emptyClst;
+        for (uint32_t iClst= 0; iClst<numClst; ++iClst)
+            if ( miniBatch ? totalCounts[iClst]==0 : workers[0]->counts_[iClst]==0 )
+                emptyClst.push_back(iClst);
+
+        if (emptyClst.size()>0){
+            sameRandomUint32 sr(emptyClst.size(), seed + 2*iter + 2);
+            sameRandomStreamUint32 srS(sr);
+            for (uint32_t i= 0; i<emptyClst.size(); ++i)
+                setToDescriptor(descFile, srS.getNext0ToN(numDescs), &centres[emptyClst[i]*numDims]);
+
+            s.str(""); s.clear();
+            s << "Cluster log \niter "<<iter<<": "<<emptyClst.size()<<" clusters have zero points assigned to them - using random points";
+            ViseMessageQueue::Instance()->Push( s.str() );
+        }
+
+        s.str(""); s.clear();
+        s << "Cluster log \nIteration "<<iter+1<<"/"<<numIter<<" : sse = "<<distortion<<", took "<<timing::toc(t0)/1000<<"s";
+        ViseMessageQueue::Instance()->Push( s.str() );
+        s.str(""); s.clear();
+        s << "Cluster progress "<<iter+1<<"/"<<numIter;
+        ViseMessageQueue::Instance()->Push( s.str() );
+
+        saveClusters(checkpointFn, centres, numDims, iter+1, numIter, numDescs, seed, distortion, totalCountsPtr);
+    }
+
+    util::delPointerVector(workers);
+
+    if (rank==0){
+        // a vocabulary tree trained earlier with this clstFn is stale (it wouldn't be used, see vocTree)
+        boost::filesystem::remove(vocTree::getFn(clstFn));
+        saveClusters(clstFn, centres, numDims, numIter, numIter, numDescs, seed, distortion);
+        boost::filesystem::remove(checkpointFn);
+    }
+
+    #ifdef RR_MPI
+    if (!useThreads) comm.barrier();
+    #endif
+}
+
+
+
+// k-means of the descriptors of one node of a level of the vocabulary tree,
+// writes the centres of its children and sorts its descriptors by child.
+// Nodes of a level are independent and each job writes only to its own parts of the arrays
+class vocTreeLevelWorker : public queueWorker<trainKMeansResult> {
+    public:
+
+        vocTreeLevelWorker(std::vector<float> const &descs,
+                           uint32_t const numDims,
+                           uint32_t const branching,
+                           uint32_t const numIter,
+                           uint32_t const seed,
+                           float const *parentCentres,
+                           std::vector<uint32_t> &perm,
+                           std::vector<uint32_t> const &bounds,
+                           std::vector<uint32_t> &childBounds,
+                           float *childCentres)
+            : descs_(&descs[0]),
+              numDims_(numDims),
+              branching_(branching),
+              numIter_(numIter),
+              seed_(seed),
+              parentCentres_(parentCentres),
+              perm_(&perm),
+              bounds_(&bounds),
+              childBounds_(&childBounds),
+              childCentres_(childCentres)
+            {}
+
+        void
+            operator() ( uint32_t jobID, trainKMeansResult &result ) const;
+
+    private:
+        float const *descs_;
+        uint32_t const numDims_, branching_, numIter_, seed_;
+        float const *parentCentres_;
+        std::vector<uint32_t> *perm_;
+        std::vector<uint32_t> const *bounds_;
+        std::vector<uint32_t> *childBounds_;
+        float *childCentres_;
+
+        DISALLOW_COPY_AND_ASSIGN(vocTreeLevelWorker)
+};
+
+
+
+void
+vocTreeLevelWorker::operator() ( uint32_t jobID, trainKMeansResult &result ) const {
+
+    uint32_t const begin= (*bounds_)[jobID], n= (*bounds_)[jobID+1] - begin;
+    uint32_t *ids= &(*perm_)[0] + begin;
+    float *centres= childCentres_ + static_cast<uint64_t>(jobID)*branching_*numDims_;
+    std::vector<uint32_t> assigns(n, 0), counts(branching_, 0);
+    result= 0.0;
+
+    if (n<=branching_){
+        // each descriptor is a word, the remaining words are copies of the parent (and stay empty)
+        for (uint32_t c= 0; c<branching_; ++c)
+            if (c<n){
+                std::copy(descs_ + static_cast<uint64_t>(ids[c])*numDims_, descs_ + static_cast<uint64_t>(ids[c]+1)*numDims_, centres + c*numDims_);
+                assigns[c]= c;
+                counts[c]= 1;
+            } else if (parentCentres_!=NULL)
+                std::copy(parentCentres_ + static_cast<uint64_t>(jobID)*numDims_, parentCentres_ + static_cast<uint64_t>(jobID+1)*numDims_, centres + c*numDims_);
+            else
+                std::fill(centres + c*numDims_, centres + (c+1)*numDims_, 0.0f);
+
+    } else {
+
+        // initialize with random distinct descriptors (partial shuffle), seeded by the node
+        sameRandomUint32 sr(branching_*(numIter_+1), seed_ + jobID);
+        sameRandomStreamUint32 srS(sr);
+        for (uint32_t c= 0; c<branching_; ++c){
+            std::swap(ids[c], ids[c + srS.getNext0ToN(n-c)]);
+            std::copy(descs_ + static_cast<uint64_t>(ids[c])*numDims_, descs_ + static_cast<uint64_t>(ids[c]+1)*numDims_, centres + c*numDims_);
+        }
+
+        std::vector<double> sums(branching_*numDims_);
+        for (uint32_t iter= 0; iter<=numIter_; ++iter){
+
+            // assign
+            bool changed= false;
+            result= 0.0;
+            std::fill(counts.begin(), counts.end(), 0);
+            for (uint32_t i= 0; i<n; ++i){
+                float const *desc= descs_ + static_cast<uint64_t>(ids[i])*numDims_;
+                uint32_t best= 0;
+                float bestDistSq= compactDist::l2(desc, centres, numDims_);
+                for (uint32_t c= 1; c<branching_; ++c){
+                    float const distSq= compactDist::l2(desc, centres + c*numDims_, numDims_);
+                    if (distSq<bestDistSq){
+                        bestDistSq= distSq;
+                        best= c;
+                    }
+                }
+                changed= changed || assigns[i]!=best || iter==0;
+                assigns[i]= best;
+                ++counts[best];
+                result+= bestDistSq;
+            }
+            if (iter==numIter_ || !changed)
+                break;
+
+            // update, empty clusters get a random descriptor
+            std::fill(sums.begin(), sums.end(), 0.0);
+            for (uint32_t i= 0; i<n; ++i){
+                float const *desc= descs_ + static_cast<uint64_t>(ids[i])*numDims_;
+                double *sum= &sums[assigns[i]*numDims_];
+                for (uint32_t iDim= 0; iDim<numDims_; ++iDim)
+                    sum[iDim]+= desc[iDim];
+            }
+            for (uint32_t c= 0; c<branching_; ++c)
+                if (counts[c]==0){
+                    uint32_t const id= ids[srS.getNext0ToN(n)];
+                    std::copy(descs_ + static_cast<uint64_t>(id)*numDims_, descs_ + static_cast<uint64_t>(id+1)*numDims_, centres + c*numDims_);
+                } else
+                    for (uint32_t iDim= 0; iDim<numDims_; ++iDim)
+                        centres[c*numDims_+iDim]= static_cast<float>(sums[c*numDims_+iDim] / counts[c]);
+        }
+    }
+
+    // sort the descriptors by child (counting sort), children are consecutive ranges
+    std::vector<uint32_t> offsets(branching_, begin), sorted(n);
+    for (uint32_t c= 1; c<branching_; ++c)
+        offsets[c]= offsets[c-1] + counts[c-1];
+    for (uint32_t c= 0; c<branching_; ++c)
+        (*childBounds_)[jobID*branching_ + c + 1]= offsets[c] + counts[c];
+    for (uint32_t i= 0; i<n; ++i)
+        sorted[ (offsets[assigns[i]]++) - begin ]= ids[i];
+    std::copy(sorted.begin(), sorted.end(), ids);
+}
+
+
+
+void
+computeVocTree(
+        std::string const clstFn,
+        bool const RootSIFT,
+        std::string const trainDescsFn,
+        uint32_t const vocSize,
+        uint32_t const branching,
+        uint32_t const numIter,
+        uint32_t const maxTrainDescs,
+        uint32_t const beam,
+        uint32_t const seed){
+
+    MPI_GLOBAL_RANK;
+    std::ostringstream s;
+
+    if (boost::filesystem::exists(clstFn)){
+        if (rank==0)
+            ViseMessageQueue::Instance()->Push( "Cluster log \nfile already exists!" );
+        return;
+    }
+    ASSERT( boost::filesystem::exists(trainDescsFn) );
+    ASSERT( branching>=2 );
+
+    // only multithreaded, other processes just wait
+    if (rank!=0){
+        #ifdef RR_MPI
+        comm.barrier();
+        #endif
+        return;
+    }
+
+    uint32_t const numWorkerThreads= 8;
+
+    flatDescsFile const descFile(trainDescsFn, RootSIFT);
+    uint32_t const numDims= descFile.numDims();
+    uint32_t const numClst= vocSize;
+    uint32_t depth= 0;
+    for (uint64_t size= 1; size<numClst; size*= branching, ++depth);
+    if (std::pow(static_cast<double>(branching), static_cast<double>(depth)) != numClst){
+        std::cerr<<"buildIndex::computeVocTree: vocSize= "<<numClst<<" is not a power of the branching factor "<<branching<<"\n";
+        ASSERT(0);
+    }
+    ASSERT( depth>=1 && descFile.numDescs()>=numClst );
+
+    // --- load the training descriptors, blocks evenly spread over the file if there are too many
+
+    uint32_t const numDescs= std::min(descFile.numDescs(), std::max(maxTrainDescs, numClst));
+    std::vector<float> descs(static_cast<uint64_t>(numDescs)*numDims);
+    {
+        // the descriptors which aren't used are split into nBlocks equal gaps, one after each
+        // block, so blocks never overlap (and are contiguous if all descriptors are used)
+        uint32_t const blockSize= 1000;
+        uint32_t const nBlocks= (numDescs+blockSize-1)/blockSize;
+        uint32_t const numSkipped= descFile.numDescs()-numDescs;
+        uint32_t iDesc= 0;
+        for (uint32_t iBlock= 0; iBlock<nBlocks; ++iBlock){
+            uint32_t const count= std::min(blockSize, numDescs-iDesc);
+            uint32_t const start= iDesc + static_cast<uint32_t>( static_cast<uint64_t>(iBlock)*numSkipped/nBlocks );
+            descFile.readDescs(start, start+count, &descs[static_cast<uint64_t>(iDesc)*numDims]);
+            iDesc+= count;
+        }
+    }
+
+    s << "Cluster log \nVocabulary tree: clustering "<<numDescs<<" x "<<numDims<<" descriptors into "
+      <<branching<<"^"<<depth<<" = "<<numClst<<" clusters";
+    ViseMessageQueue::Instance()->Push( s.str() );
+
+    // --- cluster level by level, the descriptors of each node are a range of perm
+
+    std::vector<uint32_t> perm(numDescs);
+    for (uint32_t iDesc= 0; iDesc<numDescs; ++iDesc)
+        perm[iDesc]= iDesc;
+    std::vector<uint32_t> bounds(2, 0);
+    bounds[1]= numDescs;
+
+    std::vector<float> internalCentres, levelCentres, childCentres;
+    double distortion= 0.0;
+    uint32_t numNodes= 1;
+
+    for (uint32_t level= 0; level<depth; ++level){
+
+        double t0= timing::tic();
+
+        childCentres.resize(static_cast<uint64_t>(numNodes)*branching*numDims);
+        std::vector<uint32_t> childBounds(numNodes*branching+1, 0);
+        {
+            vocTreeLevelWorker worker(descs, numDims, branching, numIter, seed + level*numClst,
+                                      level==0 ? NULL : &levelCentres[0],
+                                      perm, bounds, childBounds, &childCentres[0]);
+            trainKMeansManager manager;
+            threadQueue<trainKMeansResult>::start( numNodes, worker, manager, numWorkerThreads );
+            distortion= manager.distortion_;
+        }
+
+        levelCentres.swap(childCentres);
+        bounds.swap(childBounds);
+        numNodes*= branching;
+        if (level+1<depth)
+            internalCentres.insert(internalCentres.end(), levelCentres.begin(), levelCentres.end());
+
+        s.str(""); s.clear();
+        s << "Cluster log \nLevel "<<level+1<<"/"<<depth<<" : sse = "<<distortion<<", took "<<timing::toc(t0)/1000<<"s";
+        ViseMessageQueue::Instance()->Push( s.str() );
+        s.str(""); s.clear();
+        s << "Cluster progress "<<level+1<<"/"<<depth;
+        ViseMessageQueue::Instance()->Push( s.str() );
+    }
+
+    // the internal nodes (which record the checksum of the words file) before renaming the
+    // words to clstFn, as clstFn marks that clustering is done
+    std::string const wordsFn= clstFn + ".words";
+    saveClusters(wordsFn, levelCentres, numDims, numIter, numIter, numDescs, seed, distortion);
+    vocTree::save(vocTree::getFn(clstFn), wordsFn, numDims, branching, depth, beam, internalCentres);
+    boost::filesystem::rename(wordsFn, clstFn);
+
+    #ifdef RR_MPI
+    comm.barrier();
+    #endif
+}
+
+};
@@ -0,0 +1,54 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _TRAIN_KMEANS_H_
+#define _TRAIN_KMEANS_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace buildIndex {
+
+    // Approximate k-means (kd-forest assignment) of the training descriptors,
+    // replaces compute_clusters.py (dkmeans_relja) and writes clstFn in the same format.
+    // Resumes from clstFn+".checkpoint" if it exists.
+    // If miniBatchSize>0 each iteration uses only a random sample of miniBatchSize descriptors
+    // and centres are updated with per-centre learning rates (i.e. mini-batch k-means)
+    void
+        computeClusters(std::string const clstFn,
+                        bool const RootSIFT,
+                        std::string const trainDescsFn,
+                        uint32_t const vocSize,
+                        uint32_t const numIter= 30,
+                        uint32_t const miniBatchSize= 0,
+                        uint32_t const seed= 43);
+
+    // Vocabulary tree (hierarchical k-means, see vocTree) with vocSize= branching^depth words,
+    // writes the words to clstFn (same format and word IDs as computeClusters) and the
+    // internal nodes to vocTree::getFn(clstFn). Each node is clustered with numIter k-means
+    // iterations on at most maxTrainDescs descriptors (evenly spread over trainDescsFn),
+    // beam is the default number of nodes kept per level during assignment
+    void
+        computeVocTree(std::string const clstFn,
+                       bool const RootSIFT,
+                       std::string const trainDescsFn,
+                       uint32_t const vocSize,
+                       uint32_t const branching,
+                       uint32_t const numIter= 10,
+                       uint32_t const maxTrainDescs= 2000000,
+                       uint32_t const beam= 2,
+                       uint32_t const seed= 43);
+}
+
+#endif
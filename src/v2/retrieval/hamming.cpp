@@ -84,13 +84,14 @@ hamming::queryExecute(
     if (ueIter->isEnd())
         return;
     
-    hammingEmbedder *heQ= embFactory_->getEmbedder();
-    hammingEmbedder *heDb= embFactory_->getEmbedder();
-    
-    heQ->setDataCopy(queryRep.data());
-    charStream* csQ= heQ->getCharStream();
-    ASSERT(csQ->getNum() == static_cast<uint32_t>(queryRep.id_size()));
+    // decode all signatures in bulk straight from the index entries (no copies into embedders)
+    uint32_t const numBits= embFactory_->numBits();
+    charStreamView const viewQ(numBits, queryRep.data());
+    ASSERT(viewQ.getNum() == static_cast<uint32_t>(queryRep.id_size()));
     ASSERT(ueIter->getNum() == static_cast<uint32_t>(queryRep.id_size()));
+    std::vector<uint64_t> querySigs(viewQ.getNum()), dbSigs;
+    if (!querySigs.empty())
+        viewQ.decode(0, querySigs.size(), &querySigs[0]);
     
     // query
     
@@ -124,7 +125,7 @@ hamming::queryExecute(
         for (; iQueryWord < queryWordEnd; ++iQueryWord) {
             ASSERT( static_cast<uint32_t>(iQueryWord) == ueIter->getInd() );
             
-            uint64_t const querySig= csQ->getNextUnsafe();
+            uint64_t const querySig= querySigs[iQueryWord];
             queryL2+= w;
             
             std::vector<rr::indexEntry> *entries= ueIter->getEntries();
@@ -147,13 +148,16 @@ hamming::queryExecute(
                 uint32_t const *itID= entry.id().data();
                 uint32_t const *endID= itID + entry.id_size();
                 
-                heDb->setDataCopy(entry.data());
-                charStream* csDb= heDb->getCharStream();
-                ASSERT(csDb->getNum() == static_cast<uint32_t>(entry.id_size()));
+                charStreamView const viewDb(numBits, entry.data());
+                ASSERT(viewDb.getNum() == static_cast<uint32_t>(entry.id_size()));
+                dbSigs.resize(viewDb.getNum());
+                if (!dbSigs.empty())
+                    viewDb.decode(0, dbSigs.size(), &dbSigs[0]);
+                uint64_t const *itSig= dbSigs.empty() ? NULL : &dbSigs[0];
                 
                 while (itID!=endID){
-                    for (; itID!=endID && *itID==prevDocID; ++itID, ++thisNum){
-                        hammDist= bitcount64(querySig ^ csDb->getNextUnsafe());
+                    for (; itID!=endID && *itID==prevDocID; ++itID, ++itSig, ++thisNum){
+                        hammDist= bitcount64(querySig ^ *itSig);
                         if (hammDist <= distThrSpatial_){
                             thisOneScore=
                             #if HAMM_DO_WEIGHTED
@@ -192,7 +196,4 @@ hamming::queryExecute(
     for (std::vector<double>::iterator itS= scores.begin(); itS!=scores.end(); ++itS, ++docL2Iter)
         (*itS)= (*itS) / ( queryL2 * (*docL2Iter) );
     
-    delete heQ;
-    delete heDb;
-    
 }
@@ -14,9 +14,15 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "image_graph.h"
 
+#include <math.h>
+
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <set>
 
+#include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 
 #ifdef RR_MPI
@@ -29,7 +35,9 @@ No usage or redistribution is allowed without explicit permission.
 #include "par_queue.h"
 #include "proto_db_file.h"
 #include "proto_index.h"
+#include "thread_queue.h"
 #include "timing.h"
+#include "util.h"
 
 
 
@@ -245,22 +253,25 @@ class imageGraphWorker : public queueWorker<imageGraphResult> {
     
     public:
         
+        // job i queries document firstDocID+i
         imageGraphWorker(
             retriever const &retrieverObj,
-            uint32_t maxNeighs)
+            uint32_t maxNeighs,
+            uint32_t firstDocID= 0)
                 : retriever_(retrieverObj),
-                maxNeighs_(maxNeighs) {}
+                maxNeighs_(maxNeighs),
+                firstDocID_(firstDocID) {}
         
         void
-            operator() ( uint32_t docID, imageGraphResult &queryRes ) const {
+            operator() ( uint32_t jobID, imageGraphResult &queryRes ) const {
                 queryRes.clear();
-                retriever_.internalQuery(docID, queryRes, maxNeighs_);
+                retriever_.internalQuery(firstDocID_ + jobID, queryRes, maxNeighs_);
                 ASSERT( maxNeighs_==0 || queryRes.size()<=maxNeighs_ );
             }
         
     private:
         retriever const &retriever_;
-        uint32_t const maxNeighs_;
+        uint32_t const maxNeighs_, firstDocID_;
 };
 
 
@@ -307,17 +318,505 @@ imageGraph::computeParallel(
 
 
 
-// -------
+// ------- imageGraph::computeTfidfBatch and helper functions
+
+
+
+// neighbours of each document of a tile
+typedef std::vector<imageGraphResult> imageGraphTileResult;
+
+// upper bound on the postings of a tile's words, each cached by a worker as a docID and a weight
+static uint64_t const imageGraphMaxTilePostings= 16<<20;
+
+class imageGraphTfidfWorker : public queueWorker<imageGraphTileResult> {
+    
+    public:
+        
+        imageGraphTfidfWorker(
+            protoIndex const &iidx,
+            protoIndex const &fidx,
+            std::vector<double> const &idf,
+            std::vector<double> const &docL2,
+            uint32_t tileSize,
+            uint32_t maxNeighs,
+            double scoreThr)
+                : iidx_(iidx), fidx_(fidx),
+                  idf_(idf), docL2_(docL2),
+                  numDocs_(docL2.size()),
+                  tileSize_(tileSize),
+                  maxNeighs_(maxNeighs),
+                  scoreThr_(scoreThr),
+                  scores_(docL2.size(), 0.0) {}
+        
+        void
+            operator() ( uint32_t tileID, imageGraphTileResult &tileRes ) const;
+        
+    private:
+        
+        protoIndex const &iidx_, &fidx_;
+        std::vector<double> const &idf_, &docL2_;
+        uint32_t const numDocs_, tileSize_, maxNeighs_;
+        double const scoreThr_;
+        
+        // score accumulators for all documents, reused for every document of every tile this
+        // worker does (i.e. one worker per thread) and reset through the list of touched ones
+        mutable std::vector<double> scores_;
+        mutable std::vector<uint32_t> touched_;
+};
+
+
+
+// larger score first, ties broken by docID, i.e. a min-heap keeps the worst at the front
+static bool
+betterNeigh( indScorePair const &a, indScorePair const &b ){
+    return a.second > b.second || (a.second == b.second && a.first < b.first);
+}
 
 
 
 void
-imageGraph::loadFromFile( std::string filename ){
+imageGraphTfidfWorker::operator() ( uint32_t tileID, imageGraphTileResult &tileRes ) const {
     
-    std::cout<<"imageGraph::loadFromFile\n";
+    uint32_t const docBegin= tileID*tileSize_;
+    uint32_t const docEnd= std::min(docBegin+tileSize_, numDocs_);
+    uint32_t const tileLen= docEnd-docBegin;
+    
+    tileRes.clear();
+    tileRes.resize(tileLen);
+    
+    // words present in the tile (union of the rows of A)
+    
+    std::vector<uint32_t> words;
+    std::vector<rr::indexEntry> entries;
+    for (uint32_t docID= docBegin; docID<docEnd; ++docID){
+        fidx_.getEntries(docID, entries);
+        for (uint32_t iEntry= 0; iEntry<entries.size(); ++iEntry)
+            words.insert(words.end(), entries[iEntry].id().begin(), entries[iEntry].id().end());
+    }
+    std::sort(words.begin(), words.end());
+    words.erase( std::unique(words.begin(), words.end()), words.end() );
+    
+    // fetch every posting list once for the whole tile and keep only its docIDs and tf
+    // weights; each tile document gets the list of (cached word, idf*queryWeight) it scores with
+    
+    std::vector<uint32_t> postIDs;
+    std::vector<float> postW;
+    std::vector<uint64_t> wordBegin(words.size()+1, 0);
+    std::vector< std::vector< std::pair<uint32_t, double> > > rowWords(tileLen);
+    std::vector<double> queryL2(tileLen, 0.0), tileTf(tileLen, 0.0);
+    std::vector<uint32_t> tileDocs;
+    
+    for (uint32_t iWord= 0; iWord<words.size(); ++iWord){
+        
+        uint32_t const wordID= words[iWord];
+        double const idf= idf_[wordID];
+        iidx_.getEntries(wordID, entries);
+        
+        // tf of the tile documents: count/weight/number of features as in weighterV2
+        tileDocs.clear();
+        for (uint32_t iEntry= 0; iEntry<entries.size(); ++iEntry){
+            rr::indexEntry const &entry= entries[iEntry];
+            uint32_t const *ids= entry.id().data();
+            // docIDs are sorted so only the tile's part of the list is looked at
+            int i= std::lower_bound(ids, ids + entry.id_size(), docBegin) - ids;
+            for (; i<entry.id_size() && ids[i]<docEnd; ++i){
+                double &tf= tileTf[ids[i]-docBegin];
+                if (tf==0.0)
+                    tileDocs.push_back(ids[i]-docBegin);
+                tf+= entry.weight_size()!=0 ? entry.weight(i) : (entry.count_size()!=0 ? entry.count(i) : 1.0);
+            }
+        }
+        
+        bool used= false;
+        for (uint32_t iTileDoc= 0; iTileDoc<tileDocs.size(); ++iTileDoc){
+            uint32_t const t= tileDocs[iTileDoc];
+            double const queryW= idf * tileTf[t];
+            double const widf= idf * queryW;
+            tileTf[t]= 0.0;
+            queryL2[t]+= queryW * queryW;
+            if (widf!=0.0){
+                rowWords[t].push_back( std::make_pair(iWord, widf) );
+                used= true;
+            }
+        }
+        
+        if (used){
+            for (uint32_t iEntry= 0; iEntry<entries.size(); ++iEntry){
+                rr::indexEntry const &entry= entries[iEntry];
+                postIDs.insert(postIDs.end(), entry.id().begin(), entry.id().end());
+                if (entry.weight_size()!=0) {
+                    ASSERT( entry.id_size() == entry.weight_size() );
+                    postW.insert(postW.end(), entry.weight().begin(), entry.weight().end());
+                } else if (entry.count_size()!=0) {
+                    ASSERT( entry.id_size() == entry.count_size() );
+                    postW.insert(postW.end(), entry.count().begin(), entry.count().end());
+                } else
+                    postW.resize(postIDs.size(), 1.0f);
+            }
+        }
+        wordBegin[iWord+1]= postIDs.size();
+    }
+    entries.clear();
+    
+    // A(t,:)*A' one tile document at a time from the cached lists, then normalize and prune:
+    // only the touched documents are looked at, the best maxNeighs (including self, as
+    // internalQuery with toReturn=maxNeighs) kept in a heap
+    
+    std::vector<indScorePair> heap;
+    
+    for (uint32_t t= 0; t<tileLen; ++t){
+        
+        std::vector< std::pair<uint32_t, double> > const &thisRowWords= rowWords[t];
+        for (uint32_t iRowWord= 0; iRowWord<thisRowWords.size(); ++iRowWord){
+            uint32_t const iWord= thisRowWords[iRowWord].first;
+            double const widf= thisRowWords[iRowWord].second;
+            uint32_t const *itID= &postIDs[0] + wordBegin[iWord];
+            uint32_t const *endID= &postIDs[0] + wordBegin[iWord+1];
+            float const *itW= &postW[0] + wordBegin[iWord];
+            for (; itID!=endID; ++itW, ++itID){
+                double &score= scores_[*itID];
+                if (score==0.0 && *itW!=0.0f)
+                    touched_.push_back(*itID);
+                score+= *itW * widf;
+            }
+        }
+        
+        uint32_t const docID= docBegin+t;
+        double queryL2sqrt= sqrt(queryL2[t]);
+        if (queryL2sqrt <= 1e-7)
+            queryL2sqrt= 1.0;
+        
+        heap.clear();
+        for (uint32_t iDoc= 0; iDoc<touched_.size(); ++iDoc){
+            uint32_t const docIDres= touched_[iDoc];
+            double const score= scores_[docIDres] / ( queryL2sqrt * docL2_[docIDres] );
+            scores_[docIDres]= 0.0;
+            if (!(score >= scoreThr_) && docIDres!=docID)
+                continue;
+            indScorePair const cand(docIDres, score);
+            if (maxNeighs_==0 || heap.size()<maxNeighs_){
+                heap.push_back(cand);
+                std::push_heap(heap.begin(), heap.end(), betterNeigh);
+            } else if (betterNeigh(cand, heap.front())){
+                std::pop_heap(heap.begin(), heap.end(), betterNeigh);
+                heap.back()= cand;
+                std::push_heap(heap.begin(), heap.end(), betterNeigh);
+            }
+        }
+        touched_.clear();
+        std::sort_heap(heap.begin(), heap.end(), betterNeigh);
+        
+        imageGraphResult &res= tileRes[t];
+        res.reserve(heap.size());
+        for (uint32_t i= 0; i<heap.size(); ++i)
+            if (heap[i].first!=docID && heap[i].second >= scoreThr_)
+                res.push_back(heap[i]);
+        ASSERT( maxNeighs_==0 || res.size()<=maxNeighs_ );
+    }
+}
+
+
+
+// Largest power of 2 documents per tile (at most maxTileSize) for which the posting lists of
+// the tile's words stay within imageGraphMaxTilePostings. The more documents a tile has, the
+// more of them share each fetched list, so this is as much reuse as the cache allows.
+// Estimated on a few tiles spread over the collection, with the real list sizes from the iidx
+// (one posting per feature, not per document, so the df would underestimate bursty words);
+// only the sampled words are fetched, each once for all candidate sizes.
+static uint32_t
+imageGraphTfidfTileSize( protoIndex const &iidx, protoIndex const &fidx, uint32_t numDocs, uint32_t maxTileSize ){
+    
+    uint32_t const numSamples= 4;
+    std::vector<rr::indexEntry> entries;
+    std::vector<uint32_t> words;
+    std::map<uint32_t, uint32_t> postingSize;
+    uint32_t tileSize= 1;
+    
+    for (uint32_t candidate= 2; candidate<=maxTileSize && candidate<=numDocs; candidate*= 2){
+        
+        uint64_t maxPostings= 0;
+        for (uint32_t iSample= 0; iSample<numSamples; ++iSample){
+            uint32_t const docBegin= static_cast<uint64_t>(iSample)*(numDocs-candidate)/numSamples;
+            words.clear();
+            for (uint32_t docID= docBegin; docID<docBegin+candidate && docID<fidx.numIDs(); ++docID){
+                fidx.getEntries(docID, entries);
+                for (uint32_t iEntry= 0; iEntry<entries.size(); ++iEntry)
+                    words.insert(words.end(), entries[iEntry].id().begin(), entries[iEntry].id().end());
+            }
+            std::sort(words.begin(), words.end());
+            words.erase( std::unique(words.begin(), words.end()), words.end() );
+            uint64_t postings= 0;
+            for (uint32_t iWord= 0; iWord<words.size(); ++iWord){
+                std::map<uint32_t, uint32_t>::const_iterator it= postingSize.find(words[iWord]);
+                if (it==postingSize.end())
+                    it= postingSize.insert( std::make_pair(words[iWord], iidx.getNumWithID(words[iWord])) ).first;
+                postings+= it->second;
+            }
+            maxPostings= std::max(maxPostings, postings);
+        }
+        
+        if (maxPostings > imageGraphMaxTilePostings)
+            break;
+        tileSize= candidate;
+    }
+    
+    return tileSize;
+}
+
+
+
+class imageGraphTfidfManager : public managerWithTiming<imageGraphTileResult> {
+    public:
+        
+        imageGraphTfidfManager(std::string filename,
+                               uint32_t numDocs,
+                               uint32_t numTiles,
+                               uint32_t tileSize,
+                               double scoreThr)
+            : managerWithTiming<imageGraphTileResult>(numTiles, "imageGraph"),
+              docManager_(filename, numDocs, scoreThr),
+              tileSize_(tileSize)
+                {}
+        
+        // the document manager saves in ascending docID order, whatever the order of tiles
+        void
+            compute(uint32_t tileID, imageGraphTileResult &tileRes){
+                for (uint32_t t= 0; t<tileRes.size(); ++t)
+                    docManager_.compute(tileID*tileSize_ + t, tileRes[t]);
+            }
+        
+        void
+            finalize(){ docManager_.finalize(); }
+        
+        imageGraphManager docManager_;
+        
+    private:
+        uint32_t const tileSize_;
+};
+
+
+
+void
+imageGraph::computeTfidfBatch(
+        std::string filename,
+        protoIndex const &iidx,
+        protoIndex const &fidx,
+        std::vector<double> const &idf,
+        std::vector<double> const &docL2,
+        uint32_t maxNeighs,
+        double scoreThr,
+        uint32_t tileSize ) {
+    
+    MPI_GLOBAL_RANK
+    bool useThreads= detectUseThreads();
+    uint32_t numWorkerThreads= 4;
     
     graph_.clear();
     
+    uint32_t const numDocs= docL2.size();
+    ASSERT( fidx.numIDs() <= numDocs );
+    if (tileSize==0)
+        // as much posting list reuse as the cache allows, but enough tiles to keep all workers busy
+        tileSize= imageGraphTfidfTileSize( iidx, fidx, numDocs,
+                                           std::min(4096U, std::max(numDocs / (4*numWorkerThreads), 1U)) );
+    tileSize= std::min(tileSize, std::max(numDocs, 1U));
+    uint32_t const numTiles= (numDocs + tileSize - 1) / tileSize;
+    
+    if (rank==0)
+        std::cout<<"imageGraph::computeTfidfBatch: "<<numTiles<<" tiles of "<<tileSize<<" documents\n";
+    
+    imageGraphTfidfManager *manager= (rank==0) ?
+            new imageGraphTfidfManager(filename, numDocs, numTiles, tileSize, scoreThr) :
+            NULL;
+    
+    if (useThreads){
+        
+        // one worker per thread as each has its own score accumulators
+        std::vector<queueWorker<imageGraphTileResult> const *> workers;
+        for (uint32_t i= 0; i<numWorkerThreads; ++i)
+            workers.push_back( new imageGraphTfidfWorker(iidx, fidx, idf, docL2, tileSize, maxNeighs, scoreThr) );
+        threadQueue<imageGraphTileResult>::start( numTiles, workers, *manager );
+        util::delPointerVector(workers);
+        
+    } else {
+        
+        imageGraphTfidfWorker worker(iidx, fidx, idf, docL2, tileSize, maxNeighs, scoreThr);
+        parQueue<imageGraphTileResult>::startStatic(
+            numTiles,
+            worker,
+            manager,
+            useThreads,
+            numWorkerThreads);
+        
+    }
+    
+    if (rank==0) graph_= manager->docManager_.graph_;
+    
+    if (rank==0) delete manager;
+    
+}
+
+
+
+// ------- imageGraph::computeIncremental and helper functions
+
+
+
+// keeps the query results of all jobs
+class imageGraphCollectManager : public managerWithTiming<imageGraphResult> {
+    public:
+        
+        imageGraphCollectManager(std::vector<imageGraphResult> &results)
+            : managerWithTiming<imageGraphResult>(results.size(), "imageGraph"),
+              results_(&results)
+                {}
+        
+        void
+            compute(uint32_t jobID, imageGraphResult &queryRes){
+                (*results_)[jobID].swap(queryRes);
+            }
+        
+    private:
+        std::vector<imageGraphResult> *results_;
+};
+
+
+
+static bool
+higherScore( indScorePair const &a, indScorePair const &b ){
+    return a.second > b.second;
+}
+
+
+
+static void
+addNeighs( indexBuilder &idxBuilder, uint32_t docID, std::vector<indScorePair> const &neighs ){
+    rr::indexEntry entry;
+    for (std::vector<indScorePair>::const_iterator itN= neighs.begin(); itN!=neighs.end(); ++itN){
+        entry.add_id(itN->first);
+        entry.add_weight(itN->second);
+    }
+    idxBuilder.addEntry(docID, entry);
+}
+
+
+
+void
+imageGraph::computeIncremental(
+        std::string deltaFilename,
+        uint32_t firstNewDocID,
+        uint32_t numDocs,
+        retriever const &retrieverObj,
+        uint32_t maxNeighs,
+        double scoreThr ) {
+    
+    MPI_GLOBAL_RANK
+    bool useThreads= detectUseThreads();
+    uint32_t numWorkerThreads= 4;
+    
+    ASSERT(firstNewDocID<=numDocs);
+    uint32_t const numNew= numDocs - firstNewDocID;
+    
+    if (rank==0)
+        std::cout<<"imageGraph::computeIncremental: "<<numNew<<" new documents\n";
+    
+    // query with the new documents only
+    
+    std::vector<imageGraphResult> results;
+    imageGraphCollectManager *manager= NULL;
+    if (rank==0){
+        results.resize(numNew);
+        manager= new imageGraphCollectManager(results);
+    }
+    
+    imageGraphWorker worker(retrieverObj, maxNeighs, firstNewDocID);
+    
+    parQueue<imageGraphResult>::startStatic(
+        numNew,
+        worker,
+        manager,
+        useThreads,
+        numWorkerThreads);
+    
+    if (rank!=0)
+        return;
+    delete manager;
+    
+    std::set<uint32_t> changed;
+    uint32_t numUpdated= 0;
+    
+    // lists of the new documents, as in computeParallel
+    
+    for (uint32_t iNew= 0; iNew<numNew; ++iNew){
+        uint32_t const docID= firstNewDocID + iNew;
+        std::vector<indScorePair> neighs;
+        for (std::vector<indScorePair>::const_iterator itRes= results[iNew].begin();
+             itRes!=results[iNew].end() && itRes->second >= scoreThr;
+             ++itRes)
+            if (itRes->first != docID)
+                neighs.push_back( *itRes );
+        graph_.erase(docID);
+        if (neighs.size() > 0){
+            graph_[docID]= neighs;
+            changed.insert(docID);
+        }
+    }
+    
+    // reciprocal edges into the existing documents (new ones already have all theirs)
+    
+    for (uint32_t docID= firstNewDocID; docID<numDocs; ++docID){
+        
+        imageGraphType::const_iterator itNew= graph_.find(docID);
+        if (itNew==graph_.end())
+            continue;
+        
+        for (std::vector<indScorePair>::const_iterator itN= itNew->second.begin(); itN!=itNew->second.end(); ++itN){
+            
+            if (itN->first >= firstNewDocID)
+                continue;
+            
+            std::vector<indScorePair> &neighs= graph_[itN->first];
+            // maxNeighs query results, one of which is normally the document itself
+            size_t const capacity= (maxNeighs==0) ?
+                neighs.size()+1 :
+                std::max(neighs.size(), static_cast<size_t>(maxNeighs-1));
+            
+            indScorePair const edge(docID, itN->second);
+            std::vector<indScorePair>::iterator pos= std::upper_bound(neighs.begin(), neighs.end(), edge, higherScore);
+            if (pos==neighs.end() && neighs.size()>=capacity){
+                if (neighs.empty())
+                    graph_.erase(itN->first);
+                continue;
+            }
+            neighs.insert(pos, edge);
+            if (neighs.size()>capacity)
+                neighs.pop_back();
+            numUpdated+= changed.insert(itN->first).second;
+        }
+    }
+    
+    // save the lists of new and modified nodes
+    
+    protoDbFileBuilder dbBuilder(deltaFilename, "image graph delta");
+    indexBuilder idxBuilder(dbBuilder, false, false, false);
+    for (std::set<uint32_t>::const_iterator itD= changed.begin(); itD!=changed.end(); ++itD)
+        addNeighs(idxBuilder, *itD, graph_[*itD]);
+    idxBuilder.close();
+    
+    std::cout<<"imageGraph::computeIncremental: "<<numUpdated<<" existing nodes updated\n";
+    
+}
+
+
+
+// -------
+
+
+
+// nodes of the graph file replace the ones in graph
+static void
+loadNodes( std::string filename, imageGraph::imageGraphType &graph ){
+    
     // open files
     protoDbFile db(filename);
     protoIndex idx(db, false);
@@ -333,10 +832,11 @@ imageGraph::loadFromFile( std::string filename ){
         // if there are edges to this node
         if (entries.size()==1){
             
-            // copy from indexEntry to graph_
+            // copy from indexEntry to graph
             rr::indexEntry const &entry= entries[0];
-            std::vector<indScorePair> &neighs= graph_[docID];
+            std::vector<indScorePair> &neighs= graph[docID];
             ASSERT( entry.id_size() == entry.weight_size() );
+            neighs.clear();
             neighs.reserve( entry.id_size() );
             
             for (int iEntry= 0; iEntry<entry.id_size(); ++iEntry)
@@ -347,6 +847,64 @@ imageGraph::loadFromFile( std::string filename ){
         
     }
     
+}
+
+
+
+void
+imageGraph::loadFromFile( std::string filename ){
+    
+    std::cout<<"imageGraph::loadFromFile\n";
+    
+    graph_.clear();
+    loadNodes(filename, graph_);
+    
     std::cout<<"imageGraph::loadFromFile - DONE\n";
     
 }
+
+
+
+void
+imageGraph::applyDelta( std::string filename ){
+    
+    std::cout<<"imageGraph::applyDelta\n";
+    
+    loadNodes(filename, graph_);
+    
+    std::cout<<"imageGraph::applyDelta - DONE\n";
+    
+}
+
+
+
+void
+imageGraph::saveToFile( std::string filename ) const {
+    
+    std::string const tempFn= filename + boost::filesystem::unique_path(".%%%%-%%%%-%%%%-%%%%").native();
+    {
+        protoDbFileBuilder dbBuilder(tempFn, "image graph");
+        indexBuilder idxBuilder(dbBuilder, false, false, false);
+        for (imageGraphType::const_iterator itG= graph_.begin(); itG!=graph_.end(); ++itG)
+            if (itG->second.size() > 0)
+                addNeighs(idxBuilder, itG->first, itG->second);
+        idxBuilder.close();
+    }
+    boost::filesystem::rename(tempFn, filename);
+    
+}
+
+
+
+void
+imageGraph::compact( std::string filename, std::vector<std::string> const &deltaFilenames ){
+    
+    imageGraph graph(filename);
+    for (uint32_t iDelta= 0; iDelta<deltaFilenames.size(); ++iDelta)
+        graph.applyDelta(deltaFilenames[iDelta]);
+    graph.saveToFile(filename);
+    
+    for (uint32_t iDelta= 0; iDelta<deltaFilenames.size(); ++iDelta)
+        boost::filesystem::remove(deltaFilenames[iDelta]);
+    
+}
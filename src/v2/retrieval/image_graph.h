@@ -16,8 +16,11 @@ No usage or redistribution is allowed without explicit permission.
 #define _IMAGE_GRAPH_H_
 
 #include <map>
+#include <string>
+#include <vector>
 
 #include "macros.h"
+#include "proto_index.h"
 #include "retriever.h"
 
 
@@ -50,9 +53,53 @@ class imageGraph {
                              uint32_t maxNeighs= 0,
                              double scoreThr= -inf );
         
+        // tf-idf graph in parallel directly from the indexes, without querying: scores are the
+        // blocked sparse product A*A' where A(d,w)= idf(w)*tf(w,d), normalized as tfidfV2 does
+        // (i.e. the same as computeParallel with a tfidfV2 retriever). Documents are processed in
+        // tiles of tileSize consecutive docIDs, each posting list is fetched once per tile and used
+        // for all documents of the tile containing the word (0: the largest tile whose posting lists
+        // fit a ~128 MB cache, up to 4096 documents). Each thread reuses a single set of score
+        // accumulators reset through the touched documents, so memory is O(numDocs) per thread.
+        // fidx only provides the words of a document, tf comes from the iidx.
+        // Only pairs which share a word get an edge, i.e. equivalent to computeParallel for scoreThr>0
+        void
+            computeTfidfBatch( std::string filename,
+                               protoIndex const &iidx,
+                               protoIndex const &fidx,
+                               std::vector<double> const &idf,
+                               std::vector<double> const &docL2,
+                               uint32_t maxNeighs= 0,
+                               double scoreThr= -inf,
+                               uint32_t tileSize= 0 );
+        
+        // add documents [firstNewDocID, numDocs) to graph_ (which has to hold the current graph,
+        // i.e. loaded base file and deltas) by querying only them in parallel against the full index.
+        // Their edges are also inserted into lists of the existing documents they are in reach of,
+        // keeping those sorted, above scoreThr and no longer than maxNeighs results (as computeParallel,
+        // i.e. including self). The lists of all new and modified nodes are saved to deltaFilename
+        void
+            computeIncremental( std::string deltaFilename,
+                                uint32_t firstNewDocID,
+                                uint32_t numDocs,
+                                retriever const &retriever,
+                                uint32_t maxNeighs= 0,
+                                double scoreThr= -inf );
+        
         void
             loadFromFile( std::string filename );
         
+        // replace lists of the nodes present in the delta file (computeIncremental)
+        void
+            applyDelta( std::string filename );
+        
+        // whole graph, written to a temporary file first
+        void
+            saveToFile( std::string filename ) const;
+        
+        // fold the delta files (in the order they were made) into the base file and remove them
+        static void
+            compact( std::string filename, std::vector<std::string> const &deltaFilenames );
+        
         imageGraphType graph_;
     
     private:
@@ -14,7 +14,277 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "mq_filter_outliers.h"
 
+#include <algorithm>
+
 #include "bitcount.h"
+#include "par_queue.h"
+#include "thread_queue.h"
+#include "util.h"
+
+#if defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && (defined(__x86_64__) || defined(__i386__))
+#define MQ_FILTER_OUTLIERS_SIMD
+#include <immintrin.h>
+#endif
+
+
+
+namespace mqFilterOutliersImpl {
+    
+    uint32_t
+    countScalar(uint64_t sig, uint64_t const *sigs, uint32_t n, int distThr){
+        uint32_t count= 0;
+        for (uint32_t i= 0; i<n; ++i)
+            count+= ( bitcount64(sig^sigs[i]) <= distThr );
+        return count;
+    }
+    
+    
+    
+    #ifdef MQ_FILTER_OUTLIERS_SIMD
+    
+    // 4 signatures at a time, popcount with a nibble lookup table and _mm256_sad_epu8
+    __attribute__((target("avx2")))
+    uint32_t
+    countAVX2(uint64_t sig, uint64_t const *sigs, uint32_t n, int distThr){
+        __m256i const lut= _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                            0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+        __m256i const lowMask= _mm256_set1_epi8(0x0F);
+        __m256i const q= _mm256_set1_epi64x(static_cast<long long>(sig));
+        __m256i const thr= _mm256_set1_epi64x(distThr+1);
+        __m256i counts= _mm256_setzero_si256();
+        uint32_t i= 0;
+        for (; i+4<=n; i+= 4){
+            __m256i const x= _mm256_xor_si256(q, _mm256_loadu_si256(reinterpret_cast<__m256i const *>(sigs+i)));
+            __m256i const cnt= _mm256_add_epi8(
+                _mm256_shuffle_epi8(lut, _mm256_and_si256(x, lowMask)),
+                _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask)) );
+            __m256i const dist= _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+            // -1 where within the threshold
+            counts= _mm256_sub_epi64(counts, _mm256_cmpgt_epi64(thr, dist));
+        }
+        uint64_t c[4];
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(c), counts);
+        _mm256_zeroupper();
+        return static_cast<uint32_t>(c[0]+c[1]+c[2]+c[3]) + countScalar(sig, sigs+i, n-i, distThr);
+    }
+    
+    
+    
+    bool
+    useAVX2(){
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+    
+    static bool const avx2= useAVX2();
+    
+    #else
+    
+    uint32_t
+    countAVX2(uint64_t sig, uint64_t const *sigs, uint32_t n, int distThr){
+        return countScalar(sig, sigs, n, distThr);
+    }
+    
+    static bool const avx2= false;
+    
+    #endif
+    
+    
+    
+    bool
+    hasAVX2(){
+        return avx2;
+    }
+    
+    
+    
+    inline uint32_t
+    count(uint64_t sig, uint64_t const *sigs, uint32_t n, int distThr){
+        if (avx2 && n>=4)
+            return countAVX2(sig, sigs, n, distThr);
+        return countScalar(sig, sigs, n, distThr);
+    }
+    
+    
+    
+    // Hamming signatures of all queries grouped by visual word: the block of a word is
+    // [blockBegin[b], blockBegin[b+1]) in sigs and queryInd, sorted by query
+    struct wordBlocks {
+        std::vector<uint64_t> sigs;
+        std::vector<uint32_t> queryInd, blockBegin;
+    };
+    
+    
+    
+    class repWorker : public queueWorker<bool> {
+        public:
+            
+            repWorker(retrieverV2 const &baseRet,
+                      hammingEmbedderFactory const &embFactory,
+                      std::vector<query> const &queries,
+                      std::vector<rr::indexEntry> &queryReps,
+                      std::vector< std::vector<uint64_t> > &hammingSigs)
+                : baseRet_(&baseRet), embFactory_(&embFactory), queries_(&queries),
+                  queryReps_(&queryReps), hammingSigs_(&hammingSigs) {}
+            
+            // each job writes only its own query's elements
+            void
+                operator() ( uint32_t iQ, bool &result ) const {
+                    rr::indexEntry &queryRep= (*queryReps_)[iQ];
+                    baseRet_->getQueryRep((*queries_)[iQ], queryRep);
+                    ASSERT( queryRep.id_size()==0 || queryRep.has_data() );
+                    
+                    charStreamView const view(embFactory_->numBits(), queryRep.data());
+                    ASSERT(view.getNum() == static_cast<uint32_t>(queryRep.id_size()));
+                    
+                    std::vector<uint64_t> &sig= (*hammingSigs_)[iQ];
+                    sig.resize(view.getNum());
+                    if (!sig.empty())
+                        view.decode(0, sig.size(), &sig[0]);
+                    result= true;
+                }
+            
+        private:
+            retrieverV2 const *baseRet_;
+            hammingEmbedderFactory const *embFactory_;
+            std::vector<query> const *queries_;
+            std::vector<rr::indexEntry> *queryReps_;
+            std::vector< std::vector<uint64_t> > *hammingSigs_;
+            DISALLOW_COPY_AND_ASSIGN(repWorker)
+    };
+    
+    
+    
+    // counts matches between features of different queries in the blocks of a job,
+    // into the worker's own nQ*nQ (upper triangular) score
+    class pairWorker : public queueWorker<bool> {
+        public:
+            
+            pairWorker(wordBlocks const &blocks,
+                       std::vector<uint32_t> const &jobBlockBegin,
+                       uint32_t nQ,
+                       int distThr)
+                : score_(nQ*nQ, 0),
+                  blocks_(&blocks), jobBlockBegin_(&jobBlockBegin), nQ_(nQ), distThr_(distThr) {}
+            
+            void
+                operator() ( uint32_t jobID, bool &result ) const {
+                    uint64_t const *sigs= blocks_->sigs.empty() ? NULL : &blocks_->sigs[0];
+                    std::vector<uint32_t> const &queryInd= blocks_->queryInd;
+                    std::vector<uint32_t> const &blockBegin= blocks_->blockBegin;
+                    std::vector<uint32_t> runBegin; // features of one query within the block
+                    
+                    for (uint32_t iBlock= (*jobBlockBegin_)[jobID]; iBlock<(*jobBlockBegin_)[jobID+1]; ++iBlock){
+                        uint32_t const end= blockBegin[iBlock+1];
+                        runBegin.clear();
+                        for (uint32_t i= blockBegin[iBlock]; i<end; ++i)
+                            if (i==blockBegin[iBlock] || queryInd[i]!=queryInd[i-1])
+                                runBegin.push_back(i);
+                        runBegin.push_back(end);
+                        
+                        for (uint32_t iRun1= 0; iRun1+2<runBegin.size(); ++iRun1){
+                            uint32_t *score1= &score_[ queryInd[runBegin[iRun1]]*nQ_ ];
+                            for (uint32_t i= runBegin[iRun1]; i<runBegin[iRun1+1]; ++i)
+                                for (uint32_t iRun2= iRun1+1; iRun2+1<runBegin.size(); ++iRun2)
+                                    score1[ queryInd[runBegin[iRun2]] ]+=
+                                        count(sigs[i], sigs+runBegin[iRun2], runBegin[iRun2+1]-runBegin[iRun2], distThr_);
+                        }
+                    }
+                    result= true;
+                }
+            
+            mutable std::vector<uint32_t> score_;
+            
+        private:
+            wordBlocks const *blocks_;
+            std::vector<uint32_t> const *jobBlockBegin_;
+            uint32_t const nQ_;
+            int const distThr_;
+            DISALLOW_COPY_AND_ASSIGN(pairWorker)
+    };
+    
+    
+    
+    void
+    pairScores(std::vector<rr::indexEntry> const &queryReps,
+               std::vector< std::vector<uint64_t> > const &hammingSigs,
+               int distThr, uint32_t numWorkerThreads,
+               std::vector<uint32_t> &score){
+        
+        uint32_t const nQ= queryReps.size();
+        
+        // group the signatures of all queries by visual word (each queryRep is sorted by word),
+        // so that only features of the same word are compared
+        
+        wordBlocks blocks;
+        {
+            std::vector<uint64_t> keys; // wordID, index into allSigs
+            std::vector<uint64_t> allSigs;
+            std::vector<uint32_t> allQueryInd;
+            for (uint32_t iQ= 0; iQ<nQ; ++iQ){
+                rr::indexEntry const &q= queryReps[iQ];
+                for (int i= 0; i<q.id_size(); ++i){
+                    keys.push_back( (static_cast<uint64_t>(q.id(i))<<32) | allSigs.size() );
+                    allSigs.push_back(hammingSigs[iQ][i]);
+                    allQueryInd.push_back(iQ);
+                }
+            }
+            std::sort(keys.begin(), keys.end());
+        
+            blocks.sigs.reserve(keys.size());
+            blocks.queryInd.reserve(keys.size());
+            for (uint32_t i= 0; i<keys.size(); ++i){
+                if (i==0 || (keys[i]>>32)!=(keys[i-1]>>32))
+                    blocks.blockBegin.push_back(i);
+                uint32_t const ind= static_cast<uint32_t>(keys[i]);
+                blocks.sigs.push_back(allSigs[ind]);
+                blocks.queryInd.push_back(allQueryInd[ind]);
+            }
+            blocks.blockBegin.push_back(keys.size());
+        }
+        uint32_t const numBlocks= blocks.blockBegin.size()-1;
+        
+        // match all pairs, jobs are ranges of words with about equal numbers of comparisons
+        
+        score.assign(nQ*nQ, 0);
+        uint64_t totalCost= 0;
+        for (uint32_t iBlock= 0; iBlock<numBlocks; ++iBlock){
+            uint64_t const n= blocks.blockBegin[iBlock+1]-blocks.blockBegin[iBlock];
+            totalCost+= n*n;
+        }
+        uint32_t const maxJobs= 4*numWorkerThreads;
+        std::vector<uint32_t> jobBlockBegin(1, 0);
+        uint64_t cost= 0;
+        for (uint32_t iBlock= 0; iBlock<numBlocks; ++iBlock){
+            uint64_t const n= blocks.blockBegin[iBlock+1]-blocks.blockBegin[iBlock];
+            cost+= n*n;
+            if (cost*maxJobs >= totalCost*jobBlockBegin.size() || iBlock+1==numBlocks)
+                jobBlockBegin.push_back(iBlock+1);
+        }
+        uint32_t const nJobs= jobBlockBegin.size()-1;
+        
+        std::vector<queueWorker<bool> const *> workers;
+        for (uint32_t i= 0; i<std::max(std::min(numWorkerThreads, nJobs), 1U); ++i)
+            workers.push_back( new pairWorker(blocks, jobBlockBegin, nQ, distThr) );
+        queueManager<bool> manager;
+        threadQueue<bool>::start( nJobs, workers, manager );
+        
+        // reduce and make symmetric
+        for (uint32_t i= 0; i<workers.size(); ++i){
+            std::vector<uint32_t> const &partial= static_cast<pairWorker const *>(workers[i])->score_;
+            for (uint32_t j= 0; j<nQ*nQ; ++j)
+                score[j]+= partial[j];
+        }
+        util::delPointerVector(workers);
+        
+        for (uint32_t iQ1= 0; iQ1<nQ; ++iQ1){
+            score[ iQ1*nQ + iQ1 ]= queryReps[iQ1].id_size();
+            for (uint32_t iQ2= iQ1+1; iQ2<nQ; ++iQ2)
+                score[ iQ2*nQ + iQ1 ]= score[ iQ1*nQ + iQ2 ];
+        }
+    }
+    
+};
 
 
 
@@ -40,90 +310,25 @@ mqFilterOutliers::mqFilterOutliers(
 void
 mqFilterOutliers::queryExecute( std::vector<query> const &queries, std::vector<indScorePair> &queryRes, uint32_t toReturn ) const {
     
+    using namespace mqFilterOutliersImpl;
+    
     uint32_t nQ= queries.size();
     uint32_t const minKept= static_cast<uint32_t>( round(failureProp_ * nQ) );
+    uint32_t const numWorkerThreads= 8;
     
-    // collect query representations
-    // TODO parallel as this could potentially be a bit slow for internal queries where queryRep needs to be collected by going through the inverted index
+    // collect query representations in parallel
     // TODO reuse this in the mq_->queryExecute call
     
     std::vector<rr::indexEntry> queryReps(nQ);
     std::vector< std::vector<uint64_t> > hammingSigs(nQ);
-    
-    for (uint32_t iQ= 0; iQ<nQ; ++iQ){
-        baseRet_->getQueryRep(queries[iQ], queryReps[iQ]);
-        ASSERT( queryReps[iQ].id_size()==0 || queryReps[iQ].has_data() );
-        
-        hammingEmbedder *emb= embFactory_->getEmbedder();
-        emb->setDataCopy(queryReps[iQ].data());
-        charStream* cs= emb->getCharStream();
-        ASSERT(cs->getNum() == static_cast<uint32_t>(queryReps[iQ].id_size()));
-        
-        std::vector<uint64_t> &sig= hammingSigs[iQ];
-        sig.reserve(queryReps[iQ].id_size());
-        for (int i= 0; i<queryReps[iQ].id_size(); ++i)
-            sig.push_back( cs->getNextUnsafe() );
-        
-        delete emb;
+    {
+        repWorker worker(*baseRet_, *embFactory_, queries, queryReps, hammingSigs);
+        queueManager<bool> manager;
+        threadQueue<bool>::start( nQ, worker, manager, numWorkerThreads );
     }
     
-    // match all pairs
-    uint32_t *score= new uint32_t[nQ*nQ];
-    
-    for (uint32_t iQ1= 0; iQ1<nQ-1; ++iQ1){
-        
-        rr::indexEntry const &q1= queryReps[iQ1];
-        std::vector<uint64_t> const &sig1= hammingSigs[iQ1];
-        
-        score[ iQ1*nQ + iQ1 ]= q1.id_size();
-        
-        for (uint32_t iQ2= iQ1+1; iQ2<nQ; ++iQ2){
-            
-            rr::indexEntry const &q2= queryReps[iQ2];
-            std::vector<uint64_t> const &sig2= hammingSigs[iQ2];
-            
-            uint32_t thisScore= 0;
-            
-            // match features assuming wordIDs are sorted
-            
-            int i1= 0, i1end;
-            int i2= 0, i2end;
-            
-            while (i1 < q1.id_size() && i2 < q2.id_size()){
-                
-                // find equal wordIDs accross queryRep's
-                while(i1 < q1.id_size() && i2 < q2.id_size() &&
-                      q1.id(i1) != q2.id(i2)) {
-                    
-                    if (q1.id(i1) < q2.id(i2))
-                        ++i1;
-                    else
-                        ++i2;
-                }
-                
-                // found equal or end
-                
-                if (i1 < q1.id_size() && i2 < q2.id_size()){
-                    ASSERT(q1.id(i1) == q2.id(i2));
-                    // find all with same wordID within one queryRep
-                    for (i1end= i1; i1end < q1.id_size() && q1.id(i1)==q1.id(i1end); ++i1end);
-                    for (i2end= i2; i2end < q2.id_size() && q2.id(i2)==q2.id(i2end); ++i2end);
-                    // measure all similarities
-                    for (int j1= i1; j1<i1end; ++j1){
-                        for (int j2= i2; j2<i2end; ++j2)
-                            if ( bitcount64(sig1[j1]^sig2[j2]) <= distThr_ )
-                                ++thisScore;
-                    }
-                    i1= i1end;
-                    i2= i2end;
-                }
-                
-            }
-            
-            score[ iQ1*nQ + iQ2 ]= thisScore;
-            score[ iQ2*nQ + iQ1 ]= thisScore;
-        }
-    }
+    std::vector<uint32_t> score;
+    pairScores(queryReps, hammingSigs, distThr_, numWorkerThreads, score);
     
     // figure out which ones to keep
     
@@ -186,8 +391,6 @@ mqFilterOutliers::queryExecute( std::vector<query> const &queries, std::vector<i
         ASSERT( scoreThr_!=1 ); // if equal to 1, this line shouldn't have been reached
     }
     
-    delete []score;
-    
     // filter the queries
     std::vector<query> queriesFilt;
     queriesFilt.reserve(nQ);
@@ -15,13 +15,44 @@ No usage or redistribution is allowed without explicit permission.
 #ifndef _MQ_FILTER_OUTLIERS_H_
 #define _MQ_FILTER_OUTLIERS_H_
 
+#include <stdint.h>
+#include <vector>
+
 #include "hamming_embedder.h"
+#include "index_entry.pb.h"
 #include "macros.h"
 #include "multi_query.h"
 #include "retriever_v2.h"
 
 
 
+// Hamming matching of mqFilterOutliers::queryExecute (exposed for tests/mq_filter_outliers_test)
+namespace mqFilterOutliersImpl {
+    
+    // number of sigs[0..n) within distThr of sig
+    uint32_t
+        countScalar(uint64_t sig, uint64_t const *sigs, uint32_t n, int distThr);
+    
+    // as countScalar, 4 signatures at a time; only valid if hasAVX2()
+    uint32_t
+        countAVX2(uint64_t sig, uint64_t const *sigs, uint32_t n, int distThr);
+    
+    bool
+        hasAVX2();
+    
+    // nQ x nQ symmetric matrix, score[iQ1*nQ+iQ2] is the number of pairs of features of the two
+    // queries with the same word (each queryRep is sorted by word) within distThr,
+    // and the diagonal is the number of features of the query
+    void
+        pairScores(std::vector<rr::indexEntry> const &queryReps,
+                   std::vector< std::vector<uint64_t> > const &hammingSigs,
+                   int distThr, uint32_t numWorkerThreads,
+                   std::vector<uint32_t> &score);
+    
+};
+
+
+
 class mqFilterOutliers : public multiQuery {
     
     public:
@@ -14,8 +14,123 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "mq_joint_avg.h"
 
+#include <algorithm>
+
 #include "hamming_embedder.h"
-#include "protobuf_util.h"
+#include "util.h"
+
+
+
+// position in the query rep of one example, for the k-way merge
+struct mqJointAvgCursor {
+    uint32_t iQuery;
+    int pos;
+};
+
+
+
+// min-heap order: by word, then example, i.e. a stable sort of the concatenated reps by word
+class mqJointAvgLater {
+    public:
+        mqJointAvgLater(std::vector<rr::indexEntry> const &queryReps) : queryReps_(&queryReps) {}
+        
+        inline bool
+            operator()( mqJointAvgCursor const &left, mqJointAvgCursor const &right ) const {
+                uint32_t const l= (*queryReps_)[left.iQuery].id(left.pos), r= (*queryReps_)[right.iQuery].id(right.pos);
+                return l > r || (l == r && left.iQuery > right.iQuery);
+            }
+    
+    private:
+        std::vector<rr::indexEntry> const *queryReps_;
+};
+
+
+
+void
+mqJointAvgImpl::mergeReps(
+        std::vector<rr::indexEntry> const &queryReps,
+        embedderFactory const *eF,
+        rr::indexEntry &queryRep ){
+    
+    std::vector<embedder*> embs( queryReps.size(), static_cast<embedder*>(NULL) );
+    std::vector<mqJointAvgCursor> heads;
+    uint32_t size= 0;
+    
+    for (uint32_t iQuery= 0; iQuery<queryReps.size(); ++iQuery){
+        rr::indexEntry const &thisQueryRep= queryReps[iQuery];
+        if (thisQueryRep.id_size()>0){
+            if (eF!=NULL){
+                embs[iQuery]= eF->getEmbedder();
+                embs[iQuery]->setDataCopy(thisQueryRep.data());
+            }
+            mqJointAvgCursor const head= {iQuery, 0};
+            heads.push_back(head);
+            size+= thisQueryRep.id_size();
+        }
+    }
+    
+    // each rep is sorted by word: k-way merge straight into the joint query.
+    // With an embedding the merge only concatenates: every feature (with its geometry and
+    // embedding) is kept as is, nothing is combined or averaged. For BoW all features of the
+    // same word are combined into one, weighted by its average count over the examples
+    
+    queryRep.Clear();
+    google::protobuf::RepeatedField<uint32_t> *wordIDs= queryRep.mutable_id();
+    wordIDs->Reserve(size);
+    embedder *emb= NULL;
+    google::protobuf::RepeatedField<uint32_t> *qx= NULL, *qy= NULL;
+    google::protobuf::RepeatedField<float> *weights= NULL;
+    if (eF!=NULL){
+        emb= eF->getEmbedder();
+        emb->reserve(size);
+        qx= queryRep.mutable_qx();
+        qy= queryRep.mutable_qy();
+        qx->Reserve(size);
+        qy->Reserve(size);
+    } else {
+        weights= queryRep.mutable_weight();
+        weights->Reserve(size);
+    }
+    float const avgWeight= 1.0f / std::max(queryReps.size(), static_cast<size_t>(1));
+    
+    mqJointAvgLater const later(queryReps);
+    std::make_heap(heads.begin(), heads.end(), later);
+    
+    while (!heads.empty()){
+        std::pop_heap(heads.begin(), heads.end(), later);
+        mqJointAvgCursor &cur= heads.back();
+        rr::indexEntry const &thisQueryRep= queryReps[cur.iQuery];
+        uint32_t const wordID= thisQueryRep.id(cur.pos);
+        
+        if (eF!=NULL){
+            wordIDs->AddAlreadyReserved(wordID);
+            qx->AddAlreadyReserved(thisQueryRep.qx(cur.pos));
+            qy->AddAlreadyReserved(thisQueryRep.qy(cur.pos));
+            emb->copyFrom(*embs[cur.iQuery], cur.pos);
+        } else {
+            float const w= avgWeight * (
+                thisQueryRep.weight_size()>0 ? thisQueryRep.weight(cur.pos) :
+                (thisQueryRep.count_size()>0 ? thisQueryRep.count(cur.pos) : 1.0f) );
+            if (wordIDs->size()>0 && wordIDs->Get(wordIDs->size()-1)==wordID)
+                weights->Set(weights->size()-1, weights->Get(weights->size()-1) + w);
+            else {
+                wordIDs->AddAlreadyReserved(wordID);
+                weights->AddAlreadyReserved(w);
+            }
+        }
+        
+        if (++cur.pos < thisQueryRep.id_size())
+            std::push_heap(heads.begin(), heads.end(), later);
+        else
+            heads.pop_back();
+    }
+    
+    if (eF!=NULL){
+        queryRep.set_data(emb->getEncoding());
+        delete emb;
+        util::delPointerVector(embs);
+    }
+}
 
 
 
@@ -25,16 +140,10 @@ multiQueryJointAvg::queryExecute(
         std::vector<indScorePair> &queryRes,
         uint32_t toReturn ) const {
     
-    rr::indexEntry queryRepTemp;
-    
     embedderFactory const *eF= (retriever_->embFactory_==NULL) ?
         NULL :
         retriever_->embFactory_;
     
-    embedder *embTemp= NULL;
-    if (eF!=NULL)
-        embTemp= eF->getEmbedder();
-    
     std::vector<rr::indexEntry> queryReps( queries.size() );
     
     for (uint32_t iQuery= 0; iQuery<queries.size(); ++iQuery){
@@ -44,58 +153,17 @@ multiQueryJointAvg::queryExecute(
         else
             retriever_->getQueryRep(queries[iQuery], thisQueryRep);
         
-        ASSERT( thisQueryRep.id_size()==0 || thisQueryRep.has_data() );
+        // a BoW rep needs neither the embedding nor, unless it is spatially verified, the geometry
+        ASSERT( eF==NULL || thisQueryRep.id_size()==0 || thisQueryRep.has_data() );
         
         if (thisQueryRep.id_size()>0){
-            
             indexEntryUtil::quantXY(thisQueryRep);
-            ASSERT(thisQueryRep.qx_size()>0);
-            
-            PROTOBUFUTIL_ADD_ALL(thisQueryRep, queryRepTemp, id);
-            PROTOBUFUTIL_ADD_ALL(thisQueryRep, queryRepTemp, qx);
-            PROTOBUFUTIL_ADD_ALL(thisQueryRep, queryRepTemp, qy);
-            
-            if (eF!=NULL){
-                embedder *embThis= eF->getEmbedder();
-                embThis->setDataCopy(thisQueryRep.data());
-                
-                embTemp->copyRangeFrom(*embThis, 0, thisQueryRep.id_size());
-                
-                delete embThis;
-            }
+            ASSERT( (eF==NULL && spat_==NULL) || thisQueryRep.qx_size()>0 );
         }
     }
     
-    // sort according to clusterID
-    std::vector<int> inds;
-    indexEntryUtil::argSort::sort(queryRepTemp, inds);
-    
-    // apply the sort
-    rr::indexEntry queryRep= queryRepTemp; // to get all repeated field sizes correctly
-    uint32_t *wordID= queryRep.mutable_id()->mutable_data();
-    uint32_t *docID= queryRep.mutable_docid()->mutable_data();
-    uint32_t *qx= queryRep.mutable_qx()->mutable_data();
-    uint32_t *qy= queryRep.mutable_qy()->mutable_data();
-    uint32_t size= queryRepTemp.id_size();
-    embedder *emb= NULL;
-    if (eF!=NULL)
-        emb= eF->getEmbedder();
-    
-    for (uint32_t i= 0; i<size; ++i, ++wordID, ++docID, ++qx, ++qy){
-        int ind= inds[i];
-        *wordID= queryRepTemp.id(ind);
-        *qx= queryRepTemp.qx(ind);
-        *qy= queryRepTemp.qy(ind);
-        if (eF!=NULL)
-            emb->copyFrom(*embTemp, ind);
-    }
-    
-    queryRep.set_data(emb->getEncoding());
-    
-    if (eF!=NULL){
-        delete emb;
-        delete embTemp;
-    }
+    rr::indexEntry queryRep;
+    mqJointAvgImpl::mergeReps(queryReps, eF, queryRep);
     
     // do the query
     retriever_->queryExecute(queryRep, queryRes, toReturn);
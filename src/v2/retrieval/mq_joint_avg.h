@@ -15,6 +15,10 @@ No usage or redistribution is allowed without explicit permission.
 #ifndef _MQ_JOINT_AVG_H_
 #define _MQ_JOINT_AVG_H_
 
+#include <vector>
+
+#include "embedder.h"
+#include "index_entry.pb.h"
 #include "macros.h"
 #include "multi_query.h"
 #include "retriever_v2.h"
@@ -22,6 +26,21 @@ No usage or redistribution is allowed without explicit permission.
 
 
 
+// the joint query of multiQueryJointAvg (exposed for tests/mq_joint_avg_test)
+namespace mqJointAvgImpl {
+    
+    // k-way merge of the example reps, each sorted by word (and with quantized geometry
+    // if eF!=NULL): with an embedding all features are kept in word order, for BoW
+    // each word is one feature weighted by its average count (or weight) over the examples
+    void
+        mergeReps(std::vector<rr::indexEntry> const &queryReps,
+                  embedderFactory const *eF,
+                  rr::indexEntry &queryRep);
+    
+};
+
+
+
 // Never really going to use this one so didn't parallelize
 // Easy to do, but waste of time
 // Included this code only because I needed it for a paper
@@ -41,10 +41,16 @@ retrieverV2::getQueryRep( query const &queryObj, rr::indexEntry &queryRep ) cons
             
             ASSERT(entries.size()==1);
             rr::indexEntry const &entry= entries[0];
-            
+
+            // full fidx (buildIndex::build with fullFidx) contains all features with geometry
+            bool const hasXY= entry.x_size()>0 || entry.qx_size()>0;
+            bool const hasEllipse= entry.a_size()>0 || entry.qel_scale().length()>0;
+
             if (
-                ( (needXYForThis && (entry.x_size()>0 || entry.qx_size()>0)) ||
-                   (!needXYForThis && (entry.count_size()>0 || entry.weight_size()>0)) )
+                ( (needXYForThis && hasXY) ||
+                   (!needXYForThis && (entry.count_size()>0 || entry.weight_size()>0 || hasXY)) )
+                &&
+                ( !needEllipse_ || hasEllipse )
                 &&
                 ( embFactory_==NULL || (entry.has_data() && entry.data().size()>0) )
                 )
@@ -173,19 +179,22 @@ retrieverV2::externalQuery_computeData( std::string imageFn, query const &queryO
     embedder *emb0= embFactory_->getEmbedder();
     emb0->reserve( numFeats * KNN );
     
-    unsigned *clusterID= new unsigned[KNN];
-    float *distSq= new float[KNN];
+    // assign to clusters, all features at once
+    unsigned *clusterIDs= new unsigned[numFeats*KNN];
+    float *distSqs= new float[numFeats*KNN];
     uint32_t const numDims= featGetter_->numDims();
     
     float *residual= new float[numDims];
+    std::vector<float> centreBuf(numDims);
     
     std::cout<<"retrieverV2::externalQuery_computeData: assigning to clusters\n";
     
+    if (numFeats>0)
+        nn_->search_knn(descs, numFeats, KNN, clusterIDs, distSqs);
+    
     for (uint32_t iFeat=0; iFeat<numFeats; ++iFeat){
         
-        // assign to clusters
-        
-        nn_->search_knn(descs+iFeat*numDims, 1, KNN, clusterID, distSq);
+        unsigned const *clusterID= clusterIDs + iFeat*KNN;
         
         ellipse const &region= regions[iFeat];
         
@@ -200,7 +209,7 @@ retrieverV2::externalQuery_computeData( std::string imageFn, query const &queryO
             if (emb0->doesSomething()){
                 // due to KNN need to make a copy
                 float const *itD= descs+iFeat*numDims;
-                float const *itC= clstCentres_->clstC_flat + clusterID[i] * numDims;
+                float const *itC= clstCentres_->getCentre(clusterID[i], &centreBuf[0]);
                 float const *endC= itC + numDims;
                 float *itResidual= residual;
                 for (; itC!=endC; ++itC, ++itD, ++itResidual)
@@ -213,8 +222,8 @@ retrieverV2::externalQuery_computeData( std::string imageFn, query const &queryO
     std::cout<<"retrieverV2::externalQuery_computeData: assigning to clusters - DONE\n";
     
     // cleanup
-    delete []clusterID;
-    delete []distSq;
+    delete []clusterIDs;
+    delete []distSqs;
     delete []descs;
     delete []residual;
     
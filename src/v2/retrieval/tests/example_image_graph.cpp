@@ -38,6 +38,7 @@ void printUsageAndExit(uint32_t rank){
     std::cout<<"e : Print some nodes and their edges\n";
     std::cout<<"s : Compute image graph by querying sequentially\n";
     std::cout<<"p : Compute image graph in parallel\n";
+    std::cout<<"b : Compute tf-idf image graph directly from the indexes (tiled sparse product)\n";
     exit(1);
 }
 
@@ -53,7 +54,7 @@ int main(int argc, char* argv[]){
         printUsageAndExit(rank);
     
     char choice= argv[1][0];
-    if (!(choice=='e' || choice=='s' || choice=='p') ||
+    if (!(choice=='e' || choice=='s' || choice=='p' || choice=='b') ||
         ((choice=='e' || choice=='s') && numProc>1) )
         printUsageAndExit(rank);
     
@@ -62,7 +63,7 @@ int main(int argc, char* argv[]){
     
     // create the image graph
     
-    if (choice=='s' || choice=='p') {
+    if (choice=='s' || choice=='p' || choice=='b') {
         
         // file names
         
@@ -91,7 +92,11 @@ int main(int argc, char* argv[]){
         spatialVerifV2 spatVerifHamm(hammingObj, &iidx, &fidx, true);
         
         imageGraph imGraph;
-        if (choice=='s')
+        if (choice=='b')
+            // tf-idf scores without querying, i.e. as computeParallel with tfidfObj
+            imGraph.computeTfidfBatch(
+                imageGraphFn, iidx, fidx, tfidfObj.getIdf(), tfidfObj.getDocL2(), 100, 0.05 );
+        else if (choice=='s')
             // compute image graph sequential querying
             imGraph.computeSingle(
                 imageGraphFn, fidx.numIDs(), spatVerifHamm, 100, 10 );
@@ -68,6 +68,28 @@ int main(int argc, char* argv[]){
     
     uint32_t numTests= std::min(300u, dset.getNumDoc());
     
+    // setting up the query (i.e. retrieverV2::getQueryRep) is O(query) with a full fidx
+    // (buildIndex::build with fullFidx), while it is O(sum of posting list lengths) with a bare fidx
+    // as all posting lists of the query words need to be scanned in the iidx;
+    // the price is a fidx of roughly the size of the iidx
+    std::cout<<"InternalQuerySpeedTest fidx size= "<<util::fileSize(fidxFn)/1024/1024<<" MB, "
+             <<"iidx size= "<<util::fileSize(iidxFn)/1024/1024<<" MB\n";
+    
+    {
+        timing::progressPrint progressPrint(numTests, "InternalQuerySpeedTest queryRep");
+        double t0= timing::tic();
+        uint64_t numFeats= 0;
+        
+        for (uint32_t docID= 0; docID<numTests; ++docID, progressPrint.inc()){
+            rr::indexEntry queryRep;
+            tfidfObj.getQueryRep(query(docID, true), queryRep);
+            numFeats+= queryRep.id_size();
+        }
+        
+        std::cout<<"InternalQuerySpeedTest queryRep: "<<timing::toc(t0)/numTests<<" ms per query, "
+                 <<static_cast<double>(numFeats)/numTests<<" features per query\n";
+    }
+    
     {
         timing::progressPrint progressPrint(numTests, "InternalQuerySpeedTest tfidf");
         std::vector<indScorePair> queryRes;
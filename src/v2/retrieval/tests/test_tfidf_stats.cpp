@@ -0,0 +1,112 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "tfidf_stats.h"
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <vector>
+
+#include "macros.h"
+#include "same_random.h"
+
+
+
+void
+expectedVec(std::vector<double> const &val, std::vector<double> const &exp){
+    ASSERT(val.size()==exp.size());
+    for (uint32_t i= 0; i<val.size(); ++i)
+        ASSERT(fabs(val[i]-exp[i]) < 1e-9 * std::max(1.0, fabs(exp[i])));
+}
+
+
+
+int main(){
+
+    uint32_t const numWords= 50, numDocs= 30;
+
+    sameRandomUint32 rand(100000, 43);
+    sameRandomStreamUint32 randStream(rand);
+
+    // random posting lists (sorted docIDs, possibly repeated)
+    std::vector< std::vector<uint32_t> > postings(numWords);
+    for (uint32_t wordID= 0; wordID<numWords; ++wordID){
+        if (wordID % 7 == 3)
+            continue; // some words without postings
+        uint32_t n= randStream.getNextNtoM(1, 40);
+        for (uint32_t i= 0; i<n; ++i)
+            postings[wordID].push_back( randStream.getNext0ToN(numDocs) );
+        std::sort(postings[wordID].begin(), postings[wordID].end());
+    }
+
+    // reference, as in the original tfidfV2/wgc computeIdf and computeDocL2
+    std::vector<double> idfRef(numWords), docL2Ref(numDocs, 0.0), wgcDocL2Ref(numDocs, 0.0);
+    for (uint32_t wordID= 0; wordID<numWords; ++wordID){
+        std::vector<uint32_t> const &p= postings[wordID];
+        uint32_t numUniq= 0;
+        for (uint32_t i= 0; i<p.size(); ++i)
+            if (i==0 || p[i]!=p[i-1])
+                ++numUniq;
+        idfRef[wordID]= log( static_cast<double>(numDocs) / std::max(1u, numUniq) );
+        std::vector<double> tf(numDocs, 0.0);
+        for (uint32_t i= 0; i<p.size(); ++i){
+            tf[p[i]]+= 1.0;
+            wgcDocL2Ref[p[i]]+= idfRef[wordID] * idfRef[wordID];
+        }
+        for (uint32_t docID= 0; docID<numDocs; ++docID)
+            docL2Ref[docID]+= idfRef[wordID] * idfRef[wordID] * tf[docID] * tf[docID];
+    }
+    for (uint32_t docID= 0; docID<numDocs; ++docID){
+        docL2Ref[docID]= docL2Ref[docID] <= 1e-7 ? 1.0 : sqrt(docL2Ref[docID]);
+        wgcDocL2Ref[docID]= wgcDocL2Ref[docID] <= 1e-7 ? 1.0 : sqrt(wgcDocL2Ref[docID]);
+    }
+
+    // single streaming pass
+    {
+        tfidfStatsBuilder builder(numDocs, numWords);
+        for (uint32_t wordID= 0; wordID<numWords; ++wordID)
+            for (uint32_t i= 0; i<postings[wordID].size(); ++i)
+                builder.add(wordID, postings[wordID][i]);
+
+        std::vector<double> idf, docL2, wgcDocL2;
+        builder.finish(idf, docL2, &wgcDocL2);
+        expectedVec(idf, idfRef);
+        expectedVec(docL2, docL2Ref);
+        expectedVec(wgcDocL2, wgcDocL2Ref);
+        std::cout<<"single pass OK\n";
+    }
+
+    // word-sharded (interleaved) with merging, number of words not known in advance
+    {
+        tfidfStatsBuilder builder1(numDocs), builder2(numDocs, numWords);
+        for (uint32_t wordID= 0; wordID<numWords; ++wordID){
+            tfidfStatsBuilder &builder= (wordID/5) % 2 ? builder1 : builder2;
+            for (uint32_t i= 0; i<postings[wordID].size(); ++i)
+                builder.add(wordID, postings[wordID][i]);
+        }
+        builder1.merge(builder2);
+
+        std::vector<double> idf, docL2, wgcDocL2;
+        builder1.finish(idf, docL2, &wgcDocL2);
+        expectedVec(idf, idfRef);
+        expectedVec(docL2, docL2Ref);
+        expectedVec(wgcDocL2, wgcDocL2Ref);
+        std::cout<<"sharded OK\n";
+    }
+
+    std::cout<<"\nAll OK\n";
+
+    return 0;
+}
@@ -0,0 +1,287 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "tfidf_stats.h"
+
+#include <fstream>
+#include <math.h>
+
+#include "par_queue.h"
+#include "tfidf_data.pb.h"
+#include "thread_queue.h"
+#include "timing.h"
+#include "util.h"
+
+
+
+static uint32_t const noneID= 0xFFFFFFFF;
+
+
+
+tfidfStatsBuilder::tfidfStatsBuilder(uint32_t numDocs, uint32_t numWords)
+        : numDocs_(numDocs),
+          numUniq_(numWords, 0),
+          docL2Sq_(numDocs, 0.0),
+          wgcDocL2Sq_(numDocs, 0.0),
+          wordID_(noneID),
+          docID_(noneID),
+          docTf_(0.0),
+          docTfSq_(0.0) {
+}
+
+
+
+void
+tfidfStatsBuilder::add(uint32_t wordID, uint32_t docID, double weight){
+    if (wordID!=wordID_){
+        finishWord();
+        if (wordID >= numUniq_.size())
+            numUniq_.resize(wordID+1, 0);
+        wordID_= wordID;
+    }
+    if (docID!=docID_){
+        finishDoc();
+        ASSERT(docID < numDocs_);
+        docID_= docID;
+    }
+    docTf_+= weight;
+    docTfSq_+= weight*weight;
+}
+
+
+
+void
+tfidfStatsBuilder::add(uint32_t wordID, rr::indexEntry const &entry){
+
+    // same as tfidfV2::weightStatic
+    bool hasWeigth= (entry.weight_size()!=0);
+    bool hasCount= (entry.count_size()!=0);
+    if (hasWeigth)
+        ASSERT( entry.id_size() == entry.weight_size() );
+    if (hasCount)
+        ASSERT( entry.id_size() == entry.count_size() );
+
+    for (int i= 0; i < entry.id_size(); ++i)
+        add( wordID, entry.id(i),
+             hasWeigth ? entry.weight(i) : (hasCount ? entry.count(i) : 1.0) );
+}
+
+
+
+void
+tfidfStatsBuilder::finishDoc(){
+    if (docID_==noneID)
+        return;
+    wordDocIDs_.push_back(docID_);
+    wordTf_.push_back(docTf_);
+    wordTfSq_.push_back(docTfSq_);
+    docID_= noneID;
+    docTf_= 0.0;
+    docTfSq_= 0.0;
+}
+
+
+
+void
+tfidfStatsBuilder::finishWord(){
+    finishDoc();
+    if (wordID_==noneID)
+        return;
+
+    // posting lists of a word have to be contiguous
+    ASSERT(numUniq_[wordID_]==0);
+    uint32_t const n= wordDocIDs_.size();
+    numUniq_[wordID_]= n;
+
+    double const idf= log( static_cast<double>(numDocs_) / std::max(static_cast<uint32_t>(1), n) );
+    double const idfSq= idf*idf;
+
+    for (uint32_t i= 0; i<n; ++i){
+        uint32_t docID= wordDocIDs_[i];
+        docL2Sq_[docID]+= idfSq * wordTf_[i] * wordTf_[i];
+        wgcDocL2Sq_[docID]+= idfSq * wordTfSq_[i];
+    }
+
+    wordDocIDs_.clear();
+    wordTf_.clear();
+    wordTfSq_.clear();
+    wordID_= noneID;
+}
+
+
+
+void
+tfidfStatsBuilder::merge(tfidfStatsBuilder &other){
+    ASSERT(numDocs_==other.numDocs_);
+    finishWord();
+    other.finishWord();
+
+    if (other.numUniq_.size() > numUniq_.size())
+        numUniq_.resize(other.numUniq_.size(), 0);
+    for (uint32_t wordID= 0; wordID<other.numUniq_.size(); ++wordID){
+        ASSERT(numUniq_[wordID]==0 || other.numUniq_[wordID]==0);
+        numUniq_[wordID]+= other.numUniq_[wordID];
+    }
+    for (uint32_t docID= 0; docID<numDocs_; ++docID){
+        docL2Sq_[docID]+= other.docL2Sq_[docID];
+        wgcDocL2Sq_[docID]+= other.wgcDocL2Sq_[docID];
+    }
+}
+
+
+
+void
+tfidfStatsBuilder::finish(
+        std::vector<double> &idf,
+        std::vector<double> &docL2,
+        std::vector<double> *wgcDocL2){
+
+    finishWord();
+
+    // pretend a word appears in 1 document if it appears in 0 to prevent division by 0
+    uint32_t const numWords= numUniq_.size();
+    idf.resize(numWords);
+    for (uint32_t wordID= 0; wordID<numWords; ++wordID)
+        idf[wordID]= log(
+            static_cast<double>(numDocs_) /
+            std::max(static_cast<uint32_t>(1), numUniq_[wordID]) );
+
+    docL2.resize(numDocs_);
+    if (wgcDocL2!=NULL)
+        wgcDocL2->resize(numDocs_);
+
+    for (uint32_t docID= 0; docID<numDocs_; ++docID){
+        docL2[docID]= (docL2Sq_[docID] <= 1e-7) ? 1.0 : sqrt(docL2Sq_[docID]);
+        if (wgcDocL2!=NULL)
+            (*wgcDocL2)[docID]= (wgcDocL2Sq_[docID] <= 1e-7) ? 1.0 : sqrt(wgcDocL2Sq_[docID]);
+    }
+}
+
+
+
+namespace tfidfStats {
+
+
+
+static uint32_t const wordsPerJob= 1000;
+
+
+
+class statsWorker : public queueWorker<bool> {
+    public:
+
+        statsWorker(protoIndex const &iidx, uint32_t numDocs)
+            : iidx_(&iidx),
+              numWords_(iidx.numIDs()),
+              builder_(numDocs, numWords_) {}
+
+        void
+            operator() ( uint32_t jobID, bool &result ) const {
+                std::vector<rr::indexEntry> entries;
+                uint32_t const end= std::min( (jobID+1)*wordsPerJob, numWords_ );
+                for (uint32_t wordID= jobID*wordsPerJob; wordID<end; ++wordID){
+                    iidx_->getEntries(wordID, entries);
+                    for (uint32_t iEntry= 0; iEntry<entries.size(); ++iEntry)
+                        builder_.add(wordID, entries[iEntry]);
+                }
+                result= true;
+            }
+
+        protoIndex const *iidx_;
+        uint32_t const numWords_;
+        mutable tfidfStatsBuilder builder_;
+
+    private:
+        DISALLOW_COPY_AND_ASSIGN(statsWorker)
+};
+
+
+
+void
+compute(protoIndex const &iidx,
+        uint32_t numDocs,
+        std::vector<double> &idf,
+        std::vector<double> &docL2,
+        std::vector<double> *wgcDocL2,
+        uint32_t numWorkerThreads){
+
+    std::cout<<"tfidfStats::compute\n";
+    double time= timing::tic();
+
+    uint32_t const numWords= iidx.numIDs();
+    uint32_t const nJobs= (numWords + wordsPerJob - 1) / wordsPerJob;
+    numWorkerThreads= std::max( static_cast<uint32_t>(1), std::min(numWorkerThreads, nJobs) );
+
+    // each worker accumulates its own docL2 partials, protoIndex::getEntries is thread safe
+    std::vector<queueWorker<bool> const *> workers;
+    for (uint32_t i= 0; i<numWorkerThreads; ++i)
+        workers.push_back( new statsWorker(iidx, numDocs) );
+
+    managerWithTiming<bool> manager(nJobs, "tfidfStats::compute");
+    threadQueue<bool>::start( nJobs, workers, manager );
+
+    // reduce
+    tfidfStatsBuilder &builder= ((statsWorker*)workers[0])->builder_;
+    for (uint32_t i= 1; i<workers.size(); ++i)
+        builder.merge( ((statsWorker*)workers[i])->builder_ );
+    builder.finish(idf, docL2, wgcDocL2);
+
+    util::delPointerVector(workers);
+
+    std::cout<<"tfidfStats::compute: DONE ("<<timing::toc(time)<<" ms)\n";
+}
+
+
+
+void
+load(std::string wghtFn, std::vector<double> &idf, std::vector<double> &docL2){
+
+    rr::tfidfData data;
+
+    std::ifstream in(wghtFn.c_str(), std::ios::binary);
+    ASSERT(data.ParseFromIstream(&in));
+    in.close();
+
+    idf.clear();
+    idf.reserve(data.idf_size());
+    for (int i= 0; i<data.idf_size(); ++i)
+        idf.push_back( data.idf(i) );
+
+    docL2.clear();
+    docL2.reserve(data.docl2_size());
+    for (int i= 0; i<data.docl2_size(); ++i)
+        docL2.push_back( data.docl2(i) );
+
+}
+
+
+
+void
+save(std::string wghtFn, std::vector<double> const &idf, std::vector<double> const &docL2){
+
+    rr::tfidfData data;
+    data.mutable_idf()->Reserve(idf.size());
+    for (uint32_t i= 0; i<idf.size(); ++i)
+        data.add_idf(idf[i]);
+    data.mutable_docl2()->Reserve(docL2.size());
+    for (uint32_t i= 0; i<docL2.size(); ++i)
+        data.add_docl2(docL2[i]);
+
+    std::ofstream of(wghtFn.c_str(), std::ios::binary);
+    data.SerializeToOstream(&of);
+    of.close();
+
+}
+
+};
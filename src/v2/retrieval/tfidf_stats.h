@@ -0,0 +1,115 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _TFIDF_STATS_H_
+#define _TFIDF_STATS_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "index_entry.pb.h"
+#include "macros.h"
+#include "proto_index.h"
+
+
+
+// Computes idf and docL2 (i.e. what is stored in the weights file) in a single
+// streaming pass over the posting lists, for both tfidfV2 and wgc at the same time:
+//   idf(w)= log( numDocs / max(1, number of documents containing w) )
+//   tfidfV2 docL2(d)= sqrt( sum_w ( idf(w) * tf(w,d) )^2 )
+//   wgc docL2(d)= sqrt( sum_w sum_{features of w in d} ( idf(w) * weight )^2 )
+// Each posting list has to be added contiguously with docIDs sorted (as produced by buildIndex),
+// but it can be split over many add() calls.
+// Partial results from disjoint sets of words can be merged (used for parallel computation).
+// The number of words doesn't need to be known in advance (e.g. when building the iidx), idf is
+// computed for words [0, largest added wordID] or [0, numWords) if that is larger.
+
+class tfidfStatsBuilder {
+
+    public:
+
+        tfidfStatsBuilder(uint32_t numDocs, uint32_t numWords= 0);
+
+        // a feature of document docID which is assigned to wordID
+        void
+            add(uint32_t wordID, uint32_t docID, double weight= 1.0);
+
+        // all features in an iidx entry (ids are docIDs), weighted by its count/weight if present
+        void
+            add(uint32_t wordID, rr::indexEntry const &entry);
+
+        // merge partial results computed for a disjoint set of words
+        void
+            merge(tfidfStatsBuilder &other);
+
+        void
+            finish(std::vector<double> &idf,
+                   std::vector<double> &docL2,
+                   std::vector<double> *wgcDocL2= NULL);
+
+        inline uint32_t
+            numDocs() const { return numDocs_; }
+
+    private:
+
+        void
+            finishWord();
+
+        void
+            finishDoc();
+
+        uint32_t const numDocs_;
+
+        // per word number of unique documents (grows as needed)
+        std::vector<uint32_t> numUniq_;
+        // per document sum of squares
+        std::vector<double> docL2Sq_, wgcDocL2Sq_;
+
+        // current word (0xFFFFFFFF if none)
+        uint32_t wordID_;
+        std::vector<uint32_t> wordDocIDs_;
+        std::vector<double> wordTf_, wordTfSq_;
+
+        // current document within the current word
+        uint32_t docID_;
+        double docTf_, docTfSq_;
+
+        DISALLOW_COPY_AND_ASSIGN(tfidfStatsBuilder)
+};
+
+
+
+namespace tfidfStats {
+
+    // word-sharded parallel pass over the entire iidx with per-thread docL2 partials,
+    // only a single pass is made as opposed to computing idf and docL2 separately
+    void
+        compute(protoIndex const &iidx,
+                uint32_t numDocs,
+                std::vector<double> &idf,
+                std::vector<double> &docL2,
+                std::vector<double> *wgcDocL2= NULL,
+                uint32_t numWorkerThreads= 8);
+
+    // weights file format (rr::tfidfData)
+    void
+        load(std::string wghtFn, std::vector<double> &idf, std::vector<double> &docL2);
+
+    void
+        save(std::string wghtFn, std::vector<double> const &idf, std::vector<double> const &docL2);
+
+};
+
+#endif
@@ -19,7 +19,7 @@ No usage or redistribution is allowed without explicit permission.
 #include <boost/filesystem.hpp>
 
 #include "argsort.h"
-#include "tfidf_data.pb.h"
+#include "tfidf_stats.h"
 #include "timing.h"
 #include "weighter_v2.h"
 
@@ -46,8 +46,10 @@ tfidfV2::tfidfV2(
         
     } else {
         
-        computeIdf();
-        computeDocL2();
+        // idf and docL2 in a single parallel pass over the iidx
+        ASSERT(iidx_!=NULL);
+        ASSERT(fidx_!=NULL); // if needed, this could be replaced by computing numDocs as max(all ids)
+        tfidfStats::compute(*iidx_, fidx_->numIDs(), idf_, docL2_);
         numDocs_= docL2_.size();
         
         if (tfidfFn.length()>0)
@@ -61,42 +63,14 @@ tfidfV2::tfidfV2(
 
 void
 tfidfV2::load(std::string tfidfFn, std::vector<double> &idf, std::vector<double> &docL2){
-    
-    rr::tfidfData data;
-    
-    std::ifstream in(tfidfFn.c_str(), std::ios::binary);
-    ASSERT(data.ParseFromIstream(&in));
-    in.close();
-    
-    idf.clear();
-    idf.reserve(data.idf_size());
-    for (int i= 0; i<data.idf_size(); ++i)
-        idf.push_back( data.idf(i) );
-    
-    docL2.clear();
-    docL2.reserve(data.docl2_size());
-    for (int i= 0; i<data.docl2_size(); ++i)
-        docL2.push_back( data.docl2(i) );
-    
+    tfidfStats::load(tfidfFn, idf, docL2);
 }
 
 
 
 void
 tfidfV2::save(std::string tfidfFn, std::vector<double> const &idf, std::vector<double> const &docL2){
-    
-    rr::tfidfData data;
-    data.mutable_idf()->Reserve(idf.size());
-    for (uint32_t i= 0; i<idf.size(); ++i)
-        data.add_idf(idf[i]);
-    data.mutable_docl2()->Reserve(docL2.size());
-    for (uint32_t i= 0; i<docL2.size(); ++i)
-        data.add_docl2(docL2[i]);
-    
-    std::ofstream of(tfidfFn.c_str(), std::ios::binary);
-    data.SerializeToOstream(&of);
-    of.close();
-    
+    tfidfStats::save(tfidfFn, idf, docL2);
 }
 
 
@@ -191,61 +165,6 @@ tfidfV2::computeIdf(protoIndex const &iidx, std::vector<double> &idf, protoIndex
 
 
 
-void
-tfidfV2::computeDocL2() {
-    
-    uint32_t numWords= iidx_->numIDs();
-    ASSERT(fidx_!=NULL); // if needed, this could be replaced by computing numDocs as max(all ids)
-    uint32_t numDocs= fidx_->numIDs();
-    
-    docL2_.clear();
-    docL2_.resize( numDocs, 0.0 );
-    std::vector<rr::indexEntry> entries;
-    
-    uint32_t numWords_printStep= std::max(static_cast<uint32_t>(1),numWords/20);
-    
-    std::cout<<"tfidfV2::computeDocL2\n";
-    double time= timing::tic();
-    
-    for (uint32_t wordID= 0; wordID < numWords; ++wordID){
-        if (wordID % numWords_printStep == 0)
-            std::cout<<"tfidfV2::computeDocL2: wordID= "<<wordID<<" / "<<numWords<<" "<<timing::toc(time)<<" ms\n";
-        
-        iidx_->getEntries( wordID, entries );
-        
-        // set/add weights and multiply by idf
-        for (uint32_t iEntry= 0; iEntry<entries.size(); ++iEntry)
-            weight(entries[iEntry], &idf_[wordID]);
-        
-        indexEntryVector iev(entries);
-        ievIterator it= iev.beginIter(), end= iev.endIter();
-        uint32_t docID;
-        double weight;
-        
-        while (it != end){
-            docID= *it;
-            weight= 0.0;
-            for (; it != end && *it==docID; ++it){
-                std::pair<uint32_t, int> p= iev.getInds(it.getInd());
-                weight+= entries[p.first].weight(p.second);
-            }
-            docL2_[ docID ]+= weight * weight;
-        }
-    }
-    
-    for (uint32_t docID= 0; docID < numDocs; ++docID){
-        if ( docL2_[docID] <= 1e-7 )
-            docL2_[docID]= 1.0;
-        else
-            docL2_[docID]= sqrt( docL2_[docID] );
-    }
-    
-    std::cout<<"tfidfV2::computeDocL2: DONE ("<<timing::toc(time)<<" ms)\n";
-    
-}
-
-
-
 void
 tfidfV2::externalQuery_computeData( std::string imageFn, query const &queryObj ) const {
     
@@ -74,15 +74,6 @@ class tfidfV2 : public retrieverFromIter {
     
     private:
         
-        inline void
-            computeIdf(){
-                ASSERT(iidx_!=NULL);
-                computeIdf(*iidx_, idf_, fidx_);
-            }
-        
-        void
-            computeDocL2();
-        
         inline void
             weight(rr::indexEntry &entry, double *weight= NULL) const {
                 weightStatic(entry, weight, &idf_);
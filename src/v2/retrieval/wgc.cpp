@@ -19,7 +19,7 @@ No usage or redistribution is allowed without explicit permission.
 #include <boost/filesystem.hpp>
 
 #include "tfidf_v2.h"
-#include "tfidf_data.pb.h"
+#include "tfidf_stats.h"
 #include "timing.h"
 #include "weighter_v2.h"
 
@@ -34,8 +34,10 @@ wgc::wgc( protoIndex const &iidx, protoIndex const *fidx, std::string wgcFn ) :
         
     } else {
         
-        tfidfV2::computeIdf(*iidx_, idf_, fidx_);
-        computeDocL2();
+        // idf and docL2 in a single parallel pass over the iidx
+        ASSERT(fidx_!=NULL); // if needed, this could be replaced by computing numDocs as max(all ids)
+        std::vector<double> tfidfDocL2;
+        tfidfStats::compute(*iidx_, fidx_->numIDs(), idf_, tfidfDocL2, &docL2_);
         numDocs_= docL2_.size();
         
         if (wgcFn.length()>0)
@@ -66,50 +68,3 @@ wgc::queryExecute( rr::indexEntry &queryRep, ueIterator *ueIter, std::vector<dou
     weighterV2::queryExecuteWGC(queryRep, ueIter, idf_, docL2_, scores, 128);
     
 }
-
-
-
-void
-wgc::computeDocL2() {
-    
-    uint32_t numWords= iidx_->numIDs();
-    ASSERT(fidx_!=NULL); // if needed, this could be replaced by computing numDocs as max(all ids)
-    uint32_t numDocs= fidx_->numIDs();
-    
-    docL2_.clear();
-    docL2_.resize( numDocs, 0.0 );
-    std::vector<rr::indexEntry> entries;
-    
-    uint32_t numWords_printStep= std::max(static_cast<uint32_t>(1),numWords/20);
-    
-    std::cout<<"wgc::computeDocL2\n";
-    double time= timing::tic();
-    
-    for (uint32_t wordID= 0; wordID < numWords; ++wordID){
-        if (wordID % numWords_printStep == 0)
-            std::cout<<"wgc::computeDocL2: wordID= "<<wordID<<" / "<<numWords<<" "<<timing::toc(time)<<" ms\n";
-        
-        iidx_->getEntries( wordID, entries );
-        
-        for (uint32_t iEntry= 0; iEntry<entries.size(); ++iEntry){
-            rr::indexEntry &entry= entries[iEntry];
-            
-            // set/add weights and multiply by idf
-            tfidfV2::weightStatic(entry, &idf_[wordID], NULL);
-            
-            for (int i= 0; i<entry.id_size(); ++i)
-                docL2_[ entry.id(i) ]+= entry.weight(i) * entry.weight(i);
-        }
-        
-    }
-    
-    for (uint32_t docID= 0; docID < numDocs; ++docID){
-        if ( docL2_[docID] <= 1e-7 )
-            docL2_[docID]= 1.0;
-        else
-            docL2_[docID]= sqrt( docL2_[docID] );
-    }
-    
-    std::cout<<"wgc::computeDocL2: DONE ("<<timing::toc(time)<<" ms)\n";
-    
-}
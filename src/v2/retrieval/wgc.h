@@ -42,14 +42,6 @@ class wgc : public retrieverFromIter {
     
     private:
         
-        // same as tfidfV2
-        void
-            computeIdf();
-        
-        // different from tfidfV2
-        void
-            computeDocL2();
-        
         protoIndex const *iidx_;
         std::vector<double> idf_, docL2_;
         uint32_t numDocs_;